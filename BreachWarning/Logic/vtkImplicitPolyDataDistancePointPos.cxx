@@ -16,16 +16,20 @@
 
 #include "vtkCellData.h"
 #include "vtkCellLocator.h"
+#include "vtkDoubleArray.h"
 #include "vtkGenericCell.h"
+#include "vtkIdList.h"
+#include "vtkIdTypeArray.h"
 #include "vtkMath.h"
 #include "vtkObjectFactory.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
-#include "vtkPolygon.h"
+#include "vtkTriangle.h"
 #include "vtkTriangleFilter.h"
 #include "vtkSmartPointer.h"
 
 vtkStandardNewMacro(vtkImplicitPolyDataDistancePointPos);
-vtkCxxSetObjectMacro(vtkImplicitPolyDataDistancePointPos,Locator,vtkCellLocator);
+vtkCxxSetObjectMacro(vtkImplicitPolyDataDistancePointPos,Locator,vtkAbstractCellLocator);
 
 //-----------------------------------------------------------------------------
 vtkImplicitPolyDataDistancePointPos::vtkImplicitPolyDataDistancePointPos()
@@ -43,6 +47,17 @@ vtkImplicitPolyDataDistancePointPos::vtkImplicitPolyDataDistancePointPos()
   this->Input = NULL;
   this->Locator = NULL;
   this->Tolerance = 1e-12;
+
+  this->LastClosestCellId = -1;
+
+  for (int i = 0; i < 6; i++)
+    {
+    this->InputBounds[i] = 0.0;
+    }
+
+  this->Cell = vtkGenericCell::New();
+  this->CellIds = vtkIdList::New();
+  this->PointIds = vtkIdList::New();
 }
 
 //-----------------------------------------------------------------------------
@@ -61,19 +76,92 @@ void vtkImplicitPolyDataDistancePointPos::SetInput(vtkPolyData* input)
     triangleFilter->SetInputData( input );
     triangleFilter->Update();
 
-    this->Input = triangleFilter->GetOutput();
+    this->SetTriangleInput(triangleFilter->GetOutput());
+    }
+}
+
+//-----------------------------------------------------------------------------
+void vtkImplicitPolyDataDistancePointPos::SetTriangleInput(vtkPolyData* triangles)
+{
+  if (triangles == NULL)
+    {
+    vtkErrorMacro("SetTriangleInput failed: invalid input");
+    return;
+    }
+  if (this->Input == triangles)
+    {
+    return;
+    }
+
+  triangles->Register(this);
+  if (this->Input)
+    {
+    this->Input->UnRegister(this);
+    }
+  this->Input = triangles;
+
+  this->Input->BuildLinks();
+  this->NoValue = this->Input->GetLength();
+  this->Input->GetBounds(this->InputBounds);
+
+  this->ComputePseudoNormals();
+
+  this->CreateDefaultLocator();
+  this->Locator->SetDataSet(this->Input);
+  this->Locator->SetTolerance(this->Tolerance);
+  this->Locator->CacheCellBoundsOn();
+  this->Locator->AutomaticOn();
+  this->Locator->BuildLocator();
+}
+
+//-----------------------------------------------------------------------------
+void vtkImplicitPolyDataDistancePointPos::ShareInput(vtkImplicitPolyDataDistancePointPos* source)
+{
+  if (source == NULL || source->Input == NULL)
+    {
+    vtkErrorMacro("ShareInput failed: invalid source");
+    return;
+    }
+
+  source->Input->Register(this);
+  if (this->Input)
+    {
+    this->Input->UnRegister(this);
+    }
+  this->Input = source->Input;
+  this->NoValue = source->NoValue;
+  this->Tolerance = source->Tolerance;
+  for (int i = 0; i < 6; i++)
+    {
+    this->InputBounds[i] = source->InputBounds[i];
+    }
 
-    this->Input->BuildLinks();
-    this->NoValue = this->Input->GetLength();
+  // Pseudonormals are only read during evaluation, therefore they can be shared
+  this->FaceNormals = source->FaceNormals;
+  this->EdgeNormals = source->EdgeNormals;
+  this->VertexNormals = source->VertexNormals;
 
-    this->CreateDefaultLocator();   
-    this->Locator->SetDataSet(this->Input);
-    this->Locator->SetTolerance(this->Tolerance);
-    this->Locator->SetNumberOfCellsPerBucket(10);
-    this->Locator->CacheCellBoundsOn();
-    this->Locator->AutomaticOn();
-    this->Locator->BuildLocator();
+  // The locator may not be thread-safe (e.g., vtkCellLocator stores query state),
+  // therefore a new one of the same type is built
+  if (this->Locator)
+    {
+    this->Locator->UnRegister(this);
+    this->Locator = NULL;
+    }
+  if (source->Locator)
+    {
+    this->Locator = source->Locator->NewInstance();
+    this->Locator->SetNumberOfCellsPerNode(source->Locator->GetNumberOfCellsPerNode());
     }
+  else
+    {
+    this->CreateDefaultLocator();
+    }
+  this->Locator->SetDataSet(this->Input);
+  this->Locator->SetTolerance(this->Tolerance);
+  this->Locator->CacheCellBoundsOn();
+  this->Locator->AutomaticOn();
+  this->Locator->BuildLocator();
 }
 
 //-----------------------------------------------------------------------------
@@ -99,6 +187,17 @@ vtkImplicitPolyDataDistancePointPos::~vtkImplicitPolyDataDistancePointPos()
     this->Locator->UnRegister(this);
     this->Locator = NULL;
     }
+  this->Cell->Delete();
+  this->Cell = NULL;
+  this->CellIds->Delete();
+  this->CellIds = NULL;
+  this->PointIds->Delete();
+  this->PointIds = NULL;
+  if ( this->Input )
+    {
+    this->Input->UnRegister(this);
+    this->Input = NULL;
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -106,7 +205,9 @@ void vtkImplicitPolyDataDistancePointPos::CreateDefaultLocator()
 {
   if ( this->Locator == NULL )
     {
-    this->Locator = vtkCellLocator::New();
+    vtkCellLocator* cellLocator = vtkCellLocator::New();
+    cellLocator->SetNumberOfCellsPerBucket(10);
+    this->Locator = cellLocator;
     }
 }
 
@@ -125,6 +226,123 @@ double vtkImplicitPolyDataDistancePointPos::EvaluateFunctionAndGetClosestPoint(d
   return this->SharedEvaluate(x, g, cp); // distance value returned and point on vtkPolyData stored in cp (normal not used).
 }
 
+//-----------------------------------------------------------------------------
+double vtkImplicitPolyDataDistancePointPos::EvaluateFunctionAndGetClosestPointWithHint(double x[3], vtkIdType& cellIdHint, double cp[3])
+{
+  double g[3];
+  if (this->Input != NULL && cellIdHint >= 0 && cellIdHint < this->Input->GetNumberOfCells())
+    {
+    // Distance from the hint cell is an upper bound, search only within that radius
+    this->Input->GetCell(cellIdHint, this->Cell);
+    double p[3], pcoords[3], weights[3], dist2 = 0.0;
+    int subId = 0;
+    this->Cell->EvaluatePosition(x, p, subId, pcoords, dist2, weights);
+    double radius = sqrt(dist2) * (1.0 + 1e-6) + this->Tolerance;
+
+    vtkIdType cellId = -1;
+    int inside = 0;
+    if (this->Locator->FindClosestPointWithinRadius(x, radius, p, this->Cell, cellId, subId, dist2, inside) && cellId >= 0)
+      {
+      this->LastClosestCellId = cellId;
+      cellIdHint = cellId;
+      return this->ComputeSignedDistance(x, p, dist2, cellId, this->Cell, g, cp);
+      }
+    }
+
+  // No valid hint or the bounded search failed
+  double value = this->SharedEvaluate(x, g, cp);
+  cellIdHint = this->LastClosestCellId;
+  return value;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkImplicitPolyDataDistancePointPos::EvaluateFunctionWithinDistance(double x[3], double maximumDistance, double& value, double cp[3])
+{
+  if (this->Input == NULL || this->Input->GetNumberOfCells() == 0)
+    {
+    vtkErrorMacro(<<"No polygons to evaluate function!");
+    return false;
+    }
+
+  // Distance from the bounding box is a lower bound of the distance from the surface
+  double boundsDistance2 = 0.0;
+  bool insideBounds = true;
+  for (int i = 0; i < 3; i++)
+    {
+    double d = 0.0;
+    if (x[i] < this->InputBounds[2*i])
+      {
+      d = this->InputBounds[2*i] - x[i];
+      }
+    else if (x[i] > this->InputBounds[2*i+1])
+      {
+      d = x[i] - this->InputBounds[2*i+1];
+      }
+    if (d > 0.0)
+      {
+      insideBounds = false;
+      boundsDistance2 += d * d;
+      }
+    }
+  if (boundsDistance2 > maximumDistance * maximumDistance)
+    {
+    return false;
+    }
+
+  // Only search for cells within the radius
+  double p[3], g[3], dist2 = 0.0;
+  vtkIdType cellId = -1;
+  int subId = 0;
+  int inside = 0;
+  if (this->Locator->FindClosestPointWithinRadius(x, maximumDistance, p, this->Cell, cellId, subId, dist2, inside) && cellId >= 0)
+    {
+    this->LastClosestCellId = cellId;
+    value = this->ComputeSignedDistance(x, p, dist2, cellId, this->Cell, g, cp);
+    return true;
+    }
+
+  if (!insideBounds)
+    {
+    // outside the bounding box and no surface nearby: outside, far from the surface
+    return false;
+    }
+
+  // There is no surface within the radius, but the point may be deep inside the surface.
+  // The sign can only be determined by a full search.
+  value = this->SharedEvaluate(x, g, cp);
+  return (value <= maximumDistance);
+}
+
+//-----------------------------------------------------------------------------
+bool vtkImplicitPolyDataDistancePointPos::IntersectWithSegment(double p1[3], double p2[3], double& t, double x[3], vtkIdType& cellId)
+{
+  cellId = -1;
+  if (this->Input == NULL || this->Input->GetNumberOfCells() == 0 || this->Locator == NULL)
+    {
+    vtkErrorMacro(<<"No polygons to intersect with!");
+    return false;
+    }
+
+  // Segment is outside the bounding box of the input if both endpoints are beyond the same bounding plane
+  for (int i = 0; i < 3; i++)
+    {
+    if ((p1[i] < this->InputBounds[2*i] && p2[i] < this->InputBounds[2*i])
+      || (p1[i] > this->InputBounds[2*i+1] && p2[i] > this->InputBounds[2*i+1]))
+      {
+      return false;
+      }
+    }
+
+  double pcoords[3] = { 0.0, 0.0, 0.0 };
+  int subId = 0;
+  if (!this->Locator->IntersectWithLine(p1, p2, this->Tolerance, t, x, pcoords, subId, cellId, this->Cell) || cellId < 0)
+    {
+    cellId = -1;
+    return false;
+    }
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 void vtkImplicitPolyDataDistancePointPos::EvaluateGradient(double x[3], double g[3])
 {
@@ -132,6 +350,183 @@ void vtkImplicitPolyDataDistancePointPos::EvaluateGradient(double x[3], double g
   this->SharedEvaluate(x, g, cp);	// get normal, returned distance value not used and closest point not used
 }
 
+//-----------------------------------------------------------------------------
+double vtkImplicitPolyDataDistancePointPos::EvaluateFunctionAtPointsAndGetClosestPoint(vtkPoints* points, double cp[3], vtkIdType& closestPointIndex,
+  vtkDoubleArray* distances, vtkIdTypeArray* closestCellIds)
+{
+  closestPointIndex = -1;
+  double minDistance = this->NoValue;
+  for( int i=0; i < 3; i++ )
+    {
+    cp[i] = this->NoClosestPoint[i];
+    }
+
+  vtkIdType numberOfPoints = (points ? points->GetNumberOfPoints() : 0);
+  if (distances)
+    {
+    distances->SetNumberOfComponents(1);
+    distances->SetNumberOfTuples(numberOfPoints);
+    }
+  bool useCellIdHints = false;
+  if (closestCellIds)
+    {
+    useCellIdHints = (closestCellIds->GetNumberOfComponents() == 1 && closestCellIds->GetNumberOfTuples() == numberOfPoints);
+    if (!useCellIdHints)
+      {
+      closestCellIds->SetNumberOfComponents(1);
+      closestCellIds->SetNumberOfTuples(numberOfPoints);
+      }
+    }
+  if (numberOfPoints == 0)
+    {
+    return minDistance;
+    }
+
+  // Temporary objects (Cell) are shared between all the evaluations
+  vtkIdType closestCellId = -1;
+  for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; pointIndex++)
+    {
+    double x[3], g[3], pointCp[3];
+    points->GetPoint(pointIndex, x);
+    double distance = 0.0;
+    if (useCellIdHints)
+      {
+      vtkIdType cellId = closestCellIds->GetValue(pointIndex);
+      distance = this->EvaluateFunctionAndGetClosestPointWithHint(x, cellId, pointCp);
+      }
+    else
+      {
+      distance = this->SharedEvaluate(x, g, pointCp);
+      }
+    if (distances)
+      {
+      distances->SetValue(pointIndex, distance);
+      }
+    if (closestCellIds)
+      {
+      closestCellIds->SetValue(pointIndex, this->LastClosestCellId);
+      }
+    if (closestPointIndex < 0 || distance < minDistance)
+      {
+      minDistance = distance;
+      closestPointIndex = pointIndex;
+      closestCellId = this->LastClosestCellId;
+      for (int i = 0; i < 3; i++)
+        {
+        cp[i] = pointCp[i];
+        }
+      }
+    }
+  this->LastClosestCellId = closestCellId;
+
+  return minDistance;
+}
+
+//-----------------------------------------------------------------------------
+void vtkImplicitPolyDataDistancePointPos::ComputePseudoNormals()
+{
+  vtkIdType numberOfCells = this->Input->GetNumberOfCells();
+  vtkIdType numberOfPoints = this->Input->GetNumberOfPoints();
+  // New arrays are created (instead of reusing existing ones) because they may be shared with other instances
+  this->FaceNormals = vtkSmartPointer<vtkDoubleArray>::New();
+  this->FaceNormals->SetNumberOfComponents(3);
+  this->FaceNormals->SetNumberOfTuples(numberOfCells);
+  this->EdgeNormals = vtkSmartPointer<vtkDoubleArray>::New();
+  this->EdgeNormals->SetNumberOfComponents(3);
+  this->EdgeNormals->SetNumberOfTuples(3 * numberOfCells);
+  this->VertexNormals = vtkSmartPointer<vtkDoubleArray>::New();
+  this->VertexNormals->SetNumberOfComponents(3);
+  this->VertexNormals->SetNumberOfTuples(numberOfPoints);
+  for (int component = 0; component < 3; component++)
+    {
+    this->FaceNormals->FillComponent(component, 0.0);
+    this->EdgeNormals->FillComponent(component, 0.0);
+    this->VertexNormals->FillComponent(component, 0.0);
+    }
+
+  vtkDataArray* cnorms = 0;
+  if ( this->Input->GetCellData() && this->Input->GetCellData()->GetNormals() )
+    {
+    cnorms = this->Input->GetCellData()->GetNormals();
+    }
+
+  // Face normals
+  for (vtkIdType cellId = 0; cellId < numberOfCells; cellId++)
+    {
+    double* faceNormal = this->FaceNormals->GetPointer(3 * cellId);
+    if (cnorms)
+      {
+      cnorms->GetTuple(cellId, faceNormal);
+      continue;
+      }
+    this->Input->GetCellPoints(cellId, this->PointIds);
+    if (this->PointIds->GetNumberOfIds() != 3)
+      {
+      continue;
+      }
+    double p0[3], p1[3], p2[3];
+    this->Input->GetPoint(this->PointIds->GetId(0), p0);
+    this->Input->GetPoint(this->PointIds->GetId(1), p1);
+    this->Input->GetPoint(this->PointIds->GetId(2), p2);
+    vtkTriangle::ComputeNormal(p0, p1, p2, faceNormal);
+    }
+
+  for (vtkIdType cellId = 0; cellId < numberOfCells; cellId++)
+    {
+    this->Input->GetCellPoints(cellId, this->PointIds);
+    if (this->PointIds->GetNumberOfIds() != 3)
+      {
+      continue;
+      }
+    vtkIdType cellPointIds[3] = { this->PointIds->GetId(0), this->PointIds->GetId(1), this->PointIds->GetId(2) };
+    const double* faceNormal = this->FaceNormals->GetPointer(3 * cellId);
+
+    // Vertex normals: sum of incident face normals weighted by the incident angle
+    for (int vertex = 0; vertex < 3; vertex++)
+      {
+      double pa[3], pb[3], pc[3];
+      this->Input->GetPoint(cellPointIds[vertex], pa);
+      this->Input->GetPoint(cellPointIds[(vertex + 1) % 3], pb);
+      this->Input->GetPoint(cellPointIds[(vertex + 2) % 3], pc);
+      for (int j = 0; j < 3; j++) { pb[j] -= pa[j]; pc[j] -= pa[j]; }
+      vtkMath::Normalize(pb);
+      vtkMath::Normalize(pc);
+      double cosAlpha = vtkMath::Dot(pb, pc);
+      cosAlpha = (cosAlpha > 1.0 ? 1.0 : (cosAlpha < -1.0 ? -1.0 : cosAlpha));
+      double alpha = acos(cosAlpha);
+      double* vertexNormal = this->VertexNormals->GetPointer(3 * cellPointIds[vertex]);
+      for (int j = 0; j < 3; j++)
+        {
+        vertexNormal[j] += alpha * faceNormal[j];
+        }
+      }
+
+    // Edge normals: sum of the normals of the faces that share the edge.
+    // Edge i is the edge opposite to the i-th point of the triangle (the edge where the i-th barycentric weight is 0).
+    for (int edge = 0; edge < 3; edge++)
+      {
+      // The first argument is the cell ID. We pass a bogus cell ID so that
+      // all face IDs attached to the edge are returned in the CellIds.
+      this->Input->GetCellEdgeNeighbors(VTK_ID_MAX, cellPointIds[(edge + 1) % 3], cellPointIds[(edge + 2) % 3], this->CellIds);
+      double* edgeNormal = this->EdgeNormals->GetPointer(9 * cellId + 3 * edge);
+      for (vtkIdType i = 0; i < this->CellIds->GetNumberOfIds(); i++)
+        {
+        const double* neighborFaceNormal = this->FaceNormals->GetPointer(3 * this->CellIds->GetId(i));
+        for (int j = 0; j < 3; j++)
+          {
+          edgeNormal[j] += neighborFaceNormal[j];
+          }
+        }
+      vtkMath::Normalize(edgeNormal);
+      }
+    }
+
+  for (vtkIdType pointId = 0; pointId < numberOfPoints; pointId++)
+    {
+    vtkMath::Normalize(this->VertexNormals->GetPointer(3 * pointId));
+    }
+}
+
 //-----------------------------------------------------------------------------
 double vtkImplicitPolyDataDistancePointPos::SharedEvaluate(double x[3], double g[3], double cp[3])
 {
@@ -160,175 +555,154 @@ double vtkImplicitPolyDataDistancePointPos::SharedEvaluate(double x[3], double g
   int subId;
   double vlen2;
 
-  vtkDataArray* cnorms = 0;
-  if ( this->Input->GetCellData() && this->Input->GetCellData()->GetNormals() )
-    {
-    cnorms = this->Input->GetCellData()->GetNormals();
-    }
-
   // Get point id of closest point in data set.
-  vtkSmartPointer<vtkGenericCell> cell =
-    vtkSmartPointer<vtkGenericCell>::New();
-  this->Locator->FindClosestPoint(x, p, cell, cellId, subId, vlen2);
+  // Cell is a member variable to avoid memory allocations at each evaluation.
+  this->Locator->FindClosestPoint(x, p, this->Cell, cellId, subId, vlen2);
+  this->LastClosestCellId = cellId;
 
   if (cellId != -1)	// point located
     {
-    // dist = | point - x |
-    ret = sqrt(vlen2);
-    // grad = (point - x) / dist
-    for (int i = 0; i < 3; i++)
-      {
-      g[i] = (p[i] - x[i]) / (ret == 0. ? 1. : ret);
-      }
+    ret = this->ComputeSignedDistance(x, p, vlen2, cellId, this->Cell, g, cp);
+    }
 
-    double dist2, weights[3], pcoords[3], awnorm[3] = {0, 0, 0};
-    double closestPoint[3];
-    cell->EvaluatePosition(p, cp, subId, pcoords, dist2, weights);
+  return ret;
+}
 
-    vtkIdList* idList = vtkIdList::New();
-    int count = 0;
-    for (int i = 0; i < 3; i++)
+//-----------------------------------------------------------------------------
+double vtkImplicitPolyDataDistancePointPos::EvaluateFunctionForCell(double x[3], vtkIdType cellId, double g[3], double cp[3])
+{
+  this->Input->GetCell(cellId, this->Cell);
+  double p[3], pcoords[3], weights[3], dist2;
+  int subId;
+  this->Cell->EvaluatePosition(x, p, subId, pcoords, dist2, weights);
+  return this->ComputeSignedDistance(x, p, dist2, cellId, this->Cell, g, cp);
+}
+
+//-----------------------------------------------------------------------------
+double vtkImplicitPolyDataDistancePointPos::ComputeSignedDistance(double x[3], double p[3], double vlen2,
+  vtkIdType cellId, vtkGenericCell* cell, double g[3], double cp[3])
+{
+  // dist = | point - x |
+  double ret = sqrt(vlen2);
+  // grad = (point - x) / dist
+  for (int i = 0; i < 3; i++)
+    {
+    g[i] = (p[i] - x[i]) / (ret == 0. ? 1. : ret);
+    }
+
+  int subId;
+  double dist2, weights[3], pcoords[3];
+  cell->EvaluatePosition(p, cp, subId, pcoords, dist2, weights);
+
+  // Angle-weighted pseudonormals are precomputed in SetInput, just look them up.
+  // Zero barycentric weights indicate that the closest point is on an edge or a vertex.
+  const double* awnorm = this->FaceNormals->GetPointer(3 * cellId); // Face case - weights contains no 0s
+  int count = 0;
+  int zeroWeightIndex = -1;
+  int nonZeroWeightIndex = -1;
+  for (int i = 0; i < 3; i++)
+    {
+    if (fabs(weights[i]) < this->Tolerance)
       {
-      count += (fabs(weights[i]) < this->Tolerance ? 1 : 0);
+      count++;
+      zeroWeightIndex = i;
       }
-    // Face case - weights contains no 0s
-    if ( count == 0 )
+    else
       {
-      // Compute face normal.
-      if ( cnorms )
-        {
-        cnorms->GetTuple(cellId, awnorm);
-        }
-      else
-        {
-        vtkPolygon::ComputeNormal(cell->Points, awnorm);
-        }
+      nonZeroWeightIndex = i;
       }
-    // Edge case - weights contain one 0
-    else if ( count == 1 )
+    }
+  if ( count == 1 )
+    {
+    // Edge case - weights contain one 0, the edge is opposite to the point with zero weight
+    awnorm = this->EdgeNormals->GetPointer(9 * cellId + 3 * zeroWeightIndex);
+    }
+  else if ( count == 2 )
+    {
+    // Vertex case - weights contain two 0s
+    if ( nonZeroWeightIndex < 0 )
       {
-      // ... edge ... get two adjacent faces, compute average normal
-      int a = -1, b = -1;
-      for ( int edge = 0; edge < 3; edge++ )
-        {
-        if ( fabs(weights[edge]) < this->Tolerance )
-          {
-          a = cell->PointIds->GetId((edge + 1) % 3);
-          b = cell->PointIds->GetId((edge + 2) % 3);
-          break;
-          }
-        }
-
-      if ( a == -1 )
-        {
-        vtkErrorMacro( << "Could not find edge when closest point is "
-                       << "expected to be on an edge." );
-        return this->NoValue;
-        }
+      vtkErrorMacro( << "Could not find point when closest point is "
+                     << "expected to be a point." );
+      return this->NoValue;
+      }
+    awnorm = this->VertexNormals->GetPointer(3 * cell->PointIds->GetId(nonZeroWeightIndex));
+    }
 
-      // The first argument is the cell ID. We pass a bogus cell ID so that
-      // all face IDs attached to the edge are returned in the idList.
-      this->Input->GetCellEdgeNeighbors(VTK_ID_MAX, a, b, idList);
-      for (int i = 0; i < idList->GetNumberOfIds(); i++)
-        {
-        double norm[3];
-        if (cnorms)
-          {
-          cnorms->GetTuple(idList->GetId(i), norm);
-          }
-        else
-          {
-          vtkPolygon::ComputeNormal(this->Input->GetCell(idList->GetId(i))->GetPoints(), norm);
-          }
-        awnorm[0] += norm[0];
-        awnorm[1] += norm[1];
-        awnorm[2] += norm[2];
-        }
-      vtkMath::Normalize(awnorm);
+  // sign(dist) = dot(grad, cell normal)
+  if (ret == 0)
+    {
+    for (int i = 0; i < 3; i++)
+      {
+      g[i] = awnorm[i];
       }
+    }
+  ret *= (vtkMath::Dot(g, awnorm) < 0.) ? 1. : -1.;
 
-    // Vertex case - weights contain two 0s
-    else if ( count == 2 )
+  if (ret > 0.)
+    {
+    for (int i = 0; i < 3; i++)
       {
-      // ... vertex ... this is the expensive case, get all adjacent
-      // faces and compute sum(a_i * n_i) Angle-Weighted Pseudo
-      // Normals, J. Andreas Baerentzen and Henrik Aanaes
-      int a = -1;
-      for (int i = 0; i < 3; i++)
-        {
-        if ( fabs( weights[i] ) > this->Tolerance )
-          {
-          a = cell->PointIds->GetId(i);
-          }
-        }
+      g[i] = -g[i];
+      }
+    }
 
-      if ( a == -1 )
-        {
-        vtkErrorMacro( << "Could not find point when closest point is "
-                       << "expected to be a point." );
-        return this->NoValue;
-        }
+  return ret;
+}
 
-      this->Input->GetPointCells(a, idList);
-      for (int i = 0; i < idList->GetNumberOfIds(); i++)
-        {
-        double norm[3];
-        if ( cnorms )
-          {
-          cnorms->GetTuple(idList->GetId(i), norm);
-          }
-        else
-          {
-          vtkPolygon::ComputeNormal(this->Input->GetCell(idList->GetId(i))->GetPoints(), norm);
-          }
+//-----------------------------------------------------------------------------
+void vtkImplicitPolyDataDistancePointPos::EvaluateFunctionForCellGroups(double x[3], double radius,
+  vtkDataArray* cellGroupIds, int numberOfGroups, double* groupDistances)
+{
+  this->GroupClosestCellIds.resize(numberOfGroups);
+  this->GroupClosestDistance2.resize(numberOfGroups);
+  for (int group = 0; group < numberOfGroups; group++)
+    {
+    groupDistances[group] = VTK_DOUBLE_MAX;
+    this->GroupClosestCellIds[group] = -1;
+    this->GroupClosestDistance2[group] = VTK_DOUBLE_MAX;
+    }
+  if (this->Input == NULL || this->Locator == NULL || cellGroupIds == NULL)
+    {
+    vtkErrorMacro("EvaluateFunctionForCellGroups failed: invalid input");
+    return;
+    }
 
-        // Compute angle at point a
-        int b = this->Input->GetCell(idList->GetId(i))->GetPointId(0);
-        int c = this->Input->GetCell(idList->GetId(i))->GetPointId(1);
-        if (a == b)
-          {
-          b = this->Input->GetCell(idList->GetId(i))->GetPointId(2);
-          }
-        else if (a == c)
-          {
-          c = this->Input->GetCell(idList->GetId(i))->GetPointId(2);
-          }
-        double pa[3], pb[3], pc[3];
-        this->Input->GetPoint(a, pa);
-        this->Input->GetPoint(b, pb);
-        this->Input->GetPoint(c, pc);
-        for (int j = 0; j < 3; j++) { pb[j] -= pa[j]; pc[j] -= pa[j]; }
-        vtkMath::Normalize(pb);
-        vtkMath::Normalize(pc);
-        double alpha = acos(vtkMath::Dot(pb, pc));
-        awnorm[0] += alpha * norm[0];
-        awnorm[1] += alpha * norm[1];
-        awnorm[2] += alpha * norm[2];
-        }
-      vtkMath::Normalize(awnorm);
-      }
-    idList->Delete();
+  // Get candidate cells from the locator
+  double bbox[6] = { x[0] - radius, x[0] + radius, x[1] - radius, x[1] + radius, x[2] - radius, x[2] + radius };
+  this->Locator->FindCellsWithinBounds(bbox, this->CellIds);
 
-    // sign(dist) = dot(grad, cell normal)
-    if (ret == 0)
+  // Find closest cell of each group
+  double radius2 = radius * radius;
+  for (vtkIdType i = 0; i < this->CellIds->GetNumberOfIds(); i++)
+    {
+    vtkIdType cellId = this->CellIds->GetId(i);
+    int group = static_cast<int>(cellGroupIds->GetTuple1(cellId));
+    if (group < 0 || group >= numberOfGroups)
       {
-      for (int i = 0; i < 3; i++)
-        {
-        g[i] = awnorm[i];
-        }
+      continue;
       }
-    ret *= (vtkMath::Dot(g, awnorm) < 0.) ? 1. : -1.;
-
-    if (ret > 0.)
+    this->Input->GetCell(cellId, this->Cell);
+    double p[3], pcoords[3], weights[3], dist2;
+    int subId;
+    this->Cell->EvaluatePosition(x, p, subId, pcoords, dist2, weights);
+    if (dist2 <= radius2 && dist2 < this->GroupClosestDistance2[group])
       {
-      for (int i = 0; i < 3; i++)
-        {
-        g[i] = -g[i];
-        }
+      this->GroupClosestDistance2[group] = dist2;
+      this->GroupClosestCellIds[group] = cellId;
       }
     }
 
-  return ret;
+  // Compute signed distance for each group
+  for (int group = 0; group < numberOfGroups; group++)
+    {
+    if (this->GroupClosestCellIds[group] < 0)
+      {
+      continue;
+      }
+    double g[3], cp[3];
+    groupDistances[group] = this->EvaluateFunctionForCell(x, this->GroupClosestCellIds[group], g, cp);
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -38,6 +38,14 @@
 // - Made private members protected for access in derived classes
 // - Added a method EvaluateFunctionAndGetClosestPoint for accessing closest point on input vtkPolyData
 // - Added possibility of setting the locator
+// - Added a method EvaluateFunctionAtPointsAndGetClosestPoint for evaluating multiple points in one pass
+// - Temporary objects are reused, evaluation does not allocate heap memory
+// - Angle-weighted pseudonormals are precomputed when the input is set
+// - Added methods for evaluating distance to a given cell and to groups of cells (EvaluateFunctionForCellGroups)
+// - Added a method EvaluateFunctionWithinDistance for fast rejection of points that are far from the surface
+// - Closest point search can be started from the closest cell of a previous evaluation (temporal coherence)
+// - Any vtkAbstractCellLocator can be used as locator (such as vtkTriangleBVHLocator)
+// - Added a method IntersectWithSegment for detecting surface crossing between two positions
 
 #ifndef vtkImplicitPolyDataDistancePointPos_h
 #define vtkImplicitPolyDataDistancePointPos_h
@@ -45,9 +53,18 @@
 // If this class is moved to VTK then the include file has to be changed to "vtkFiltersCoreModule.h"
 #include "vtkSlicerBreachWarningModuleLogicExport.h" // For export macro
 
+#include "vtkDoubleArray.h"
 #include "vtkImplicitFunction.h"
+#include "vtkSmartPointer.h"
 
-class vtkCellLocator;
+#include <vector>
+
+class vtkAbstractCellLocator;
+class vtkDataArray;
+class vtkGenericCell;
+class vtkIdList;
+class vtkIdTypeArray;
+class vtkPoints;
 class vtkPolyData;
 
 // If this class is moved to VTK then export directive has to be changed to VTKFILTERSCORE_EXPORT
@@ -64,6 +81,9 @@ public:
 
   // Description:
   // Evaluate plane equation of nearest triangle to point x[3].
+  // Evaluation methods are not thread-safe: they store intermediate results in member variables
+  // (Cell, CellIds, PointIds, LastClosestCellId) and in the locator. To evaluate from multiple threads,
+  // create one instance for each thread (see ShareInput).
   double EvaluateFunction(double x[3]);
 
   // Description:
@@ -74,6 +94,58 @@ public:
   // Evaluate plane equation of nearest triangle to point x[3] and provides closest point on an input vtkPolyData.
   double EvaluateFunctionAndGetClosestPoint (double x[3], double cp[3]);
 
+  // Description:
+  // Evaluate the function at each point and return the minimum (signed) value.
+  // Index of the point where the minimum was found is returned in closestPointIndex
+  // (-1 if there are no points) and the closest point on the input vtkPolyData to that point is returned in cp.
+  // If distances is not NULL then it is filled with the function value at each point.
+  // If closestCellIds is not NULL then it is filled with the closest cell id of each point. If it already
+  // contains a value for each point (computed in the previous call) then those are used as cell id hints
+  // (see EvaluateFunctionAndGetClosestPointWithHint), which makes tracking of slowly moving points much faster.
+  // Temporary objects needed for the evaluation are allocated once and reused for all the points.
+  double EvaluateFunctionAtPointsAndGetClosestPoint(vtkPoints* points, double cp[3], vtkIdType& closestPointIndex,
+    vtkDoubleArray* distances=NULL, vtkIdTypeArray* closestCellIds=NULL);
+
+  // Description:
+  // Evaluate function value and closest point, starting the search from a cell that is expected to be close
+  // (typically the closest cell of a previous evaluation at a nearby point). Distance from the hint cell is an upper bound
+  // of the distance from the surface, therefore only cells within that radius have to be searched.
+  // A full search is performed if cellIdHint is invalid (e.g., -1) or the bounded search fails.
+  // cellIdHint is updated with the closest cell id.
+  double EvaluateFunctionAndGetClosestPointWithHint(double x[3], vtkIdType& cellIdHint, double cp[3]);
+
+  // Description:
+  // Evaluate function value and closest point only if the point is closer to the input vtkPolyData than maximumDistance.
+  // Returns false (value and cp are not set) if the point is known to be farther, which is determined
+  // much faster than a full evaluation, by using the input bounding box as a lower bound and a radius-limited locator search.
+  // Points deep inside the surface (farther than maximumDistance from the surface) require a full evaluation.
+  bool EvaluateFunctionWithinDistance(double x[3], double maximumDistance, double& value, double cp[3]);
+
+  // Description:
+  // Find the first intersection of the line segment p1-p2 with the input surface.
+  // Returns true if the segment intersects the surface. The intersection point is returned in x,
+  // its parametric coordinate along the segment (0 at p1, 1 at p2) in t, the intersected cell in cellId.
+  // Used for detecting that a point moved through the surface between two evaluations.
+  bool IntersectWithSegment(double p1[3], double p2[3], double& t, double x[3], vtkIdType& cellId);
+
+  // Description:
+  // Evaluate the function using only the specified cell of the input (instead of the nearest cell).
+  // Gradient and closest point are returned in g and cp.
+  double EvaluateFunctionForCell(double x[3], vtkIdType cellId, double g[3], double cp[3]);
+
+  // Description:
+  // Compute distance from point x to each group of cells. Group of each cell is defined by
+  // cellGroupIds (one value for each cell of the triangulated input, in the range of 0..numberOfGroups-1).
+  // Only cells within the specified radius are considered. groupDistances must have numberOfGroups elements,
+  // groups that have no cells within the radius get VTK_DOUBLE_MAX distance value.
+  // Used for getting distance to each structure when the input is composed of multiple structures.
+  void EvaluateFunctionForCellGroups(double x[3], double radius, vtkDataArray* cellGroupIds, int numberOfGroups, double* groupDistances);
+
+  // Description:
+  // Id of the closest input cell found in the last evaluation (-1 if not found).
+  // For multiple point evaluation it is the cell that is closest to the point with the minimum function value.
+  vtkGetMacro(LastClosestCellId, vtkIdType);
+
   // Description:
   // Set the input vtkPolyData used for the implicit function
   // evaluation.  Passes input through an internal instance of
@@ -81,6 +153,24 @@ public:
   // triangular polygons for evaluation as implicit planes.
   void SetInput(vtkPolyData *input);
 
+  // Description:
+  // Set an input that contains only triangles (no vertices, lines, strips, or polygons with more than 3 points).
+  // The input is used as is (it is not copied or triangulated) and no VTK pipeline is executed,
+  // therefore this method can be used for building the locator in a background thread.
+  void SetTriangleInput(vtkPolyData *triangles);
+
+  // Description:
+  // Get the triangulated input that the function is evaluated on.
+  vtkGetObjectMacro(Input, vtkPolyData);
+
+  // Description:
+  // Evaluate the same surface as the source object. The triangulated input and pseudonormals
+  // are shared with the source (they are only read during evaluation), only a new locator is built.
+  // Since evaluation uses temporary member variables and the locator stores query state,
+  // one instance is needed for each thread when evaluating the function in parallel.
+  // All instances can be set up this way without re-triangulating the input.
+  void ShareInput(vtkImplicitPolyDataDistancePointPos* source);
+
   // Description:
   // Set/get the function value to use if no input vtkPolyData
   // specified.
@@ -106,9 +196,11 @@ public:
 
   // Description:
   // Set/Get a spatial locator for speeding up the search process.
-  // An instance of vtkCellLocator is used by default.
-  void SetLocator(vtkCellLocator *locator);
-  vtkGetObjectMacro(Locator, vtkCellLocator);
+  // An instance of vtkCellLocator is used by default. The locator must be set before the input.
+  // Any cell locator that implements FindClosestPoint, FindClosestPointWithinRadius and
+  // FindCellsWithinBounds can be used (e.g., vtkStaticCellLocator, vtkTriangleBVHLocator).
+  void SetLocator(vtkAbstractCellLocator *locator);
+  vtkGetObjectMacro(Locator, vtkAbstractCellLocator);
 
 protected:
   vtkImplicitPolyDataDistancePointPos();
@@ -118,7 +210,21 @@ protected:
   // Create default locator. Used to create one when none is specified.
   void CreateDefaultLocator(void);
 
+  // Description:
+  // Evaluate function value, gradient, and closest point.
+  // Uses the Cell member variable as temporary storage,
+  // therefore no heap memory is allocated during evaluation.
   double SharedEvaluate(double x[3], double g[3], double cp[3]);
+
+  // Description:
+  // Compute signed distance, gradient, and closest point from point x and its closest point p on the specified cell.
+  // vlen2 is the squared distance between x and p.
+  double ComputeSignedDistance(double x[3], double p[3], double vlen2, vtkIdType cellId, vtkGenericCell* cell, double g[3], double cp[3]);
+
+  // Description:
+  // Compute angle-weighted pseudonormals for all faces, edges, and vertices of the input.
+  // Called once when the input is set, so that no normal computation is needed at evaluation time.
+  void ComputePseudoNormals();
   
   double NoGradient[3];
   double NoClosestPoint[3];
@@ -126,7 +232,22 @@ protected:
   double Tolerance;
 
   vtkPolyData       *Input;
-  vtkCellLocator    *Locator;
+  double            InputBounds[6];
+  vtkAbstractCellLocator *Locator;
+
+  // Temporary objects that are reused between evaluations
+  vtkGenericCell    *Cell;
+  vtkIdList         *CellIds;
+  vtkIdList         *PointIds;
+  std::vector<vtkIdType> GroupClosestCellIds;
+  std::vector<double> GroupClosestDistance2;
+
+  vtkIdType LastClosestCellId;
+
+  // Precomputed angle-weighted pseudonormals
+  vtkSmartPointer<vtkDoubleArray> FaceNormals;    // one tuple for each cell
+  vtkSmartPointer<vtkDoubleArray> EdgeNormals;    // one tuple for each edge of each cell, edge i is opposite to the i-th point of the cell
+  vtkSmartPointer<vtkDoubleArray> VertexNormals;  // one tuple for each point
 
 private:
   vtkImplicitPolyDataDistancePointPos(const vtkImplicitPolyDataDistancePointPos&);  // Not implemented.
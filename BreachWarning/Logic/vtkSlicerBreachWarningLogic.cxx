@@ -17,6 +17,7 @@
 
 // BreachWarning includes
 #include "vtkSlicerBreachWarningLogic.h"
+#include "vtkTriangleBVHLocator.h"
 
 // MRML includes
 #include "vtkMRMLAnnotationLineDisplayNode.h"
@@ -30,163 +31,1487 @@
 #include "vtkMRMLTransformNode.h"
 
 // VTK includes
+#include <vtkAbstractCellLocator.h>
+#include <vtkAppendPolyData.h>
+#include <vtkCellArray.h>
 #include <vtkCellData.h>
-#include <vtkCellLocator.h>
 #include <vtkGeneralTransform.h>
 #include <vtkGenericCell.h>
+#include <vtkIdList.h>
+#include <vtkIdTypeArray.h>
+#include <vtkIntArray.h>
+#include <vtkImageData.h>
 #include <vtkImplicitPolyDataDistancePointPos.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkPolygon.h>
 #include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
 #include <vtkTransformPolyDataFilter.h>
+#include <vtkVersion.h>
+#include <vtkWeakPointer.h>
+#if (VTK_MAJOR_VERSION >= 9)
+#include <vtkStaticCellLocator.h>
+#else
+#include <vtkMutexLock.h>
+#endif
 
 // STD includes
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#if (VTK_MAJOR_VERSION >= 9)
+#include <mutex>
+#include <system_error>
+#include <thread>
+#endif
+
+// Constants
+static const char* WATCHED_MODEL_INDEX_ARRAY_NAME = "WatchedModelIndex";
+
+//------------------------------------------------------------------------------
+class vtkSlicerBreachWarningLogic::vtkInternal
+{
+public:
+  enum EngineInputTransformType
+  {
+    EngineInputNotTransformed,
+    EngineInputLinearTransformed,
+    EngineInputNonLinearTransformed
+  };
+
+  // Description of a watched model that the distance engine was built from
+  struct EngineSource
+  {
+    vtkWeakPointer<vtkPolyData> PolyData;
+    unsigned long PolyDataMTime;
+    EngineInputTransformType Transform;
+    vtkSmartPointer<vtkMatrix4x4> ModelToEngineMatrix; // only used if the input is linearly transformed
+
+    EngineSource()
+    : PolyDataMTime(0)
+    , Transform(EngineInputNotTransformed)
+    {
+    }
+  };
+
+  // Watched model surface that a distance engine is built from in a background thread
+  struct EngineBuildSource
+  {
+    vtkSmartPointer<vtkPolyData> PolyData; // shallow copy of the model's polydata, made in the main thread
+    bool Transformed;
+    double ModelToEngineMatrix[4][4]; // only used if Transformed is true
+    int ModelIndex;
+
+    EngineBuildSource()
+    : Transformed(false)
+    , ModelIndex(0)
+    {
+    }
+  };
+
+  // Distance engine that is being built in a background thread.
+  // All the geometry preparation (transform, triangulation, appending of models) is done in the
+  // background thread, without executing VTK pipelines. Only the job's own objects are accessed from
+  // the background thread until the job is completed.
+  struct EngineBuildJob
+  {
+    vtkSmartPointer<vtkImplicitPolyDataDistancePointPos> DistanceEngine;
+    std::vector<EngineBuildSource> BuildSources;
+    bool LabelModels; // store model index of each cell in WATCHED_MODEL_INDEX_ARRAY_NAME cell data array
+    std::vector<EngineSource> EngineSources;
+    EngineInputTransformType EngineInputTransform;
+    bool EngineInModelCoordinates;
+    int DistanceLocator;
+    bool Completed;
+    // vtkMutexLock and thread spawning in vtkMultiThreader are deprecated since VTK 9,
+    // the standard library is used there instead
+#if (VTK_MAJOR_VERSION >= 9)
+    std::thread Thread;
+    std::mutex CompletedMutex;
+#else
+    int ThreadId;
+    vtkSmartPointer<vtkMutexLock> CompletedMutex;
+#endif
+
+    EngineBuildJob()
+    : LabelModels(false)
+    , EngineInputTransform(EngineInputNotTransformed)
+    , EngineInModelCoordinates(false)
+    , DistanceLocator(vtkMRMLBreachWarningNode::DISTANCE_LOCATOR_CELL)
+    , Completed(false)
+#if (VTK_MAJOR_VERSION < 9)
+    , ThreadId(-1)
+    , CompletedMutex(vtkSmartPointer<vtkMutexLock>::New())
+#endif
+    {
+    }
+
+    void LockCompleted()
+    {
+#if (VTK_MAJOR_VERSION >= 9)
+      this->CompletedMutex.lock();
+#else
+      this->CompletedMutex->Lock();
+#endif
+    }
+
+    void UnlockCompleted()
+    {
+#if (VTK_MAJOR_VERSION >= 9)
+      this->CompletedMutex.unlock();
+#else
+      this->CompletedMutex->Unlock();
+#endif
+    }
+
+    bool IsCompleted()
+    {
+      this->LockCompleted();
+      bool completed = this->Completed;
+      this->UnlockCompleted();
+      return completed;
+    }
+  };
+
+  struct BreachWarningNodeInfo
+  {
+    vtkSmartPointer<vtkImplicitPolyDataDistancePointPos> DistanceEngine;
+
+    // Description of the inputs that the distance engine was built from.
+    // The engine is only rebuilt if any of these change.
+    std::vector<EngineSource> EngineSources;
+    EngineInputTransformType EngineInputTransform; // non-linear if any of the sources is non-linearly transformed
+    bool EngineInModelCoordinates; // if false then the engine is in RAS coordinate system
+    int DistanceLocator; // locator type of the engine
+
+    // New distance engine that is being built in the background (NULL if there is none)
+    EngineBuildJob* BuildJob;
+
+    // Tool sample point positions in the engine's coordinate system, stored to avoid reallocation at each update
+    vtkSmartPointer<vtkPoints> ToolSamplePoints_Engine;
+
+    // Distance of each watched model, stored to avoid reallocation at each update
+    std::vector<double> WatchedModelDistances;
+
+    // Original color of watched models (other than the first one, which is stored in the node)
+    // that are currently displayed with the warning color, indexed by model node ID
+    std::map< std::string, std::vector<double> > WarningColoredModelOriginalColors;
+
+    // Closest cell of each tool sample point in the previous update. Consecutive tool positions are close
+    // to each other, so these are used as starting points for the closest point search.
+    vtkSmartPointer<vtkIdTypeArray> ClosestCellIds;
+
+    // Tool tip position at the previous update, for checking if the tool tip path crossed the model surface
+    double PreviousToolTip_Ras[3];
+    bool PreviousToolTipValid;
+
+    // Line to closest point is temporarily hidden because the tool is beyond MaximumReportedDistanceMm
+    bool LineToClosestPointHiddenBeyondRange;
+
+    // Input has changed since the last update (only used if updates are throttled)
+    bool UpdatePending;
+    unsigned long NumberOfSkippedUpdates;
+
+    // Performance statistics
+    unsigned long NumberOfEvaluations;
+    unsigned long NumberOfLocatorBuilds;
+    unsigned long NumberOfModelTransforms;
+    // Rolling window of the most recent evaluation times (ring buffer, oldest value is overwritten when full)
+    std::vector<double> EvaluationTimesSec;
+    size_t NextEvaluationTimeIndex;
+
+    // Signed distance map in the engine's coordinate system and the parameters it was computed with
+    vtkSmartPointer<vtkImageData> DistanceMap;
+    vtkWeakPointer<vtkImplicitPolyDataDistancePointPos> DistanceMapEngine;
+    double DistanceMapSpacingMm;
+    double DistanceMapMarginMm;
+
+    BreachWarningNodeInfo()
+    : EngineInputTransform(EngineInputNotTransformed)
+    , EngineInModelCoordinates(false)
+    , DistanceLocator(vtkMRMLBreachWarningNode::DISTANCE_LOCATOR_CELL)
+    , BuildJob(NULL)
+    , PreviousToolTipValid(false)
+    , LineToClosestPointHiddenBeyondRange(false)
+    , UpdatePending(false)
+    , NumberOfSkippedUpdates(0)
+    , NumberOfEvaluations(0)
+    , NumberOfLocatorBuilds(0)
+    , NumberOfModelTransforms(0)
+    , NextEvaluationTimeIndex(0)
+    , DistanceMapSpacingMm(0.0)
+    , DistanceMapMarginMm(0.0)
+    {
+    }
+  };
+
+  vtkInternal()
+#if (VTK_MAJOR_VERSION < 9)
+  : Threader(vtkSmartPointer<vtkMultiThreader>::New())
+#endif
+  {
+  }
+
+  ~vtkInternal()
+  {
+    for (NodeInfoMapType::iterator nodeInfoIt = this->NodeInfos.begin(); nodeInfoIt != this->NodeInfos.end(); ++nodeInfoIt)
+    {
+      this->FinishEngineBuild(nodeInfoIt->second);
+    }
+  }
+
+  static bool IsEngineSourceEqual(const EngineSource& a, const EngineSource& b);
+
+  // Start building the engine of the job in a background thread. Returns false if the thread could not be started.
+  bool StartEngineBuild(EngineBuildJob* job);
+
+  // Wait for the background engine build to complete and make the new engine the current one
+  void FinishEngineBuild(BreachWarningNodeInfo& nodeInfo);
+
+  // Build the engine of the job (runs in the background thread)
+  static void BuildEngine(EngineBuildJob* job);
+#if (VTK_MAJOR_VERSION < 9)
+  static VTK_THREAD_RETURN_TYPE BuildEngineThreadFunction(void* arg);
+#endif
+
+  // Collect triangles of all the sources (in engine coordinates) into one polydata without using VTK pipelines,
+  // so that it can be called from a background thread. Polygons and triangle strips are triangulated,
+  // vertices and lines are ignored (same as vtkImplicitPolyDataDistancePointPos::SetInput).
+  // Point and cell data (including cell normals) are not copied: the engine computes the face normals
+  // from the triangle vertices for the angle-weighted pseudonormals (see ComputePseudoNormals).
+  static void AppendTriangles(const std::vector<EngineBuildSource>& sources, bool labelModels, vtkPolyData* output);
+
+  // Add evaluation time to the rolling window of the node
+  static void RecordEvaluationTime(BreachWarningNodeInfo& nodeInfo, double evaluationTimeSec, int windowSize);
+
+  // Temporary storage for computing percentiles, reused to avoid reallocation
+  std::vector<double> SortedEvaluationTimesSec;
+
+  typedef std::map< vtkMRMLBreachWarningNode*, BreachWarningNodeInfo > NodeInfoMapType;
+  NodeInfoMapType NodeInfos;
+
+#if (VTK_MAJOR_VERSION < 9)
+  vtkSmartPointer<vtkMultiThreader> Threader;
+#endif
+};
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::BuildEngine(EngineBuildJob* job)
+{
+  vtkSmartPointer< vtkPolyData > engineInput = vtkSmartPointer< vtkPolyData >::New();
+  AppendTriangles( job->BuildSources, job->LabelModels, engineInput );
+  job->BuildSources.clear(); // release the model snapshots as soon as they are not needed
+  job->DistanceEngine->SetTriangleInput( engineInput ); // expensive: builds a locator
+  job->LockCompleted();
+  job->Completed = true;
+  job->UnlockCompleted();
+}
+
+#if (VTK_MAJOR_VERSION < 9)
+//------------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerBreachWarningLogic::vtkInternal::BuildEngineThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  BuildEngine( static_cast< EngineBuildJob* >( threadInfo->UserData ) );
+  return VTK_THREAD_RETURN_VALUE;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Get point ids of the next cell in a cell array. Unlike vtkCellArray::GetNextCell, it does not change the
+// traversal state of the cell array, therefore it is safe to use while the main thread accesses the same cell array.
+// location must be 0 for the first cell.
+static bool GetNextCellPointIds( vtkCellArray* cells, vtkIdType& location, vtkIdList* pointIds )
+{
+#if (VTK_MAJOR_VERSION >= 9)
+  if ( location >= cells->GetNumberOfCells() )
+  {
+    return false;
+  }
+  cells->GetCellAtId( location++, pointIds );
+#else
+  if ( location >= cells->GetNumberOfConnectivityEntries() )
+  {
+    return false;
+  }
+  vtkIdType* cellData = cells->GetPointer() + location;
+  vtkIdType numberOfPoints = cellData[0];
+  pointIds->SetNumberOfIds( numberOfPoints );
+  for ( vtkIdType i = 0; i < numberOfPoints; i++ )
+  {
+    pointIds->SetId( i, cellData[i + 1] );
+  }
+  location += numberOfPoints + 1;
+#endif
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::AppendTriangles(const std::vector<EngineBuildSource>& sources, bool labelModels, vtkPolyData* output)
+{
+  vtkSmartPointer< vtkPoints > points = vtkSmartPointer< vtkPoints >::New();
+  points->SetDataTypeToDouble();
+  vtkSmartPointer< vtkCellArray > triangles = vtkSmartPointer< vtkCellArray >::New();
+  vtkSmartPointer< vtkIntArray > modelIndexArray = vtkSmartPointer< vtkIntArray >::New();
+  modelIndexArray->SetName( WATCHED_MODEL_INDEX_ARRAY_NAME );
+
+  vtkNew< vtkIdList > cellPointIds;
+  vtkNew< vtkIdList > polygonTriangleIds;
+  vtkNew< vtkPolygon > polygon;
+  for ( std::vector<EngineBuildSource>::const_iterator sourceIt = sources.begin(); sourceIt != sources.end(); ++sourceIt )
+  {
+    vtkPolyData* polyData = sourceIt->PolyData;
+    if ( polyData == NULL || polyData->GetPoints() == NULL )
+    {
+      continue;
+    }
+
+    // Points, in engine coordinates
+    vtkPoints* sourcePoints = polyData->GetPoints();
+    vtkIdType pointIdOffset = points->GetNumberOfPoints();
+    for ( vtkIdType pointIndex = 0; pointIndex < sourcePoints->GetNumberOfPoints(); pointIndex++ )
+    {
+      double point_Model[4] = { 0.0, 0.0, 0.0, 1.0 };
+      sourcePoints->GetPoint( pointIndex, point_Model );
+      if ( !sourceIt->Transformed )
+      {
+        points->InsertNextPoint( point_Model );
+        continue;
+      }
+      double point_Engine[3] = { 0.0, 0.0, 0.0 };
+      for ( int row = 0; row < 3; row++ )
+      {
+        point_Engine[row] = sourceIt->ModelToEngineMatrix[row][0] * point_Model[0] + sourceIt->ModelToEngineMatrix[row][1] * point_Model[1]
+          + sourceIt->ModelToEngineMatrix[row][2] * point_Model[2] + sourceIt->ModelToEngineMatrix[row][3];
+      }
+      points->InsertNextPoint( point_Engine );
+    }
+
+    // Polygons
+    vtkIdType numberOfTrianglesBefore = triangles->GetNumberOfCells();
+    vtkIdType location = 0;
+    while ( GetNextCellPointIds( polyData->GetPolys(), location, cellPointIds.GetPointer() ) )
+    {
+      vtkIdType numberOfCellPoints = cellPointIds->GetNumberOfIds();
+      if ( numberOfCellPoints < 3 )
+      {
+        continue;
+      }
+      if ( numberOfCellPoints == 3 )
+      {
+        triangles->InsertNextCell( 3 );
+        for ( int i = 0; i < 3; i++ )
+        {
+          triangles->InsertCellPoint( cellPointIds->GetId( i ) + pointIdOffset );
+        }
+        continue;
+      }
+      polygon->GetPointIds()->SetNumberOfIds( numberOfCellPoints );
+      polygon->GetPoints()->SetNumberOfPoints( numberOfCellPoints );
+      for ( vtkIdType i = 0; i < numberOfCellPoints; i++ )
+      {
+        polygon->GetPointIds()->SetId( i, i );
+        polygon->GetPoints()->SetPoint( i, points->GetPoint( cellPointIds->GetId( i ) + pointIdOffset ) );
+      }
+      polygon->Triangulate( polygonTriangleIds.GetPointer() ); // ids are indices of polygon points
+      for ( vtkIdType i = 0; i + 2 < polygonTriangleIds->GetNumberOfIds(); i += 3 )
+      {
+        triangles->InsertNextCell( 3 );
+        for ( int j = 0; j < 3; j++ )
+        {
+          triangles->InsertCellPoint( cellPointIds->GetId( polygonTriangleIds->GetId( i + j ) ) + pointIdOffset );
+        }
+      }
+    }
+
+    // Triangle strips (orientation of every second triangle is flipped to keep consistent normals)
+    location = 0;
+    while ( GetNextCellPointIds( polyData->GetStrips(), location, cellPointIds.GetPointer() ) )
+    {
+      for ( vtkIdType i = 0; i + 2 < cellPointIds->GetNumberOfIds(); i++ )
+      {
+        triangles->InsertNextCell( 3 );
+        triangles->InsertCellPoint( cellPointIds->GetId( i % 2 == 0 ? i : i + 1 ) + pointIdOffset );
+        triangles->InsertCellPoint( cellPointIds->GetId( i % 2 == 0 ? i + 1 : i ) + pointIdOffset );
+        triangles->InsertCellPoint( cellPointIds->GetId( i + 2 ) + pointIdOffset );
+      }
+    }
+
+    if ( labelModels )
+    {
+      for ( vtkIdType cellIndex = numberOfTrianglesBefore; cellIndex < triangles->GetNumberOfCells(); cellIndex++ )
+      {
+        modelIndexArray->InsertNextValue( sourceIt->ModelIndex );
+      }
+    }
+  }
+
+  output->SetPoints( points );
+  output->SetPolys( triangles );
+  if ( labelModels )
+  {
+    output->GetCellData()->AddArray( modelIndexArray );
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::RecordEvaluationTime(BreachWarningNodeInfo& nodeInfo, double evaluationTimeSec, int windowSize)
+{
+  if ( nodeInfo.EvaluationTimesSec.size() < static_cast<size_t>( windowSize ) )
+  {
+    nodeInfo.EvaluationTimesSec.push_back( evaluationTimeSec );
+    return;
+  }
+  if ( nodeInfo.NextEvaluationTimeIndex >= nodeInfo.EvaluationTimesSec.size() )
+  {
+    nodeInfo.NextEvaluationTimeIndex = 0;
+  }
+  nodeInfo.EvaluationTimesSec[nodeInfo.NextEvaluationTimeIndex++] = evaluationTimeSec;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::StartEngineBuild(EngineBuildJob* job)
+{
+#if (VTK_MAJOR_VERSION >= 9)
+  try
+  {
+    job->Thread = std::thread( BuildEngine, job );
+  }
+  catch ( const std::system_error& )
+  {
+    return false;
+  }
+  return true;
+#else
+  job->ThreadId = this->Threader->SpawnThread( BuildEngineThreadFunction, job );
+  return ( job->ThreadId >= 0 );
+#endif
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::FinishEngineBuild(BreachWarningNodeInfo& nodeInfo)
+{
+  EngineBuildJob* job = nodeInfo.BuildJob;
+  if ( job == NULL )
+  {
+    return;
+  }
+  // Wait for the thread to finish
+#if (VTK_MAJOR_VERSION >= 9)
+  job->Thread.join();
+#else
+  this->Threader->TerminateThread( job->ThreadId );
+#endif
+  nodeInfo.DistanceEngine = job->DistanceEngine;
+  nodeInfo.ClosestCellIds = NULL; // cell ids of the previous engine are not valid anymore
+  nodeInfo.EngineSources = job->EngineSources;
+  nodeInfo.EngineInputTransform = job->EngineInputTransform;
+  nodeInfo.EngineInModelCoordinates = job->EngineInModelCoordinates;
+  nodeInfo.DistanceLocator = job->DistanceLocator;
+  nodeInfo.BuildJob = NULL;
+  delete job;
+}
+
+//------------------------------------------------------------------------------
+// Returns a new locator of the specified type for the distance engine.
+// Returns NULL if the engine's default locator (vtkCellLocator) is to be used.
+static vtkSmartPointer<vtkAbstractCellLocator> CreateDistanceLocator(int distanceLocator)
+{
+  vtkSmartPointer<vtkAbstractCellLocator> locator;
+  switch (distanceLocator)
+  {
+  case vtkMRMLBreachWarningNode::DISTANCE_LOCATOR_STATIC_CELL:
+#if (VTK_MAJOR_VERSION >= 9)
+    locator.TakeReference(vtkStaticCellLocator::New());
+#else
+    // Closest point search is not implemented in vtkStaticCellLocator in earlier VTK versions
+    vtkGenericWarningMacro("Static cell locator requires VTK 9 or later, using default cell locator instead");
+#endif
+    break;
+  case vtkMRMLBreachWarningNode::DISTANCE_LOCATOR_TRIANGLE_BVH:
+    locator.TakeReference(vtkTriangleBVHLocator::New());
+    break;
+  default:
+    break;
+  }
+  return locator;
+}
+
+//------------------------------------------------------------------------------
+static bool IsMatrixEqual(vtkMatrix4x4* a, vtkMatrix4x4* b)
+{
+  for (int row = 0; row < 4; row++)
+  {
+    for (int col = 0; col < 4; col++)
+    {
+      if (a->GetElement(row, col) != b->GetElement(row, col))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::IsEngineSourceEqual(const EngineSource& a, const EngineSource& b)
+{
+  if ( a.PolyData.GetPointer() != b.PolyData.GetPointer() || a.PolyDataMTime != b.PolyDataMTime || a.Transform != b.Transform )
+  {
+    return false;
+  }
+  if ( a.Transform == EngineInputLinearTransformed )
+  {
+    return IsMatrixEqual( a.ModelToEngineMatrix, b.ModelToEngineMatrix );
+  }
+  else if ( a.Transform == EngineInputNonLinearTransformed )
+  {
+    // changes of a non-linear transform cannot be detected cheaply, so always rebuild
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Returns true if the matrix only contains rotation, translation, and uniform scaling.
+// Such transforms preserve closest points, therefore they can be applied to the query point
+// instead of the queried surface.
+static bool IsSimilarityTransform(vtkMatrix4x4* m)
+{
+  const double tolerance = 1e-6;
+  if ( m->GetElement(3,0) != 0.0 || m->GetElement(3,1) != 0.0 || m->GetElement(3,2) != 0.0 || m->GetElement(3,3) != 1.0 )
+  {
+    return false;
+  }
+  double columns[3][3] = { { 0.0 } };
+  for (int col = 0; col < 3; col++)
+  {
+    for (int row = 0; row < 3; row++)
+    {
+      columns[col][row] = m->GetElement(row, col);
+    }
+  }
+  double scale2 = vtkMath::Dot( columns[0], columns[0] );
+  if ( scale2 <= 0.0 )
+  {
+    return false;
+  }
+  for (int col = 0; col < 3; col++)
+  {
+    if ( fabs( vtkMath::Dot( columns[col], columns[col] ) - scale2 ) > tolerance * scale2
+      || fabs( vtkMath::Dot( columns[col], columns[(col+1)%3] ) ) > tolerance * scale2 )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Compute distance map geometry that covers the bounds extended by the margin
+static void ComputeDistanceMapGeometry(double bounds[6], double spacingMm, double marginMm, double origin[3], int dimensions[3])
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    origin[axis] = bounds[axis*2] - marginMm;
+    double size = bounds[axis*2+1] - bounds[axis*2] + 2 * marginMm;
+    dimensions[axis] = static_cast<int>( ceil( size / spacingMm ) ) + 1;
+    if ( dimensions[axis] < 2 )
+    {
+      // at least two samples are needed along each axis for interpolation
+      dimensions[axis] = 2;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+struct DistanceMapComputationJob
+{
+  float* Scalars;
+  int Dimensions[3];
+  double Origin[3];
+  double Spacing;
+  // One distance engine for each thread (distance engines cannot be used from multiple threads)
+  std::vector< vtkSmartPointer< vtkImplicitPolyDataDistancePointPos > > DistanceEngines;
+};
+
+//------------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE ComputeDistanceMapThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  DistanceMapComputationJob* job = static_cast< DistanceMapComputationJob* >( threadInfo->UserData );
+  int threadId = threadInfo->ThreadID;
+  int numberOfThreads = threadInfo->NumberOfThreads;
+
+  vtkImplicitPolyDataDistancePointPos* distanceEngine = job->DistanceEngines[threadId];
+  if ( threadId > 0 )
+  {
+    // Only the locator is built, input and pseudonormals are shared with the first engine
+    distanceEngine->ShareInput( job->DistanceEngines[0] );
+  }
+
+  // Slices are interleaved between threads for better load balancing
+  // (slices that intersect the model take longer to compute)
+  const int* dims = job->Dimensions;
+  for ( int k = threadId; k < dims[2]; k += numberOfThreads )
+  {
+    double x[3] = { 0.0, 0.0, job->Origin[2] + k * job->Spacing };
+    float* slice = job->Scalars + static_cast< vtkIdType >( k ) * dims[0] * dims[1];
+    for ( int j = 0; j < dims[1]; j++ )
+    {
+      x[1] = job->Origin[1] + j * job->Spacing;
+      for ( int i = 0; i < dims[0]; i++ )
+      {
+        x[0] = job->Origin[0] + i * job->Spacing;
+        slice[ j * dims[0] + i ] = static_cast< float >( distanceEngine->EvaluateFunction( x ) );
+      }
+    }
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//------------------------------------------------------------------------------
+// Get signed distance and closest point by trilinear interpolation of the distance map.
+// Returns false if the point is outside the distance map.
+static bool InterpolateDistanceMap(vtkImageData* distanceMap, const double x[3], double& distance, double closestPoint[3])
+{
+  double* origin = distanceMap->GetOrigin();
+  double* spacing = distanceMap->GetSpacing();
+  int* dims = distanceMap->GetDimensions();
+  int baseIndex[3] = { 0, 0, 0 };
+  double f[3] = { 0.0, 0.0, 0.0 };
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    double continuousIndex = ( x[axis] - origin[axis] ) / spacing[axis];
+    if ( continuousIndex < 0 || continuousIndex > dims[axis] - 1 )
+    {
+      return false;
+    }
+    baseIndex[axis] = static_cast< int >( floor( continuousIndex ) );
+    if ( baseIndex[axis] > dims[axis] - 2 )
+    {
+      baseIndex[axis] = dims[axis] - 2;
+    }
+    f[axis] = continuousIndex - baseIndex[axis];
+  }
+
+  const float* scalars = static_cast< float* >( distanceMap->GetScalarPointer() );
+  vtkIdType strideY = dims[0];
+  vtkIdType strideZ = static_cast< vtkIdType >( dims[0] ) * dims[1];
+  const float* v = scalars + baseIndex[0] + baseIndex[1] * strideY + baseIndex[2] * strideZ;
+  double v000 = v[0];
+  double v100 = v[1];
+  double v010 = v[strideY];
+  double v110 = v[strideY + 1];
+  double v001 = v[strideZ];
+  double v101 = v[strideZ + 1];
+  double v011 = v[strideZ + strideY];
+  double v111 = v[strideZ + strideY + 1];
+
+  // Interpolate along x
+  double v00 = v000 + f[0] * ( v100 - v000 );
+  double v10 = v010 + f[0] * ( v110 - v010 );
+  double v01 = v001 + f[0] * ( v101 - v001 );
+  double v11 = v011 + f[0] * ( v111 - v011 );
+  // Interpolate along y
+  double v0 = v00 + f[1] * ( v10 - v00 );
+  double v1 = v01 + f[1] * ( v11 - v01 );
+  // Interpolate along z
+  distance = v0 + f[2] * ( v1 - v0 );
+
+  // Gradient of the interpolated field points away from the closest surface point
+  double gradient[3] =
+  {
+    ( ( 1 - f[1] ) * ( 1 - f[2] ) * ( v100 - v000 ) + f[1] * ( 1 - f[2] ) * ( v110 - v010 )
+      + ( 1 - f[1] ) * f[2] * ( v101 - v001 ) + f[1] * f[2] * ( v111 - v011 ) ) / spacing[0],
+    ( ( 1 - f[2] ) * ( v10 - v00 ) + f[2] * ( v11 - v01 ) ) / spacing[1],
+    ( v1 - v0 ) / spacing[2]
+  };
+  if ( vtkMath::Normalize( gradient ) == 0.0 )
+  {
+    closestPoint[0] = x[0];
+    closestPoint[1] = x[1];
+    closestPoint[2] = x[2];
+    return true;
+  }
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    closestPoint[axis] = x[axis] - distance * gradient[axis];
+  }
+  return true;
+}
+
+// Slicer methods 
+
+vtkStandardNewMacro(vtkSlicerBreachWarningLogic);
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkSlicerBreachWarningLogic()
+: WarningSoundPlaying(false)
+, DefaultLineToClosestPointTextScale(2.0)
+, DefaultLineToClosestPointThickness(3.0)
+, DistanceMapMaximumMemorySizeMB(512.0)
+, MaximumUpdateRateHz(0.0)
+, BuildDistanceEngineInBackground(false)
+, EvaluationTimeWindowSize(1000)
+{
+  this->Internal = new vtkInternal;
+  this->DefaultLineToClosestPointColor[0]=0;
+  this->DefaultLineToClosestPointColor[1]=1;
+  this->DefaultLineToClosestPointColor[2]=0;
+}
+
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::~vtkSlicerBreachWarningLogic()
+{
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::SetMRMLSceneInternal(vtkMRMLScene * newScene)
+{
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
+  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
+  events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
+  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::RegisterNodes()
+{
+  if( ! this->GetMRMLScene() )
+  {
+    vtkWarningMacro( "MRML scene not yet created" );
+    return;
+  }
+
+  this->GetMRMLScene()->RegisterNodeClass( vtkSmartPointer< vtkMRMLBreachWarningNode >::New() );
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateToolState( vtkMRMLBreachWarningNode* bwNode )
+{
+  if ( bwNode == NULL )
+  {
+    return;
+  }
+
+  vtkMRMLTransformNode* toolToRasNode = bwNode->GetToolTransformNode();
+
+  if ( bwNode->GetNumberOfWatchedModelNodes() == 0 || toolToRasNode == NULL )
+  {
+    bwNode->SetClosestDistanceReady(false);
+    bwNode->SetClosestDistanceToModelFromToolTip(0);
+    bwNode->SetClosestDistanceBeyondRange(false);
+    bwNode->SetClosestModelIndex(-1);
+    bwNode->SetToolTipPathCrossedModel(false);
+    this->Internal->NodeInfos[bwNode].PreviousToolTipValid = false;
+    return;
+  }
+
+  vtkNew< vtkMatrix4x4 > engineToRasMatrix;
+  vtkImplicitPolyDataDistancePointPos* implicitDistanceFilter = this->GetDistanceEngine( bwNode, engineToRasMatrix.GetPointer() );
+  if ( implicitDistanceFilter == NULL )
+  {
+    if ( this->Internal->NodeInfos[bwNode].BuildJob != NULL )
+    {
+      // distance engine is being built in the background
+      bwNode->SetClosestDistanceReady(false);
+      return;
+    }
+    vtkWarningMacro( "No surface model in node" );
+    bwNode->SetClosestDistanceReady(false);
+    return;
+  }
+  bwNode->SetClosestDistanceReady(true);
+
+  vtkInternal::BreachWarningNodeInfo& nodeInfo = this->Internal->NodeInfos[bwNode];
+  if ( nodeInfo.ToolSamplePoints_Engine.GetPointer() == NULL )
+  {
+    nodeInfo.ToolSamplePoints_Engine = vtkSmartPointer< vtkPoints >::New();
+  }
+  vtkPoints* toolSamplePoints_Engine = nodeInfo.ToolSamplePoints_Engine;
+  if ( nodeInfo.ClosestCellIds.GetPointer() == NULL )
+  {
+    nodeInfo.ClosestCellIds = vtkSmartPointer< vtkIdTypeArray >::New();
+  }
+  vtkIdTypeArray* closestCellIds = nodeInfo.ClosestCellIds;
+
+  // Compute distance in the engine's coordinate system (model coordinate system, if the model is transformed
+  // by a similarity transform) so that only the tool points have to be transformed and not the whole model.
+  vtkSmartPointer<vtkGeneralTransform> toolToRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  toolToRasNode->GetTransformToWorld( toolToRasTransform ); 
+  vtkNew< vtkMatrix4x4 > rasToEngineMatrix;
+  vtkMatrix4x4::Invert( engineToRasMatrix.GetPointer(), rasToEngineMatrix.GetPointer() );
+
+  // If no sample points are specified then only the tool tip (origin of the tool coordinate system) is checked
+  vtkPoints* toolSamplePoints_Tool = bwNode->GetToolSamplePoints();
+  vtkIdType numberOfToolSamplePoints = toolSamplePoints_Tool->GetNumberOfPoints();
+  toolSamplePoints_Engine->SetNumberOfPoints( numberOfToolSamplePoints > 0 ? numberOfToolSamplePoints : 1 );
+  for ( vtkIdType pointIndex = 0; pointIndex < toolSamplePoints_Engine->GetNumberOfPoints(); pointIndex++ )
+  {
+    double toolSamplePoint_Tool[4] = { 0.0, 0.0, 0.0, 1.0 };
+    if ( numberOfToolSamplePoints > 0 )
+    {
+      toolSamplePoints_Tool->GetPoint( pointIndex, toolSamplePoint_Tool );
+    }
+    double toolSamplePoint_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+    toolToRasTransform->TransformPoint( toolSamplePoint_Tool, toolSamplePoint_Ras );
+    double toolSamplePoint_Engine[4] = { 0.0, 0.0, 0.0, 1.0 };
+    rasToEngineMatrix->MultiplyPoint( toolSamplePoint_Ras, toolSamplePoint_Engine );
+    toolSamplePoints_Engine->SetPoint( pointIndex, toolSamplePoint_Engine );
+  }
+  toolSamplePoints_Engine->Modified();
+
+  // A fast moving tool may pass through a thin structure between two updates without any of the sampled
+  // tool tip positions being inside, therefore the path since the previous update is checked, too.
+  // It is a single segment intersection query, so it costs about the same as one closest point search.
+  bool toolTipPathCrossedModel = false;
+  if ( bwNode->GetCheckToolTipPath() )
+  {
+    double toolTip_Tool[3] = { 0.0, 0.0, 0.0 };
+    double toolTip_Ras[3] = { 0.0, 0.0, 0.0 };
+    toolToRasTransform->TransformPoint( toolTip_Tool, toolTip_Ras );
+    if ( nodeInfo.PreviousToolTipValid && vtkMath::Distance2BetweenPoints( nodeInfo.PreviousToolTip_Ras, toolTip_Ras ) > 0.0 )
+    {
+      double previousToolTip_Ras[4] = { nodeInfo.PreviousToolTip_Ras[0], nodeInfo.PreviousToolTip_Ras[1], nodeInfo.PreviousToolTip_Ras[2], 1.0 };
+      double previousToolTip_Engine[4] = { 0.0, 0.0, 0.0, 1.0 };
+      rasToEngineMatrix->MultiplyPoint( previousToolTip_Ras, previousToolTip_Engine );
+      double currentToolTip_Ras[4] = { toolTip_Ras[0], toolTip_Ras[1], toolTip_Ras[2], 1.0 };
+      double currentToolTip_Engine[4] = { 0.0, 0.0, 0.0, 1.0 };
+      rasToEngineMatrix->MultiplyPoint( currentToolTip_Ras, currentToolTip_Engine );
+      double crossingFraction = 0.0;
+      double crossingPoint_Engine[4] = { 0.0, 0.0, 0.0, 1.0 };
+      vtkIdType crossedCellId = -1;
+      if ( implicitDistanceFilter->IntersectWithSegment( previousToolTip_Engine, currentToolTip_Engine, crossingFraction, crossingPoint_Engine, crossedCellId ) )
+      {
+        double crossingPoint_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+        engineToRasMatrix->MultiplyPoint( crossingPoint_Engine, crossingPoint_Ras );
+        bwNode->SetToolTipPathCrossingPoint( crossingPoint_Ras );
+        bwNode->SetToolTipPathCrossingFraction( crossingFraction );
+        bwNode->SetToolTipPathCrossedModelIndex( this->GetWatchedModelIndexOfCell( bwNode, implicitDistanceFilter, crossedCellId ) );
+        toolTipPathCrossedModel = true;
+      }
+    }
+    nodeInfo.PreviousToolTip_Ras[0] = toolTip_Ras[0];
+    nodeInfo.PreviousToolTip_Ras[1] = toolTip_Ras[1];
+    nodeInfo.PreviousToolTip_Ras[2] = toolTip_Ras[2];
+    nodeInfo.PreviousToolTipValid = true;
+  }
+  else
+  {
+    nodeInfo.PreviousToolTipValid = false;
+  }
+  bwNode->SetToolTipPathCrossedModel( toolTipPathCrossedModel );
+
+  // Similarity transform: distances are only scaled, the sign (inside/outside) is preserved
+  double engineToRasScale = sqrt( engineToRasMatrix->GetElement(0,0)*engineToRasMatrix->GetElement(0,0)
+    + engineToRasMatrix->GetElement(1,0)*engineToRasMatrix->GetElement(1,0)
+    + engineToRasMatrix->GetElement(2,0)*engineToRasMatrix->GetElement(2,0) );
+
+  // If a maximum distance is specified then the search for the closest point is skipped for points that are farther
+  bool boundedSearch = ( bwNode->GetMaximumReportedDistanceMm() > 0 );
+  double maximumReportedDistance_Engine = bwNode->GetMaximumReportedDistanceMm() / engineToRasScale;
+
+  double closestPointOnModel_Engine[4] = { 0.0, 0.0, 0.0, 1.0 };
+  vtkIdType closestToolSamplePointIndex = -1;
+  double closestPointDistance_Engine = 0.0;
+  vtkImageData* distanceMap = this->GetDistanceMap( bwNode );
+  if ( distanceMap != NULL || boundedSearch )
+  {
+    if ( closestCellIds->GetNumberOfTuples() != toolSamplePoints_Engine->GetNumberOfPoints() )
+    {
+      closestCellIds->SetNumberOfTuples( toolSamplePoints_Engine->GetNumberOfPoints() );
+      closestCellIds->FillComponent( 0, -1 );
+    }
+    // Interpolate from the distance map (if available), use exact computation for points outside the map
+    for ( vtkIdType pointIndex = 0; pointIndex < toolSamplePoints_Engine->GetNumberOfPoints(); pointIndex++ )
+    {
+      double toolSamplePoint_Engine[3] = { 0.0, 0.0, 0.0 };
+      toolSamplePoints_Engine->GetPoint( pointIndex, toolSamplePoint_Engine );
+      double distance = 0.0;
+      double closestPoint[3] = { 0.0, 0.0, 0.0 };
+      bool distanceFound = ( distanceMap != NULL && InterpolateDistanceMap( distanceMap, toolSamplePoint_Engine, distance, closestPoint ) );
+      if ( !distanceFound )
+      {
+        if ( boundedSearch )
+        {
+          distanceFound = implicitDistanceFilter->EvaluateFunctionWithinDistance( toolSamplePoint_Engine, maximumReportedDistance_Engine, distance, closestPoint );
+        }
+        else
+        {
+          vtkIdType closestCellId = closestCellIds->GetValue( pointIndex );
+          distance = implicitDistanceFilter->EvaluateFunctionAndGetClosestPointWithHint( toolSamplePoint_Engine, closestCellId, closestPoint );
+          closestCellIds->SetValue( pointIndex, closestCellId );
+          distanceFound = true;
+        }
+      }
+      if ( !distanceFound )
+      {
+        // farther than the maximum reported distance
+        continue;
+      }
+      if ( closestToolSamplePointIndex < 0 || distance < closestPointDistance_Engine )
+      {
+        closestPointDistance_Engine = distance;
+        closestToolSamplePointIndex = pointIndex;
+        closestPointOnModel_Engine[0] = closestPoint[0];
+        closestPointOnModel_Engine[1] = closestPoint[1];
+        closestPointOnModel_Engine[2] = closestPoint[2];
+      }
+    }
+  }
+  else
+  {
+    // Evaluate all the points in one pass, starting from the closest cells of the previous update
+    closestPointDistance_Engine = implicitDistanceFilter->EvaluateFunctionAtPointsAndGetClosestPoint(
+      toolSamplePoints_Engine, closestPointOnModel_Engine, closestToolSamplePointIndex, NULL, closestCellIds );
+  }
+
+  if ( boundedSearch && ( closestToolSamplePointIndex < 0 || closestPointDistance_Engine > maximumReportedDistance_Engine ) )
+  {
+    // All the tool sample points are far from the watched models, exact distance is not reported.
+    // The closest point is unknown, so it is set to the tool tip and the line to the closest point is hidden
+    // (otherwise they would remain at the last position where the tool was within range).
+    double toolTip_Tool[3] = { 0.0, 0.0, 0.0 };
+    double toolTip_Ras[3] = { 0.0, 0.0, 0.0 };
+    toolToRasTransform->TransformPoint( toolTip_Tool, toolTip_Ras );
+    bwNode->SetClosestDistanceToModelFromToolTip( bwNode->GetMaximumReportedDistanceMm() );
+    bwNode->SetClosestDistanceBeyondRange( true );
+    bwNode->SetClosestPointOnModel( toolTip_Ras );
+    bwNode->SetClosestModelIndex( -1 );
+    nodeInfo.WatchedModelDistances.assign( bwNode->GetNumberOfWatchedModelNodes(), VTK_DOUBLE_MAX );
+    bwNode->SetWatchedModelDistances( nodeInfo.WatchedModelDistances );
+    vtkMRMLAnnotationRulerNode* ruler = bwNode->GetLineToClosestPointNode();
+    if ( ruler != NULL && ruler->GetDisplayVisibility() )
+    {
+      ruler->SetDisplayVisibility( false );
+      nodeInfo.LineToClosestPointHiddenBeyondRange = true;
+    }
+    return;
+  }
+
+  if ( closestToolSamplePointIndex < 0 )
+  {
+    closestToolSamplePointIndex = 0;
+  }
+
+  double closestToolSamplePoint_Engine[4] = { 0.0, 0.0, 0.0, 1.0 };
+  toolSamplePoints_Engine->GetPoint( closestToolSamplePointIndex, closestToolSamplePoint_Engine );
+  double closestToolSamplePoint_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+  engineToRasMatrix->MultiplyPoint( closestToolSamplePoint_Engine, closestToolSamplePoint_Ras );
+  double closestPointOnModel_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+  engineToRasMatrix->MultiplyPoint( closestPointOnModel_Engine, closestPointOnModel_Ras );
+  double closestPointDistance = closestPointDistance_Engine * engineToRasScale;
+
+  // Get distance of each watched model from the closest tool sample point.
+  // Models farther than the threshold are not evaluated (only the closest model is always included).
+  int numberOfModels = bwNode->GetNumberOfWatchedModelNodes();
+  int closestModelIndex = -1;
+  nodeInfo.WatchedModelDistances.assign( numberOfModels, VTK_DOUBLE_MAX );
+  vtkDataArray* modelIndexArray = implicitDistanceFilter->GetInput()->GetCellData()->GetArray( WATCHED_MODEL_INDEX_ARRAY_NAME );
+  if ( numberOfModels > 1 && modelIndexArray != NULL )
+  {
+    double searchRadius_Engine = std::max( bwNode->GetWatchedModelDistanceThresholdMm() / engineToRasScale,
+      fabs( closestPointDistance_Engine ) * 1.001 + implicitDistanceFilter->GetTolerance() );
+    implicitDistanceFilter->EvaluateFunctionForCellGroups( closestToolSamplePoint_Engine, searchRadius_Engine,
+      modelIndexArray, numberOfModels, &( nodeInfo.WatchedModelDistances[0] ) );
+    for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+    {
+      if ( nodeInfo.WatchedModelDistances[modelIndex] == VTK_DOUBLE_MAX )
+      {
+        continue;
+      }
+      nodeInfo.WatchedModelDistances[modelIndex] *= engineToRasScale;
+      if ( closestModelIndex < 0 || nodeInfo.WatchedModelDistances[modelIndex] < nodeInfo.WatchedModelDistances[closestModelIndex] )
+      {
+        closestModelIndex = modelIndex;
+      }
+    }
+  }
+  else
+  {
+    // Single model: the first valid model
+    for ( closestModelIndex = 0; closestModelIndex < numberOfModels; closestModelIndex++ )
+    {
+      vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( closestModelIndex );
+      if ( modelNode != NULL && modelNode->GetPolyData() != NULL )
+      {
+        break;
+      }
+    }
+    if ( closestModelIndex < numberOfModels )
+    {
+      nodeInfo.WatchedModelDistances[closestModelIndex] = closestPointDistance;
+    }
+  }
+
+  bwNode->SetClosestDistanceToModelFromToolTip(closestPointDistance);
+  bwNode->SetClosestDistanceBeyondRange(false);
+  bwNode->SetClosestPointOnModel(closestPointOnModel_Ras);
+  bwNode->SetClosestToolSamplePointIndex(closestToolSamplePointIndex);
+  bwNode->SetClosestModelIndex( ( closestModelIndex >= 0 && closestModelIndex < numberOfModels ) ? closestModelIndex : -1 );
+  bwNode->SetWatchedModelDistances(nodeInfo.WatchedModelDistances);
+
+  this->UpdateLineToClosestPoint(bwNode, closestToolSamplePoint_Ras, closestPointOnModel_Ras, closestPointDistance);
+}
+
+//------------------------------------------------------------------------------
+vtkImplicitPolyDataDistancePointPos* vtkSlicerBreachWarningLogic::GetDistanceEngine( vtkMRMLBreachWarningNode* bwNode, vtkMatrix4x4* engineToRasMatrix )
+{
+  engineToRasMatrix->Identity();
+
+  vtkInternal::BreachWarningNodeInfo& nodeInfo = this->Internal->NodeInfos[bwNode];
+  if ( nodeInfo.BuildJob != NULL && nodeInfo.BuildJob->IsCompleted() )
+  {
+    // Engine has been built in the background, start using it
+    this->Internal->FinishEngineBuild( nodeInfo );
+  }
+
+  int numberOfModels = bwNode->GetNumberOfWatchedModelNodes();
+  std::vector< vtkMRMLModelNode* > modelNodes( numberOfModels, static_cast< vtkMRMLModelNode* >( NULL ) );
+  vtkMRMLModelNode* firstModelNode = NULL;
+  bool commonParentTransform = true;
+  for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+  {
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( modelIndex );
+    if ( modelNode == NULL || modelNode->GetPolyData() == NULL )
+    {
+      continue;
+    }
+    modelNodes[modelIndex] = modelNode;
+    if ( firstModelNode == NULL )
+    {
+      firstModelNode = modelNode;
+    }
+    else if ( modelNode->GetParentTransformNode() != firstModelNode->GetParentTransformNode() )
+    {
+      commonParentTransform = false;
+    }
+  }
+  if ( firstModelNode == NULL )
+  {
+    return NULL;
+  }
+
+  // If all the models are under the same similarity transform then the engine is built in model coordinates
+  // and the tool tip will be transformed into model coordinates instead.
+  // Otherwise models are transformed to RAS (closest points are not preserved by non-uniform scaling or shearing).
+  bool modelsInEngineCoordinates = false;
+  if ( commonParentTransform )
+  {
+    vtkMRMLTransformNode* parentTransform = firstModelNode->GetParentTransformNode();
+    if ( parentTransform == NULL )
+    {
+      modelsInEngineCoordinates = true;
+    }
+    else if ( parentTransform->IsTransformToWorldLinear() )
+    {
+      vtkNew< vtkMatrix4x4 > modelToRasMatrix;
+      parentTransform->GetMatrixTransformToWorld( modelToRasMatrix.GetPointer() );
+      if ( IsSimilarityTransform( modelToRasMatrix.GetPointer() ) )
+      {
+        engineToRasMatrix->DeepCopy( modelToRasMatrix.GetPointer() );
+        modelsInEngineCoordinates = true;
+      }
+    }
+  }
+
+  // Determine what transform would have to be baked into the engine's input for each model
+  std::vector< vtkInternal::EngineSource > engineSources( numberOfModels );
+  vtkInternal::EngineInputTransformType engineInputTransform = vtkInternal::EngineInputNotTransformed;
+  for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+  {
+    vtkMRMLModelNode* modelNode = modelNodes[modelIndex];
+    if ( modelNode == NULL )
+    {
+      continue;
+    }
+    vtkInternal::EngineSource& engineSource = engineSources[modelIndex];
+    engineSource.PolyData = modelNode->GetPolyData();
+    engineSource.PolyDataMTime = modelNode->GetPolyData()->GetMTime();
+    vtkMRMLTransformNode* parentTransform = modelNode->GetParentTransformNode();
+    if ( modelsInEngineCoordinates || parentTransform == NULL )
+    {
+      continue;
+    }
+    if ( parentTransform->IsTransformToWorldLinear() )
+    {
+      engineSource.Transform = vtkInternal::EngineInputLinearTransformed;
+      engineSource.ModelToEngineMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+      parentTransform->GetMatrixTransformToWorld( engineSource.ModelToEngineMatrix );
+      if ( engineInputTransform == vtkInternal::EngineInputNotTransformed )
+      {
+        engineInputTransform = vtkInternal::EngineInputLinearTransformed;
+      }
+    }
+    else
+    {
+      engineSource.Transform = vtkInternal::EngineInputNonLinearTransformed;
+      engineInputTransform = vtkInternal::EngineInputNonLinearTransformed;
+    }
+  }
+
+  bool engineUpToDate = nodeInfo.DistanceEngine.GetPointer() != NULL
+    && nodeInfo.DistanceLocator == bwNode->GetDistanceLocator()
+    && nodeInfo.EngineSources.size() == engineSources.size();
+  for ( int modelIndex = 0; engineUpToDate && modelIndex < numberOfModels; modelIndex++ )
+  {
+    engineUpToDate = vtkInternal::IsEngineSourceEqual( nodeInfo.EngineSources[modelIndex], engineSources[modelIndex] );
+  }
+  if ( engineUpToDate )
+  {
+    return nodeInfo.DistanceEngine;
+  }
+
+  // Previous engine can be used while a new one is being built if it is in the same coordinate system
+  bool previousEngineUsable = nodeInfo.DistanceEngine.GetPointer() != NULL
+    && nodeInfo.EngineInModelCoordinates == modelsInEngineCoordinates;
+  if ( nodeInfo.BuildJob != NULL )
+  {
+    // A new engine is being built already. If that is outdated, too, then another build will be started when it is completed.
+    return previousEngineUsable ? nodeInfo.DistanceEngine.GetPointer() : NULL;
+  }
+
+  vtkSmartPointer< vtkImplicitPolyDataDistancePointPos > implicitDistanceFilter = vtkSmartPointer< vtkImplicitPolyDataDistancePointPos >::New();
+  vtkSmartPointer< vtkAbstractCellLocator > locator = CreateDistanceLocator( bwNode->GetDistanceLocator() );
+  if ( locator.GetPointer() != NULL )
+  {
+    implicitDistanceFilter->SetLocator( locator ); // must be set before the input
+  }
+
+  // Engine is rebuilt at each update if there is a non-linear transform, so it is not built in the background then
+  if ( this->BuildDistanceEngineInBackground && engineInputTransform != vtkInternal::EngineInputNonLinearTransformed )
+  {
+    vtkInternal::EngineBuildJob* job = new vtkInternal::EngineBuildJob;
+    job->DistanceEngine = implicitDistanceFilter;
+    job->LabelModels = ( numberOfModels > 1 );
+    for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+    {
+      if ( modelNodes[modelIndex] == NULL )
+      {
+        continue;
+      }
+      // Shallow copy is cheap and keeps the current points and cells alive even if the model is updated while building
+      vtkInternal::EngineBuildSource buildSource;
+      buildSource.PolyData = vtkSmartPointer< vtkPolyData >::New();
+      buildSource.PolyData->ShallowCopy( modelNodes[modelIndex]->GetPolyData() );
+      buildSource.ModelIndex = modelIndex;
+      if ( engineSources[modelIndex].Transform == vtkInternal::EngineInputLinearTransformed )
+      {
+        buildSource.Transformed = true;
+        for ( int row = 0; row < 4; row++ )
+        {
+          for ( int col = 0; col < 4; col++ )
+          {
+            buildSource.ModelToEngineMatrix[row][col] = engineSources[modelIndex].ModelToEngineMatrix->GetElement( row, col );
+          }
+        }
+        nodeInfo.NumberOfModelTransforms++;
+      }
+      job->BuildSources.push_back( buildSource );
+    }
+    job->EngineSources = engineSources;
+    job->EngineInputTransform = engineInputTransform;
+    job->EngineInModelCoordinates = modelsInEngineCoordinates;
+    job->DistanceLocator = bwNode->GetDistanceLocator();
+    if ( this->Internal->StartEngineBuild( job ) )
+    {
+      nodeInfo.BuildJob = job;
+      nodeInfo.NumberOfLocatorBuilds++;
+      this->InvokeEvent(PendingUpdatesRequestedEvent);
+      return previousEngineUsable ? nodeInfo.DistanceEngine.GetPointer() : NULL;
+    }
+    vtkWarningMacro( "Failed to start distance engine build in the background" );
+    delete job;
+  }
+
+  // Collect all the watched surfaces (in engine coordinates) into one polydata so that a single
+  // spatial index is built. When multiple models are watched, each cell stores the index of its model.
+  vtkNew< vtkAppendPolyData > appendFilter;
+  vtkSmartPointer< vtkPolyData > engineInput;
+  for ( int modelIndex = 0; modelIndex < numberOfModels; modelIndex++ )
+  {
+    vtkMRMLModelNode* modelNode = modelNodes[modelIndex];
+    if ( modelNode == NULL )
+    {
+      continue;
+    }
+    vtkSmartPointer< vtkPolyData > body = modelNode->GetPolyData();
 
-// Slicer methods 
+    // Transform the body poly data if there is a parent transform that cannot be applied to the tool tip instead.
+    if ( engineSources[modelIndex].Transform != vtkInternal::EngineInputNotTransformed )
+    {
+      vtkSmartPointer< vtkGeneralTransform > bodyToRasTransform = vtkSmartPointer< vtkGeneralTransform >::New();
+      modelNode->GetParentTransformNode()->GetTransformToWorld( bodyToRasTransform );
 
-vtkStandardNewMacro(vtkSlicerBreachWarningLogic);
+      vtkSmartPointer< vtkTransformPolyDataFilter > bodyToRasFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
+#if (VTK_MAJOR_VERSION <= 5)
+      bodyToRasFilter->SetInput( body );
+#else
+      bodyToRasFilter->SetInputData( body );
+#endif
+      bodyToRasFilter->SetTransform( bodyToRasTransform );
+      bodyToRasFilter->Update(); // expensive: transforms all the points of the polydata
+      nodeInfo.NumberOfModelTransforms++;
+      body = bodyToRasFilter->GetOutput();
+    }
 
-//------------------------------------------------------------------------------
-vtkSlicerBreachWarningLogic::vtkSlicerBreachWarningLogic()
-: WarningSoundPlaying(false)
-, DefaultLineToClosestPointTextScale(2.0)
-, DefaultLineToClosestPointThickness(3.0)
-{
-  this->DefaultLineToClosestPointColor[0]=0;
-  this->DefaultLineToClosestPointColor[1]=1;
-  this->DefaultLineToClosestPointColor[2]=0;
-}
+    if ( numberOfModels == 1 )
+    {
+      engineInput = body;
+      break;
+    }
 
+    // Only the model index is kept from the point and cell data
+    vtkSmartPointer< vtkPolyData > labeledBody = vtkSmartPointer< vtkPolyData >::New();
+    labeledBody->ShallowCopy( body );
+    labeledBody->GetPointData()->Initialize();
+    labeledBody->GetCellData()->Initialize();
+    vtkSmartPointer< vtkIntArray > modelIndexArray = vtkSmartPointer< vtkIntArray >::New();
+    modelIndexArray->SetName( WATCHED_MODEL_INDEX_ARRAY_NAME );
+    modelIndexArray->SetNumberOfTuples( labeledBody->GetNumberOfCells() );
+    modelIndexArray->FillComponent( 0, modelIndex );
+    labeledBody->GetCellData()->AddArray( modelIndexArray );
+#if (VTK_MAJOR_VERSION <= 5)
+    appendFilter->AddInput( labeledBody );
+#else
+    appendFilter->AddInputData( labeledBody );
+#endif
+  }
+  if ( engineInput.GetPointer() == NULL )
+  {
+    appendFilter->Update();
+    engineInput = appendFilter->GetOutput();
+  }
 
-//------------------------------------------------------------------------------
-vtkSlicerBreachWarningLogic::~vtkSlicerBreachWarningLogic()
-{
-}
+  implicitDistanceFilter->SetInput( engineInput ); // expensive: builds a locator
+  nodeInfo.NumberOfLocatorBuilds++;
 
-//------------------------------------------------------------------------------
-void vtkSlicerBreachWarningLogic::PrintSelf(ostream& os, vtkIndent indent)
-{
-  this->Superclass::PrintSelf(os, indent);
-}
+  nodeInfo.DistanceEngine = implicitDistanceFilter;
+  nodeInfo.ClosestCellIds = NULL; // cell ids of the previous engine are not valid anymore
+  nodeInfo.EngineSources = engineSources;
+  nodeInfo.EngineInputTransform = engineInputTransform;
+  nodeInfo.EngineInModelCoordinates = modelsInEngineCoordinates;
+  nodeInfo.DistanceLocator = bwNode->GetDistanceLocator();
 
-//------------------------------------------------------------------------------
-void vtkSlicerBreachWarningLogic::SetMRMLSceneInternal(vtkMRMLScene * newScene)
-{
-  vtkNew<vtkIntArray> events;
-  events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
-  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
-  events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
-  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+  return nodeInfo.DistanceEngine;
 }
 
 //------------------------------------------------------------------------------
-void vtkSlicerBreachWarningLogic::RegisterNodes()
+vtkImageData* vtkSlicerBreachWarningLogic::GetDistanceMap( vtkMRMLBreachWarningNode* bwNode )
 {
-  if( ! this->GetMRMLScene() )
+  vtkInternal::BreachWarningNodeInfo& nodeInfo = this->Internal->NodeInfos[bwNode];
+  if ( !bwNode->GetUseDistanceMap() || nodeInfo.DistanceEngine.GetPointer() == NULL
+    || nodeInfo.DistanceEngine->GetInput() == NULL || nodeInfo.DistanceEngine->GetInput()->GetNumberOfCells() == 0 )
   {
-    vtkWarningMacro( "MRML scene not yet created" );
-    return;
+    nodeInfo.DistanceMap = NULL;
+    return NULL;
   }
-
-  this->GetMRMLScene()->RegisterNodeClass( vtkSmartPointer< vtkMRMLBreachWarningNode >::New() );
-}
-
-//------------------------------------------------------------------------------
-void vtkSlicerBreachWarningLogic::UpdateToolState( vtkMRMLBreachWarningNode* bwNode )
-{
-  if ( bwNode == NULL )
+  if ( nodeInfo.EngineInputTransform == vtkInternal::EngineInputNonLinearTransformed )
   {
-    return;
+    // The engine is rebuilt at each update, it is not worth precomputing a distance map
+    nodeInfo.DistanceMap = NULL;
+    return NULL;
   }
 
-  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
-  vtkMRMLTransformNode* toolToRasNode = bwNode->GetToolTransformNode();
-
-  if ( modelNode == NULL || toolToRasNode == NULL )
+  if ( nodeInfo.DistanceMap.GetPointer() != NULL
+    && nodeInfo.DistanceMapEngine.GetPointer() == nodeInfo.DistanceEngine.GetPointer()
+    && nodeInfo.DistanceMapSpacingMm == bwNode->GetDistanceMapSpacingMm()
+    && nodeInfo.DistanceMapMarginMm == bwNode->GetDistanceMapMarginMm() )
   {
-    bwNode->SetClosestDistanceToModelFromToolTip(0);
-    return;
+    // up-to-date
+    return nodeInfo.DistanceMap;
   }
+  nodeInfo.DistanceMap = NULL;
 
-  vtkPolyData* body = modelNode->GetPolyData();
-  if ( body == NULL )
+  double spacingMm = bwNode->GetDistanceMapSpacingMm();
+  double marginMm = bwNode->GetDistanceMapMarginMm();
+  double memorySizeMB = this->GetDistanceMapMemorySizeMB( bwNode );
+  if ( memorySizeMB > this->DistanceMapMaximumMemorySizeMB )
   {
-    vtkWarningMacro( "No surface model in node" );
-    return;
+    vtkWarningMacro( "Distance map would require " << memorySizeMB << "MB memory (maximum allowed is "
+      << this->DistanceMapMaximumMemorySizeMB << "MB). Increase the distance map spacing. Exact distance computation is used." );
+    // Remember the settings so that the warning is not logged at each update
+    nodeInfo.DistanceMapEngine = nodeInfo.DistanceEngine;
+    nodeInfo.DistanceMapSpacingMm = spacingMm;
+    nodeInfo.DistanceMapMarginMm = marginMm;
+    return NULL;
   }
-  
-  vtkSmartPointer< vtkImplicitPolyDataDistancePointPos > implicitDistanceFilter = vtkSmartPointer< vtkImplicitPolyDataDistancePointPos >::New();
 
-  // Transform the body poly data if there is a parent transform.
-  vtkMRMLTransformNode* bodyParentTransform = modelNode->GetParentTransformNode();
-  if ( bodyParentTransform != NULL )
-  {
-    vtkSmartPointer< vtkGeneralTransform > bodyToRasTransform = vtkSmartPointer< vtkGeneralTransform >::New();
-    bodyParentTransform->GetTransformToWorld( bodyToRasTransform );
+  DistanceMapComputationJob job;
+  double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  // Computing bounds here ensures that the input is not modified (by bounds computation) in the threads
+  nodeInfo.DistanceEngine->GetInput()->GetBounds( bounds );
+  ComputeDistanceMapGeometry( bounds, spacingMm, marginMm, job.Origin, job.Dimensions );
+  job.Spacing = spacingMm;
 
-    vtkSmartPointer< vtkTransformPolyDataFilter > bodyToRasFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
+  vtkSmartPointer< vtkImageData > distanceMap = vtkSmartPointer< vtkImageData >::New();
+  distanceMap->SetOrigin( job.Origin );
+  distanceMap->SetSpacing( spacingMm, spacingMm, spacingMm );
+  distanceMap->SetDimensions( job.Dimensions );
 #if (VTK_MAJOR_VERSION <= 5)
-    bodyToRasFilter->SetInput( body );
+  distanceMap->SetScalarTypeToFloat();
+  distanceMap->SetNumberOfScalarComponents( 1 );
+  distanceMap->AllocateScalars();
 #else
-    bodyToRasFilter->SetInputData( body );
+  distanceMap->AllocateScalars( VTK_FLOAT, 1 );
 #endif
-    bodyToRasFilter->SetTransform( bodyToRasTransform );
-    bodyToRasFilter->Update(); // expensive: transforms all the points of the polydata
+  job.Scalars = static_cast< float* >( distanceMap->GetScalarPointer() );
 
-    implicitDistanceFilter->SetInput( bodyToRasFilter->GetOutput() ); // expensive: builds a locator
+  vtkNew< vtkMultiThreader > threader;
+  int numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  if ( numberOfThreads > job.Dimensions[2] )
+  {
+    numberOfThreads = job.Dimensions[2];
   }
-  else
+  job.DistanceEngines.push_back( nodeInfo.DistanceEngine );
+  for ( int threadIndex = 1; threadIndex < numberOfThreads; threadIndex++ )
   {
-    implicitDistanceFilter->SetInput( body ); // expensive: builds a locator
+    job.DistanceEngines.push_back( vtkSmartPointer< vtkImplicitPolyDataDistancePointPos >::New() );
   }
-  
-  // Note: Performance could be improved by
-  // - keeping the filter in memory for all the observed nodes.
-  // - in case of linear transform of model and tooltip: transform only the tooltip (with the tooltip to model transform),
-  //   and not transform the model at all
-
-  vtkSmartPointer<vtkGeneralTransform> toolToRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  toolToRasNode->GetTransformToWorld( toolToRasTransform ); 
-  double toolTipPosition_Tool[4] = { 0.0, 0.0, 0.0, 1.0 };
-  double* toolTipPosition_Ras = toolToRasTransform->TransformDoublePoint( toolTipPosition_Tool);
-
-  double closestPointOnModel_Ras[3] = {0};
-  double closestPointDistance = implicitDistanceFilter->EvaluateFunctionAndGetClosestPoint( toolTipPosition_Ras, closestPointOnModel_Ras);
-  bwNode->SetClosestDistanceToModelFromToolTip(closestPointDistance);
-  bwNode->SetClosestPointOnModel(closestPointOnModel_Ras);
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( ComputeDistanceMapThreadFunction, &job );
+  threader->SingleMethodExecute();
 
-  this->UpdateLineToClosestPoint(bwNode, toolTipPosition_Ras, closestPointOnModel_Ras, closestPointDistance);
+  nodeInfo.DistanceMap = distanceMap;
+  nodeInfo.DistanceMapEngine = nodeInfo.DistanceEngine;
+  nodeInfo.DistanceMapSpacingMm = spacingMm;
+  nodeInfo.DistanceMapMarginMm = marginMm;
+  return nodeInfo.DistanceMap;
 }
 
 //------------------------------------------------------------------------------
-void vtkSlicerBreachWarningLogic::UpdateModelColor( vtkMRMLBreachWarningNode* bwNode )
+double vtkSlicerBreachWarningLogic::GetDistanceMapMemorySizeMB( vtkMRMLBreachWarningNode* bwNode )
 {
   if ( bwNode == NULL )
   {
-    return;
+    vtkErrorMacro( "GetDistanceMapMemorySizeMB failed: invalid bwNode" );
+    return 0.0;
   }
-  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
-  if ( modelNode == NULL )
+  // The distance map is computed in the distance engine's coordinate system. If the engine is not created yet
+  // then the bounds of the model in its own coordinate system are used as an estimate.
+  double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find( bwNode );
+  if ( nodeInfoIt != this->Internal->NodeInfos.end() && nodeInfoIt->second.DistanceEngine.GetPointer() != NULL
+    && nodeInfoIt->second.DistanceEngine->GetInput() != NULL )
   {
-    return;
+    nodeInfoIt->second.DistanceEngine->GetInput()->GetBounds( bounds );
+  }
+  else
+  {
+    vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
+    vtkPolyData* body = ( modelNode != NULL ? modelNode->GetPolyData() : NULL );
+    if ( body == NULL || body->GetNumberOfPoints() == 0 )
+    {
+      return 0.0;
+    }
+    body->GetBounds( bounds );
+  }
+  double origin[3] = { 0.0, 0.0, 0.0 };
+  int dimensions[3] = { 0, 0, 0 };
+  ComputeDistanceMapGeometry( bounds, bwNode->GetDistanceMapSpacingMm(), bwNode->GetDistanceMapMarginMm(), origin, dimensions );
+  double numberOfVoxels = double( dimensions[0] ) * double( dimensions[1] ) * double( dimensions[2] );
+  return numberOfVoxels * sizeof( float ) / ( 1024.0 * 1024.0 );
+}
+
+//------------------------------------------------------------------------------
+int vtkSlicerBreachWarningLogic::GetWatchedModelIndexOfCell( vtkMRMLBreachWarningNode* bwNode, vtkImplicitPolyDataDistancePointPos* distanceEngine, vtkIdType cellId )
+{
+  vtkDataArray* modelIndexArray = distanceEngine->GetInput()->GetCellData()->GetArray( WATCHED_MODEL_INDEX_ARRAY_NAME );
+  if ( modelIndexArray != NULL && cellId >= 0 && cellId < modelIndexArray->GetNumberOfTuples() )
+  {
+    return static_cast<int>( modelIndexArray->GetTuple1( cellId ) );
+  }
+  // Single model: the first valid model
+  for ( int modelIndex = 0; modelIndex < bwNode->GetNumberOfWatchedModelNodes(); modelIndex++ )
+  {
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( modelIndex );
+    if ( modelNode != NULL && modelNode->GetPolyData() != NULL )
+    {
+      return modelIndex;
+    }
   }
-  if ( modelNode->GetDisplayNode() == NULL )
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateModelColor( vtkMRMLBreachWarningNode* bwNode )
+{
+  if ( bwNode == NULL )
   {
     return;
   }
+  vtkInternal::BreachWarningNodeInfo& nodeInfo = this->Internal->NodeInfos[bwNode];
 
-  if ( bwNode->IsToolTipInsideModel())
+  // Each breached model is displayed with the warning color, all the others with their original color
+  std::set< std::string > watchedModelIds;
+  for ( int modelIndex = 0; modelIndex < bwNode->GetNumberOfWatchedModelNodes(); modelIndex++ )
   {
-    double* color = bwNode->GetWarningColor();
-    modelNode->GetDisplayNode()->SetColor(color);
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( modelIndex );
+    if ( modelNode == NULL || modelNode->GetID() == NULL || modelNode->GetDisplayNode() == NULL )
+    {
+      continue;
+    }
+    bool modelBreached = bwNode->IsNthWatchedModelBreached( modelIndex );
+    if ( modelIndex == 0 )
+    {
+      // Original color of the first model is stored in the node (see SetWatchedModelNode)
+      modelNode->GetDisplayNode()->SetColor( modelBreached ? bwNode->GetWarningColor() : bwNode->GetOriginalColor() );
+      continue;
+    }
+    watchedModelIds.insert( modelNode->GetID() );
+    std::map< std::string, std::vector<double> >::iterator originalColorIt = nodeInfo.WarningColoredModelOriginalColors.find( modelNode->GetID() );
+    if ( modelBreached )
+    {
+      if ( originalColorIt == nodeInfo.WarningColoredModelOriginalColors.end() )
+      {
+        std::vector<double> originalColor( 3, 0.5 );
+        modelNode->GetDisplayNode()->GetColor( &( originalColor[0] ) );
+        nodeInfo.WarningColoredModelOriginalColors[modelNode->GetID()] = originalColor;
+      }
+      modelNode->GetDisplayNode()->SetColor( bwNode->GetWarningColor() );
+    }
+    else if ( originalColorIt != nodeInfo.WarningColoredModelOriginalColors.end() )
+    {
+      modelNode->GetDisplayNode()->SetColor( &( originalColorIt->second[0] ) );
+      nodeInfo.WarningColoredModelOriginalColors.erase( originalColorIt );
+    }
   }
-  else
+
+  // Restore the color of models that are not watched anymore
+  std::map< std::string, std::vector<double> >::iterator originalColorIt = nodeInfo.WarningColoredModelOriginalColors.begin();
+  while ( originalColorIt != nodeInfo.WarningColoredModelOriginalColors.end() )
   {
-    double* color = bwNode->GetOriginalColor();
-    modelNode->GetDisplayNode()->SetColor(color);
+    if ( watchedModelIds.find( originalColorIt->first ) != watchedModelIds.end() )
+    {
+      ++originalColorIt;
+      continue;
+    }
+    vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast( this->GetMRMLScene() ? this->GetMRMLScene()->GetNodeByID( originalColorIt->first ) : NULL );
+    if ( modelNode != NULL && modelNode->GetDisplayNode() != NULL )
+    {
+      modelNode->GetDisplayNode()->SetColor( &( originalColorIt->second[0] ) );
+    }
+    nodeInfo.WarningColoredModelOriginalColors.erase( originalColorIt++ );
   }
 }
 
@@ -208,7 +1533,7 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeAdded( vtkMRMLNode* node )
     events->InsertNextValue( vtkCommand::ModifiedEvent );
     events->InsertNextValue( vtkMRMLBreachWarningNode::InputDataModifiedEvent );
     vtkObserveMRMLNodeEventsMacro( bwNode, events.GetPointer() );
-    if(bwNode->GetPlayWarningSound() && bwNode->IsToolTipInsideModel())
+    if(bwNode->GetPlayWarningSound() && bwNode->IsModelBreached())
     {
       // Add to list of playing nodes (if not there already)
       std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
@@ -242,6 +1567,12 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeRemoved( vtkMRMLNode* node )
   {
     vtkDebugMacro( "OnMRMLSceneNodeRemoved" );
     vtkUnObserveMRMLNodeMacro( node );
+    vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    if ( nodeInfoIt != this->Internal->NodeInfos.end() )
+    {
+      this->Internal->FinishEngineBuild( nodeInfoIt->second );
+      this->Internal->NodeInfos.erase( nodeInfoIt );
+    }
     for (std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator it=this->WarningSoundPlayingNodes.begin(); it!=this->WarningSoundPlayingNodes.end(); ++it)
     {
       if (it->GetPointer()==node)
@@ -331,40 +1662,285 @@ void vtkSlicerBreachWarningLogic::ProcessMRMLNodesEvents( vtkObject* caller, uns
   {
     // only recompute output if the input is changed
     // (for example we do not recompute the distance if the computed distance is changed)
-    this->UpdateToolState(bwNode);
-    if (bwNode->GetDisplayWarningColor())
-    {
-      this->UpdateModelColor(bwNode);
-    }
-    std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
-    for (; foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end(); ++foundPlayingNodeIt)
+    if (this->MaximumUpdateRateHz > 0)
     {
-      if (foundPlayingNodeIt->GetPointer()==bwNode)
+      // Throttled update: just mark the node for update, the latest input will be used in the next ProcessPendingUpdates call
+      vtkInternal::BreachWarningNodeInfo& nodeInfo = this->Internal->NodeInfos[bwNode];
+      if (nodeInfo.UpdatePending)
       {
-        // found current bw node is already in the playing list
-        break;
+        nodeInfo.NumberOfSkippedUpdates++;
+        return;
       }
+      nodeInfo.UpdatePending = true;
+      this->InvokeEvent(PendingUpdatesRequestedEvent);
+      return;
+    }
+    this->UpdateNode(bwNode);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateNode( vtkMRMLBreachWarningNode* bwNode )
+{
+  this->Internal->NodeInfos[bwNode].UpdatePending = false;
+  double startTime = vtkTimerLog::GetUniversalTime();
+  this->UpdateToolState(bwNode);
+  double evaluationTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt != this->Internal->NodeInfos.end())
+  {
+    nodeInfoIt->second.NumberOfEvaluations++;
+    vtkInternal::RecordEvaluationTime(nodeInfoIt->second, evaluationTimeSec, this->EvaluationTimeWindowSize);
+  }
+  if (bwNode->GetDisplayWarningColor())
+  {
+    this->UpdateModelColor(bwNode);
+  }
+  std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
+  for (; foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end(); ++foundPlayingNodeIt)
+  {
+    if (foundPlayingNodeIt->GetPointer()==bwNode)
+    {
+      // found current bw node is already in the playing list
+      break;
     }
-    if(bwNode->GetPlayWarningSound() && bwNode->IsToolTipInsideModel())
+  }
+  if(bwNode->GetPlayWarningSound() && bwNode->IsModelBreached())
+  {
+    // Add to list of playing nodes (if not there already)
+    if (foundPlayingNodeIt==this->WarningSoundPlayingNodes.end())
     {
-      // Add to list of playing nodes (if not there already)
-      if (foundPlayingNodeIt==this->WarningSoundPlayingNodes.end())
-      {
-        this->WarningSoundPlayingNodes.push_back(bwNode);
-      }
+      this->WarningSoundPlayingNodes.push_back(bwNode);
     }
-    else
+  }
+  else
+  {
+    // Remove from list of playing nodes (if still there)
+    if (foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end())
     {
-      // Remove from list of playing nodes (if still there)
-      if (foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end())
-      {
-        this->WarningSoundPlayingNodes.erase(foundPlayingNodeIt);
-      }
+      this->WarningSoundPlayingNodes.erase(foundPlayingNodeIt);
     }
-    this->SetWarningSoundPlaying(!this->WarningSoundPlayingNodes.empty());
   }
+  this->SetWarningSoundPlaying(!this->WarningSoundPlayingNodes.empty());
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::SetMaximumUpdateRateHz(double rateHz)
+{
+  if (rateHz < 0)
+  {
+    vtkErrorMacro("SetMaximumUpdateRateHz failed: rate must not be negative");
+    return;
+  }
+  if (this->MaximumUpdateRateHz == rateHz)
+  {
+    return;
+  }
+  this->MaximumUpdateRateHz = rateHz;
+  if (this->MaximumUpdateRateHz == 0)
+  {
+    // Switched to immediate update, make sure pending updates are not lost
+    this->ProcessPendingUpdates();
+  }
+  this->Modified();
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::HasPendingUpdates()
+{
+  for (vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.begin();
+    nodeInfoIt != this->Internal->NodeInfos.end(); ++nodeInfoIt)
+  {
+    if (nodeInfoIt->second.UpdatePending || nodeInfoIt->second.BuildJob != NULL)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::ProcessPendingUpdates()
+{
+  // Collect nodes first, as updating a node may change the node map
+  std::vector< vtkMRMLBreachWarningNode* > pendingNodes;
+  for (vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.begin();
+    nodeInfoIt != this->Internal->NodeInfos.end(); ++nodeInfoIt)
+  {
+    if (nodeInfoIt->second.BuildJob != NULL && nodeInfoIt->second.BuildJob->IsCompleted())
+    {
+      // New distance engine is available, the node has to be updated even if the inputs have not changed
+      nodeInfoIt->second.UpdatePending = true;
+    }
+    if (nodeInfoIt->second.UpdatePending)
+    {
+      pendingNodes.push_back(nodeInfoIt->first);
+    }
+  }
+  for (std::vector< vtkMRMLBreachWarningNode* >::iterator nodeIt = pendingNodes.begin(); nodeIt != pendingNodes.end(); ++nodeIt)
+  {
+    vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(*nodeIt);
+    if (nodeInfoIt == this->Internal->NodeInfos.end() || !nodeInfoIt->second.UpdatePending)
+    {
+      // node has been removed or already updated
+      continue;
+    }
+    this->UpdateNode(*nodeIt);
+  }
+}
+
+//------------------------------------------------------------------------------
+unsigned long vtkSlicerBreachWarningLogic::GetNumberOfSkippedUpdates(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end())
+  {
+    return 0;
+  }
+  return nodeInfoIt->second.NumberOfSkippedUpdates;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::ResetNumberOfSkippedUpdates(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end())
+  {
+    return;
+  }
+  nodeInfoIt->second.NumberOfSkippedUpdates = 0;
+}
+
+//------------------------------------------------------------------------------
+unsigned long vtkSlicerBreachWarningLogic::GetNumberOfEvaluations(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end())
+  {
+    return 0;
+  }
+  return nodeInfoIt->second.NumberOfEvaluations;
+}
+
+//------------------------------------------------------------------------------
+unsigned long vtkSlicerBreachWarningLogic::GetNumberOfLocatorBuilds(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end())
+  {
+    return 0;
+  }
+  return nodeInfoIt->second.NumberOfLocatorBuilds;
+}
+
+//------------------------------------------------------------------------------
+unsigned long vtkSlicerBreachWarningLogic::GetNumberOfModelTransforms(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end())
+  {
+    return 0;
+  }
+  return nodeInfoIt->second.NumberOfModelTransforms;
+}
+
+//------------------------------------------------------------------------------
+double vtkSlicerBreachWarningLogic::GetMinimumEvaluationTimeSec(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end() || nodeInfoIt->second.EvaluationTimesSec.empty())
+  {
+    return 0.0;
+  }
+  const std::vector<double>& evaluationTimesSec = nodeInfoIt->second.EvaluationTimesSec;
+  return *std::min_element(evaluationTimesSec.begin(), evaluationTimesSec.end());
+}
+
+//------------------------------------------------------------------------------
+double vtkSlicerBreachWarningLogic::GetMeanEvaluationTimeSec(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end() || nodeInfoIt->second.EvaluationTimesSec.empty())
+  {
+    return 0.0;
+  }
+  const std::vector<double>& evaluationTimesSec = nodeInfoIt->second.EvaluationTimesSec;
+  double sumEvaluationTimesSec = 0.0;
+  for (std::vector<double>::const_iterator timeIt = evaluationTimesSec.begin(); timeIt != evaluationTimesSec.end(); ++timeIt)
+  {
+    sumEvaluationTimesSec += *timeIt;
+  }
+  return sumEvaluationTimesSec / evaluationTimesSec.size();
+}
+
+//------------------------------------------------------------------------------
+double vtkSlicerBreachWarningLogic::GetEvaluationTimePercentileSec(vtkMRMLBreachWarningNode* bwNode, double percentile)
+{
+  if (percentile < 0.0 || percentile > 100.0)
+  {
+    vtkErrorMacro("GetEvaluationTimePercentileSec failed: percentile must be between 0 and 100");
+    return 0.0;
+  }
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end() || nodeInfoIt->second.EvaluationTimesSec.empty())
+  {
+    return 0.0;
+  }
+  // Nearest-rank percentile
+  std::vector<double>& sortedTimesSec = this->Internal->SortedEvaluationTimesSec;
+  sortedTimesSec.assign(nodeInfoIt->second.EvaluationTimesSec.begin(), nodeInfoIt->second.EvaluationTimesSec.end());
+  size_t rank = static_cast<size_t>(ceil(percentile / 100.0 * sortedTimesSec.size()));
+  size_t index = (rank > 0 ? rank - 1 : 0);
+  std::nth_element(sortedTimesSec.begin(), sortedTimesSec.begin() + index, sortedTimesSec.end());
+  return sortedTimesSec[index];
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::ResetStatistics(vtkMRMLBreachWarningNode* bwNode)
+{
+  vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.find(bwNode);
+  if (nodeInfoIt == this->Internal->NodeInfos.end())
+  {
+    return;
+  }
+  nodeInfoIt->second.NumberOfEvaluations = 0;
+  nodeInfoIt->second.NumberOfLocatorBuilds = 0;
+  nodeInfoIt->second.NumberOfModelTransforms = 0;
+  nodeInfoIt->second.EvaluationTimesSec.clear();
+  nodeInfoIt->second.NextEvaluationTimeIndex = 0;
 }
 
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::SetEvaluationTimeWindowSize(int windowSize)
+{
+  if (windowSize < 1)
+  {
+    vtkErrorMacro("SetEvaluationTimeWindowSize failed: window size must be positive");
+    return;
+  }
+  if (this->EvaluationTimeWindowSize == windowSize)
+  {
+    return;
+  }
+  this->EvaluationTimeWindowSize = windowSize;
+  // Keep only the most recent evaluation times that fit in the new window
+  for (vtkInternal::NodeInfoMapType::iterator nodeInfoIt = this->Internal->NodeInfos.begin();
+    nodeInfoIt != this->Internal->NodeInfos.end(); ++nodeInfoIt)
+  {
+    std::vector<double>& evaluationTimesSec = nodeInfoIt->second.EvaluationTimesSec;
+    if (nodeInfoIt->second.NextEvaluationTimeIndex < evaluationTimesSec.size())
+    {
+      // chronological order
+      std::rotate(evaluationTimesSec.begin(), evaluationTimesSec.begin() + nodeInfoIt->second.NextEvaluationTimeIndex, evaluationTimesSec.end());
+    }
+    if (evaluationTimesSec.size() > static_cast<size_t>(windowSize))
+    {
+      evaluationTimesSec.erase(evaluationTimesSec.begin(), evaluationTimesSec.end() - windowSize);
+    }
+    nodeInfoIt->second.NextEvaluationTimeIndex = 0;
+  }
+  this->Modified();
+}
 
 //------------------------------------------------------------------------------
 void vtkSlicerBreachWarningLogic::UpdateLineToClosestPoint(vtkMRMLBreachWarningNode* bwNode, double* toolTipPosition_Ras, double* closestPointOnModel_Ras, double closestPointDistance)
@@ -381,6 +1957,14 @@ void vtkSlicerBreachWarningLogic::UpdateLineToClosestPoint(vtkMRMLBreachWarningN
     return;
   }
 
+  vtkInternal::BreachWarningNodeInfo& nodeInfo = this->Internal->NodeInfos[bwNode];
+  if (nodeInfo.LineToClosestPointHiddenBeyondRange)
+  {
+    // tool is within range again, show the line that was hidden when the tool got out of range
+    ruler->SetDisplayVisibility(true);
+    nodeInfo.LineToClosestPointHiddenBeyondRange = false;
+  }
+
   ruler->SetPosition1(toolTipPosition_Ras);
   ruler->SetPosition2(closestPointOnModel_Ras);
   if (closestPointDistance<0)
@@ -412,7 +1996,8 @@ bool vtkSlicerBreachWarningLogic::GetLineToClosestPointVisibility(vtkMRMLBreachW
     vtkErrorMacro("vtkSlicerBreachWarningLogic::GetLineToClosestPointVisibility failed: invalid displayNode");
     return false;
   }
-  return displayNode->GetVisibility();
+  // line is visible if it is only hidden temporarily, while the tool is out of range
+  return displayNode->GetVisibility() || this->Internal->NodeInfos[moduleNode].LineToClosestPointHiddenBeyondRange;
 }
 
 //------------------------------------------------------------------------------
@@ -451,7 +2036,10 @@ void vtkSlicerBreachWarningLogic::SetLineToClosestPointVisibility(bool visible,
   else if (ruler != NULL)
   {
     // line exists, but it is not needed - hide it (don't delete it because it stores thickness, color, etc. parameters)
-    ruler->SetDisplayVisibility(visible);
+    // If the tool is out of range then the line is kept hidden until the tool gets within range.
+    bool hiddenBeyondRange = visible && moduleNode->GetClosestDistanceBeyondRange();
+    this->Internal->NodeInfos[moduleNode].LineToClosestPointHiddenBeyondRange = hiddenBeyondRange;
+    ruler->SetDisplayVisibility(visible && !hiddenBeyondRange);
   }
 }
 
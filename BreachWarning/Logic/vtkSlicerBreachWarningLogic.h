@@ -28,6 +28,7 @@
 #include <deque>
 
 // VTK includes
+#include <vtkCommand.h>
 #include "vtkWeakPointer.h"
 
 // Slicer includes
@@ -46,6 +47,9 @@ class vtkMRMLBreachWarningNode;
 
 class vtkMRMLModelNode;
 class vtkMRMLTransformNode;
+class vtkImplicitPolyDataDistancePointPos;
+class vtkImageData;
+class vtkMatrix4x4;
 
 // STD includes
 #include <cstdlib>
@@ -60,6 +64,15 @@ public:
   vtkTypeMacro(vtkSlicerBreachWarningLogic,vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  enum Events
+  {
+    /// Invoked when the logic gets work that has to be completed in a later ProcessPendingUpdates() call
+    /// (a node is marked for a throttled update or a distance engine build is started in the background).
+    /// The application only has to call ProcessPendingUpdates() periodically while HasPendingUpdates() returns true.
+    // vtkCommand::UserEvent + 557 is just a random value that is very unlikely to be used for anything else in this class
+    PendingUpdatesRequestedEvent = vtkCommand::UserEvent + 557
+  };
+
   /// Changes the watched model node, making sure the original color of the previously selected model node is restored
   void SetWatchedModelNode( vtkMRMLModelNode* newModel, vtkMRMLBreachWarningNode* moduleNode );
 
@@ -86,6 +99,67 @@ public:
   vtkGetMacro(WarningSoundPlaying, bool);
   vtkSetMacro(WarningSoundPlaying, bool);
 
+  /// Returns the memory size (in MB) that the distance map of the watched model would require
+  /// with the current distance map spacing and margin settings of the node.
+  /// Can be used for choosing a distance map spacing that offers good accuracy with acceptable memory usage.
+  double GetDistanceMapMemorySizeMB(vtkMRMLBreachWarningNode* bwNode);
+
+  /// Distance maps larger than this size are not computed (exact distance computation is used instead).
+  /// Default: 512MB.
+  vtkGetMacro(DistanceMapMaximumMemorySizeMB, double);
+  vtkSetMacro(DistanceMapMaximumMemorySizeMB, double);
+
+  /// Maximum rate of breach warning computations (in updates per second).
+  /// If 0 (default) then the breach warning node is updated immediately when any of its inputs change.
+  /// If positive then input changes only mark the node for update and all the marked nodes are updated
+  /// at most once in each ProcessPendingUpdates() call, which is called periodically by the module
+  /// at this rate. This prevents recomputing the distance multiple times per rendered frame
+  /// when tool transforms are received at a high rate.
+  vtkGetMacro(MaximumUpdateRateHz, double);
+  void SetMaximumUpdateRateHz(double rateHz);
+
+  /// Update all breach warning nodes that have been marked for update since the last call
+  /// (if MaximumUpdateRateHz is positive) or that have a new distance engine built in the background.
+  /// Called periodically by the module.
+  void ProcessPendingUpdates();
+
+  /// Returns true if any node is marked for update or has a distance engine being built in the background,
+  /// i.e., ProcessPendingUpdates() has to be called later.
+  bool HasPendingUpdates();
+
+  /// If enabled then distance engines (locators) are built in a background thread when the watched models change,
+  /// so that building the locator for large meshes does not block the application.
+  /// Until the new engine is ready, the previous engine is used (if available) or the node's
+  /// ClosestDistanceReady flag is set to false. Disabled by default.
+  vtkGetMacro(BuildDistanceEngineInBackground, bool);
+  vtkSetMacro(BuildDistanceEngineInBackground, bool);
+  vtkBooleanMacro(BuildDistanceEngineInBackground, bool);
+
+  /// Number of input changes that did not trigger a separate update because the node
+  /// was already marked for update (only if MaximumUpdateRateHz is positive).
+  unsigned long GetNumberOfSkippedUpdates(vtkMRMLBreachWarningNode* bwNode);
+  void ResetNumberOfSkippedUpdates(vtkMRMLBreachWarningNode* bwNode);
+
+  /// Performance statistics of a breach warning node, for verifying that the computation keeps up
+  /// with the tracker's update rate. Counters are accumulated since the node was added or ResetStatistics() was called.
+  /// Number of tool state evaluations (distance computations).
+  unsigned long GetNumberOfEvaluations(vtkMRMLBreachWarningNode* bwNode);
+  /// Number of times the spatial index (locator) of the watched models was built.
+  unsigned long GetNumberOfLocatorBuilds(vtkMRMLBreachWarningNode* bwNode);
+  /// Number of times a watched model's polydata was transformed because the transform could not be applied to the tool instead.
+  unsigned long GetNumberOfModelTransforms(vtkMRMLBreachWarningNode* bwNode);
+  /// Evaluation time statistics (in seconds) of the most recent evaluations (see EvaluationTimeWindowSize).
+  /// Evaluation time includes rebuilding the locator if the watched models have changed.
+  double GetMinimumEvaluationTimeSec(vtkMRMLBreachWarningNode* bwNode);
+  double GetMeanEvaluationTimeSec(vtkMRMLBreachWarningNode* bwNode);
+  /// Percentile of the evaluation time in the range of 0-100 (e.g., 99 for the time that 99% of evaluations are faster than).
+  double GetEvaluationTimePercentileSec(vtkMRMLBreachWarningNode* bwNode, double percentile);
+  void ResetStatistics(vtkMRMLBreachWarningNode* bwNode);
+
+  /// Number of most recent evaluations that evaluation time statistics are computed from. Default: 1000.
+  vtkGetMacro(EvaluationTimeWindowSize, int);
+  void SetEvaluationTimeWindowSize(int windowSize);
+
 protected:
   vtkSlicerBreachWarningLogic();
   virtual ~vtkSlicerBreachWarningLogic();
@@ -97,8 +171,32 @@ protected:
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
 
+  /// Recompute all outputs of the node (distance, model color, warning sound, line to closest point)
+  void UpdateNode( vtkMRMLBreachWarningNode* bwNode );
+
   void UpdateToolState( vtkMRMLBreachWarningNode* bwNode );
+
+  /// Returns a distance engine (implicit distance function with a built locator) for the watched models.
+  /// If the engine is built in the background then the previous engine is returned until the new one is ready,
+  /// or NULL if there is no usable previous engine.
+  /// The engine is cached for each breach warning node and only rebuilt when a watched model's polydata
+  /// (or the transform that is baked into the engine's input) changes.
+  /// If all the models have the same parent transform and it is a similarity transform (rotation, translation, uniform scaling)
+  /// then the engine is built in model coordinates and engineToRasMatrix is set to the model to RAS transform,
+  /// otherwise the models are transformed to RAS and engineToRasMatrix is set to identity.
+  /// If multiple models are watched then a single locator is built for all of them and the index of the
+  /// watched model is stored for each cell in the WatchedModelIndex cell data array of the engine's input.
+  vtkImplicitPolyDataDistancePointPos* GetDistanceEngine( vtkMRMLBreachWarningNode* bwNode, vtkMatrix4x4* engineToRasMatrix );
+
+  /// Returns the signed distance map of the watched model in the distance engine's coordinate system.
+  /// The map is computed (using all CPU cores) when it is first needed and cached until the distance engine
+  /// or the distance map settings change.
+  /// Returns NULL if distance map is not enabled in the node or it cannot be used.
+  vtkImageData* GetDistanceMap( vtkMRMLBreachWarningNode* bwNode );
+  /// Displays each breached watched model with the warning color and restores the original color of the others.
   void UpdateModelColor( vtkMRMLBreachWarningNode* bwNode );
+  /// Returns the index of the watched model that the specified cell of the distance engine's input belongs to.
+  int GetWatchedModelIndexOfCell( vtkMRMLBreachWarningNode* bwNode, vtkImplicitPolyDataDistancePointPos* distanceEngine, vtkIdType cellId );
   void UpdateLineToClosestPoint(vtkMRMLBreachWarningNode* bwNode, double* toolTipPosition_Ras, double* closestPointOnModel_Ras, double closestPointDistance);
   
 private:
@@ -109,10 +207,20 @@ private:
 
   std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > > WarningSoundPlayingNodes;
   bool WarningSoundPlaying;
+
+  /// Cached per breach warning node computation data (distance engines, etc.)
+  class vtkInternal;
+  vtkInternal* Internal;
   
   double DefaultLineToClosestPointColor[3];
   double DefaultLineToClosestPointTextScale;
   double DefaultLineToClosestPointThickness;
+
+  double DistanceMapMaximumMemorySizeMB;
+
+  double MaximumUpdateRateHz;
+  bool BuildDistanceEngineInBackground;
+  int EvaluationTimeWindowSize;
 };
 
 #endif
@@ -0,0 +1,722 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkTriangleBVHLocator.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCellType.h>
+#include <vtkDataSet.h>
+#include <vtkGenericCell.h>
+#include <vtkIdList.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+vtkStandardNewMacro(vtkTriangleBVHLocator);
+
+namespace
+{
+  // Balanced median split guarantees that the tree depth is below the number of bits in the triangle index
+  const int TRAVERSAL_STACK_SIZE = 128;
+
+  // Number of leaf triangles processed by one call of the closest point kernel
+  const int KERNEL_BLOCK_SIZE = 8;
+
+  //----------------------------------------------------------------------------
+  // Orders triangle indices by the centroid coordinate along an axis
+  struct CentroidLess
+  {
+    CentroidLess(const double* centroids, int axis) : Centroids(centroids), Axis(axis) {}
+    bool operator()(int a, int b) const
+    {
+      return this->Centroids[3 * a + this->Axis] < this->Centroids[3 * b + this->Axis];
+    }
+    const double* Centroids;
+    int Axis;
+  };
+
+  //----------------------------------------------------------------------------
+  // Squared distance between a point and an axis-aligned box (0 if the point is inside)
+  inline double BoxDistance2(const double bounds[6], const double x[3])
+  {
+    double dist2 = 0.0;
+    for (int i = 0; i < 3; i++)
+    {
+      double d = 0.0;
+      if (x[i] < bounds[2 * i])
+      {
+        d = bounds[2 * i] - x[i];
+      }
+      else if (x[i] > bounds[2 * i + 1])
+      {
+        d = x[i] - bounds[2 * i + 1];
+      }
+      dist2 += d * d;
+    }
+    return dist2;
+  }
+
+  //----------------------------------------------------------------------------
+  // Returns true if the segment p1 + t*dir, t in [0, tMax] intersects the box (slab test)
+  inline bool SegmentIntersectsBox(const double p1[3], const double dir[3], const double bounds[6], double tMax)
+  {
+    double tMin = 0.0;
+    for (int i = 0; i < 3; i++)
+    {
+      if (dir[i] == 0.0)
+      {
+        if (p1[i] < bounds[2 * i] || p1[i] > bounds[2 * i + 1])
+        {
+          return false;
+        }
+        continue;
+      }
+      double invDir = 1.0 / dir[i];
+      double t0 = (bounds[2 * i] - p1[i]) * invDir;
+      double t1 = (bounds[2 * i + 1] - p1[i]) * invDir;
+      if (t0 > t1)
+      {
+        std::swap(t0, t1);
+      }
+      tMin = std::max(tMin, t0);
+      tMax = std::min(tMax, t1);
+      if (tMin > tMax)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Clamp to [0, 1] without comparisons. Written with fabs instead of min/max, because compilers
+  // turn a clamp against constants into branches, which prevents vectorization of the kernel loop.
+  inline double Clamp01(double t)
+  {
+    return 0.5 * (fabs(t) - fabs(t - 1.0) + 1.0);
+  }
+
+  //----------------------------------------------------------------------------
+  // Closest points of a block of consecutive triangles (first .. first+count-1) to point x.
+  // Triangles are defined by the first vertex p0 and edge vectors e1, e2 (structure-of-arrays),
+  // e1e1, e1e2, e2e2 are the precomputed edge dot products.
+  // Returns the squared distance and the parametric coordinates (v, w) of the closest point
+  // (p0 + v*e1 + w*e2) of each triangle in dist2, v, w (count elements).
+  //
+  // The loop body has no branches so that the compiler can vectorize it (processing several triangles
+  // with one instruction): instead of the usual Voronoi region tests ("Real-Time Collision Detection",
+  // C. Ericson, 5.1.5) the closest point is computed on the plane of the triangle and on each of the
+  // three edges, and the result is selected from these candidates. Degenerate triangles produce NaN
+  // or infinite candidates, which are never selected over a finite edge candidate.
+  inline void ClosestPointsOnTriangles(const double x[3], const double* const p0[3], const double* const e1[3],
+    const double* const e2[3], const double* e1e1, const double* e1e2, const double* e2e2, int first, int count,
+    double* dist2, double* v, double* w)
+  {
+    for (int k = 0; k < count; k++)
+    {
+      int i = first + k;
+      double ap0 = x[0] - p0[0][i];
+      double ap1 = x[1] - p0[1][i];
+      double ap2 = x[2] - p0[2][i];
+      double a = e1e1[i];
+      double b = e1e2[i];
+      double c = e2e2[i];
+      double d1 = e1[0][i] * ap0 + e1[1][i] * ap1 + e1[2][i] * ap2;
+      double d2 = e2[0][i] * ap0 + e2[1][i] * ap1 + e2[2][i] * ap2;
+
+      // Closest point on each edge: parameter along the edge clamped to the edge endpoints
+      double t01 = Clamp01(d1 / a);
+      double t02 = Clamp01(d2 / c);
+      double t12 = Clamp01((d2 - d1 + a - b) / (a - 2.0 * b + c));
+      double s12 = 1.0 - t12;
+
+      // Select the nearest edge point. q is the squared distance minus |ap|^2, which is the same for all candidates.
+      double q01 = t01 * t01 * a - 2.0 * t01 * d1;
+      double q02 = t02 * t02 * c - 2.0 * t02 * d2;
+      double q12 = s12 * s12 * a + 2.0 * s12 * t12 * b + t12 * t12 * c - 2.0 * s12 * d1 - 2.0 * t12 * d2;
+      bool edge01 = (q01 <= q02);
+      double q = edge01 ? q01 : q02;
+      double vk = edge01 ? t01 : 0.0;
+      double wk = edge01 ? 0.0 : t02;
+      bool edge12 = (q12 < q);
+      vk = edge12 ? s12 : vk;
+      wk = edge12 ? t12 : wk;
+
+      // Projection to the triangle plane is the closest point if it is inside the triangle
+      double det = a * c - b * b;
+      double vf = (c * d1 - b * d2) / det;
+      double wf = (a * d2 - b * d1) / det;
+      bool inside = (vf >= 0.0) & (wf >= 0.0) & (vf + wf <= 1.0);
+      vk = inside ? vf : vk;
+      wk = inside ? wf : wk;
+
+      double dx0 = ap0 - vk * e1[0][i] - wk * e2[0][i];
+      double dx1 = ap1 - vk * e1[1][i] - wk * e2[1][i];
+      double dx2 = ap2 - vk * e1[2][i] - wk * e2[2][i];
+      dist2[k] = dx0 * dx0 + dx1 * dx1 + dx2 * dx2;
+      v[k] = vk;
+      w[k] = wk;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkTriangleBVHLocator::vtkTriangleBVHLocator()
+{
+  this->NumberOfCellsPerNode = 8;
+}
+
+//----------------------------------------------------------------------------
+vtkTriangleBVHLocator::~vtkTriangleBVHLocator()
+{
+  this->FreeSearchStructure();
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfNodes: " << this->GetNumberOfNodes() << "\n";
+  os << indent << "NumberOfTriangles: " << this->GetNumberOfTriangles() << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLocator::GetNumberOfNodes()
+{
+  return static_cast<int>(this->Nodes.size());
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkTriangleBVHLocator::GetNumberOfTriangles()
+{
+  return static_cast<vtkIdType>(this->CellIds.size());
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::FreeSearchStructure()
+{
+  // swap with empty containers to release the memory
+  std::vector<Node>().swap(this->Nodes);
+  for (int i = 0; i < 3; i++)
+  {
+    std::vector<double>().swap(this->P0[i]);
+    std::vector<double>().swap(this->E1[i]);
+    std::vector<double>().swap(this->E2[i]);
+  }
+  std::vector<double>().swap(this->E1E1);
+  std::vector<double>().swap(this->E1E2);
+  std::vector<double>().swap(this->E2E2);
+  std::vector<vtkIdType>().swap(this->CellIds);
+  std::vector<int>().swap(this->TriangleOrder);
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::UpdateSearchStructure()
+{
+  if (this->Nodes.empty() || this->BuildTime < this->MTime
+    || (this->DataSet != NULL && this->BuildTime < this->DataSet->GetMTime()))
+  {
+    this->BuildLocator();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::BuildLocator()
+{
+  if (this->DataSet == NULL)
+  {
+    vtkErrorMacro("vtkTriangleBVHLocator::BuildLocator failed: input dataset is not set");
+    return;
+  }
+  if (this->BuildTime > this->MTime && this->BuildTime > this->DataSet->GetMTime())
+  {
+    // up-to-date
+    return;
+  }
+  this->FreeSearchStructure();
+  this->Level = 0;
+
+  vtkIdType numberOfCells = this->DataSet->GetNumberOfCells();
+  std::vector<double> vertices;
+  vertices.reserve(9 * numberOfCells);
+  std::vector<double> triangleBounds;
+  triangleBounds.reserve(6 * numberOfCells);
+  std::vector<double> triangleCentroids;
+  triangleCentroids.reserve(3 * numberOfCells);
+  std::vector<vtkIdType> triangleCellIds;
+  triangleCellIds.reserve(numberOfCells);
+
+  vtkNew<vtkIdList> pointIds;
+  for (vtkIdType cellId = 0; cellId < numberOfCells; cellId++)
+  {
+    if (this->DataSet->GetCellType(cellId) != VTK_TRIANGLE)
+    {
+      continue;
+    }
+    this->DataSet->GetCellPoints(cellId, pointIds.GetPointer());
+    double p[3][3];
+    for (int k = 0; k < 3; k++)
+    {
+      this->DataSet->GetPoint(pointIds->GetId(k), p[k]);
+      vertices.push_back(p[k][0]);
+      vertices.push_back(p[k][1]);
+      vertices.push_back(p[k][2]);
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+      triangleBounds.push_back(std::min(p[0][axis], std::min(p[1][axis], p[2][axis])));
+      triangleBounds.push_back(std::max(p[0][axis], std::max(p[1][axis], p[2][axis])));
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+      triangleCentroids.push_back((p[0][axis] + p[1][axis] + p[2][axis]) / 3.0);
+    }
+    triangleCellIds.push_back(cellId);
+  }
+
+  int numberOfTriangles = static_cast<int>(triangleCellIds.size());
+  if (numberOfTriangles == 0)
+  {
+    this->BuildTime.Modified();
+    return;
+  }
+
+  this->TriangleOrder.resize(numberOfTriangles);
+  for (int i = 0; i < numberOfTriangles; i++)
+  {
+    this->TriangleOrder[i] = i;
+  }
+  int trianglesPerLeaf = std::max(1, this->NumberOfCellsPerNode);
+  this->Nodes.reserve(2 * (numberOfTriangles / trianglesPerLeaf + 1));
+  this->BuildNode(0, numberOfTriangles, 0, triangleBounds, triangleCentroids);
+
+  // Copy triangles in leaf order, so that triangles of a leaf are contiguous in memory
+  for (int axis = 0; axis < 3; axis++)
+  {
+    this->P0[axis].resize(numberOfTriangles);
+    this->E1[axis].resize(numberOfTriangles);
+    this->E2[axis].resize(numberOfTriangles);
+  }
+  this->E1E1.resize(numberOfTriangles);
+  this->E1E2.resize(numberOfTriangles);
+  this->E2E2.resize(numberOfTriangles);
+  this->CellIds.resize(numberOfTriangles);
+  for (int i = 0; i < numberOfTriangles; i++)
+  {
+    const double* p = &vertices[9 * this->TriangleOrder[i]];
+    double e1[3] = { p[3] - p[0], p[4] - p[1], p[5] - p[2] };
+    double e2[3] = { p[6] - p[0], p[7] - p[1], p[8] - p[2] };
+    for (int axis = 0; axis < 3; axis++)
+    {
+      this->P0[axis][i] = p[axis];
+      this->E1[axis][i] = e1[axis];
+      this->E2[axis][i] = e2[axis];
+    }
+    this->E1E1[i] = e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2];
+    this->E1E2[i] = e1[0] * e2[0] + e1[1] * e2[1] + e1[2] * e2[2];
+    this->E2E2[i] = e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2];
+    this->CellIds[i] = triangleCellIds[this->TriangleOrder[i]];
+  }
+  std::vector<int>().swap(this->TriangleOrder);
+
+  this->BuildTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLocator::BuildNode(int first, int count, int level, const std::vector<double>& triangleBounds,
+  const std::vector<double>& triangleCentroids)
+{
+  int nodeIndex = static_cast<int>(this->Nodes.size());
+  this->Nodes.push_back(Node());
+
+  double bounds[6] = { VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+  double centroidBounds[6] = { VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+  for (int i = first; i < first + count; i++)
+  {
+    int triangleIndex = this->TriangleOrder[i];
+    for (int axis = 0; axis < 3; axis++)
+    {
+      bounds[2 * axis] = std::min(bounds[2 * axis], triangleBounds[6 * triangleIndex + 2 * axis]);
+      bounds[2 * axis + 1] = std::max(bounds[2 * axis + 1], triangleBounds[6 * triangleIndex + 2 * axis + 1]);
+      double centroid = triangleCentroids[3 * triangleIndex + axis];
+      centroidBounds[2 * axis] = std::min(centroidBounds[2 * axis], centroid);
+      centroidBounds[2 * axis + 1] = std::max(centroidBounds[2 * axis + 1], centroid);
+    }
+  }
+  // Nodes vector may be reallocated while building the children, so the node is always accessed by index
+  std::copy(bounds, bounds + 6, this->Nodes[nodeIndex].Bounds);
+  this->Nodes[nodeIndex].FirstTriangle = first;
+  this->Nodes[nodeIndex].RightChild = -1;
+  if (level > this->Level)
+  {
+    this->Level = level;
+  }
+
+  if (count <= std::max(1, this->NumberOfCellsPerNode))
+  {
+    // leaf
+    this->Nodes[nodeIndex].NumberOfTriangles = count;
+    return nodeIndex;
+  }
+  this->Nodes[nodeIndex].NumberOfTriangles = 0;
+
+  // Split at the median centroid along the longest axis
+  int splitAxis = 0;
+  for (int axis = 1; axis < 3; axis++)
+  {
+    if (centroidBounds[2 * axis + 1] - centroidBounds[2 * axis] > centroidBounds[2 * splitAxis + 1] - centroidBounds[2 * splitAxis])
+    {
+      splitAxis = axis;
+    }
+  }
+  int leftCount = count / 2;
+  std::vector<int>::iterator begin = this->TriangleOrder.begin() + first;
+  std::nth_element(begin, begin + leftCount, begin + count, CentroidLess(&triangleCentroids[0], splitAxis));
+
+  this->BuildNode(first, leftCount, level + 1, triangleBounds, triangleCentroids);
+  int rightChild = this->BuildNode(first + leftCount, count - leftCount, level + 1, triangleBounds, triangleCentroids);
+  this->Nodes[nodeIndex].RightChild = rightChild;
+  return nodeIndex;
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLocator::FindClosestTriangle(const double x[3], double maxDist2, double closestPoint[3], double& dist2)
+{
+  if (this->Nodes.empty())
+  {
+    return -1;
+  }
+
+  const double* p0[3] = { &this->P0[0][0], &this->P0[1][0], &this->P0[2][0] };
+  const double* e1[3] = { &this->E1[0][0], &this->E1[1][0], &this->E1[2][0] };
+  const double* e2[3] = { &this->E2[0][0], &this->E2[1][0], &this->E2[2][0] };
+  const double* e1e1 = &this->E1E1[0];
+  const double* e1e2 = &this->E1E2[0];
+  const double* e2e2 = &this->E2E2[0];
+
+  double bestDist2 = maxDist2;
+  int bestTriangle = -1;
+  double bestV = 0.0;
+  double bestW = 0.0;
+
+  int stack[TRAVERSAL_STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0)
+  {
+    int nodeIndex = stack[--stackSize];
+    const Node& node = this->Nodes[nodeIndex];
+    if (BoxDistance2(node.Bounds, x) > bestDist2)
+    {
+      continue;
+    }
+    if (node.NumberOfTriangles > 0)
+    {
+      double triangleDist2[KERNEL_BLOCK_SIZE];
+      double triangleV[KERNEL_BLOCK_SIZE];
+      double triangleW[KERNEL_BLOCK_SIZE];
+      int lastTriangle = node.FirstTriangle + node.NumberOfTriangles;
+      for (int blockStart = node.FirstTriangle; blockStart < lastTriangle; blockStart += KERNEL_BLOCK_SIZE)
+      {
+        int blockSize = std::min(KERNEL_BLOCK_SIZE, lastTriangle - blockStart);
+        ClosestPointsOnTriangles(x, p0, e1, e2, e1e1, e1e2, e2e2, blockStart, blockSize, triangleDist2, triangleV, triangleW);
+        for (int k = 0; k < blockSize; k++)
+        {
+          // NaN distance (not expected, but cannot be ruled out for invalid input) fails this comparison
+          if (triangleDist2[k] <= bestDist2)
+          {
+            bestDist2 = triangleDist2[k];
+            bestTriangle = blockStart + k;
+            bestV = triangleV[k];
+            bestW = triangleW[k];
+          }
+        }
+      }
+      continue;
+    }
+    // Visit the nearer child first, it is more likely to contain the closest point
+    int leftChild = nodeIndex + 1;
+    int rightChild = node.RightChild;
+    double leftDist2 = BoxDistance2(this->Nodes[leftChild].Bounds, x);
+    double rightDist2 = BoxDistance2(this->Nodes[rightChild].Bounds, x);
+    if (leftDist2 <= rightDist2)
+    {
+      if (rightDist2 <= bestDist2)
+      {
+        stack[stackSize++] = rightChild;
+      }
+      stack[stackSize++] = leftChild;
+    }
+    else
+    {
+      if (leftDist2 <= bestDist2)
+      {
+        stack[stackSize++] = leftChild;
+      }
+      stack[stackSize++] = rightChild;
+    }
+  }
+
+  if (bestTriangle < 0)
+  {
+    return -1;
+  }
+  for (int axis = 0; axis < 3; axis++)
+  {
+    closestPoint[axis] = p0[axis][bestTriangle] + bestV * e1[axis][bestTriangle] + bestW * e2[axis][bestTriangle];
+  }
+  dist2 = bestDist2;
+  return bestTriangle;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::FindClosestPoint(double x[3], double closestPoint[3], vtkGenericCell *cell,
+  vtkIdType &cellId, int &subId, double& dist2)
+{
+  this->UpdateSearchStructure();
+  subId = 0;
+  int triangle = this->FindClosestTriangle(x, VTK_DOUBLE_MAX, closestPoint, dist2);
+  if (triangle < 0)
+  {
+    cellId = -1;
+    return;
+  }
+  cellId = this->CellIds[triangle];
+  if (cell != NULL)
+  {
+    this->DataSet->GetCell(cellId, cell);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkTriangleBVHLocator::FindClosestPointWithinRadius(double x[3], double radius, double closestPoint[3],
+  vtkGenericCell *cell, vtkIdType &cellId, int &subId, double& dist2, int &inside)
+{
+  this->UpdateSearchStructure();
+  subId = 0;
+  inside = 0;
+  int triangle = this->FindClosestTriangle(x, radius * radius, closestPoint, dist2);
+  if (triangle < 0)
+  {
+    cellId = -1;
+    return 0;
+  }
+  cellId = this->CellIds[triangle];
+  if (cell != NULL)
+  {
+    this->DataSet->GetCell(cellId, cell);
+  }
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::FindCellsWithinBounds(double *bbox, vtkIdList *cells)
+{
+  this->UpdateSearchStructure();
+  cells->Reset();
+  if (this->Nodes.empty())
+  {
+    return;
+  }
+
+  int stack[TRAVERSAL_STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0)
+  {
+    int nodeIndex = stack[--stackSize];
+    const Node& node = this->Nodes[nodeIndex];
+    if (node.Bounds[0] > bbox[1] || node.Bounds[1] < bbox[0]
+      || node.Bounds[2] > bbox[3] || node.Bounds[3] < bbox[2]
+      || node.Bounds[4] > bbox[5] || node.Bounds[5] < bbox[4])
+    {
+      continue;
+    }
+    if (node.NumberOfTriangles == 0)
+    {
+      stack[stackSize++] = node.RightChild;
+      stack[stackSize++] = nodeIndex + 1;
+      continue;
+    }
+    int lastTriangle = node.FirstTriangle + node.NumberOfTriangles;
+    for (int i = node.FirstTriangle; i < lastTriangle; i++)
+    {
+      bool overlaps = true;
+      for (int axis = 0; axis < 3 && overlaps; axis++)
+      {
+        double p0 = this->P0[axis][i];
+        double p1 = p0 + this->E1[axis][i];
+        double p2 = p0 + this->E2[axis][i];
+        overlaps = std::min(p0, std::min(p1, p2)) <= bbox[2 * axis + 1] && std::max(p0, std::max(p1, p2)) >= bbox[2 * axis];
+      }
+      if (overlaps)
+      {
+        cells->InsertNextId(this->CellIds[i]);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLocator::IntersectWithLine(double p1[3], double p2[3], double vtkNotUsed(tol), double& t, double x[3],
+  double pcoords[3], int &subId, vtkIdType &cellId, vtkGenericCell *cell)
+{
+  this->UpdateSearchStructure();
+  if (this->Nodes.empty())
+  {
+    return 0;
+  }
+
+  double dir[3] = { p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+  double bestT = 1.0;
+  int bestTriangle = -1;
+  double bestU = 0.0;
+  double bestV = 0.0;
+
+  int stack[TRAVERSAL_STACK_SIZE];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0)
+  {
+    int nodeIndex = stack[--stackSize];
+    const Node& node = this->Nodes[nodeIndex];
+    if (!SegmentIntersectsBox(p1, dir, node.Bounds, bestT))
+    {
+      continue;
+    }
+    if (node.NumberOfTriangles == 0)
+    {
+      stack[stackSize++] = node.RightChild;
+      stack[stackSize++] = nodeIndex + 1;
+      continue;
+    }
+    // Moller-Trumbore ray-triangle intersection
+    int lastTriangle = node.FirstTriangle + node.NumberOfTriangles;
+    for (int i = node.FirstTriangle; i < lastTriangle; i++)
+    {
+      double e1[3] = { this->E1[0][i], this->E1[1][i], this->E1[2][i] };
+      double e2[3] = { this->E2[0][i], this->E2[1][i], this->E2[2][i] };
+      double pvec[3] = { dir[1] * e2[2] - dir[2] * e2[1], dir[2] * e2[0] - dir[0] * e2[2], dir[0] * e2[1] - dir[1] * e2[0] };
+      double det = e1[0] * pvec[0] + e1[1] * pvec[1] + e1[2] * pvec[2];
+      if (det == 0.0)
+      {
+        // segment is parallel to the triangle
+        continue;
+      }
+      double invDet = 1.0 / det;
+      double tvec[3] = { p1[0] - this->P0[0][i], p1[1] - this->P0[1][i], p1[2] - this->P0[2][i] };
+      double u = (tvec[0] * pvec[0] + tvec[1] * pvec[1] + tvec[2] * pvec[2]) * invDet;
+      if (u < 0.0 || u > 1.0)
+      {
+        continue;
+      }
+      double qvec[3] = { tvec[1] * e1[2] - tvec[2] * e1[1], tvec[2] * e1[0] - tvec[0] * e1[2], tvec[0] * e1[1] - tvec[1] * e1[0] };
+      double v = (dir[0] * qvec[0] + dir[1] * qvec[1] + dir[2] * qvec[2]) * invDet;
+      if (v < 0.0 || u + v > 1.0)
+      {
+        continue;
+      }
+      double triangleT = (e2[0] * qvec[0] + e2[1] * qvec[1] + e2[2] * qvec[2]) * invDet;
+      if (triangleT < 0.0 || triangleT > bestT || (triangleT == bestT && bestTriangle >= 0))
+      {
+        continue;
+      }
+      bestT = triangleT;
+      bestTriangle = i;
+      bestU = u;
+      bestV = v;
+    }
+  }
+
+  if (bestTriangle < 0)
+  {
+    return 0;
+  }
+  t = bestT;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    x[axis] = p1[axis] + t * dir[axis];
+  }
+  pcoords[0] = bestU;
+  pcoords[1] = bestV;
+  pcoords[2] = 0.0;
+  subId = 0;
+  cellId = this->CellIds[bestTriangle];
+  if (cell != NULL)
+  {
+    this->DataSet->GetCell(cellId, cell);
+  }
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVHLocator::GenerateRepresentation(int level, vtkPolyData *pd)
+{
+  if (pd == NULL)
+  {
+    return;
+  }
+  this->UpdateSearchStructure();
+
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  // Box edges as pairs of corner indices (corner bit 0: x max, bit 1: y max, bit 2: z max)
+  static const int edges[12][2] = { {0,1}, {2,3}, {4,5}, {6,7}, {0,2}, {1,3}, {4,6}, {5,7}, {0,4}, {1,5}, {2,6}, {3,7} };
+
+  // Stack of (node index, node level) pairs
+  int stack[2 * TRAVERSAL_STACK_SIZE];
+  int stackSize = 0;
+  if (!this->Nodes.empty())
+  {
+    stack[stackSize++] = 0;
+    stack[stackSize++] = 0;
+  }
+  while (stackSize > 0)
+  {
+    int nodeLevel = stack[--stackSize];
+    int nodeIndex = stack[--stackSize];
+    const Node& node = this->Nodes[nodeIndex];
+    if (node.NumberOfTriangles == 0 && nodeLevel != level)
+    {
+      stack[stackSize++] = node.RightChild;
+      stack[stackSize++] = nodeLevel + 1;
+      stack[stackSize++] = nodeIndex + 1;
+      stack[stackSize++] = nodeLevel + 1;
+      continue;
+    }
+    // Leaf or node at the requested level
+    vtkIdType firstCorner = points->GetNumberOfPoints();
+    for (int corner = 0; corner < 8; corner++)
+    {
+      points->InsertNextPoint(node.Bounds[(corner & 1) ? 1 : 0], node.Bounds[(corner & 2) ? 3 : 2], node.Bounds[(corner & 4) ? 5 : 4]);
+    }
+    for (int edge = 0; edge < 12; edge++)
+    {
+      vtkIdType edgePointIds[2] = { firstCorner + edges[edge][0], firstCorner + edges[edge][1] };
+      lines->InsertNextCell(2, edgePointIds);
+    }
+  }
+
+  pd->SetPoints(points.GetPointer());
+  pd->SetLines(lines.GetPointer());
+}
@@ -0,0 +1,137 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkTriangleBVHLocator - compact bounding volume hierarchy for triangle meshes
+// .SECTION Description
+// Cell locator optimized for the closest point queries of vtkImplicitPolyDataDistancePointPos.
+// Triangles are organized into a bounding volume hierarchy: a binary tree of axis-aligned boxes,
+// built by splitting the triangles at the median of their centroids along the longest axis.
+// Nodes are stored in a single array in depth-first order (the left child immediately follows its parent),
+// and triangle vertices are copied in structure-of-arrays layout in leaf order, so that all triangles
+// of a leaf are processed in a tight loop over contiguous arrays, without accessing the dataset.
+// The point-triangle distance of a leaf is computed by a branch-free kernel that the compiler
+// can vectorize (several triangles per instruction).
+// Queries do not modify the locator, therefore they can be run from multiple threads.
+//
+// Only triangle cells are stored, other cells are ignored (use vtkTriangleFilter to triangulate the input).
+// Implemented queries: FindClosestPoint, FindClosestPointWithinRadius, FindCellsWithinBounds, IntersectWithLine.
+// NumberOfCellsPerNode specifies the maximum number of triangles in a leaf (default: 8).
+
+#ifndef __vtkTriangleBVHLocator_h
+#define __vtkTriangleBVHLocator_h
+
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+// VTK includes
+#include "vtkAbstractCellLocator.h"
+
+// STD includes
+#include <vector>
+
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkTriangleBVHLocator : public vtkAbstractCellLocator
+{
+public:
+  static vtkTriangleBVHLocator *New();
+  vtkTypeMacro(vtkTriangleBVHLocator, vtkAbstractCellLocator);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  using vtkAbstractCellLocator::FindClosestPoint;
+  using vtkAbstractCellLocator::FindClosestPointWithinRadius;
+  using vtkAbstractCellLocator::IntersectWithLine;
+
+  // Description:
+  // Find the closest point on the stored triangles to x.
+  virtual void FindClosestPoint(double x[3], double closestPoint[3], vtkGenericCell *cell,
+    vtkIdType &cellId, int &subId, double& dist2);
+
+  // Description:
+  // Find the closest point on the stored triangles to x, only considering triangles within radius.
+  // Returns 1 if a triangle was found within the radius, 0 otherwise.
+  virtual vtkIdType FindClosestPointWithinRadius(double x[3], double radius, double closestPoint[3],
+    vtkGenericCell *cell, vtkIdType &cellId, int &subId, double& dist2, int &inside);
+
+  // Description:
+  // Return ids of triangles whose bounding box intersects bbox.
+  virtual void FindCellsWithinBounds(double *bbox, vtkIdList *cells);
+
+  // Description:
+  // Find the first intersection of the line segment p1-p2 with the stored triangles.
+  // t is the parametric coordinate of the intersection along the segment (0 at p1, 1 at p2).
+  // Returns 1 if an intersection was found, 0 otherwise. tol is ignored, intersections are computed exactly.
+  virtual int IntersectWithLine(double p1[3], double p2[3], double tol, double& t, double x[3],
+    double pcoords[3], int &subId, vtkIdType &cellId, vtkGenericCell *cell);
+
+  // Description:
+  // Satisfy vtkLocator abstract interface.
+  virtual void BuildLocator();
+  virtual void FreeSearchStructure();
+  virtual void GenerateRepresentation(int level, vtkPolyData *pd);
+
+  // Description:
+  // Number of nodes and number of stored triangles in the hierarchy.
+  int GetNumberOfNodes();
+  vtkIdType GetNumberOfTriangles();
+
+protected:
+  vtkTriangleBVHLocator();
+  ~vtkTriangleBVHLocator();
+
+  struct Node
+  {
+    double Bounds[6];
+    int RightChild; // index of the right child node, left child is the next node (only for inner nodes)
+    int FirstTriangle;
+    int NumberOfTriangles; // 0 for inner nodes
+  };
+
+  // Description:
+  // Create node for triangles [first, first+count) of TriangleOrder and its descendants.
+  // Returns the node index.
+  int BuildNode(int first, int count, int level, const std::vector<double>& triangleBounds,
+    const std::vector<double>& triangleCentroids);
+
+  // Description:
+  // Closest point search that only considers triangles closer than sqrt(maxDist2).
+  // Returns the index of the closest triangle (in leaf order), -1 if not found.
+  int FindClosestTriangle(const double x[3], double maxDist2, double closestPoint[3], double& dist2);
+
+  std::vector<Node> Nodes;
+
+  // Triangles in leaf order, structure of arrays: first vertex (P0), edge vectors (E1=P1-P0, E2=P2-P0)
+  std::vector<double> P0[3];
+  std::vector<double> E1[3];
+  std::vector<double> E2[3];
+  // Dot products of the edge vectors, used in the point-triangle distance computation
+  std::vector<double> E1E1;
+  std::vector<double> E1E2;
+  std::vector<double> E2E2;
+  std::vector<vtkIdType> CellIds;
+
+  // Only used during build
+  std::vector<int> TriangleOrder;
+
+private:
+  // Description:
+  // Build the search structure if it is missing or older than the locator or the dataset.
+  // Used instead of vtkLocator::BuildLocatorIfNeeded, which is not available in older VTK versions.
+  void UpdateSearchStructure();
+
+  vtkTriangleBVHLocator(const vtkTriangleBVHLocator&);  // Not implemented.
+  void operator=(const vtkTriangleBVHLocator&);  // Not implemented.
+};
+
+#endif
@@ -13,6 +13,7 @@
 #include <vtkNew.h>
 #include <vtkIntArray.h>
 #include <vtkCommand.h>
+#include <vtkPoints.h>
 
 // Other includes
 #include <sstream>
@@ -57,11 +58,34 @@ vtkMRMLBreachWarningNode::vtkMRMLBreachWarningNode()
   this->ClosestPointOnModel[1] = 0.0;
   this->ClosestPointOnModel[2] = 0.0;
 
+  this->ClosestToolSamplePointIndex = 0;
+  this->ClosestModelIndex = -1;
+  this->WatchedModelDistanceThresholdMm = 10.0;
+  this->MaximumReportedDistanceMm = 0.0;
+  this->ClosestDistanceBeyondRange = false;
+  this->ClosestDistanceReady = true;
+  this->CheckToolTipPath = false;
+  this->ToolTipPathCrossedModel = false;
+  this->ToolTipPathCrossedModelIndex = -1;
+  this->ToolTipPathCrossingPoint[0] = 0.0;
+  this->ToolTipPathCrossingPoint[1] = 0.0;
+  this->ToolTipPathCrossingPoint[2] = 0.0;
+  this->ToolTipPathCrossingFraction = 0.0;
+
+  this->ToolSamplePoints = vtkPoints::New();
+
+  this->UseDistanceMap = false;
+  this->DistanceMapSpacingMm = 1.0;
+  this->DistanceMapMarginMm = 20.0;
+
+  this->DistanceLocator = DISTANCE_LOCATOR_CELL;
 }
 
 //------------------------------------------------------------------------------
 vtkMRMLBreachWarningNode::~vtkMRMLBreachWarningNode()
 {
+  this->ToolSamplePoints->Delete();
+  this->ToolSamplePoints = NULL;
 }
 
 //------------------------------------------------------------------------------
@@ -76,6 +100,22 @@ void vtkMRMLBreachWarningNode::WriteXML( ostream& of, int nIndent )
   of << indent << " playWarningSound=\"" << ( this->PlayWarningSound ? "true" : "false" ) << "\"";
   of << indent << " closestDistanceToModelFromToolTip=\"" << ClosestDistanceToModelFromToolTip << "\"";
   of << indent << " closestPointOnModel=\"" << this->ClosestPointOnModel[0] << " " << this->ClosestPointOnModel[1] << " " << this->ClosestPointOnModel[2] << "\"";
+
+  of << indent << " toolSamplePoints=\"";
+  for (vtkIdType pointIndex = 0; pointIndex < this->ToolSamplePoints->GetNumberOfPoints(); pointIndex++)
+  {
+    double* point = this->ToolSamplePoints->GetPoint(pointIndex);
+    of << ( pointIndex > 0 ? " " : "" ) << point[0] << " " << point[1] << " " << point[2];
+  }
+  of << "\"";
+
+  of << indent << " useDistanceMap=\"" << ( this->UseDistanceMap ? "true" : "false" ) << "\"";
+  of << indent << " distanceMapSpacingMm=\"" << this->DistanceMapSpacingMm << "\"";
+  of << indent << " distanceMapMarginMm=\"" << this->DistanceMapMarginMm << "\"";
+  of << indent << " watchedModelDistanceThresholdMm=\"" << this->WatchedModelDistanceThresholdMm << "\"";
+  of << indent << " maximumReportedDistanceMm=\"" << this->MaximumReportedDistanceMm << "\"";
+  of << indent << " checkToolTipPath=\"" << ( this->CheckToolTipPath ? "true" : "false" ) << "\"";
+  of << indent << " distanceLocator=\"" << ConvertDistanceLocatorToString(this->DistanceLocator) << "\"";
 }
 
 //------------------------------------------------------------------------------
@@ -158,6 +198,77 @@ void vtkMRMLBreachWarningNode::ReadXMLAttributes( const char** atts )
       ss >> val;
       this->ClosestPointOnModel[2] = val;
     }
+    else if (!strcmp(attName, "toolSamplePoints"))
+    {
+      this->ToolSamplePoints->Reset();
+      std::stringstream ss;
+      ss << attValue;
+      double point[3] = {0.0, 0.0, 0.0};
+      while (ss >> point[0] >> point[1] >> point[2])
+      {
+        this->ToolSamplePoints->InsertNextPoint(point);
+      }
+      this->ToolSamplePoints->Modified();
+    }
+    else if ( ! strcmp( attName, "useDistanceMap" ) )
+    {
+      this->UseDistanceMap = ( strcmp( attValue, "true" ) == 0 );
+    }
+    else if (!strcmp(attName, "distanceMapSpacingMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=1.0;
+      ss >> val;
+      if (val > 0)
+      {
+        this->DistanceMapSpacingMm = val;
+      }
+      else
+      {
+        vtkWarningMacro("ReadXMLAttributes: invalid distanceMapSpacingMm value (" << attValue << "), spacing must be positive. Default value is used.");
+      }
+    }
+    else if (!strcmp(attName, "distanceMapMarginMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=20.0;
+      ss >> val;
+      this->DistanceMapMarginMm = val;
+    }
+    else if (!strcmp(attName, "watchedModelDistanceThresholdMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=10.0;
+      ss >> val;
+      this->WatchedModelDistanceThresholdMm = val;
+    }
+    else if (!strcmp(attName, "maximumReportedDistanceMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.0;
+      ss >> val;
+      this->MaximumReportedDistanceMm = val;
+    }
+    else if ( ! strcmp( attName, "checkToolTipPath" ) )
+    {
+      this->CheckToolTipPath = ( strcmp( attValue, "true" ) == 0 );
+    }
+    else if (!strcmp(attName, "distanceLocator"))
+    {
+      int distanceLocator = ConvertDistanceLocatorFromString(attValue);
+      if (distanceLocator >= 0)
+      {
+        this->DistanceLocator = distanceLocator;
+      }
+      else
+      {
+        vtkWarningMacro("Unknown distance locator type: " << attValue << ", using default");
+      }
+    }
   }
 }
 
@@ -176,6 +287,14 @@ void vtkMRMLBreachWarningNode::Copy( vtkMRMLNode *anode )
 
   this->PlayWarningSound = node->PlayWarningSound;  
   this->DisplayWarningColor = node->DisplayWarningColor;
+  this->ToolSamplePoints->DeepCopy( node->ToolSamplePoints );
+  this->UseDistanceMap = node->UseDistanceMap;
+  this->DistanceMapSpacingMm = node->DistanceMapSpacingMm;
+  this->DistanceMapMarginMm = node->DistanceMapMarginMm;
+  this->WatchedModelDistanceThresholdMm = node->WatchedModelDistanceThresholdMm;
+  this->MaximumReportedDistanceMm = node->MaximumReportedDistanceMm;
+  this->DistanceLocator = node->DistanceLocator;
+  this->CheckToolTipPath = node->CheckToolTipPath;
 
   this->Modified();
 }
@@ -185,8 +304,12 @@ void vtkMRMLBreachWarningNode::PrintSelf( ostream& os, vtkIndent indent )
 {
   vtkMRMLNode::PrintSelf(os,indent); // This will take care of referenced nodes
 
-  os << indent << "WatchedModelID: " << (this->GetWatchedModelNode() && this->GetWatchedModelNode()->GetID() ?
-   this->GetWatchedModelNode()->GetID() : "(none)" ) << std::endl;
+  for (int modelIndex = 0; modelIndex < this->GetNumberOfWatchedModelNodes(); modelIndex++)
+  {
+    vtkMRMLModelNode* modelNode = this->GetNthWatchedModelNode(modelIndex);
+    os << indent << "WatchedModelID[" << modelIndex << "]: " << (modelNode && modelNode->GetID() ?
+      modelNode->GetID() : "(none)" ) << std::endl;
+  }
   os << indent << "ToolTipTransformID: " << (this->GetToolTransformNode() && this->GetToolTransformNode()->GetID() ?
    this->GetToolTransformNode()->GetID() : "(none)" ) << std::endl;
   os << indent << "LineToClosestPointID: " << (this->GetLineToClosestPointNode() && this->GetLineToClosestPointNode()->GetID() ?
@@ -195,6 +318,22 @@ void vtkMRMLBreachWarningNode::PrintSelf( ostream& os, vtkIndent indent )
   os << indent << "PlayWarningSound: " << this->PlayWarningSound << std::endl;
   os << indent << "WarningColor: " << this->WarningColor[0] << ", " << this->WarningColor[1] << ", " << this->WarningColor[2] << std::endl;
   os << indent << "OriginalColor: " << this->OriginalColor[0] << ", " << this->OriginalColor[1] << ", " << this->OriginalColor[2] << std::endl;
+  os << indent << "NumberOfToolSamplePoints: " << this->ToolSamplePoints->GetNumberOfPoints() << std::endl;
+  os << indent << "ClosestToolSamplePointIndex: " << this->ClosestToolSamplePointIndex << std::endl;
+  os << indent << "UseDistanceMap: " << this->UseDistanceMap << std::endl;
+  os << indent << "DistanceMapSpacingMm: " << this->DistanceMapSpacingMm << std::endl;
+  os << indent << "DistanceMapMarginMm: " << this->DistanceMapMarginMm << std::endl;
+  os << indent << "ClosestModelIndex: " << this->ClosestModelIndex << std::endl;
+  os << indent << "WatchedModelDistanceThresholdMm: " << this->WatchedModelDistanceThresholdMm << std::endl;
+  os << indent << "MaximumReportedDistanceMm: " << this->MaximumReportedDistanceMm << std::endl;
+  os << indent << "ClosestDistanceBeyondRange: " << this->ClosestDistanceBeyondRange << std::endl;
+  os << indent << "ClosestDistanceReady: " << this->ClosestDistanceReady << std::endl;
+  os << indent << "CheckToolTipPath: " << this->CheckToolTipPath << std::endl;
+  os << indent << "ToolTipPathCrossedModel: " << this->ToolTipPathCrossedModel << std::endl;
+  os << indent << "ToolTipPathCrossedModelIndex: " << this->ToolTipPathCrossedModelIndex << std::endl;
+  os << indent << "ToolTipPathCrossingPoint: " << this->ToolTipPathCrossingPoint[0] << ", " << this->ToolTipPathCrossingPoint[1] << ", " << this->ToolTipPathCrossingPoint[2] << std::endl;
+  os << indent << "ToolTipPathCrossingFraction: " << this->ToolTipPathCrossingFraction << std::endl;
+  os << indent << "DistanceLocator: " << ConvertDistanceLocatorToString(this->DistanceLocator) << std::endl;
 }
 
 //------------------------------------------------------------------------------
@@ -226,6 +365,75 @@ void vtkMRMLBreachWarningNode::SetAndObserveWatchedModelNodeID( const char* mode
   this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
 }
 
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfWatchedModelNodes()
+{
+  return this->GetNumberOfNodeReferences( MODEL_ROLE );
+}
+
+//------------------------------------------------------------------------------
+vtkMRMLModelNode* vtkMRMLBreachWarningNode::GetNthWatchedModelNode( int n )
+{
+  vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast( this->GetNthNodeReference( MODEL_ROLE, n ) );
+  return modelNode;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::AddAndObserveWatchedModelNodeID( const char* modelId )
+{
+  if (modelId==NULL)
+  {
+    return;
+  }
+  for (int modelIndex = 0; modelIndex < this->GetNumberOfWatchedModelNodes(); modelIndex++)
+  {
+    const char* currentNodeId=this->GetNthNodeReferenceID(MODEL_ROLE, modelIndex);
+    if (currentNodeId!=NULL && strcmp(modelId,currentNodeId)==0)
+    {
+      // already watched
+      return;
+    }
+  }
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue( vtkCommand::ModifiedEvent );
+  events->InsertNextValue( vtkMRMLTransformNode::TransformModifiedEvent );
+  this->AddAndObserveNodeReferenceID( MODEL_ROLE, modelId, events.GetPointer() );
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveNthWatchedModelNode( int n )
+{
+  if (n<0 || n>=this->GetNumberOfWatchedModelNodes())
+  {
+    vtkErrorMacro("RemoveNthWatchedModelNode failed: invalid model index "<<n);
+    return;
+  }
+  this->RemoveNthNodeReferenceID( MODEL_ROLE, n );
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+double vtkMRMLBreachWarningNode::GetNthWatchedModelDistance( int n )
+{
+  if (n<0 || n>=static_cast<int>(this->WatchedModelDistances.size()))
+  {
+    return VTK_DOUBLE_MAX;
+  }
+  return this->WatchedModelDistances[n];
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetWatchedModelDistances( const std::vector<double>& distances )
+{
+  if (this->WatchedModelDistances == distances)
+  {
+    return;
+  }
+  this->WatchedModelDistances = distances;
+  this->Modified();
+}
+
 //------------------------------------------------------------------------------
 vtkMRMLAnnotationRulerNode* vtkMRMLBreachWarningNode::GetLineToClosestPointNode()
 {
@@ -292,9 +500,16 @@ void vtkMRMLBreachWarningNode::ProcessMRMLEvents( vtkObject *caller, unsigned lo
   {
     this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
   }
-  else if (this->GetWatchedModelNode() && this->GetWatchedModelNode()==caller)
+  else
   {
-    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+    for (int modelIndex = 0; modelIndex < this->GetNumberOfWatchedModelNodes(); modelIndex++)
+    {
+      if (this->GetNthWatchedModelNode(modelIndex)==caller)
+      {
+        this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+        break;
+      }
+    }
   }
 }
 
@@ -304,6 +519,34 @@ bool vtkMRMLBreachWarningNode::IsToolTipInsideModel()
   return (this->ClosestDistanceToModelFromToolTip<0);
 }
 
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsModelBreached()
+{
+  return this->IsToolTipInsideModel() || (this->CheckToolTipPath && this->ToolTipPathCrossedModel);
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsNthWatchedModelBreached( int n )
+{
+  if (this->GetNthWatchedModelDistance(n) < 0)
+  {
+    return true;
+  }
+  return (this->CheckToolTipPath && this->ToolTipPathCrossedModel && this->ToolTipPathCrossedModelIndex == n);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetCheckToolTipPath(bool _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting CheckToolTipPath to " << _arg);
+  if (this->CheckToolTipPath != _arg)
+  {
+    this->CheckToolTipPath = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
 //------------------------------------------------------------------------------
 void vtkMRMLBreachWarningNode::SetDisplayWarningColor(bool _arg)
 {
@@ -367,3 +610,174 @@ void vtkMRMLBreachWarningNode::SetOriginalColor(double _arg[3])
 {
   this->SetOriginalColor(_arg[0], _arg[1], _arg[2]);
 }
+
+//------------------------------------------------------------------------------
+vtkPoints* vtkMRMLBreachWarningNode::GetToolSamplePoints()
+{
+  return this->ToolSamplePoints;
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfToolSamplePoints()
+{
+  return this->ToolSamplePoints->GetNumberOfPoints();
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolSamplePoints( vtkPoints* points )
+{
+  if ( points == NULL )
+  {
+    this->RemoveAllToolSamplePoints();
+    return;
+  }
+  this->ToolSamplePoints->DeepCopy( points );
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolSamplePointsAlongSegment( double startPoint_Tool[3], double endPoint_Tool[3], int numberOfSamples )
+{
+  this->ToolSamplePoints->Reset();
+  for (int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    double t = ( numberOfSamples > 1 ? double(sampleIndex) / double(numberOfSamples - 1) : 0.0 );
+    this->ToolSamplePoints->InsertNextPoint(
+      startPoint_Tool[0] + t * ( endPoint_Tool[0] - startPoint_Tool[0] ),
+      startPoint_Tool[1] + t * ( endPoint_Tool[1] - startPoint_Tool[1] ),
+      startPoint_Tool[2] + t * ( endPoint_Tool[2] - startPoint_Tool[2] ) );
+  }
+  this->ToolSamplePoints->Modified();
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveAllToolSamplePoints()
+{
+  if ( this->ToolSamplePoints->GetNumberOfPoints() == 0 )
+  {
+    return;
+  }
+  this->ToolSamplePoints->Reset();
+  this->ToolSamplePoints->Modified();
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetUseDistanceMap(bool _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting UseDistanceMap to " << _arg);
+  if (this->UseDistanceMap != _arg)
+  {
+    this->UseDistanceMap = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetDistanceMapSpacingMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting DistanceMapSpacingMm to " << _arg);
+  if (_arg <= 0)
+  {
+    vtkErrorMacro("SetDistanceMapSpacingMm failed: spacing must be positive");
+    return;
+  }
+  if (this->DistanceMapSpacingMm != _arg)
+  {
+    this->DistanceMapSpacingMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetWatchedModelDistanceThresholdMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting WatchedModelDistanceThresholdMm to " << _arg);
+  if (this->WatchedModelDistanceThresholdMm != _arg)
+  {
+    this->WatchedModelDistanceThresholdMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetMaximumReportedDistanceMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting MaximumReportedDistanceMm to " << _arg);
+  if (_arg < 0)
+  {
+    vtkErrorMacro("SetMaximumReportedDistanceMm failed: distance must not be negative");
+    return;
+  }
+  if (this->MaximumReportedDistanceMm != _arg)
+  {
+    this->MaximumReportedDistanceMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetDistanceMapMarginMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting DistanceMapMarginMm to " << _arg);
+  if (this->DistanceMapMarginMm != _arg)
+  {
+    this->DistanceMapMarginMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetDistanceLocator(int _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting DistanceLocator to " << _arg);
+  if (_arg < 0 || _arg >= DISTANCE_LOCATOR_LAST)
+  {
+    vtkErrorMacro("SetDistanceLocator failed: invalid locator type " << _arg);
+    return;
+  }
+  if (this->DistanceLocator != _arg)
+  {
+    this->DistanceLocator = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+const char* vtkMRMLBreachWarningNode::ConvertDistanceLocatorToString(int distanceLocator)
+{
+  switch (distanceLocator)
+  {
+  case DISTANCE_LOCATOR_CELL: return "cell";
+  case DISTANCE_LOCATOR_STATIC_CELL: return "staticCell";
+  case DISTANCE_LOCATOR_TRIANGLE_BVH: return "triangleBVH";
+  default: return "";
+  }
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::ConvertDistanceLocatorFromString(const char* distanceLocatorString)
+{
+  if (distanceLocatorString == NULL)
+  {
+    return -1;
+  }
+  for (int distanceLocator = 0; distanceLocator < DISTANCE_LOCATOR_LAST; distanceLocator++)
+  {
+    if (strcmp(distanceLocatorString, ConvertDistanceLocatorToString(distanceLocator)) == 0)
+    {
+      return distanceLocator;
+    }
+  }
+  return -1;
+}
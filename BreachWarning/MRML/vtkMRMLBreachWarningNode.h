@@ -31,6 +31,7 @@
 #include "vtkSlicerBreachWarningModuleMRMLExport.h"
 
 class vtkMRMLAnnotationRulerNode;
+class vtkPoints;
 class vtkMRMLTransformNode;
 class vtkMRMLModelNode;
 
@@ -47,6 +48,18 @@ public:
     // vtkCommand::UserEvent + 555 is just a random value that is very unlikely to be used for anything else in this class
     InputDataModifiedEvent = vtkCommand::UserEvent + 555
   };
+
+  /// Spatial search structure that is used for finding the closest point on the watched models
+  enum DistanceLocatorType
+  {
+    /// Uniform subdivision of the model's bounding box (vtkCellLocator)
+    DISTANCE_LOCATOR_CELL,
+    /// Static uniform subdivision, faster to build for large meshes (vtkStaticCellLocator, requires VTK 9 or later)
+    DISTANCE_LOCATOR_STATIC_CELL,
+    /// Compact triangle bounding volume hierarchy (vtkTriangleBVHLocator)
+    DISTANCE_LOCATOR_TRIANGLE_BVH,
+    DISTANCE_LOCATOR_LAST // this should be the last type of locator
+  };
   
   vtkTypeMacro( vtkMRMLBreachWarningNode, vtkMRMLNode );
   
@@ -74,16 +87,133 @@ protected:
 public:
 
   /// Distance of the closest point on the model to the tooltip. Computed parameter.
+  /// If tool sample points are specified then it is the minimum signed distance of all the sample points.
   vtkGetMacro( ClosestDistanceToModelFromToolTip, double );
   vtkSetMacro( ClosestDistanceToModelFromToolTip, double );
 
   /// Position of the closest point on the model to the tooltip in RAS coordinate system. Computed parameter.
+  /// If ClosestDistanceBeyondRange is true then the closest point is not computed and this is set to the tool tip position.
   vtkGetVector3Macro( ClosestPointOnModel, double );
   vtkSetVector3Macro( ClosestPointOnModel, double );
 
+  /// Index of the tool sample point that is the closest to (or deepest inside) the watched model.
+  /// 0 if no sample points are specified (only the tool tip is checked). Computed parameter.
+  vtkGetMacro( ClosestToolSamplePointIndex, int );
+  vtkSetMacro( ClosestToolSamplePointIndex, int );
+
+  /// Index of the watched model that is the closest to the tool (see GetNthWatchedModelNode()).
+  /// -1 if there is no watched model. Computed parameter.
+  vtkGetMacro( ClosestModelIndex, int );
+  vtkSetMacro( ClosestModelIndex, int );
+
+  /// Signed distance of the tool from the n-th watched model. Computed parameter.
+  /// Distance is only computed for models that are closer than WatchedModelDistanceThresholdMm
+  /// (and for the closest model), VTK_DOUBLE_MAX is returned for all other models.
+  double GetNthWatchedModelDistance( int n );
+  void SetWatchedModelDistances( const std::vector<double>& distances );
+
+  /// Distances from the tool are reported for each watched model that is closer than this threshold.
+  /// Only used if multiple models are watched. Default: 10.0mm.
+  vtkGetMacro( WatchedModelDistanceThresholdMm, double );
+  virtual void SetWatchedModelDistanceThresholdMm(double _arg);
+
   /// Computed parameter
   bool IsToolTipInsideModel();
 
+  /// If enabled then the path of the tool tip since the previous update (a line segment between the previous
+  /// and current tool tip positions) is checked for crossing the watched models' surface.
+  /// This detects breaches when the tool moves through a thin structure between two tracker samples,
+  /// without any sampled tool tip position being inside the model. False by default.
+  vtkGetMacro( CheckToolTipPath, bool );
+  virtual void SetCheckToolTipPath(bool _arg);
+  vtkBooleanMacro( CheckToolTipPath, bool );
+
+  /// True if the tool tip path since the previous update crossed the watched models' surface.
+  /// Only computed if CheckToolTipPath is enabled. Computed parameter.
+  vtkGetMacro( ToolTipPathCrossedModel, bool );
+  vtkSetMacro( ToolTipPathCrossedModel, bool );
+
+  /// First point where the tool tip path crossed the watched models' surface, in RAS coordinate system.
+  /// Only valid if ToolTipPathCrossedModel is true. Computed parameter.
+  vtkGetVector3Macro( ToolTipPathCrossingPoint, double );
+  vtkSetVector3Macro( ToolTipPathCrossingPoint, double );
+
+  /// Index of the watched model whose surface was crossed by the tool tip path (see GetNthWatchedModelNode()).
+  /// Only valid if ToolTipPathCrossedModel is true. Computed parameter.
+  vtkGetMacro( ToolTipPathCrossedModelIndex, int );
+  vtkSetMacro( ToolTipPathCrossedModelIndex, int );
+
+  /// Position of the first crossing along the tool tip path: 0 at the previous, 1 at the current tool tip position.
+  /// Only valid if ToolTipPathCrossedModel is true. Computed parameter.
+  vtkGetMacro( ToolTipPathCrossingFraction, double );
+  vtkSetMacro( ToolTipPathCrossingFraction, double );
+
+  /// Returns true if the tool tip is inside the watched models or its path crossed their surface
+  /// since the previous update. Warning color and sound are activated based on this.
+  bool IsModelBreached();
+
+  /// Returns true if the tool tip is inside the n-th watched model or its path crossed the n-th model's surface
+  /// since the previous update. Used for displaying the warning color on each breached model.
+  bool IsNthWatchedModelBreached( int n );
+
+  /// If positive, then exact distance is only computed if the tool is closer to the watched models than this value.
+  /// If the tool is farther then the closest point search is skipped, ClosestDistanceBeyondRange is set to true
+  /// and ClosestDistanceToModelFromToolTip is set to this value (a lower bound of the actual distance).
+  /// 0 (default) means that the distance is always computed.
+  vtkGetMacro( MaximumReportedDistanceMm, double );
+  virtual void SetMaximumReportedDistanceMm(double _arg);
+
+  /// False if the distance could not be computed yet because the spatial index of the watched models
+  /// is being built in the background. Computed parameter.
+  vtkGetMacro( ClosestDistanceReady, bool );
+  vtkSetMacro( ClosestDistanceReady, bool );
+
+  /// True if the tool is farther from the watched models than MaximumReportedDistanceMm. Computed parameter.
+  vtkGetMacro( ClosestDistanceBeyondRange, bool );
+  vtkSetMacro( ClosestDistanceBeyondRange, bool );
+
+  /// Points in the tool coordinate system where the distance from the watched model is checked
+  /// (for example, points along the shaft of a needle).
+  /// If no points are specified then only the tooltip (origin of the tool coordinate system) is checked.
+  /// The returned object must not be modified directly, use SetToolSamplePoints() instead.
+  vtkPoints* GetToolSamplePoints();
+  void SetToolSamplePoints( vtkPoints* points );
+  int GetNumberOfToolSamplePoints();
+
+  /// Set numberOfSamples tool sample points uniformly distributed along a line segment
+  /// (for example, from the needle tip to the needle base), specified in the tool coordinate system.
+  void SetToolSamplePointsAlongSegment( double startPoint_Tool[3], double endPoint_Tool[3], int numberOfSamples );
+
+  /// Remove all tool sample points, only the tooltip is checked
+  void RemoveAllToolSamplePoints();
+
+  /// If enabled then a signed distance map is computed around the watched model once and
+  /// distances are interpolated from it, instead of searching for the closest point on the model surface.
+  /// Exact computation is used for points outside the distance map and if the model is non-linearly transformed.
+  /// Suitable for static models. False by default.
+  vtkGetMacro( UseDistanceMap, bool );
+  virtual void SetUseDistanceMap(bool _arg);
+  vtkBooleanMacro( UseDistanceMap, bool );
+
+  /// Voxel size of the distance map (in model coordinate system). Smaller values give more accurate
+  /// distances but require more memory and longer computation time. Default: 1.0mm.
+  vtkGetMacro( DistanceMapSpacingMm, double );
+  virtual void SetDistanceMapSpacingMm(double _arg);
+
+  /// The distance map covers the watched model's bounding box extended by this margin. Default: 20.0mm.
+  vtkGetMacro( DistanceMapMarginMm, double );
+  virtual void SetDistanceMapMarginMm(double _arg);
+
+  /// Spatial search structure used for finding the closest point on the watched models.
+  /// The triangle BVH locator is usually the fastest for meshes with many triangles.
+  /// Default: DISTANCE_LOCATOR_CELL.
+  vtkGetMacro( DistanceLocator, int );
+  virtual void SetDistanceLocator(int _arg);
+  /// Convert between distance locator type and string (used in the scene file)
+  static const char* ConvertDistanceLocatorToString(int distanceLocator);
+  /// Returns -1 if the string does not match any locator type
+  static int ConvertDistanceLocatorFromString(const char* distanceLocatorString);
+
   /// Indicates if the warning sound is to be played.
   /// False by default.
   /// \sa SetPlayWarningSound(), GetPlayWarningSound(), PlayWarningSoundOn(), PlayWarningSoundOff()
@@ -91,6 +221,9 @@ public:
   virtual void SetPlayWarningSound(bool _arg);
 
   /// Indicates if color of the watched model should be changed.
+  /// If multiple models are watched then each breached model (see IsNthWatchedModelBreached) is displayed with
+  /// the warning color and the others with their original color. Original color of the first model is stored
+  /// in OriginalColor, original colors of the other models are restored when they are not breached anymore.
   /// True by default.
   /// \sa SetDisplayWarningColor(), GetDisplayWarningColor(), DisplayWarningColorOn(), DisplayWarningColorOff()
   vtkGetMacro( DisplayWarningColor, bool );
@@ -105,9 +238,18 @@ public:
   virtual void SetOriginalColor(double _arg[3]);
 
   /// Watched model defines the area that may breached.
+  /// If multiple models are watched then this is the first one.
   vtkMRMLModelNode* GetWatchedModelNode();
   void SetAndObserveWatchedModelNodeID( const char* modelId );
 
+  /// Multiple models can be watched by the same node (for example, all the critical structures
+  /// around the target). Distance is computed from the closest point of all the watched models
+  /// using a single spatial index, see ClosestModelIndex and GetNthWatchedModelDistance().
+  int GetNumberOfWatchedModelNodes();
+  vtkMRMLModelNode* GetNthWatchedModelNode( int n );
+  void AddAndObserveWatchedModelNodeID( const char* modelId );
+  void RemoveNthWatchedModelNode( int n );
+
   // Tool transform is interpreted as ToolTipToRas. The origin of ToolTip 
   // coordinate system is the tip of the surgical tool that needs to avoid the
   // risk area.
@@ -131,6 +273,25 @@ private:
   // the transform is inside the model.
   double ClosestDistanceToModelFromToolTip;
   double ClosestPointOnModel[3];
+  int ClosestToolSamplePointIndex;
+  int ClosestModelIndex;
+  std::vector<double> WatchedModelDistances;
+  double WatchedModelDistanceThresholdMm;
+  double MaximumReportedDistanceMm;
+  bool ClosestDistanceBeyondRange;
+  bool ClosestDistanceReady;
+  bool CheckToolTipPath;
+  bool ToolTipPathCrossedModel;
+  int ToolTipPathCrossedModelIndex;
+  double ToolTipPathCrossingPoint[3];
+  double ToolTipPathCrossingFraction;
+
+  vtkPoints* ToolSamplePoints;
+
+  bool UseDistanceMap;
+  double DistanceMapSpacingMm;
+  double DistanceMapMarginMm;
 
+  int DistanceLocator;
 };
 #endif
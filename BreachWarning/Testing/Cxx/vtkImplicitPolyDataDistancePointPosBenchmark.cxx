@@ -0,0 +1,161 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Micro-benchmark of the implicit polydata distance computation that is used in the
+// breach warning tracking loop. Reports time per query and number of heap allocations
+// per query. The query loop must not allocate heap memory.
+// Tracking of a continuously moving tool is measured both with and without using the
+// closest cell of the previous query as a starting point. No recorded tool path is available
+// in the repository, therefore a synthetic trajectory is used instead: the tip moves smoothly
+// in small steps around the model and crosses its surface repeatedly.
+
+// BreachWarning includes
+#include "vtkImplicitPolyDataDistancePointPos.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+#include <vtkTimerLog.h>
+
+// SlicerIGT testing includes
+#include "SlicerIGTTestingAllocationCounter.h"
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int vtkImplicitPolyDataDistancePointPosBenchmark(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const double sphereRadius = 50.0;
+  const int numberOfQueries = 100000;
+
+  vtkNew<vtkSphereSource> sphereSource;
+  sphereSource->SetRadius(sphereRadius);
+  sphereSource->SetThetaResolution(400);
+  sphereSource->SetPhiResolution(200);
+  sphereSource->Update();
+  vtkPolyData* model = sphereSource->GetOutput();
+
+  vtkNew<vtkImplicitPolyDataDistancePointPos> distanceEngine;
+  double startTime = vtkTimerLog::GetUniversalTime();
+  distanceEngine->SetInput(model);
+  double buildTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  // Query points around the surface (both inside and outside)
+  vtkMath::RandomSeed(1234);
+  double (*queryPoints)[3] = new double[numberOfQueries][3];
+  for (int i = 0; i < numberOfQueries; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      queryPoints[i][j] = vtkMath::Random(-1.5 * sphereRadius, 1.5 * sphereRadius);
+    }
+  }
+
+  // Warm up (temporary objects may need to grow during the first few evaluations)
+  double closestPoint[3] = { 0.0, 0.0, 0.0 };
+  for (int i = 0; i < 1000; i++)
+  {
+    distanceEngine->EvaluateFunctionAndGetClosestPoint(queryPoints[i], closestPoint);
+  }
+
+  int numberOfWrongSigns = 0;
+  unsigned long allocationsBefore = SlicerIGTTesting::GetNumberOfHeapAllocations();
+  startTime = vtkTimerLog::GetUniversalTime();
+  for (int i = 0; i < numberOfQueries; i++)
+  {
+    double distance = distanceEngine->EvaluateFunctionAndGetClosestPoint(queryPoints[i], closestPoint);
+    double distanceFromCenter = sqrt(vtkMath::Dot(queryPoints[i], queryPoints[i]));
+    // Tolerance accounts for the sphere being approximated by a triangle mesh
+    if ((distance < 0 && distanceFromCenter > sphereRadius + 0.1)
+      || (distance > 0 && distanceFromCenter < sphereRadius - 0.1))
+    {
+      numberOfWrongSigns++;
+    }
+  }
+  double queryTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+  unsigned long allocations = SlicerIGTTesting::GetNumberOfHeapAllocations() - allocationsBefore;
+
+  // Synthetic tool trajectory (substitute for a recorded tool path): tip moving smoothly around and
+  // through the surface, in small steps (similar to consecutive samples of a tracker running at a high frame rate)
+  for (int i = 0; i < numberOfQueries; i++)
+  {
+    double t = double(i) / numberOfQueries;
+    double radius = sphereRadius + 10.0 * sin(t * 40.0 * vtkMath::Pi());
+    double theta = t * 4.0 * vtkMath::Pi();
+    double phi = 0.5 * vtkMath::Pi() + 0.8 * sin(t * 6.0 * vtkMath::Pi());
+    queryPoints[i][0] = radius * sin(phi) * cos(theta);
+    queryPoints[i][1] = radius * sin(phi) * sin(theta);
+    queryPoints[i][2] = radius * cos(phi);
+  }
+
+  double* trajectoryDistances = new double[numberOfQueries];
+  startTime = vtkTimerLog::GetUniversalTime();
+  for (int i = 0; i < numberOfQueries; i++)
+  {
+    trajectoryDistances[i] = distanceEngine->EvaluateFunctionAndGetClosestPoint(queryPoints[i], closestPoint);
+  }
+  double trajectoryTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  int numberOfMismatches = 0;
+  vtkIdType closestCellIdHint = -1;
+  startTime = vtkTimerLog::GetUniversalTime();
+  for (int i = 0; i < numberOfQueries; i++)
+  {
+    double distance = distanceEngine->EvaluateFunctionAndGetClosestPointWithHint(queryPoints[i], closestCellIdHint, closestPoint);
+    if (fabs(distance - trajectoryDistances[i]) > 1e-9)
+    {
+      numberOfMismatches++;
+    }
+  }
+  double trajectoryWarmStartTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  delete[] trajectoryDistances;
+  delete[] queryPoints;
+
+  std::cout << "Number of triangles: " << model->GetNumberOfCells() << std::endl;
+  std::cout << "Locator build time: " << buildTimeSec * 1000.0 << " ms" << std::endl;
+  std::cout << "Query time: " << queryTimeSec * 1e9 / numberOfQueries << " ns/query" << std::endl;
+  std::cout << "Heap allocations: " << double(allocations) / numberOfQueries << " /query" << std::endl;
+  std::cout << "Trajectory query time: " << trajectoryTimeSec * 1e9 / numberOfQueries << " ns/query" << std::endl;
+  std::cout << "Trajectory query time with previous closest cell hint: "
+    << trajectoryWarmStartTimeSec * 1e9 / numberOfQueries << " ns/query"
+    << " (speedup: " << trajectoryTimeSec / trajectoryWarmStartTimeSec << "x)" << std::endl;
+
+  if (numberOfMismatches > 0)
+  {
+    std::cerr << "Distance computed with closest cell hint differs from full search for " << numberOfMismatches << " points" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (allocations > 0)
+  {
+    std::cerr << "Distance evaluation allocated heap memory " << allocations << " times in " << numberOfQueries << " queries" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (numberOfWrongSigns > 0)
+  {
+    std::cerr << "Inside/outside was determined incorrectly for " << numberOfWrongSigns << " points" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks that the distance is reported as not ready while the distance engine is built
+// in a background thread and that it becomes ready (with the correct value) when the build is completed.
+// Two models under different transforms are watched, so the background build has to transform
+// and append the models.
+
+// BreachWarning includes
+#include "vtkMRMLBreachWarningNode.h"
+#include "vtkSlicerBreachWarningLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+#include <vtkTimerLog.h>
+
+// VTKsys includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int vtkSlicerBreachWarningLogicBackgroundBuildTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const double maximumBuildTimeSec = 60.0;
+
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkSlicerBreachWarningLogic> logic;
+  logic->SetMRMLScene(scene.GetPointer());
+  logic->SetBuildDistanceEngineInBackground(true);
+
+  // First model: sphere at the origin, not transformed
+  vtkNew<vtkSphereSource> firstSphere;
+  firstSphere->SetRadius(50.0);
+  firstSphere->SetThetaResolution(200);
+  firstSphere->SetPhiResolution(100);
+  firstSphere->Update();
+  vtkNew<vtkMRMLModelNode> firstModel;
+  scene->AddNode(firstModel.GetPointer());
+  firstModel->SetAndObservePolyData(firstSphere->GetOutput());
+
+  // Second model: smaller sphere, translated by a parent transform
+  vtkNew<vtkSphereSource> secondSphere;
+  secondSphere->SetRadius(20.0);
+  secondSphere->SetThetaResolution(200);
+  secondSphere->SetPhiResolution(100);
+  secondSphere->Update();
+  vtkNew<vtkMRMLModelNode> secondModel;
+  scene->AddNode(secondModel.GetPointer());
+  secondModel->SetAndObservePolyData(secondSphere->GetOutput());
+  vtkNew<vtkMatrix4x4> secondModelToRas;
+  secondModelToRas->SetElement(0, 3, 200.0);
+  vtkNew<vtkMRMLLinearTransformNode> secondModelTransform;
+  scene->AddNode(secondModelTransform.GetPointer());
+  secondModelTransform->SetMatrixTransformToParent(secondModelToRas.GetPointer());
+  secondModel->SetAndObserveTransformNodeID(secondModelTransform->GetID());
+
+  // Tool tip is 10mm from the second sphere's surface
+  vtkNew<vtkMatrix4x4> toolToRas;
+  toolToRas->SetElement(0, 3, 200.0);
+  toolToRas->SetElement(2, 3, 30.0);
+  vtkNew<vtkMRMLLinearTransformNode> toolTransform;
+  scene->AddNode(toolTransform.GetPointer());
+  toolTransform->SetMatrixTransformToParent(toolToRas.GetPointer());
+
+  vtkNew<vtkMRMLBreachWarningNode> bwNode;
+  scene->AddNode(bwNode.GetPointer());
+  bwNode->AddAndObserveWatchedModelNodeID(firstModel->GetID());
+  bwNode->AddAndObserveWatchedModelNodeID(secondModel->GetID());
+  bwNode->SetAndObserveToolTransformNodeId(toolTransform->GetID());
+
+  if (!logic->HasPendingUpdates())
+  {
+    std::cerr << "Distance engine build was expected to be started in the background" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (bwNode->GetClosestDistanceReady())
+  {
+    std::cerr << "Distance was reported as ready before the distance engine build was completed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The module calls ProcessPendingUpdates periodically while the logic has pending updates
+  double startTime = vtkTimerLog::GetUniversalTime();
+  while (logic->HasPendingUpdates() && vtkTimerLog::GetUniversalTime() - startTime < maximumBuildTimeSec)
+  {
+    vtksys::SystemTools::Delay(10);
+    logic->ProcessPendingUpdates();
+  }
+
+  if (logic->HasPendingUpdates() || !bwNode->GetClosestDistanceReady())
+  {
+    std::cerr << "Distance did not become ready after the background distance engine build" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Tolerance accounts for the spheres being approximated by triangle meshes
+  if (fabs(bwNode->GetClosestDistanceToModelFromToolTip() - 10.0) > 0.1)
+  {
+    std::cerr << "Distance mismatch: expected 10.0, got " << bwNode->GetClosestDistanceToModelFromToolTip() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (bwNode->GetClosestModelIndex() != 1)
+  {
+    std::cerr << "Closest model index mismatch: expected 1, got " << bwNode->GetClosestModelIndex() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Engine is up-to-date, moving the tool must not start a new build
+  toolToRas->SetElement(2, 3, 25.0);
+  toolTransform->SetMatrixTransformToParent(toolToRas.GetPointer());
+  if (logic->HasPendingUpdates() || !bwNode->GetClosestDistanceReady()
+    || fabs(bwNode->GetClosestDistanceToModelFromToolTip() - 5.0) > 0.1)
+  {
+    std::cerr << "Distance was not updated immediately after the tool moved: " << bwNode->GetClosestDistanceToModelFromToolTip() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Compares locators that can be used by the breach warning distance computation
+// (vtkCellLocator, vtkStaticCellLocator, vtkTriangleBVHLocator) on meshes of 50k-1M triangles.
+// Reports locator build time and closest point query time, and checks that all locators
+// return the same distances as vtkCellLocator. It takes long to run, therefore it is only
+// built if SLICERIGT_BUILD_BENCHMARKS is enabled.
+
+// BreachWarning includes
+#include "vtkImplicitPolyDataDistancePointPos.h"
+#include "vtkTriangleBVHLocator.h"
+
+// VTK includes
+#include <vtkCellLocator.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTimerLog.h>
+#include <vtkVersion.h>
+#if (VTK_MAJOR_VERSION >= 9)
+#include <vtkStaticCellLocator.h>
+#endif
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Returns number of distances that differ from the reference distances
+  int RunLocatorBenchmark(const char* name, vtkAbstractCellLocator* locator, vtkPolyData* model,
+    const std::vector<double>& queryPoints, std::vector<double>& distances, const std::vector<double>* referenceDistances)
+  {
+    vtkNew<vtkImplicitPolyDataDistancePointPos> distanceEngine;
+    distanceEngine->SetLocator(locator);
+    double startTime = vtkTimerLog::GetUniversalTime();
+    distanceEngine->SetInput(model);
+    double buildTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+    int numberOfQueries = static_cast<int>(queryPoints.size() / 3);
+    distances.resize(numberOfQueries);
+    double closestPoint[3] = { 0.0, 0.0, 0.0 };
+    startTime = vtkTimerLog::GetUniversalTime();
+    for (int i = 0; i < numberOfQueries; i++)
+    {
+      double queryPoint[3] = { queryPoints[3 * i], queryPoints[3 * i + 1], queryPoints[3 * i + 2] };
+      distances[i] = distanceEngine->EvaluateFunctionAndGetClosestPoint(queryPoint, closestPoint);
+    }
+    double queryTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+    int numberOfMismatches = 0;
+    if (referenceDistances != NULL)
+    {
+      for (int i = 0; i < numberOfQueries; i++)
+      {
+        if (fabs(distances[i] - (*referenceDistances)[i]) > 1e-6)
+        {
+          numberOfMismatches++;
+        }
+      }
+    }
+
+    std::cout << "  " << name << ": build time: " << buildTimeSec * 1000.0 << " ms"
+      << ", query time: " << queryTimeSec * 1e9 / numberOfQueries << " ns/query" << std::endl;
+    if (numberOfMismatches > 0)
+    {
+      std::cerr << "  " << name << ": distance differs from vtkCellLocator for " << numberOfMismatches << " points" << std::endl;
+    }
+    return numberOfMismatches;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLocatorBenchmark(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const double sphereRadius = 50.0;
+  const int numberOfQueries = 20000;
+  // Sphere resolutions (theta, phi) resulting in approximately 50k, 250k, and 1M triangles
+  const int resolutions[3][2] = { { 250, 100 }, { 500, 250 }, { 1000, 500 } };
+
+  vtkMath::RandomSeed(1234);
+  std::vector<double> queryPoints(3 * numberOfQueries);
+  for (int i = 0; i < 3 * numberOfQueries; i++)
+  {
+    queryPoints[i] = vtkMath::Random(-1.5 * sphereRadius, 1.5 * sphereRadius);
+  }
+
+  int numberOfMismatches = 0;
+  for (int meshIndex = 0; meshIndex < 3; meshIndex++)
+  {
+    vtkNew<vtkSphereSource> sphereSource;
+    sphereSource->SetRadius(sphereRadius);
+    sphereSource->SetThetaResolution(resolutions[meshIndex][0]);
+    sphereSource->SetPhiResolution(resolutions[meshIndex][1]);
+    sphereSource->Update();
+    vtkPolyData* model = sphereSource->GetOutput();
+    std::cout << "Number of triangles: " << model->GetNumberOfCells() << std::endl;
+
+    std::vector<double> referenceDistances;
+    std::vector<double> distances;
+
+    vtkNew<vtkCellLocator> cellLocator;
+    cellLocator->SetNumberOfCellsPerBucket(10);
+    RunLocatorBenchmark("vtkCellLocator", cellLocator.GetPointer(), model, queryPoints, referenceDistances, NULL);
+
+#if (VTK_MAJOR_VERSION >= 9)
+    vtkNew<vtkStaticCellLocator> staticCellLocator;
+    numberOfMismatches += RunLocatorBenchmark("vtkStaticCellLocator", staticCellLocator.GetPointer(), model, queryPoints, distances, &referenceDistances);
+#endif
+
+    vtkNew<vtkTriangleBVHLocator> bvhLocator;
+    numberOfMismatches += RunLocatorBenchmark("vtkTriangleBVHLocator", bvhLocator.GetPointer(), model, queryPoints, distances, &referenceDistances);
+    std::cout << "  vtkTriangleBVHLocator: number of nodes: " << bvhLocator->GetNumberOfNodes()
+      << ", depth: " << bvhLocator->GetLevel() << std::endl;
+  }
+
+  if (numberOfMismatches > 0)
+  {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -161,4 +161,126 @@ class BreachWarningSelfTestTest(ScriptedLoadableModuleTest):
     sphereColor = sphereModel.GetDisplayNode().GetColor()
     self.assertNotEqual(sphereColor, warningColor)
 
+    self.delayDisplay('Tool tip is outside the sphere but the tool shaft goes through it')
+    bwNode = slicer.mrmlScene.GetNthNodeByClass(0, 'vtkMRMLBreachWarningNode')
+    shaftEndPoint_Tool = [-sphereRadius*2.1, -sphereRadius*1.3, -sphereRadius*3.2]
+    bwNode.SetToolSamplePointsAlongSegment([0,0,0], shaftEndPoint_Tool, 20)
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertEqual(sphereColor, warningColor)
+    self.assertGreater(bwNode.GetClosestToolSamplePointIndex(), 0)
+
+    self.delayDisplay('Only the tool tip is checked')
+    bwNode.RemoveAllToolSamplePoints()
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertNotEqual(sphereColor, warningColor)
+
+    self.delayDisplay('Distance is interpolated from a distance map')
+    bwNode.SetUseDistanceMap(True)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertEqual(sphereColor, warningColor)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertNotEqual(sphereColor, warningColor)
+    bwNode.SetUseDistanceMap(False)
+
+    self.delayDisplay('Distance is computed using a triangle BVH locator')
+    distanceWithCellLocator = bwNode.GetClosestDistanceToModelFromToolTip()
+    bwNode.SetDistanceLocator(slicer.vtkMRMLBreachWarningNode.DISTANCE_LOCATOR_TRIANGLE_BVH)
+    self.assertAlmostEqual(bwNode.GetClosestDistanceToModelFromToolTip(), distanceWithCellLocator)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertEqual(sphereColor, warningColor)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    bwNode.SetDistanceLocator(slicer.vtkMRMLBreachWarningNode.DISTANCE_LOCATOR_CELL)
+
+    self.delayDisplay('Tool moves through the sphere between two updates')
+    transformMatrixOppositeSide = vtk.vtkMatrix4x4()
+    transformMatrixOppositeSide.DeepCopy(sphereTransformMatrix)
+    for i in range(3):
+      transformMatrixOppositeSide.SetElement(i, 3, 2*sphereTransformMatrix.GetElement(i, 3) - transformMatrixOutside.GetElement(i, 3))
+    bwNode.SetCheckToolTipPath(True)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOppositeSide)
+    self.assertFalse(bwNode.IsToolTipInsideModel())
+    self.assertTrue(bwNode.GetToolTipPathCrossedModel())
+    self.assertGreater(bwNode.GetToolTipPathCrossingFraction(), 0.0)
+    self.assertLess(bwNode.GetToolTipPathCrossingFraction(), 0.5)
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertEqual(sphereColor, warningColor)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside) # moves through the sphere again
+    self.assertTrue(bwNode.GetToolTipPathCrossedModel())
+    bwNode.SetCheckToolTipPath(False)
+    self.assertFalse(bwNode.GetToolTipPathCrossedModel())
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertNotEqual(sphereColor, warningColor)
+
+    self.delayDisplay('Distance is only reported within a maximum distance')
+    slicer.modules.breachwarning.logic().SetLineToClosestPointVisibility(True, bwNode)
+    lineToClosestPoint = bwNode.GetLineToClosestPointNode()
+    bwNode.SetMaximumReportedDistanceMm(5.0)
+    self.assertTrue(bwNode.GetClosestDistanceBeyondRange())
+    self.assertFalse(bwNode.IsToolTipInsideModel())
+    # Closest point is unknown: it is set to the tool tip and the line to the closest point is hidden
+    for i in range(3):
+      self.assertAlmostEqual(bwNode.GetClosestPointOnModel()[i], transformMatrixOutside.GetElement(i, 3))
+    self.assertFalse(lineToClosestPoint.GetDisplayVisibility())
+    self.assertTrue(slicer.modules.breachwarning.logic().GetLineToClosestPointVisibility(bwNode))
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+    self.assertFalse(bwNode.GetClosestDistanceBeyondRange())
+    self.assertTrue(bwNode.IsToolTipInsideModel())
+    self.assertTrue(lineToClosestPoint.GetDisplayVisibility())
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    bwNode.SetMaximumReportedDistanceMm(0.0)
+    self.assertFalse(bwNode.GetClosestDistanceBeyondRange())
+    self.assertTrue(lineToClosestPoint.GetDisplayVisibility())
+
+    self.delayDisplay('Updates are coalesced when update rate is limited')
+    bwLogic = slicer.modules.breachwarning.logic()
+    bwLogic.SetMaximumUpdateRateHz(10.0)
+    bwLogic.ResetNumberOfSkippedUpdates(bwNode)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+    self.assertGreater(bwLogic.GetNumberOfSkippedUpdates(bwNode), 0)
+    bwLogic.ProcessPendingUpdates()
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertEqual(sphereColor, warningColor)
+    toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    bwLogic.SetMaximumUpdateRateHz(0.0)
+    sphereColor = sphereModel.GetDisplayNode().GetColor()
+    self.assertNotEqual(sphereColor, warningColor)
+
+    self.delayDisplay('Performance statistics are collected')
+    bwLogic.ResetStatistics(bwNode)
+    for i in range(5):
+      toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+      toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    self.assertEqual(bwLogic.GetNumberOfEvaluations(bwNode), 10)
+    self.assertEqual(bwLogic.GetNumberOfLocatorBuilds(bwNode), 0) # watched model has not changed
+    self.assertLessEqual(bwLogic.GetMinimumEvaluationTimeSec(bwNode), bwLogic.GetMeanEvaluationTimeSec(bwNode))
+    self.assertLessEqual(bwLogic.GetMeanEvaluationTimeSec(bwNode), bwLogic.GetEvaluationTimePercentileSec(bwNode, 100))
+    self.delayDisplay('Breach warning evaluation time: min={0:.3f}ms mean={1:.3f}ms p99={2:.3f}ms'.format(
+      bwLogic.GetMinimumEvaluationTimeSec(bwNode)*1000, bwLogic.GetMeanEvaluationTimeSec(bwNode)*1000,
+      bwLogic.GetEvaluationTimePercentileSec(bwNode, 99)*1000))
+
+    self.delayDisplay('Multiple models are watched')
+    secondSphereModel = createModelsLogic.CreateSphere(sphereRadius)
+    secondSphereOriginalColor = secondSphereModel.GetDisplayNode().GetColor()
+    secondSphereTransform = slicer.vtkMRMLLinearTransformNode()
+    secondSphereTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    slicer.mrmlScene.AddNode(secondSphereTransform)
+    secondSphereModel.SetAndObserveTransformNodeID(secondSphereTransform.GetID())
+    bwNode.AddAndObserveWatchedModelNodeID(secondSphereModel.GetID())
+    self.assertEqual(bwNode.GetNumberOfWatchedModelNodes(), 2)
+    self.assertEqual(bwNode.GetClosestModelIndex(), 1)
+    self.assertTrue(bwNode.IsToolTipInsideModel())
+    self.assertLess(bwNode.GetNthWatchedModelDistance(1), 0)
+    # Only the breached model is displayed with the warning color
+    self.assertEqual(secondSphereModel.GetDisplayNode().GetColor(), warningColor)
+    self.assertNotEqual(sphereModel.GetDisplayNode().GetColor(), warningColor)
+    bwNode.RemoveNthWatchedModelNode(1)
+    self.assertEqual(bwNode.GetClosestModelIndex(), 0)
+    self.assertFalse(bwNode.IsToolTipInsideModel())
+    self.assertEqual(secondSphereModel.GetDisplayNode().GetColor(), secondSphereOriginalColor)
+
     self.delayDisplay('Test passed!')
@@ -23,6 +23,9 @@
 #include <QTimer>
 #include <QtPlugin>
 
+// STD includes
+#include <algorithm>
+
 #include "qSlicerApplication.h"
 
 // BreachWarning Logic includes
@@ -44,6 +47,7 @@ public:
 
   vtkSlicerBreachWarningLogic* ObservedLogic; // should be the same as logic(), it is used for adding/removing observer safely
   QTimer UpdateWarningSoundTimer;
+  QTimer ProcessPendingUpdatesTimer;
   QPointer<QSound> WarningSound;
   double WarningSoundPeriodSec;
 };
@@ -90,7 +94,9 @@ qSlicerBreachWarningModule::~qSlicerBreachWarningModule()
     d->WarningSound->stop();
   }
   disconnect(&d->UpdateWarningSoundTimer, SIGNAL(timeout()), this, SLOT(updateWarningSound()));
+  disconnect(&d->ProcessPendingUpdatesTimer, SIGNAL(timeout()), this, SLOT(processPendingUpdates()));
   this->qvtkReconnect(d->ObservedLogic, NULL, vtkCommand::ModifiedEvent, this, SLOT(updateWarningSound()));
+  this->qvtkReconnect(d->ObservedLogic, NULL, vtkSlicerBreachWarningLogic::PendingUpdatesRequestedEvent, this, SLOT(onPendingUpdatesRequested()));
   d->ObservedLogic = NULL;
 }
 
@@ -142,10 +148,15 @@ void qSlicerBreachWarningModule::setup()
   }
 
   this->qvtkReconnect(d->ObservedLogic, moduleLogic, vtkCommand::ModifiedEvent, this, SLOT(updateWarningSound()));
+  this->qvtkReconnect(d->ObservedLogic, moduleLogic, vtkSlicerBreachWarningLogic::PendingUpdatesRequestedEvent, this, SLOT(onPendingUpdatesRequested()));
   d->ObservedLogic = moduleLogic;
 
   d->UpdateWarningSoundTimer.setSingleShot(true);
   connect(&d->UpdateWarningSoundTimer, SIGNAL(timeout()), this, SLOT(updateWarningSound()));
+
+  d->ProcessPendingUpdatesTimer.setSingleShot(true);
+  connect(&d->ProcessPendingUpdatesTimer, SIGNAL(timeout()), this, SLOT(processPendingUpdates()));
+  // Timer is started when the logic reports pending work (see onPendingUpdatesRequested)
 }
 
 //-----------------------------------------------------------------------------
@@ -188,6 +199,46 @@ void qSlicerBreachWarningModule::updateWarningSound()
 }
 
 
+//------------------------------------------------------------------------------
+int qSlicerBreachWarningModule::pendingUpdatesPeriodMsec()
+{
+  Q_D(qSlicerBreachWarningModule);
+  // If updates are not throttled then only distance engines built in the background have to be checked
+  int updatePeriodMsec = 100;
+  if (d->ObservedLogic!=NULL && d->ObservedLogic->GetMaximumUpdateRateHz()>0)
+  {
+    updatePeriodMsec = std::max(1, int(1000.0/d->ObservedLogic->GetMaximumUpdateRateHz()));
+  }
+  return updatePeriodMsec;
+}
+
+//------------------------------------------------------------------------------
+void qSlicerBreachWarningModule::onPendingUpdatesRequested()
+{
+  Q_D(qSlicerBreachWarningModule);
+  if (!d->ProcessPendingUpdatesTimer.isActive())
+  {
+    d->ProcessPendingUpdatesTimer.start(this->pendingUpdatesPeriodMsec());
+  }
+}
+
+//------------------------------------------------------------------------------
+void qSlicerBreachWarningModule::processPendingUpdates()
+{
+  Q_D(qSlicerBreachWarningModule);
+  if (d->ObservedLogic==NULL)
+  {
+    return;
+  }
+  d->ObservedLogic->ProcessPendingUpdates();
+  // Keep polling only while there is work left (e.g., a distance engine is still being built),
+  // otherwise the timer is restarted by the next onPendingUpdatesRequested call.
+  if (d->ObservedLogic->HasPendingUpdates() && !d->ProcessPendingUpdatesTimer.isActive())
+  {
+    d->ProcessPendingUpdatesTimer.start(this->pendingUpdatesPeriodMsec());
+  }
+}
+
 //------------------------------------------------------------------------------
 void qSlicerBreachWarningModule::stopSound()
 {
@@ -78,8 +78,17 @@ public slots:
   void updateWarningSound();
   void stopSound();
 
+  /// Update breach warning nodes that have changed inputs (when updates are throttled in the logic)
+  void processPendingUpdates();
+
+  /// Start the pending updates timer (called when the logic has new pending work)
+  void onPendingUpdatesRequested();
+
 protected:
 
+  /// Time between ProcessPendingUpdates calls (based on the logic's maximum update rate)
+  int pendingUpdatesPeriodMsec();
+
   /// Initialize the module. Register the volumes reader/writer
   virtual void setup();
 
@@ -25,12 +25,15 @@
 // VTK includes
 #include <vtkNew.h>
 #include <vtkSmartPointer.h>
+#include <vtkCollection.h>
 #include <vtkCommand.h>
+#include <vtkMath.h>
 #include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
 #include <vtkObjectFactory.h>
-#include <vtkTransform.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -43,6 +46,268 @@
 
 static const double PARALLEL_ANGLE_THRESHOLD_DEGREES = 20.0;
 
+// Directions with singular value below this threshold are ignored in the pivot calibration solution
+static const double PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD = 1e-1;
+
+// If the bounds of the streaming maximum orientation difference are not conclusive then it is recomputed
+// from all the stored poses at most once per this fraction of the number of stored poses added
+// (so that the amortized cost per pose does not depend on the number of stored poses)
+static const double STREAMING_ORIENTATION_RECOMPUTE_INTERVAL_FRACTION = 0.1;
+
+//----------------------------------------------------------------------------
+// Solve the 6x6 symmetric normal equations N*x=v. Directions with eigenvalue below minimumEigenvalue
+// are ignored (pseudo-inverse), which is equivalent to zeroing out the small singular values of A in A*x=b.
+// If pseudoInverse is not NULL then the pseudo-inverse of N is returned in it.
+// Returns the number of directions that were not ignored (rank of N).
+static int SolveNormalEquations6(double normalMatrix[6][6], double normalVector[6], double minimumEigenvalue, double x[6],
+  double (*pseudoInverse)[6]=NULL)
+{
+  double a[6][6];
+  double eigenvectors[6][6];
+  double eigenvalues[6];
+  double* aRows[6];
+  double* eigenvectorRows[6];
+  for (int i = 0; i < 6; i++)
+  {
+    for (int j = 0; j < 6; j++)
+    {
+      a[i][j] = normalMatrix[i][j];
+    }
+    aRows[i] = a[i];
+    eigenvectorRows[i] = eigenvectors[i];
+    x[i] = 0.0;
+    if (pseudoInverse != NULL)
+    {
+      std::fill(pseudoInverse[i], pseudoInverse[i] + 6, 0.0);
+    }
+  }
+  vtkMath::JacobiN(aRows, 6, eigenvalues, eigenvectorRows); // eigenvectors are stored in columns
+  int rank = 0;
+  for (int k = 0; k < 6; k++)
+  {
+    if (eigenvalues[k] < minimumEigenvalue)
+    {
+      continue;
+    }
+    rank++;
+    double projection = 0.0;
+    for (int i = 0; i < 6; i++)
+    {
+      projection += eigenvectors[i][k] * normalVector[i];
+    }
+    projection /= eigenvalues[k];
+    for (int i = 0; i < 6; i++)
+    {
+      x[i] += projection * eigenvectors[i][k];
+    }
+    if (pseudoInverse != NULL)
+    {
+      for (int i = 0; i < 6; i++)
+      {
+        for (int j = 0; j < 6; j++)
+        {
+          pseudoInverse[i][j] += eigenvectors[i][k] * eigenvectors[j][k] / eigenvalues[k];
+        }
+      }
+    }
+  }
+  return rank;
+}
+
+//----------------------------------------------------------------------------
+// Each tool pose adds 3 rows to the pivot calibration linear system A*x=b:
+// [ R -I ] * [ toolTipToTool; pivotPointToReference ] = -t
+// This function adds weight * (A^T*A, A^T*b, b^T*b) of these rows to the normal equations.
+static void AddPoseToPivotNormalEquations(const double r[3][3], const double t[3], double weight,
+  double normalMatrix[6][6], double normalVector[6], double& sumSquaredTranslations)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      // R^T*R
+      normalMatrix[i][j] += weight * (r[0][i] * r[0][j] + r[1][i] * r[1][j] + r[2][i] * r[2][j]);
+      // -R^T and -R
+      normalMatrix[i][j + 3] -= weight * r[j][i];
+      normalMatrix[i + 3][j] -= weight * r[i][j];
+    }
+    // I
+    normalMatrix[i + 3][i + 3] += weight;
+    // R^T*(-t) and (-I)*(-t)
+    normalVector[i] -= weight * (r[0][i] * t[0] + r[1][i] * t[1] + r[2][i] * t[2]);
+    normalVector[i + 3] += weight * t[i];
+  }
+  sumSquaredTranslations += weight * (t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+}
+
+//----------------------------------------------------------------------------
+// Distance between the pivot point and the tool tip position computed from the tool pose.
+// x contains the tool tip position in the tool coordinate system (x[0..2]) and the pivot point position (x[3..5]).
+static double GetPivotResidualMm(const double r[3][3], const double t[3], const double x[6])
+{
+  double distance2 = 0.0;
+  for (int i = 0; i < 3; i++)
+  {
+    double d = r[i][0] * x[0] + r[i][1] * x[1] + r[i][2] * x[2] + t[i] - x[i + 3];
+    distance2 += d * d;
+  }
+  return sqrt(distance2);
+}
+
+//----------------------------------------------------------------------------
+// Get the pose index grid cell of a rotation. Quaternion sign is chosen so that w>=0.
+// Returns the w component of the quaternion.
+static double GetPoseIndexCell(const double rotation[3][3], double cellSize, int cell[3], bool flipSign=false)
+{
+  double quaternion[4];
+  vtkMath::Matrix3x3ToQuaternion(rotation, quaternion);
+  double sign = (quaternion[0] < 0) ? -1.0 : 1.0;
+  if (flipSign)
+  {
+    sign = -sign;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    cell[i] = static_cast<int>(floor(sign * quaternion[i + 1] / cellSize));
+  }
+  return fabs(quaternion[0]);
+}
+
+//----------------------------------------------------------------------------
+// Get the pose index grid cell size for the minimum pose orientation difference.
+// Distance between unit quaternions of rotations that differ by angle a is 2*sin(a/4),
+// therefore similar poses are always in the same or a neighbor cell.
+// Cell size has a lower limit to keep the number of cells (and the cell index range) bounded.
+static double GetPoseIndexCellSize(double minimumOrientationDifferenceDeg)
+{
+  return std::max(2.0 * sin(vtkMath::RadiansFromDegrees(minimumOrientationDifferenceDeg) / 4.0), 1e-3);
+}
+
+//----------------------------------------------------------------------------
+static vtkTypeInt64 GetPoseIndexKey(const int cell[3])
+{
+  // Cell indices are within +/- 2^20 (cell size is limited), so they can be packed into 21 bits each
+  const vtkTypeInt64 offset = 1 << 20;
+  return ((cell[0] + offset) << 42) | ((cell[1] + offset) << 21) | (cell[2] + offset);
+}
+
+//----------------------------------------------------------------------------
+// Robust pivot calibration: RANSAC hypotheses are computed from minimal sets of 3 poses.
+// Each thread evaluates every NumberOfThreads-th hypothesis and keeps its best one.
+struct RobustPivotHypothesisJob
+{
+  // Rotation (row-major) and translation of each pose, 12 values per pose
+  std::vector<double> Poses;
+  // Indices of the 3 poses of each hypothesis
+  std::vector<int> SubsetIndices;
+  double InlierThresholdMm;
+  double MinimumEigenvalue;
+  // Best solution (6 values) and its cost for each thread
+  std::vector<double> BestSolutions;
+  std::vector<double> BestCosts;
+};
+
+//----------------------------------------------------------------------------
+// Compute tool tip and pivot point from 3 poses. Tool tip position p is the same in all poses, therefore
+// (R_k - R_0) * p = t_0 - t_k for k=1,2. Returns false if the rotations are not diverse enough to determine p.
+static bool ComputeMinimalPivotSolution(const double* poses[3], double minimumEigenvalue, double x[6])
+{
+  double normalMatrix[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  double normalVector[3] = { 0.0, 0.0, 0.0 };
+  for (int k = 1; k < 3; k++)
+  {
+    double d[3][3];
+    double e[3];
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        d[i][j] = poses[k][i * 3 + j] - poses[0][i * 3 + j];
+      }
+      e[i] = poses[0][9 + i] - poses[k][9 + i];
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        normalMatrix[i][j] += d[0][i] * d[0][j] + d[1][i] * d[1][j] + d[2][i] * d[2][j];
+      }
+      normalVector[i] += d[0][i] * e[0] + d[1][i] * e[1] + d[2][i] * e[2];
+    }
+  }
+  // Jacobi modifies the input matrix, therefore a copy is passed
+  double a[3][3];
+  double eigenvectors[3][3];
+  double eigenvalues[3];
+  double* aRows[3] = { a[0], a[1], a[2] };
+  double* eigenvectorRows[3] = { eigenvectors[0], eigenvectors[1], eigenvectors[2] };
+  std::copy(&(normalMatrix[0][0]), &(normalMatrix[0][0]) + 9, &(a[0][0]));
+  vtkMath::Jacobi(aRows, eigenvalues, eigenvectorRows); // eigenvalues are sorted in decreasing order
+  if (eigenvalues[2] < minimumEigenvalue)
+  {
+    return false;
+  }
+  double inverse[3][3];
+  vtkMath::Invert3x3(normalMatrix, inverse);
+  vtkMath::Multiply3x3(inverse, normalVector, x);
+  // Pivot point is the mean of the tool tip positions
+  for (int i = 0; i < 3; i++)
+  {
+    x[i + 3] = 0.0;
+    for (int k = 0; k < 3; k++)
+    {
+      const double* pose = poses[k];
+      x[i + 3] += (pose[i * 3] * x[0] + pose[i * 3 + 1] * x[1] + pose[i * 3 + 2] * x[2] + pose[9 + i]) / 3.0;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE RobustPivotHypothesisThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  RobustPivotHypothesisJob* job = static_cast< RobustPivotHypothesisJob* >( threadInfo->UserData );
+  int threadId = threadInfo->ThreadID;
+  int numberOfThreads = threadInfo->NumberOfThreads;
+
+  int numberOfPoses = static_cast<int>(job->Poses.size() / 12);
+  int numberOfHypotheses = static_cast<int>(job->SubsetIndices.size() / 3);
+  double thresholdSquared = job->InlierThresholdMm * job->InlierThresholdMm;
+  for (int hypothesisIndex = threadId; hypothesisIndex < numberOfHypotheses; hypothesisIndex += numberOfThreads)
+  {
+    const double* subsetPoses[3];
+    for (int k = 0; k < 3; k++)
+    {
+      subsetPoses[k] = &(job->Poses[12 * job->SubsetIndices[3 * hypothesisIndex + k]]);
+    }
+    double x[6];
+    if (!ComputeMinimalPivotSolution(subsetPoses, job->MinimumEigenvalue, x))
+    {
+      continue;
+    }
+    // MSAC cost: outliers contribute a constant cost, inliers their squared residual
+    double cost = 0.0;
+    for (int poseIndex = 0; poseIndex < numberOfPoses && cost < job->BestCosts[threadId]; poseIndex++)
+    {
+      const double* pose = &(job->Poses[12 * poseIndex]);
+      double distance2 = 0.0;
+      for (int i = 0; i < 3; i++)
+      {
+        double d = pose[i * 3] * x[0] + pose[i * 3 + 1] * x[1] + pose[i * 3 + 2] * x[2] + pose[9 + i] - x[i + 3];
+        distance2 += d * d;
+      }
+      cost += std::min(distance2, thresholdSquared);
+    }
+    if (cost < job->BestCosts[threadId])
+    {
+      job->BestCosts[threadId] = cost;
+      std::copy(x, x + 6, job->BestSolutions.begin() + 6 * threadId);
+    }
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerPivotCalibrationLogic);
 
@@ -50,8 +315,29 @@ vtkStandardNewMacro(vtkSlicerPivotCalibrationLogic);
 vtkSlicerPivotCalibrationLogic::vtkSlicerPivotCalibrationLogic()
 {
   this->ToolTipToToolMatrix = vtkMatrix4x4::New();
+  this->ObservedToolToReferenceMatrix = vtkMatrix4x4::New();
   this->ObservedTransformNode = NULL;
+  this->FirstToolToReferencePoseIndex = 0;
+  this->MaximumNumberOfToolToReferenceMatrices = 0;
+  this->PoseDiversityFilterEnabled = false;
+  this->MinimumPosePositionDifferenceMm = 1.0;
+  this->ConvergenceMinimumNumberOfSamples = 100;
+  this->ConvergenceToolTipUncertaintyThresholdMm = 0.2;
+  this->ConvergenceRMSEThresholdMm = 1.0;
+  this->NumberOfRejectedToolToReferenceMatrices = 0;
+  this->MinimumPoseOrientationDifferenceDeg = 2.0;
+  this->PoseIndexCellSize = GetPoseIndexCellSize(this->MinimumPoseOrientationDifferenceDeg);
   this->MinimumOrientationDifferenceDeg = 15.0;
+  this->RobustInlierThresholdMm = 1.0;
+  this->RobustNumberOfHypotheses = 500;
+  this->PivotInlierRatio = 0.0;
+  this->PivotRMSE = 0.0;
+  this->SpinRMSE = 0.0;
+  for (int i = 0; i < 3; i++)
+  {
+    this->PivotPointToReference[i] = 0.0;
+  }
+  this->ResetStreamingPivotCalibration();
 }
 
 //----------------------------------------------------------------------------
@@ -59,6 +345,7 @@ vtkSlicerPivotCalibrationLogic::~vtkSlicerPivotCalibrationLogic()
 {
   this->ClearToolToReferenceMatrices();
   this->ToolTipToToolMatrix->Delete();
+  this->ObservedToolToReferenceMatrix->Delete();
   this->SetAndObserveTransformNode( NULL ); // Remove the observer
 }
 
@@ -76,9 +363,8 @@ void vtkSlicerPivotCalibrationLogic::ProcessMRMLNodesEvents(vtkObject* caller, u
     vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(caller);
     if ( event == vtkMRMLLinearTransformNode::TransformModifiedEvent && this->RecordingState == true && strcmp( transformNode->GetID(), this->ObservedTransformNode->GetID() ) == 0 )
     {
-      vtkMatrix4x4* matrixCopy = vtkMatrix4x4::New();
-      transformNode->GetMatrixTransformToParent(matrixCopy);      
-      this->AddToolToReferenceMatrix(matrixCopy);
+      transformNode->GetMatrixTransformToParent(this->ObservedToolToReferenceMatrix);
+      this->AddToolToReferenceMatrix(this->ObservedToolToReferenceMatrix);
     }
   }
 }
@@ -94,39 +380,542 @@ void vtkSlicerPivotCalibrationLogic::SetAndObserveTransformNode( vtkMRMLLinearTr
 //---------------------------------------------------------------------------
 void vtkSlicerPivotCalibrationLogic::AddToolToReferenceMatrix(vtkMatrix4x4* transformMatrix)
 {
-  this->ToolToReferenceMatrices.push_back(transformMatrix);
+  if (transformMatrix == NULL)
+  {
+    vtkErrorMacro("AddToolToReferenceMatrix failed: invalid matrix");
+    return;
+  }
+  RigidPose pose;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      pose.Rotation[i][j] = transformMatrix->GetElement(i, j);
+    }
+    pose.Translation[i] = transformMatrix->GetElement(i, 3);
+  }
+
+  if (this->PoseDiversityFilterEnabled && !this->IsPoseDiverse(pose))
+  {
+    this->NumberOfRejectedToolToReferenceMatrices++;
+    return;
+  }
+
+  if (this->MaximumNumberOfToolToReferenceMatrices > 0
+    && static_cast<int>(this->ToolToReferencePoses.size()) >= this->MaximumNumberOfToolToReferenceMatrices)
+  {
+    // Buffer is full, overwrite the oldest pose
+    int storageIndex = this->FirstToolToReferencePoseIndex;
+    RigidPose& oldestPose = this->ToolToReferencePoses[storageIndex];
+    this->UpdateStreamingPivotCalibration(oldestPose, -1.0);
+    this->RemovePoseFromPoseIndex(storageIndex);
+    oldestPose = pose;
+    this->AddPoseToPoseIndex(storageIndex);
+    this->FirstToolToReferencePoseIndex = (this->FirstToolToReferencePoseIndex + 1) % static_cast<int>(this->ToolToReferencePoses.size());
+  }
+  else
+  {
+    this->ToolToReferencePoses.push_back(pose);
+    this->AddPoseToPoseIndex(static_cast<int>(this->ToolToReferencePoses.size()) - 1);
+  }
+  this->UpdateStreamingPivotCalibration(pose);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetPoseDiversityFilterEnabled(bool enabled)
+{
+  if (this->PoseDiversityFilterEnabled == enabled)
+  {
+    return;
+  }
+  this->PoseDiversityFilterEnabled = enabled;
+  this->RebuildPoseIndex();
+  this->Modified();
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::ClearToolToReferenceMatrices()
+void vtkSlicerPivotCalibrationLogic::SetMinimumPoseOrientationDifferenceDeg(double differenceDeg)
 {
-  std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  for(it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++)
+  if (this->MinimumPoseOrientationDifferenceDeg == differenceDeg)
   {
-    (*it)->Delete();
+    return;
   }
-  this->ToolToReferenceMatrices.clear();
+  this->MinimumPoseOrientationDifferenceDeg = differenceDeg;
+  this->PoseIndexCellSize = GetPoseIndexCellSize(differenceDeg);
+  this->RebuildPoseIndex();
+  this->Modified();
 }
 
-//----------------------------------------------------------------------------
-double vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix)
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::IsPoseDiverse(const RigidPose& pose)
+{
+  double minimumCosAngle = cos(vtkMath::RadiansFromDegrees(this->MinimumPoseOrientationDifferenceDeg));
+  double minimumDistance2 = this->MinimumPosePositionDifferenceMm * this->MinimumPosePositionDifferenceMm;
+
+  // Quaternions with w close to 0 may be stored with either sign, check both
+  int cell[3];
+  double w = GetPoseIndexCell(pose.Rotation, this->PoseIndexCellSize, cell);
+  int numberOfSigns = (w < this->PoseIndexCellSize) ? 2 : 1;
+  for (int signIndex = 0; signIndex < numberOfSigns; signIndex++)
+  {
+    if (signIndex > 0)
+    {
+      GetPoseIndexCell(pose.Rotation, this->PoseIndexCellSize, cell, true);
+    }
+    int neighborCell[3];
+    for (neighborCell[0] = cell[0] - 1; neighborCell[0] <= cell[0] + 1; neighborCell[0]++)
+    {
+      for (neighborCell[1] = cell[1] - 1; neighborCell[1] <= cell[1] + 1; neighborCell[1]++)
+      {
+        for (neighborCell[2] = cell[2] - 1; neighborCell[2] <= cell[2] + 1; neighborCell[2]++)
+        {
+          std::map< vtkTypeInt64, std::vector< int > >::iterator cellIt = this->PoseIndex.find(GetPoseIndexKey(neighborCell));
+          if (cellIt == this->PoseIndex.end())
+          {
+            continue;
+          }
+          for (std::vector< int >::iterator poseIt = cellIt->second.begin(); poseIt != cellIt->second.end(); ++poseIt)
+          {
+            const RigidPose& storedPose = this->ToolToReferencePoses[*poseIt];
+            double distance2 = vtkMath::Distance2BetweenPoints(pose.Translation, storedPose.Translation);
+            if (distance2 >= minimumDistance2)
+            {
+              continue;
+            }
+            // trace(Ra^T*Rb) = 1 + 2*cos(angle)
+            double trace = 0.0;
+            for (int i = 0; i < 3; i++)
+            {
+              trace += pose.Rotation[i][0] * storedPose.Rotation[i][0]
+                + pose.Rotation[i][1] * storedPose.Rotation[i][1]
+                + pose.Rotation[i][2] * storedPose.Rotation[i][2];
+            }
+            if ((trace - 1.0) / 2.0 > minimumCosAngle)
+            {
+              return false;
+            }
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AddPoseToPoseIndex(int storageIndex)
+{
+  if (!this->PoseDiversityFilterEnabled)
+  {
+    return;
+  }
+  int cell[3];
+  GetPoseIndexCell(this->ToolToReferencePoses[storageIndex].Rotation, this->PoseIndexCellSize, cell);
+  this->PoseIndex[GetPoseIndexKey(cell)].push_back(storageIndex);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::RemovePoseFromPoseIndex(int storageIndex)
+{
+  if (!this->PoseDiversityFilterEnabled)
+  {
+    return;
+  }
+  int cell[3];
+  GetPoseIndexCell(this->ToolToReferencePoses[storageIndex].Rotation, this->PoseIndexCellSize, cell);
+  std::map< vtkTypeInt64, std::vector< int > >::iterator cellIt = this->PoseIndex.find(GetPoseIndexKey(cell));
+  if (cellIt == this->PoseIndex.end())
+  {
+    return;
+  }
+  cellIt->second.erase(std::remove(cellIt->second.begin(), cellIt->second.end(), storageIndex), cellIt->second.end());
+  if (cellIt->second.empty())
+  {
+    this->PoseIndex.erase(cellIt);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::RebuildPoseIndex()
+{
+  this->PoseIndex.clear();
+  for (int storageIndex = 0; storageIndex < static_cast<int>(this->ToolToReferencePoses.size()); storageIndex++)
+  {
+    this->AddPoseToPoseIndex(storageIndex);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ReserveToolToReferenceMatrices(int numberOfMatrices)
+{
+  if (numberOfMatrices > 0)
+  {
+    this->ToolToReferencePoses.reserve(numberOfMatrices);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetMaximumNumberOfToolToReferenceMatrices(int maximumNumberOfMatrices)
+{
+  if (maximumNumberOfMatrices < 0)
+  {
+    maximumNumberOfMatrices = 0;
+  }
+  if (this->MaximumNumberOfToolToReferenceMatrices == maximumNumberOfMatrices)
+  {
+    return;
+  }
+  this->MaximumNumberOfToolToReferenceMatrices = maximumNumberOfMatrices;
+
+  // Store poses in chronological order, so that new poses can be appended
+  std::rotate(this->ToolToReferencePoses.begin(), this->ToolToReferencePoses.begin() + this->FirstToolToReferencePoseIndex,
+    this->ToolToReferencePoses.end());
+  this->FirstToolToReferencePoseIndex = 0;
+
+  if (maximumNumberOfMatrices > 0 && static_cast<int>(this->ToolToReferencePoses.size()) > maximumNumberOfMatrices)
+  {
+    // Remove the oldest poses
+    int numberOfRemovedPoses = static_cast<int>(this->ToolToReferencePoses.size()) - maximumNumberOfMatrices;
+    for (int i = 0; i < numberOfRemovedPoses; i++)
+    {
+      this->UpdateStreamingPivotCalibration(this->ToolToReferencePoses[i], -1.0);
+    }
+    this->ToolToReferencePoses.erase(this->ToolToReferencePoses.begin(), this->ToolToReferencePoses.begin() + numberOfRemovedPoses);
+  }
+  this->RebuildPoseIndex();
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogic::GetNumberOfToolToReferenceMatrices()
+{
+  return static_cast<int>(this->ToolToReferencePoses.size());
+}
+
+//---------------------------------------------------------------------------
+const vtkSlicerPivotCalibrationLogic::RigidPose& vtkSlicerPivotCalibrationLogic::GetToolToReferencePose(int index) const
+{
+  return this->ToolToReferencePoses[(this->FirstToolToReferencePoseIndex + index) % this->ToolToReferencePoses.size()];
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetToolToReferenceMatrix(int index, vtkMatrix4x4* matrix)
+{
+  if (matrix == NULL || index < 0 || index >= static_cast<int>(this->ToolToReferencePoses.size()))
+  {
+    vtkErrorMacro("GetToolToReferenceMatrix failed: invalid matrix or index " << index);
+    return;
+  }
+  const RigidPose& pose = this->GetToolToReferencePose(index);
+  matrix->Identity();
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      matrix->SetElement(i, j, pose.Rotation[i][j]);
+    }
+    matrix->SetElement(i, 3, pose.Translation[i]);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetToolToReferenceMatrices(vtkCollection* matrices)
+{
+  this->ClearToolToReferenceMatrices();
+  if (matrices == NULL)
+  {
+    return;
+  }
+  this->ReserveToolToReferenceMatrices(matrices->GetNumberOfItems());
+  for (int i = 0; i < matrices->GetNumberOfItems(); i++)
+  {
+    vtkMatrix4x4* matrix = vtkMatrix4x4::SafeDownCast(matrices->GetItemAsObject(i));
+    if (matrix == NULL)
+    {
+      vtkWarningMacro("SetToolToReferenceMatrices: item " << i << " is not a vtkMatrix4x4, ignored");
+      continue;
+    }
+    this->AddToolToReferenceMatrix(matrix);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetToolToReferenceMatrices(vtkCollection* matrices)
+{
+  if (matrices == NULL)
+  {
+    vtkErrorMacro("GetToolToReferenceMatrices failed: invalid collection");
+    return;
+  }
+  matrices->RemoveAllItems();
+  for (int i = 0; i < this->GetNumberOfToolToReferenceMatrices(); i++)
+  {
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    this->GetToolToReferenceMatrix(i, matrix);
+    matrices->AddItem(matrix);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ResetStreamingPivotCalibration()
+{
+  for (int i = 0; i < 6; i++)
+  {
+    for (int j = 0; j < 6; j++)
+    {
+      this->PivotNormalMatrix[i][j] = 0.0;
+    }
+    this->PivotNormalVector[i] = 0.0;
+  }
+  this->PivotSumSquaredTranslations = 0.0;
+  this->NumberOfStreamingPivotSamples = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    this->StreamingToolTipToToolTranslation[i] = 0.0;
+    this->StreamingPivotPointToReference[i] = 0.0;
+    for (int j = 0; j < 3; j++)
+    {
+      this->StreamingToolTipCovariance[i][j] = 0.0;
+    }
+  }
+  this->StreamingPivotRMSE = 0.0;
+  this->StreamingMaximumOrientationDifferenceLowerBoundDeg = 0.0;
+  this->StreamingMaximumOrientationDifferenceUpperBoundDeg = 0.0;
+  this->StreamingOrientationReferenceValid = false;
+  this->NumberOfStreamingSamplesSinceOrientationRecompute = 0;
+  this->StreamingPivotConverged = false;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::UpdateStreamingPivotCalibration(const RigidPose& toolToReferencePose, double weight/*=1.0*/)
 {
-  vtkSmartPointer<vtkMatrix4x4> diffMatrix = vtkSmartPointer<vtkMatrix4x4>::New(); 
-  vtkSmartPointer<vtkMatrix4x4> invBmatrix = vtkSmartPointer<vtkMatrix4x4>::New(); 
+  // Only the normal equations (A^T*A)*x = A^T*b and b^T*b of the linear system
+  // solved in ComputePivotCalibration are stored.
+  AddPoseToPivotNormalEquations(toolToReferencePose.Rotation, toolToReferencePose.Translation, weight,
+    this->PivotNormalMatrix, this->PivotNormalVector, this->PivotSumSquaredTranslations);
+  this->NumberOfStreamingPivotSamples += (weight > 0 ? 1 : -1);
+  if (this->NumberOfStreamingPivotSamples <= 0)
+  {
+    this->ResetStreamingPivotCalibration();
+    return;
+  }
+  if (weight > 0)
+  {
+    // The pose is already stored, only its difference from the oldest stored pose has to be checked.
+    // Removed poses may still be stored when they are subtracted, therefore the reference is only updated here.
+    this->UpdateStreamingOrientationReference();
+    double orientationDifferenceDeg = GetOrientationDifferenceDeg(this->StreamingOrientationReferenceRotation, toolToReferencePose.Rotation);
+    this->StreamingMaximumOrientationDifferenceLowerBoundDeg = std::max(this->StreamingMaximumOrientationDifferenceLowerBoundDeg, orientationDifferenceDeg);
+    this->StreamingMaximumOrientationDifferenceUpperBoundDeg = std::max(this->StreamingMaximumOrientationDifferenceUpperBoundDeg, orientationDifferenceDeg);
+    this->NumberOfStreamingSamplesSinceOrientationRecompute++;
+  }
 
-  vtkMatrix4x4::Invert(bMatrix, invBmatrix);  
+  double x[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  double normalMatrixPseudoInverse[6][6];
+  int rank = SolveNormalEquations6(this->PivotNormalMatrix, this->PivotNormalVector,
+    PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD * PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD, x, normalMatrixPseudoInverse);
+  for (int i = 0; i < 3; i++)
+  {
+    this->StreamingToolTipToToolTranslation[i] = x[i];
+    this->StreamingPivotPointToReference[i] = x[i + 3];
+  }
 
-  vtkMatrix4x4::Multiply4x4(aMatrix, invBmatrix, diffMatrix); 
+  // |A*x-b|^2 = x^T*(A^T*A)*x - 2*x^T*(A^T*b) + b^T*b
+  double residualSumSquares = this->PivotSumSquaredTranslations;
+  for (int i = 0; i < 6; i++)
+  {
+    double normalMatrixTimesX = 0.0;
+    for (int j = 0; j < 6; j++)
+    {
+      normalMatrixTimesX += this->PivotNormalMatrix[i][j] * x[j];
+    }
+    residualSumSquares += x[i] * normalMatrixTimesX - 2.0 * x[i] * this->PivotNormalVector[i];
+  }
+  // Residual may be slightly negative due to rounding errors
+  residualSumSquares = std::max(residualSumSquares, 0.0);
+  this->StreamingPivotRMSE = sqrt(residualSumSquares / (3 * this->NumberOfStreamingPivotSamples));
+
+  // Covariance of the solution: sigma^2 * (A^T*A)^-1, where sigma^2 is the residual variance
+  // (3 equations per sample, 6 unknowns)
+  int degreesOfFreedom = 3 * this->NumberOfStreamingPivotSamples - 6;
+  double residualVariance = (degreesOfFreedom > 0) ? residualSumSquares / degreesOfFreedom : 0.0;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->StreamingToolTipCovariance[i][j] = residualVariance * normalMatrixPseudoInverse[i][j];
+    }
+  }
 
-  vtkSmartPointer<vtkTransform> diffTransform = vtkSmartPointer<vtkTransform>::New(); 
-  diffTransform->SetMatrix(diffMatrix); 
+  // Covariance is underestimated if the solution is not fully determined (rank < 6),
+  // so convergence is only checked if there was enough variation in the rotations.
+  if (weight > 0 && !this->StreamingPivotConverged && rank == 6
+    && this->NumberOfStreamingPivotSamples >= this->ConvergenceMinimumNumberOfSamples
+    && this->GetStreamingToolTipUncertaintyMm() < this->ConvergenceToolTipUncertaintyThresholdMm
+    && this->StreamingPivotRMSE < this->ConvergenceRMSEThresholdMm
+    && this->IsStreamingOrientationDifferenceSufficient())
+  {
+    this->StreamingPivotConverged = true;
+    // Observers may clear the recorded transforms, therefore the event is invoked after all updates are completed
+    this->InvokeEvent(PivotCalibrationConvergedEvent);
+  }
+}
 
-  double angleDiff_rad= vtkMath::RadiansFromDegrees(diffTransform->GetOrientationWXYZ()[0]);
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetStreamingToolTipCovariance(double covariance[3][3])
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      covariance[i][j] = this->StreamingToolTipCovariance[i][j];
+    }
+  }
+}
 
-  double normalizedAngleDiff_rad = atan2( sin(angleDiff_rad), cos(angleDiff_rad) ); // normalize angle to domain -pi, pi 
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetStreamingToolTipUncertaintyMm()
+{
+  double trace = this->StreamingToolTipCovariance[0][0] + this->StreamingToolTipCovariance[1][1] + this->StreamingToolTipCovariance[2][2];
+  return sqrt(std::max(trace, 0.0));
+}
 
-  return vtkMath::DegreesFromRadians(normalizedAngleDiff_rad);
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetStreamingMaximumOrientationDifferenceDeg()
+{
+  this->UpdateStreamingOrientationReference();
+  if (this->StreamingMaximumOrientationDifferenceLowerBoundDeg < this->StreamingMaximumOrientationDifferenceUpperBoundDeg)
+  {
+    this->RecomputeStreamingMaximumOrientationDifference();
+  }
+  return this->StreamingMaximumOrientationDifferenceLowerBoundDeg;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::UpdateStreamingOrientationReference()
+{
+  if (this->ToolToReferencePoses.empty())
+  {
+    return;
+  }
+  const RigidPose& referencePose = this->GetToolToReferencePose(0);
+  if (!this->StreamingOrientationReferenceValid)
+  {
+    // Differences from the new reference are not known
+    this->StreamingMaximumOrientationDifferenceLowerBoundDeg = 0.0;
+    this->StreamingMaximumOrientationDifferenceUpperBoundDeg = (this->GetNumberOfToolToReferenceMatrices() > 1 ? 180.0 : 0.0);
+  }
+  else
+  {
+    bool referenceChanged = false;
+    for (int i = 0; i < 3 && !referenceChanged; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        if (this->StreamingOrientationReferenceRotation[i][j] != referencePose.Rotation[i][j])
+        {
+          referenceChanged = true;
+          break;
+        }
+      }
+    }
+    if (!referenceChanged)
+    {
+      return;
+    }
+    // Orientation difference is a distance metric, therefore the difference of each pose from the new reference
+    // is within referenceChangeDeg of its difference from the previous reference
+    double referenceChangeDeg = GetOrientationDifferenceDeg(this->StreamingOrientationReferenceRotation, referencePose.Rotation);
+    this->StreamingMaximumOrientationDifferenceLowerBoundDeg = std::max(this->StreamingMaximumOrientationDifferenceLowerBoundDeg - referenceChangeDeg, 0.0);
+    this->StreamingMaximumOrientationDifferenceUpperBoundDeg = std::min(this->StreamingMaximumOrientationDifferenceUpperBoundDeg + referenceChangeDeg, 180.0);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->StreamingOrientationReferenceRotation[i][j] = referencePose.Rotation[i][j];
+    }
+  }
+  this->StreamingOrientationReferenceValid = true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::RecomputeStreamingMaximumOrientationDifference()
+{
+  this->UpdateStreamingOrientationReference();
+  double maximumOrientationDifferenceDeg = this->GetMaximumToolOrientationDifferenceDeg();
+  this->StreamingMaximumOrientationDifferenceLowerBoundDeg = maximumOrientationDifferenceDeg;
+  this->StreamingMaximumOrientationDifferenceUpperBoundDeg = maximumOrientationDifferenceDeg;
+  this->NumberOfStreamingSamplesSinceOrientationRecompute = 0;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::IsStreamingOrientationDifferenceSufficient()
+{
+  this->UpdateStreamingOrientationReference();
+  if (this->StreamingMaximumOrientationDifferenceLowerBoundDeg >= this->MinimumOrientationDifferenceDeg)
+  {
+    return true;
+  }
+  if (this->StreamingMaximumOrientationDifferenceUpperBoundDeg < this->MinimumOrientationDifferenceDeg)
+  {
+    return false;
+  }
+  // Bounds are not conclusive (only happens after poses are removed from the ring buffer).
+  // Convergence detection may be delayed by a few samples, but the cost per sample remains constant.
+  if (this->NumberOfStreamingSamplesSinceOrientationRecompute
+    < STREAMING_ORIENTATION_RECOMPUTE_INTERVAL_FRACTION * this->GetNumberOfToolToReferenceMatrices())
+  {
+    return false;
+  }
+  this->RecomputeStreamingMaximumOrientationDifference();
+  return (this->StreamingMaximumOrientationDifferenceLowerBoundDeg >= this->MinimumOrientationDifferenceDeg);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ClearToolToReferenceMatrices()
+{
+  this->ToolToReferencePoses.clear();
+  this->FirstToolToReferencePoseIndex = 0;
+  this->PoseIndex.clear();
+  this->NumberOfRejectedToolToReferenceMatrices = 0;
+  this->ResetStreamingPivotCalibration();
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix)
+{
+  double aRotation[3][3];
+  double bRotation[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      aRotation[i][j] = aMatrix->GetElement(i, j);
+      bRotation[i][j] = bMatrix->GetElement(i, j);
+    }
+  }
+  return GetOrientationDifferenceDeg(aRotation, bRotation);
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg(const double aRotation[3][3], const double bRotation[3][3])
+{
+  // Rotation matrices are orthonormal, therefore the inverse of B is its transpose: diff = A * B^T
+  double diff[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      diff[i][j] = aRotation[i][0] * bRotation[j][0] + aRotation[i][1] * bRotation[j][1] + aRotation[i][2] * bRotation[j][2];
+    }
+  }
+  // trace(diff) = 1 + 2*cos(angle), length of the skew-symmetric part = 2*sin(angle).
+  // atan2 is accurate for small angles, too (unlike acos of the trace).
+  double cosAngleTimes2 = diff[0][0] + diff[1][1] + diff[2][2] - 1.0;
+  double skew[3] = { diff[2][1] - diff[1][2], diff[0][2] - diff[2][0], diff[1][0] - diff[0][1] };
+  double sinAngleTimes2 = vtkMath::Norm(skew);
+  return vtkMath::DegreesFromRadians(atan2(sinAngleTimes2, cosAngleTimes2));
 }
 
 //---------------------------------------------------------------------------
@@ -134,14 +923,15 @@ double vtkSlicerPivotCalibrationLogic::GetMaximumToolOrientationDifferenceDeg()
 {
   // this will store the maximum difference in orientation between the first transform and all the other transforms
   double maximumOrientationDifferenceDeg = 0;
+  if (this->ToolToReferencePoses.empty())
+  {
+    return maximumOrientationDifferenceDeg;
+  }
   
-    std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  unsigned int currentRow;
-  vtkMatrix4x4* referenceOrientationMatrix = this->ToolToReferenceMatrices.front();
-  for(currentRow = 0, it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++, currentRow += 3)
+  const RigidPose& referencePose = this->GetToolToReferencePose(0);
+  for (int poseIndex = 0; poseIndex < this->GetNumberOfToolToReferenceMatrices(); poseIndex++)
   {
-    double orientationDifferenceDeg = GetOrientationDifferenceDeg(referenceOrientationMatrix, (*it));
+    double orientationDifferenceDeg = GetOrientationDifferenceDeg(referencePose.Rotation, this->GetToolToReferencePose(poseIndex).Rotation);
     if (maximumOrientationDifferenceDeg < orientationDifferenceDeg)
     {
       maximumOrientationDifferenceDeg = orientationDifferenceDeg;    
@@ -154,7 +944,7 @@ double vtkSlicerPivotCalibrationLogic::GetMaximumToolOrientationDifferenceDeg()
 //---------------------------------------------------------------------------
 bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration()
 {
-  if (this->ToolToReferenceMatrices.size() < 10)
+  if (this->ToolToReferencePoses.size() < 10)
   {
     this->ErrorText = "Not enough input transforms are available";
     return false;
@@ -166,7 +956,7 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration()
     return false;
   }
   
-  unsigned int rows = 3 * this->ToolToReferenceMatrices.size();
+  unsigned int rows = 3 * this->ToolToReferencePoses.size();
   unsigned int columns = 6;
 
   vnl_matrix<double> A(rows, columns);
@@ -181,14 +971,13 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration()
   vnl_vector<double> x(columns);
   vnl_vector<double> t(3);
 
-  std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  unsigned int currentRow;
-  for(currentRow = 0, it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++, currentRow += 3)
-  {    
+  unsigned int currentRow = 0;
+  for (int poseIndex = 0; poseIndex < this->GetNumberOfToolToReferenceMatrices(); poseIndex++, currentRow += 3)
+  {
+    const RigidPose& pose = this->GetToolToReferencePose(poseIndex);
     for (int i = 0; i < 3; i++)
     {
-      t(i) = (*it)->GetElement(i, 3);
+      t(i) = pose.Translation[i];
     }
     t *= -1;
     b.update(t, currentRow);
@@ -197,7 +986,7 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration()
     {
       for (int j = 0; j < 3; j++ )
       {
-        R(i, j) = (*it)->GetElement(i, j);
+        R(i, j) = pose.Rotation[i][j];
       }
     }
     A.update(R, currentRow, 0);
@@ -205,7 +994,7 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration()
   }
     
   vnl_svd<double> svdA(A);    
-  svdA.zero_out_absolute( 1e-1 );    
+  svdA.zero_out_absolute( PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD );    
   x = svdA.solve( b );
     
   //set the RMSE
@@ -216,14 +1005,23 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration()
   this->ToolTipToToolMatrix->SetElement( 1, 3, x[ 1 ] );
   this->ToolTipToToolMatrix->SetElement( 2, 3, x[ 2 ] );
 
-  this->ErrorText.empty();
+  for (int i = 0; i < 3; i++)
+  {
+    this->PivotPointToReference[i] = x[i + 3];
+  }
+
+  double solution[6] = { x[0], x[1], x[2], x[3], x[4], x[5] };
+  int numberOfInliers = this->UpdatePivotSampleResiduals( solution );
+  this->PivotInlierRatio = double(numberOfInliers) / this->GetNumberOfToolToReferenceMatrices();
+
+  this->ErrorText.clear();
   return true;
 }
 
 //---------------------------------------------------------------------------
-bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation )
+bool vtkSlicerPivotCalibrationLogic::ComputeRobustPivotCalibration()
 {
-  if ( this->ToolToReferenceMatrices.size() < 10 )
+  if (this->ToolToReferencePoses.size() < 10)
   {
     this->ErrorText = "Not enough input transforms are available";
     return false;
@@ -234,44 +1032,246 @@ bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation )
     this->ErrorText = "Not enough variation in the input transforms";
     return false;
   }
-  
-  // Setup our system to find the axis of rotation
-  unsigned int rows = 3, columns = 3;
 
-  vnl_matrix<double> A( rows, columns, 0);
+  int numberOfPoses = this->GetNumberOfToolToReferenceMatrices();
+  RobustPivotHypothesisJob job;
+  job.InlierThresholdMm = this->RobustInlierThresholdMm;
+  job.MinimumEigenvalue = PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD * PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD;
+  job.Poses.resize(12 * numberOfPoses);
+  for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+  {
+    const RigidPose& pose = this->GetToolToReferencePose(poseIndex);
+    std::copy(&(pose.Rotation[0][0]), &(pose.Rotation[0][0]) + 9, job.Poses.begin() + 12 * poseIndex);
+    std::copy(pose.Translation, pose.Translation + 3, job.Poses.begin() + 12 * poseIndex + 9);
+  }
 
-  vnl_matrix<double> I( 3, 3, 0 );
-  I.set_identity();
+  // Subsets are generated upfront, in a single thread, with a fixed seed so that the result is reproducible
+  int numberOfHypotheses = std::max(this->RobustNumberOfHypotheses, 1);
+  job.SubsetIndices.resize(3 * numberOfHypotheses);
+  unsigned int randomState = 12345;
+  for (int hypothesisIndex = 0; hypothesisIndex < numberOfHypotheses; hypothesisIndex++)
+  {
+    int* subset = &(job.SubsetIndices[3 * hypothesisIndex]);
+    for (int k = 0; k < 3; k++)
+    {
+      bool duplicate = true;
+      while (duplicate)
+      {
+        randomState = randomState * 1103515245u + 12345u;
+        subset[k] = static_cast<int>((randomState >> 8) % static_cast<unsigned int>(numberOfPoses));
+        duplicate = false;
+        for (int previous = 0; previous < k; previous++)
+        {
+          duplicate = duplicate || (subset[previous] == subset[k]);
+        }
+      }
+    }
+  }
 
-  vnl_matrix<double> RI( rows, columns );
+  vtkNew< vtkMultiThreader > threader;
+  int numberOfThreads = std::min(vtkMultiThreader::GetGlobalDefaultNumberOfThreads(), numberOfHypotheses);
+  job.BestSolutions.resize(6 * numberOfThreads, 0.0);
+  job.BestCosts.resize(numberOfThreads, VTK_DOUBLE_MAX);
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( RobustPivotHypothesisThreadFunction, &job );
+  threader->SingleMethodExecute();
 
-  std::vector< vtkMatrix4x4* >::const_iterator previt = this->ToolToReferenceMatrices.end();
-  for(std::vector< vtkMatrix4x4* >::const_iterator it = this->ToolToReferenceMatrices.begin(); it != this->ToolToReferenceMatrices.end(); it++ )
+  int bestThread = static_cast<int>(std::min_element(job.BestCosts.begin(), job.BestCosts.end()) - job.BestCosts.begin());
+  if (job.BestCosts[bestThread] == VTK_DOUBLE_MAX)
   {
-    if ( previt == this->ToolToReferenceMatrices.end() )
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+  double x[6];
+  std::copy(job.BestSolutions.begin() + 6 * bestThread, job.BestSolutions.begin() + 6 * (bestThread + 1), x);
+
+  // Refine the solution using iteratively reweighted least squares with Tukey's biweight function:
+  // samples farther than the inlier threshold get zero weight.
+  const int maximumNumberOfRefinementIterations = 20;
+  const double convergenceThresholdMm = 1e-6;
+  for (int iteration = 0; iteration < maximumNumberOfRefinementIterations; iteration++)
+  {
+    double normalMatrix[6][6];
+    double normalVector[6];
+    double sumSquaredTranslations = 0.0;
+    for (int i = 0; i < 6; i++)
     {
-      previt = it;
-      continue; // No comparison to make for the first matrix
+      std::fill(normalMatrix[i], normalMatrix[i] + 6, 0.0);
+      normalVector[i] = 0.0;
     }
-    
-    vtkSmartPointer< vtkMatrix4x4 > itinverse = vtkSmartPointer< vtkMatrix4x4 >::New();
-    vtkMatrix4x4::Invert( (*it), itinverse );
+    double sumWeights = 0.0;
+    for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+    {
+      double r[3][3];
+      const double* t = &(job.Poses[12 * poseIndex + 9]);
+      std::copy(job.Poses.begin() + 12 * poseIndex, job.Poses.begin() + 12 * poseIndex + 9, &(r[0][0]));
+      double u = GetPivotResidualMm(r, t, x) / this->RobustInlierThresholdMm;
+      if (u >= 1.0)
+      {
+        continue;
+      }
+      double weight = (1.0 - u * u) * (1.0 - u * u);
+      AddPoseToPivotNormalEquations(r, t, weight, normalMatrix, normalVector, sumSquaredTranslations);
+      sumWeights += weight;
+    }
+    if (sumWeights <= 0.0)
+    {
+      break;
+    }
+    double xNew[6];
+    SolveNormalEquations6(normalMatrix, normalVector,
+      PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD * PIVOT_CALIBRATION_SINGULAR_VALUE_THRESHOLD, xNew);
+    double maximumChange = 0.0;
+    for (int i = 0; i < 6; i++)
+    {
+      maximumChange = std::max(maximumChange, fabs(xNew[i] - x[i]));
+      x[i] = xNew[i];
+    }
+    if (maximumChange < convergenceThresholdMm)
+    {
+      break;
+    }
+  }
+
+  int numberOfInliers = this->UpdatePivotSampleResiduals(x);
+  this->PivotInlierRatio = double(numberOfInliers) / numberOfPoses;
+  if (numberOfInliers < 10)
+  {
+    this->ErrorText = "Not enough inlier transforms are available";
+    return false;
+  }
+
+  // RMSE of the inliers, computed the same way as in ComputePivotCalibration (3 rows per sample)
+  double inlierSumSquaredResiduals = 0.0;
+  for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+  {
+    if (this->PivotSampleResidualsMm[poseIndex] < this->RobustInlierThresholdMm)
+    {
+      inlierSumSquaredResiduals += this->PivotSampleResidualsMm[poseIndex] * this->PivotSampleResidualsMm[poseIndex];
+    }
+  }
+  this->PivotRMSE = sqrt(inlierSumSquaredResiduals / (3 * numberOfInliers));
+
+  this->ToolTipToToolMatrix->SetElement( 0, 3, x[ 0 ] );
+  this->ToolTipToToolMatrix->SetElement( 1, 3, x[ 1 ] );
+  this->ToolTipToToolMatrix->SetElement( 2, 3, x[ 2 ] );
+  for (int i = 0; i < 3; i++)
+  {
+    this->PivotPointToReference[i] = x[i + 3];
+  }
+
+  this->ErrorText.clear();
+  return true;
+}
 
-    vtkSmartPointer< vtkMatrix4x4 > instRotation = vtkSmartPointer< vtkMatrix4x4 >::New();
-    vtkMatrix4x4::Multiply4x4( itinverse, (*previt), instRotation );
+//---------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogic::UpdatePivotSampleResiduals(const double x[6])
+{
+  int numberOfInliers = 0;
+  this->PivotSampleResidualsMm.resize(this->ToolToReferencePoses.size());
+  for (int poseIndex = 0; poseIndex < this->GetNumberOfToolToReferenceMatrices(); poseIndex++)
+  {
+    const RigidPose& pose = this->GetToolToReferencePose(poseIndex);
+    this->PivotSampleResidualsMm[poseIndex] = GetPivotResidualMm(pose.Rotation, pose.Translation, x);
+    if (this->PivotSampleResidualsMm[poseIndex] < this->RobustInlierThresholdMm)
+    {
+      numberOfInliers++;
+    }
+  }
+  return numberOfInliers;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogic::GetNumberOfPivotSampleResiduals()
+{
+  return static_cast<int>(this->PivotSampleResidualsMm.size());
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetPivotSampleResidualMm(int sampleIndex)
+{
+  if (sampleIndex < 0 || sampleIndex >= static_cast<int>(this->PivotSampleResidualsMm.size()))
+  {
+    vtkErrorMacro("GetPivotSampleResidualMm failed: invalid sample index " << sampleIndex);
+    return 0.0;
+  }
+  return this->PivotSampleResidualsMm[sampleIndex];
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::IsPivotSampleInlier(int sampleIndex)
+{
+  return this->GetPivotSampleResidualMm(sampleIndex) < this->RobustInlierThresholdMm;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ComputeSpinRotationMatrixSum( double sumRIminusISquared[3][3] )
+{
+  // Accumulated on the stack, only the rotation part of the stored poses is accessed
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++ )
+    {
+      sumRIminusISquared[i][j] = 0.0;
+    }
+  }
+  for ( int poseIndex = 1; poseIndex < this->GetNumberOfToolToReferenceMatrices(); poseIndex++ ) // No comparison to make for the first matrix
+  {
+    const double (*previousRotation)[3] = this->GetToolToReferencePose( poseIndex - 1 ).Rotation;
+    const double (*currentRotation)[3] = this->GetToolToReferencePose( poseIndex ).Rotation;
+
+    // Instantaneous rotation: inverse(current) * previous, inverse of a rotation is its transpose
+    double RIminusI[3][3];
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++ )
+      {
+        RIminusI[i][j] = currentRotation[0][i] * previousRotation[0][j]
+          + currentRotation[1][i] * previousRotation[1][j]
+          + currentRotation[2][i] * previousRotation[2][j]
+          - ( i == j ? 1.0 : 0.0 );
+      }
+    }
 
     for (int i = 0; i < 3; i++)
     {
       for (int j = 0; j < 3; j++ )
       {
-        RI(i, j) = instRotation->GetElement(i, j);
+        sumRIminusISquared[i][j] += RIminusI[0][i] * RIminusI[0][j] + RIminusI[1][i] * RIminusI[1][j] + RIminusI[2][i] * RIminusI[2][j];
       }
     }
+  }
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation )
+{
+  if ( this->ToolToReferencePoses.size() < 10 )
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
+
+  if (this->GetMaximumToolOrientationDifferenceDeg() < this->MinimumOrientationDifferenceDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+  
+  // Setup our system to find the axis of rotation
+  unsigned int rows = 3, columns = 3;
 
-    RI = RI - I;
-    A = A + RI.transpose() * RI;
+  vnl_matrix<double> A( rows, columns, 0);
 
-    previt = it;
+  // Sum of (RI-I)^T*(RI-I) for all instantaneous rotations RI
+  double sumRIminusISquared[3][3];
+  this->ComputeSpinRotationMatrixSum( sumRIminusISquared );
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++ )
+    {
+      A( i, j ) = sumRIminusISquared[i][j];
+    }
   }
 
   // Note: If the needle orientation protocol changes, only the definitions of shaftAxis and secondaryAxes need to be changed
@@ -24,14 +24,19 @@
 #include "vtkSlicerModuleLogic.h"
 
 // VTK includes
+#include <vtkCommand.h>
 #include <vtkMatrix4x4.h>
 #include <vtkMath.h>
 
 // MRML includes
 #include "vtkMRMLLinearTransformNode.h"
 
+class vtkCollection;
+
 // STD includes
 #include <cstdlib>
+#include <map>
+#include <vector>
 
 // VNL includes
 #include "vnl/vnl_matrix.h"
@@ -49,22 +54,81 @@ public:
   vtkTypeMacro(vtkSlicerPivotCalibrationLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  enum Events
+  {
+    // Invoked once (after the last clear) when the streaming pivot calibration has converged,
+    // i.e., all the convergence criteria are fulfilled. Recording can be stopped when this event is received.
+    PivotCalibrationConvergedEvent = vtkCommand::UserEvent + 231
+  };
+
   // Clears all previously acquired tool transforms.
   // Call this before start adding transforms.
   void ClearToolToReferenceMatrices();
 
+  // Preallocate storage for the specified number of tool transforms, to avoid reallocation during recording
+  void ReserveToolToReferenceMatrices( int numberOfMatrices );
+
+  // If non-zero then only the most recent MaximumNumberOfToolToReferenceMatrices transforms are kept
+  // (older transforms are overwritten). Default: 0 (unlimited).
+  vtkGetMacro(MaximumNumberOfToolToReferenceMatrices, int);
+  void SetMaximumNumberOfToolToReferenceMatrices( int maximumNumberOfMatrices );
+
   // Add a tool transforms automatically by observing transform changes
   vtkGetMacro(RecordingState, bool);
   vtkSetMacro(RecordingState, bool);
   void SetAndObserveTransformNode( vtkMRMLLinearTransformNode* );
 
-  // Add a single tool transform manually
+  // Add a single tool transform manually. The matrix is copied (its rotation and translation part),
+  // no reference is kept to it, so the caller may modify or reuse the matrix after this call.
   void AddToolToReferenceMatrix( vtkMatrix4x4* );
 
+  // If enabled then transforms that are too similar to an already stored transform are not stored:
+  // a transform is rejected if both its orientation difference is less than MinimumPoseOrientationDifferenceDeg
+  // and its position difference is less than MinimumPosePositionDifferenceMm from a stored transform.
+  // This keeps the number of samples (and computation time) bounded, regardless of recording length.
+  // Default: disabled.
+  vtkGetMacro(PoseDiversityFilterEnabled, bool);
+  void SetPoseDiversityFilterEnabled( bool enabled );
+  vtkBooleanMacro(PoseDiversityFilterEnabled, bool);
+  vtkGetMacro(MinimumPoseOrientationDifferenceDeg, double);
+  void SetMinimumPoseOrientationDifferenceDeg( double differenceDeg );
+  vtkGetMacro(MinimumPosePositionDifferenceMm, double);
+  vtkSetMacro(MinimumPosePositionDifferenceMm, double);
+  // Number of transforms rejected by the pose diversity filter since the last clear
+  vtkGetMacro(NumberOfRejectedToolToReferenceMatrices, int);
+
+  // Access recorded tool transforms (in the order they were added).
+  // The transform is copied into the matrix provided by the caller.
+  int GetNumberOfToolToReferenceMatrices();
+  void GetToolToReferenceMatrix( int index, vtkMatrix4x4* matrix );
+
+  // Import/export tool transforms as a list of vtkMatrix4x4 objects.
+  // Import replaces all the previously added transforms. Both import and export copy the matrices.
+  void SetToolToReferenceMatrices( vtkCollection* matrices );
+  void GetToolToReferenceMatrices( vtkCollection* matrices );
+
   // Computes calibration results.
   // Returns with false on failure
   bool ComputePivotCalibration();
 
+  // Computes calibration results, ignoring outlier transforms (tracker glitches, slipped pivot point).
+  // Inliers are found by RANSAC on minimal sets of 3 transforms (evaluated in parallel), then the solution
+  // is refined by iteratively reweighted least squares. PivotRMSE is computed from the inliers only.
+  // Returns with false on failure
+  bool ComputeRobustPivotCalibration();
+
+  // Transforms farther than this distance from the pivot point (in mm) are considered outliers
+  vtkGetMacro(RobustInlierThresholdMm, double);
+  vtkSetMacro(RobustInlierThresholdMm, double);
+  // Number of random minimal sets evaluated by the robust pivot calibration
+  vtkGetMacro(RobustNumberOfHypotheses, int);
+  vtkSetMacro(RobustNumberOfHypotheses, int);
+
+  // Computes the sum of (RI-I)^T*(RI-I) for the instantaneous rotations RI between consecutive tool transforms.
+  // The spin axis is the eigenvector that belongs to the smallest eigenvalue of this matrix.
+  // Used by ComputeSpinCalibration, no memory is allocated.
+  void ComputeSpinRotationMatrixSum( double sumRIminusISquared[3][3] );
+
   // Computes calibration results.
   // Returns with false on failure
   bool ComputeSpinCalibration( bool snapRotation = false ); //Note: The neede orientation protocol assumes that the shaft of the tool lies along the positive x-axis
@@ -75,6 +139,52 @@ public:
   void GetToolTipToToolMatrix( vtkMatrix4x4* );
   vtkGetMacro(PivotRMSE, double);
   vtkGetMacro(SpinRMSE, double);
+  // Pivot point position in the reference coordinate system, computed by the last pivot calibration
+  vtkGetVector3Macro(PivotPointToReference, double);
+
+  // Distance of the tool tip from the pivot point for each transform used in the last pivot calibration.
+  // Transforms with residual above RobustInlierThresholdMm are outliers.
+  int GetNumberOfPivotSampleResiduals();
+  double GetPivotSampleResidualMm(int sampleIndex);
+  bool IsPivotSampleInlier(int sampleIndex);
+  // Ratio of inlier transforms (residual below RobustInlierThresholdMm) in the last pivot calibration
+  vtkGetMacro(PivotInlierRatio, double);
+
+  // Pivot calibration results that are updated incrementally as each tool transform is added,
+  // so they are available during recording (without calling ComputePivotCalibration).
+  // Normal equations of the least squares problem are accumulated, therefore memory usage and
+  // update time do not depend on the number of recorded transforms.
+  vtkGetVector3Macro(StreamingToolTipToToolTranslation, double);
+  vtkGetVector3Macro(StreamingPivotPointToReference, double);
+  vtkGetMacro(StreamingPivotRMSE, double);
+  vtkGetMacro(NumberOfStreamingPivotSamples, int);
+
+  // Covariance matrix of the streaming tool tip estimate (in mm^2), computed from the residual variance
+  // and the normal equations. Its trace (sum of variances) is used for convergence detection.
+  void GetStreamingToolTipCovariance( double covariance[3][3] );
+  // Square root of the trace of the tool tip covariance matrix (in mm)
+  double GetStreamingToolTipUncertaintyMm();
+  // Maximum orientation difference of the stored transforms from the oldest stored transform.
+  // Only the retained transforms are considered (transforms that are removed from the ring buffer are not).
+  // After transforms are removed from the ring buffer it is recomputed from all the stored transforms.
+  double GetStreamingMaximumOrientationDifferenceDeg();
+
+  // Convergence criteria of the streaming pivot calibration. The calibration is converged if at least
+  // ConvergenceMinimumNumberOfSamples transforms are added, orientation varies at least MinimumOrientationDifferenceDeg,
+  // the tool tip uncertainty is below ConvergenceToolTipUncertaintyThresholdMm, and the RMSE is below ConvergenceRMSEThresholdMm.
+  vtkGetMacro(ConvergenceMinimumNumberOfSamples, int);
+  vtkSetMacro(ConvergenceMinimumNumberOfSamples, int);
+  vtkGetMacro(ConvergenceToolTipUncertaintyThresholdMm, double);
+  vtkSetMacro(ConvergenceToolTipUncertaintyThresholdMm, double);
+  vtkGetMacro(ConvergenceRMSEThresholdMm, double);
+  vtkSetMacro(ConvergenceRMSEThresholdMm, double);
+  // True if the streaming pivot calibration has converged since the last clear
+  vtkGetMacro(StreamingPivotConverged, bool);
+
+  // Returns the orientation difference between two rigid transforms, in degrees (between 0 and 180).
+  // Only the rotation part is used, no memory is allocated.
+  static double GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix);
+  static double GetOrientationDifferenceDeg(const double aRotation[3][3], const double bRotation[3][3]);
 
   // Returns human-readable description of the error occurred (non-empty if ComputePivotCalibration returns with failure)
   vtkGetMacro(ErrorText, std::string);
@@ -85,12 +195,46 @@ protected:
   
   void ProcessMRMLNodesEvents( vtkObject* caller, unsigned long event, void* callData );
 
-  // Returns the orientation difference in degrees between two 4x4 homogeneous transformation matrix, in degrees.
-  double GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix);
   
-  // Computes the maximum orientation difference in degrees between the first tool transformation
+  // Computes the maximum orientation difference in degrees between the first (oldest) stored tool transformation
   // and all the others. Used for determining if there was enough variation in the input data.
   double GetMaximumToolOrientationDifferenceDeg();
+
+  // Tool transform, stored without the constant last row of the homogeneous transformation matrix
+  struct RigidPose
+  {
+    double Rotation[3][3];
+    double Translation[3];
+  };
+
+  // Get a recorded tool pose, index is in the order the poses were added
+  const RigidPose& GetToolToReferencePose( int index ) const;
+
+  // Add a tool pose to the pivot calibration normal equations (weight=1) or remove it (weight=-1)
+  // and update the streaming results
+  void UpdateStreamingPivotCalibration( const RigidPose& toolToReferencePose, double weight = 1.0 );
+  void ResetStreamingPivotCalibration();
+
+  // Update the bounds of the streaming maximum orientation difference if the oldest stored pose has changed
+  void UpdateStreamingOrientationReference();
+  // Compute the streaming maximum orientation difference from all the stored poses
+  void RecomputeStreamingMaximumOrientationDifference();
+  // Returns true if the orientation criterion of the streaming convergence is met.
+  // Does not iterate through the stored poses at every call, only when the bounds are not conclusive.
+  bool IsStreamingOrientationDifferenceSufficient();
+
+  // Returns true if there is no stored pose that is closer to the pose than the pose diversity thresholds
+  bool IsPoseDiverse( const RigidPose& pose );
+
+  // Maintain the spatial index of stored poses used by the pose diversity filter.
+  // storageIndex is the index in ToolToReferencePoses.
+  void AddPoseToPoseIndex( int storageIndex );
+  void RemovePoseFromPoseIndex( int storageIndex );
+  void RebuildPoseIndex();
+
+  // Compute residual of each transform for the pivot calibration solution x (tool tip and pivot point).
+  // Returns the number of inliers.
+  int UpdatePivotSampleResiduals(const double x[6]);
   
 private:
 
@@ -99,7 +243,24 @@ private:
 
   // Calibration inputs
   double MinimumOrientationDifferenceDeg;
-  std::vector< vtkMatrix4x4* > ToolToReferenceMatrices;
+  double RobustInlierThresholdMm;
+  int RobustNumberOfHypotheses;
+  // Contiguous storage of tool poses. If MaximumNumberOfToolToReferenceMatrices is reached then it is used as
+  // a ring buffer: FirstToolToReferencePoseIndex is the index of the oldest pose.
+  std::vector< RigidPose > ToolToReferencePoses;
+  int FirstToolToReferencePoseIndex;
+  int MaximumNumberOfToolToReferenceMatrices;
+  // Pose diversity filter
+  bool PoseDiversityFilterEnabled;
+  double MinimumPoseOrientationDifferenceDeg;
+  double MinimumPosePositionDifferenceMm;
+  int NumberOfRejectedToolToReferenceMatrices;
+  // Spatial index of stored poses: uniform grid over the vector part of the unit quaternion (with w>=0).
+  // Key is the packed grid cell index, value is the list of indices in ToolToReferencePoses.
+  std::map< vtkTypeInt64, std::vector< int > > PoseIndex;
+  double PoseIndexCellSize;
+  // Matrix used for getting the observed transform without allocating a new matrix for each sample
+  vtkMatrix4x4* ObservedToolToReferenceMatrix;
   vtkMRMLLinearTransformNode* ObservedTransformNode;
   bool RecordingState;
 
@@ -107,7 +268,36 @@ private:
   vtkMatrix4x4* ToolTipToToolMatrix;
   double PivotRMSE;
   double SpinRMSE; 
+  double PivotPointToReference[3];
   std::string ErrorText;
+  std::vector<double> PivotSampleResidualsMm;
+  double PivotInlierRatio;
+
+  // Pivot calibration normal equations (A^T*A, A^T*b, b^T*b) accumulated from all the tool transforms
+  double PivotNormalMatrix[6][6];
+  double PivotNormalVector[6];
+  double PivotSumSquaredTranslations;
+  int NumberOfStreamingPivotSamples;
+
+  // Streaming pivot calibration results
+  double StreamingToolTipToToolTranslation[3];
+  double StreamingPivotPointToReference[3];
+  double StreamingPivotRMSE;
+  double StreamingToolTipCovariance[3][3];
+  // Lower and upper bound of the maximum orientation difference from the oldest stored pose (equal if exact).
+  // Updated incrementally as poses are added. When the oldest pose is removed, the bounds are widened
+  // by the orientation difference between the previous and the new oldest pose (triangle inequality).
+  double StreamingMaximumOrientationDifferenceLowerBoundDeg;
+  double StreamingMaximumOrientationDifferenceUpperBoundDeg;
+  double StreamingOrientationReferenceRotation[3][3];
+  bool StreamingOrientationReferenceValid;
+  int NumberOfStreamingSamplesSinceOrientationRecompute;
+  bool StreamingPivotConverged;
+
+  // Convergence criteria
+  int ConvergenceMinimumNumberOfSamples;
+  double ConvergenceToolTipUncertaintyThresholdMm;
+  double ConvergenceRMSEThresholdMm;
 };
 
 #endif
@@ -0,0 +1,289 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Micro-benchmark of the rotation computations of the pivot and spin calibration.
+// Reports time per 10k samples for the previous implementation (based on vtkMatrix4x4 inversion and
+// vtkTransform, with a few heap allocations per sample) and for the current rigid transform implementation
+// (rotation matrices on the stack, transpose instead of inverse). Both implementations get the same input
+// and compute the same result, which is checked. The current implementation must not allocate heap memory.
+// Also reports the time of streaming calibration updates in ring buffer mode, which must not depend on the
+// number of stored poses.
+
+// PivotCalibration includes
+#include "vtkSlicerPivotCalibrationLogic.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+#include <vtkTransform.h>
+
+// SlicerIGT testing includes
+#include "SlicerIGTTestingAllocationCounter.h"
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Previous implementation of vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg
+  double GetOrientationDifferenceDegPrevious(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix)
+  {
+    vtkSmartPointer<vtkMatrix4x4> diffMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> invBmatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Invert(bMatrix, invBmatrix);
+    vtkMatrix4x4::Multiply4x4(aMatrix, invBmatrix, diffMatrix);
+    vtkSmartPointer<vtkTransform> diffTransform = vtkSmartPointer<vtkTransform>::New();
+    diffTransform->SetMatrix(diffMatrix);
+    double angleDiff_rad = vtkMath::RadiansFromDegrees(diffTransform->GetOrientationWXYZ()[0]);
+    double normalizedAngleDiff_rad = atan2(sin(angleDiff_rad), cos(angleDiff_rad)); // normalize angle to domain -pi, pi
+    return vtkMath::DegreesFromRadians(normalizedAngleDiff_rad);
+  }
+
+  //----------------------------------------------------------------------------
+  // Previous implementation of the instantaneous rotation loop of vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration
+  void AccumulateSpinMatrixPrevious(const std::vector< vtkSmartPointer<vtkMatrix4x4> >& matrices, double sumRIminusISquared[3][3])
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        sumRIminusISquared[i][j] = 0.0;
+      }
+    }
+    for (size_t matrixIndex = 1; matrixIndex < matrices.size(); matrixIndex++)
+    {
+      vtkSmartPointer<vtkMatrix4x4> itinverse = vtkSmartPointer<vtkMatrix4x4>::New();
+      vtkMatrix4x4::Invert(matrices[matrixIndex], itinverse);
+      vtkSmartPointer<vtkMatrix4x4> instRotation = vtkSmartPointer<vtkMatrix4x4>::New();
+      vtkMatrix4x4::Multiply4x4(itinverse, matrices[matrixIndex - 1], instRotation);
+      for (int i = 0; i < 3; i++)
+      {
+        for (int j = 0; j < 3; j++)
+        {
+          for (int k = 0; k < 3; k++)
+          {
+            sumRIminusISquared[i][j] += (instRotation->GetElement(k, i) - (k == i ? 1.0 : 0.0))
+              * (instRotation->GetElement(k, j) - (k == j ? 1.0 : 0.0));
+          }
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Tool rotated around the tip (positioned at the pivot point) and spun around its shaft
+  void GenerateToolToReferenceMatrices(int numberOfSamples, double tiltAngleDeg, double spinAngleDeg,
+    std::vector< vtkSmartPointer<vtkMatrix4x4> >& matrices)
+  {
+    const double toolTipToTool[3] = { 5.0, -3.0, -150.0 };
+    const double pivotPoint[3] = { 20.0, 30.0, 40.0 };
+    vtkNew<vtkTransform> transform;
+    matrices.clear();
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+      double t = double(i) / numberOfSamples;
+      transform->Identity();
+      transform->Translate(pivotPoint);
+      transform->RotateX(tiltAngleDeg * sin(t * 10.0 * vtkMath::Pi()));
+      transform->RotateY(tiltAngleDeg * cos(t * 14.0 * vtkMath::Pi()));
+      transform->RotateZ(spinAngleDeg * t);
+      transform->Translate(-toolTipToTool[0], -toolTipToTool[1], -toolTipToTool[2]);
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      matrix->DeepCopy(transform->GetMatrix());
+      matrices.push_back(matrix);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Add the matrices to a logic that keeps the specified number of poses and return the time of adding
+  // the poses after the ring buffer is full (in seconds)
+  double GetStreamingRingBufferUpdateTimeSec(const std::vector< vtkSmartPointer<vtkMatrix4x4> >& matrices, int numberOfStoredPoses,
+    double& maximumOrientationDifferenceDeg, bool& converged)
+  {
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    logic->SetMaximumNumberOfToolToReferenceMatrices(numberOfStoredPoses);
+    for (int sampleIndex = 0; sampleIndex < numberOfStoredPoses; sampleIndex++)
+    {
+      logic->AddToolToReferenceMatrix(matrices[sampleIndex]);
+    }
+    double startTime = vtkTimerLog::GetUniversalTime();
+    for (size_t sampleIndex = numberOfStoredPoses; sampleIndex < matrices.size(); sampleIndex++)
+    {
+      logic->AddToolToReferenceMatrix(matrices[sampleIndex]);
+    }
+    double updateTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+    maximumOrientationDifferenceDeg = logic->GetStreamingMaximumOrientationDifferenceDeg();
+    converged = logic->GetStreamingPivotConverged();
+    return updateTimeSec;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogicBenchmark(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int numberOfSamples = 10000;
+  std::vector< vtkSmartPointer<vtkMatrix4x4> > matrices;
+  GenerateToolToReferenceMatrices(numberOfSamples, 30.0, 360.0, matrices);
+
+  // Orientation difference between the first and all the other samples
+  std::vector<double> previousDifferencesDeg(numberOfSamples);
+  double startTime = vtkTimerLog::GetUniversalTime();
+  for (int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    previousDifferencesDeg[sampleIndex] = GetOrientationDifferenceDegPrevious(matrices[0], matrices[sampleIndex]);
+  }
+  double previousOrientationTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  std::vector<double> differencesDeg(numberOfSamples);
+  unsigned long allocationsBefore = SlicerIGTTesting::GetNumberOfHeapAllocations();
+  startTime = vtkTimerLog::GetUniversalTime();
+  for (int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    differencesDeg[sampleIndex] = vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg(matrices[0], matrices[sampleIndex]);
+  }
+  double orientationTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+  unsigned long orientationAllocations = SlicerIGTTesting::GetNumberOfHeapAllocations() - allocationsBefore;
+
+  int numberOfMismatches = 0;
+  for (int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    // Previous implementation returned negative values for some rotations, only the magnitude is compared
+    if (fabs(differencesDeg[sampleIndex] - fabs(previousDifferencesDeg[sampleIndex])) > 1e-6)
+    {
+      std::cerr << "Orientation difference of sample " << sampleIndex << " differs from the previous implementation: "
+        << differencesDeg[sampleIndex] << " != " << previousDifferencesDeg[sampleIndex] << std::endl;
+      numberOfMismatches++;
+    }
+  }
+
+  // Instantaneous rotation loop of the spin calibration
+  double previousSumRIminusISquared[3][3];
+  startTime = vtkTimerLog::GetUniversalTime();
+  AccumulateSpinMatrixPrevious(matrices, previousSumRIminusISquared);
+  double previousSpinLoopTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+  logic->ReserveToolToReferenceMatrices(numberOfSamples);
+  for (int sampleIndex = 0; sampleIndex < numberOfSamples; sampleIndex++)
+  {
+    logic->AddToolToReferenceMatrix(matrices[sampleIndex]);
+  }
+  double sumRIminusISquared[3][3];
+  allocationsBefore = SlicerIGTTesting::GetNumberOfHeapAllocations();
+  startTime = vtkTimerLog::GetUniversalTime();
+  logic->ComputeSpinRotationMatrixSum(sumRIminusISquared);
+  double spinLoopTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+  unsigned long spinLoopAllocations = SlicerIGTTesting::GetNumberOfHeapAllocations() - allocationsBefore;
+
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      // Sum of squared small values, compared with a tolerance relative to the magnitude of the diagonal
+      double tolerance = 1e-9 * (fabs(previousSumRIminusISquared[i][i]) + fabs(previousSumRIminusISquared[j][j]) + 1e-12);
+      if (fabs(sumRIminusISquared[i][j] - previousSumRIminusISquared[i][j]) > tolerance)
+      {
+        std::cerr << "Spin calibration matrix element (" << i << ", " << j << ") differs from the previous implementation: "
+          << sumRIminusISquared[i][j] << " != " << previousSumRIminusISquared[i][j] << std::endl;
+        numberOfMismatches++;
+      }
+    }
+  }
+
+  // Complete calibrations (for reference, there is no previous implementation to compare with)
+  startTime = vtkTimerLog::GetUniversalTime();
+  bool pivotSuccess = logic->ComputePivotCalibration();
+  double pivotTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+  startTime = vtkTimerLog::GetUniversalTime();
+  bool spinSuccess = logic->ComputeSpinCalibration();
+  double spinTimeSec = vtkTimerLog::GetUniversalTime() - startTime;
+
+  // Streaming calibration in ring buffer mode. The tool is only tilted by a few degrees, so all the convergence criteria
+  // except the orientation difference are met and the orientation criterion is evaluated after each removed pose.
+  const int smallNumberOfStoredPoses = 200;
+  const int largeNumberOfStoredPoses = 5000;
+  std::vector< vtkSmartPointer<vtkMatrix4x4> > smallTiltMatrices;
+  GenerateToolToReferenceMatrices(largeNumberOfStoredPoses + numberOfSamples, 4.0, 0.0, smallTiltMatrices);
+  std::vector< vtkSmartPointer<vtkMatrix4x4> > smallBufferMatrices(smallTiltMatrices.begin(),
+    smallTiltMatrices.begin() + smallNumberOfStoredPoses + numberOfSamples);
+  double smallBufferOrientationDifferenceDeg = 0.0;
+  double largeBufferOrientationDifferenceDeg = 0.0;
+  bool smallBufferConverged = false;
+  bool largeBufferConverged = false;
+  double smallBufferUpdateTimeSec = GetStreamingRingBufferUpdateTimeSec(smallBufferMatrices, smallNumberOfStoredPoses,
+    smallBufferOrientationDifferenceDeg, smallBufferConverged);
+  double largeBufferUpdateTimeSec = GetStreamingRingBufferUpdateTimeSec(smallTiltMatrices, largeNumberOfStoredPoses,
+    largeBufferOrientationDifferenceDeg, largeBufferConverged);
+
+  std::cout << "Number of samples: " << numberOfSamples << std::endl;
+  std::cout << "GetOrientationDifferenceDeg, previous: " << previousOrientationTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples" << std::endl;
+  std::cout << "GetOrientationDifferenceDeg, current: " << orientationTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples"
+    << " (speedup: " << previousOrientationTimeSec / orientationTimeSec << "x, heap allocations: "
+    << double(orientationAllocations) / numberOfSamples << " /sample)" << std::endl;
+  std::cout << "Spin calibration instantaneous rotation loop, previous: " << previousSpinLoopTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples" << std::endl;
+  std::cout << "Spin calibration instantaneous rotation loop, current: " << spinLoopTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples"
+    << " (speedup: " << previousSpinLoopTimeSec / spinLoopTimeSec << "x, heap allocations: "
+    << double(spinLoopAllocations) / numberOfSamples << " /sample)" << std::endl;
+  std::cout << "ComputePivotCalibration: " << pivotTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples"
+    << " (RMSE: " << logic->GetPivotRMSE() << ")" << std::endl;
+  std::cout << "ComputeSpinCalibration: " << spinTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples"
+    << " (RMSE: " << logic->GetSpinRMSE() << ")" << std::endl;
+  std::cout << "Streaming update, ring buffer of " << smallNumberOfStoredPoses << " poses: "
+    << smallBufferUpdateTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples"
+    << " (maximum orientation difference: " << smallBufferOrientationDifferenceDeg << " deg)" << std::endl;
+  std::cout << "Streaming update, ring buffer of " << largeNumberOfStoredPoses << " poses: "
+    << largeBufferUpdateTimeSec * 1000.0 * 10000 / numberOfSamples << " ms/10k samples"
+    << " (maximum orientation difference: " << largeBufferOrientationDifferenceDeg << " deg)" << std::endl;
+
+  if (numberOfMismatches > 0)
+  {
+    std::cerr << "Results differ from the previous implementation for " << numberOfMismatches << " values" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (orientationAllocations > 0 || spinLoopAllocations > 0)
+  {
+    std::cerr << "Rotation computations allocated memory: GetOrientationDifferenceDeg: " << orientationAllocations
+      << ", ComputeSpinRotationMatrixSum: " << spinLoopAllocations << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!pivotSuccess || !spinSuccess)
+  {
+    std::cerr << "Calibration failed: " << logic->GetErrorText() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (smallBufferConverged || largeBufferConverged)
+  {
+    std::cerr << "Streaming calibration converged with small orientation difference" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Recomputing the orientation difference from all the stored poses at each sample would make
+  // updates with the large buffer more than 20x slower
+  if (largeBufferUpdateTimeSec > 5.0 * smallBufferUpdateTimeSec)
+  {
+    std::cerr << "Streaming update time depends on the number of stored poses: " << smallBufferUpdateTimeSec
+      << " sec with " << smallNumberOfStoredPoses << " poses, " << largeBufferUpdateTimeSec << " sec with "
+      << largeNumberOfStoredPoses << " poses" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
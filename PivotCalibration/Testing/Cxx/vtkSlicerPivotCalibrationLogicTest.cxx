@@ -0,0 +1,531 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// PivotCalibration includes
+#include "vtkSlicerPivotCalibrationLogic.h"
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  const double TOOL_TIP_TO_TOOL[3] = { 5.0, -3.0, -150.0 };
+  const double PIVOT_POINT_TO_REFERENCE[3] = { 20.0, 30.0, 40.0 };
+
+  //----------------------------------------------------------------------------
+  // Tool rotated around its tip, which is positioned at the pivot point.
+  // Gaussian noise with the specified standard deviation is added to the tool position.
+  void GeneratePivotToolToReferenceMatrices(int numberOfSamples, double positionNoiseMm,
+    std::vector< vtkSmartPointer<vtkMatrix4x4> >& matrices)
+  {
+    vtkNew<vtkTransform> transform;
+    matrices.clear();
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+      double t = double(i) / numberOfSamples;
+      transform->Identity();
+      transform->Translate(PIVOT_POINT_TO_REFERENCE);
+      transform->RotateX(30.0 * sin(t * 10.0 * vtkMath::Pi()));
+      transform->RotateY(30.0 * cos(t * 14.0 * vtkMath::Pi()));
+      transform->RotateZ(360.0 * t);
+      transform->Translate(-TOOL_TIP_TO_TOOL[0], -TOOL_TIP_TO_TOOL[1], -TOOL_TIP_TO_TOOL[2]);
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      matrix->DeepCopy(transform->GetMatrix());
+      for (int axis = 0; axis < 3; axis++)
+      {
+        matrix->SetElement(axis, 3, matrix->GetElement(axis, 3) + vtkMath::Gaussian(0.0, positionNoiseMm));
+      }
+      matrices.push_back(matrix);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Returns true if the streaming tool tip estimate is the same as the ComputePivotCalibration result
+  bool IsStreamingSolutionEqualToBatchSolution(vtkSlicerPivotCalibrationLogic* logic, double toleranceMm)
+  {
+    if (!logic->ComputePivotCalibration())
+    {
+      std::cerr << "ComputePivotCalibration failed: " << logic->GetErrorText() << std::endl;
+      return false;
+    }
+    vtkNew<vtkMatrix4x4> toolTipToToolMatrix;
+    logic->GetToolTipToToolMatrix(toolTipToToolMatrix.GetPointer());
+    double* streamingToolTipToTool = logic->GetStreamingToolTipToToolTranslation();
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (fabs(streamingToolTipToTool[axis] - toolTipToToolMatrix->GetElement(axis, 3)) > toleranceMm)
+      {
+        std::cerr << "Streaming tool tip position differs from batch solution along axis " << axis
+          << " (" << logic->GetNumberOfToolToReferenceMatrices() << " samples): "
+          << streamingToolTipToTool[axis] << " != " << toolTipToToolMatrix->GetElement(axis, 3) << std::endl;
+        return false;
+      }
+    }
+    if (fabs(logic->GetStreamingPivotRMSE() - logic->GetPivotRMSE()) > toleranceMm)
+    {
+      std::cerr << "Streaming RMSE differs from batch RMSE (" << logic->GetNumberOfToolToReferenceMatrices() << " samples): "
+        << logic->GetStreamingPivotRMSE() << " != " << logic->GetPivotRMSE() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestStreamingPivotCalibration()
+  {
+    vtkMath::RandomSeed(1);
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > matrices;
+    GeneratePivotToolToReferenceMatrices(500, 0.2, matrices);
+
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+      logic->AddToolToReferenceMatrix(matrices[i]);
+      // Compare with the batch solution during recording, not just at the end
+      int numberOfSamples = static_cast<int>(i) + 1;
+      if ((numberOfSamples == 50 || numberOfSamples == 200 || numberOfSamples == 500)
+        && !IsStreamingSolutionEqualToBatchSolution(logic.GetPointer(), 1e-6))
+      {
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (logic->GetNumberOfStreamingPivotSamples() != 500)
+    {
+      std::cerr << "Unexpected number of streaming samples: " << logic->GetNumberOfStreamingPivotSamples() << std::endl;
+      return EXIT_FAILURE;
+    }
+    double* streamingToolTipToTool = logic->GetStreamingToolTipToToolTranslation();
+    if (sqrt(vtkMath::Distance2BetweenPoints(streamingToolTipToTool, TOOL_TIP_TO_TOOL)) > 0.1)
+    {
+      std::cerr << "Streaming tool tip position is inaccurate: " << streamingToolTipToTool[0] << ", "
+        << streamingToolTipToTool[1] << ", " << streamingToolTipToTool[2] << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestRobustPivotCalibration()
+  {
+    vtkMath::RandomSeed(2);
+    const int numberOfSamples = 300;
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > matrices;
+    GeneratePivotToolToReferenceMatrices(numberOfSamples, 0.1, matrices);
+
+    // 30% gross outliers: tool position displaced by 10-50 mm in a random direction
+    std::vector<bool> isOutlier(numberOfSamples, false);
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+      if (i % 10 >= 3)
+      {
+        continue;
+      }
+      isOutlier[i] = true;
+      double direction[3] = { vtkMath::Gaussian(), vtkMath::Gaussian(), vtkMath::Gaussian() };
+      vtkMath::Normalize(direction);
+      double displacementMm = vtkMath::Random(10.0, 50.0);
+      for (int axis = 0; axis < 3; axis++)
+      {
+        matrices[i]->SetElement(axis, 3, matrices[i]->GetElement(axis, 3) + displacementMm * direction[axis]);
+      }
+    }
+
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+      logic->AddToolToReferenceMatrix(matrices[i]);
+    }
+    if (!logic->ComputeRobustPivotCalibration())
+    {
+      std::cerr << "ComputeRobustPivotCalibration failed: " << logic->GetErrorText() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    vtkNew<vtkMatrix4x4> toolTipToToolMatrix;
+    logic->GetToolTipToToolMatrix(toolTipToToolMatrix.GetPointer());
+    double toolTipToTool[3] = { toolTipToToolMatrix->GetElement(0, 3), toolTipToToolMatrix->GetElement(1, 3), toolTipToToolMatrix->GetElement(2, 3) };
+    if (sqrt(vtkMath::Distance2BetweenPoints(toolTipToTool, TOOL_TIP_TO_TOOL)) > 0.1)
+    {
+      std::cerr << "Tool tip position is not recovered: " << toolTipToTool[0] << ", " << toolTipToTool[1] << ", " << toolTipToTool[2] << std::endl;
+      return EXIT_FAILURE;
+    }
+    double* pivotPointToReference = logic->GetPivotPointToReference();
+    if (sqrt(vtkMath::Distance2BetweenPoints(pivotPointToReference, PIVOT_POINT_TO_REFERENCE)) > 0.1)
+    {
+      std::cerr << "Pivot point position is not recovered: " << pivotPointToReference[0] << ", "
+        << pivotPointToReference[1] << ", " << pivotPointToReference[2] << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (logic->GetPivotRMSE() > 0.2)
+    {
+      std::cerr << "RMSE of the inliers is too high: " << logic->GetPivotRMSE() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (logic->GetNumberOfPivotSampleResiduals() != numberOfSamples)
+    {
+      std::cerr << "Unexpected number of sample residuals: " << logic->GetNumberOfPivotSampleResiduals() << std::endl;
+      return EXIT_FAILURE;
+    }
+    int numberOfOutliers = 0;
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+      if (logic->IsPivotSampleInlier(i) == isOutlier[i])
+      {
+        std::cerr << "Sample " << i << " is incorrectly classified as " << (isOutlier[i] ? "inlier" : "outlier")
+          << " (residual: " << logic->GetPivotSampleResidualMm(i) << " mm)" << std::endl;
+        return EXIT_FAILURE;
+      }
+      numberOfOutliers += (isOutlier[i] ? 1 : 0);
+    }
+    double expectedInlierRatio = double(numberOfSamples - numberOfOutliers) / numberOfSamples;
+    if (fabs(logic->GetPivotInlierRatio() - expectedInlierRatio) > 1e-9)
+    {
+      std::cerr << "Unexpected inlier ratio: " << logic->GetPivotInlierRatio() << " (expected: " << expectedInlierRatio << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Inlier ratio must be updated by the non-robust calibration, too
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > inlierMatrices;
+    GeneratePivotToolToReferenceMatrices(100, 0.1, inlierMatrices);
+    logic->ClearToolToReferenceMatrices();
+    for (size_t i = 0; i < inlierMatrices.size(); i++)
+    {
+      logic->AddToolToReferenceMatrix(inlierMatrices[i]);
+    }
+    if (!logic->ComputePivotCalibration())
+    {
+      std::cerr << "ComputePivotCalibration failed: " << logic->GetErrorText() << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (logic->GetPivotInlierRatio() != 1.0)
+    {
+      std::cerr << "Inlier ratio is not updated by ComputePivotCalibration: " << logic->GetPivotInlierRatio() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestPivotCalibrationRingBuffer()
+  {
+    vtkMath::RandomSeed(3);
+    const int maximumNumberOfMatrices = 100;
+    const int numberOfSamples = 250;
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > matrices;
+    GeneratePivotToolToReferenceMatrices(numberOfSamples, 0.2, matrices);
+
+    // Oldest poses are evicted when the buffer wraps around (more than twice)
+    vtkNew<vtkSlicerPivotCalibrationLogic> ringBufferLogic;
+    ringBufferLogic->SetMaximumNumberOfToolToReferenceMatrices(maximumNumberOfMatrices);
+    for (int i = 0; i < numberOfSamples; i++)
+    {
+      ringBufferLogic->AddToolToReferenceMatrix(matrices[i]);
+    }
+
+    // Reference: only the retained poses are added
+    vtkNew<vtkSlicerPivotCalibrationLogic> freshLogic;
+    for (int i = numberOfSamples - maximumNumberOfMatrices; i < numberOfSamples; i++)
+    {
+      freshLogic->AddToolToReferenceMatrix(matrices[i]);
+    }
+
+    if (ringBufferLogic->GetNumberOfToolToReferenceMatrices() != maximumNumberOfMatrices
+      || ringBufferLogic->GetNumberOfStreamingPivotSamples() != maximumNumberOfMatrices)
+    {
+      std::cerr << "Unexpected number of retained poses: " << ringBufferLogic->GetNumberOfToolToReferenceMatrices()
+        << " (streaming: " << ringBufferLogic->GetNumberOfStreamingPivotSamples() << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Retained poses must be returned in the order they were added
+    vtkNew<vtkMatrix4x4> retainedMatrix;
+    for (int i = 0; i < maximumNumberOfMatrices; i++)
+    {
+      ringBufferLogic->GetToolToReferenceMatrix(i, retainedMatrix.GetPointer());
+      vtkMatrix4x4* expectedMatrix = matrices[numberOfSamples - maximumNumberOfMatrices + i];
+      for (int row = 0; row < 3; row++)
+      {
+        for (int column = 0; column < 4; column++)
+        {
+          if (retainedMatrix->GetElement(row, column) != expectedMatrix->GetElement(row, column))
+          {
+            std::cerr << "Retained pose " << i << " is not the expected pose" << std::endl;
+            return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+
+    // Normal equations after add/remove updates must give the same solution as a fresh solve
+    const double toleranceMm = 1e-6;
+    double* ringBufferToolTip = ringBufferLogic->GetStreamingToolTipToToolTranslation();
+    double* freshToolTip = freshLogic->GetStreamingToolTipToToolTranslation();
+    double* ringBufferPivotPoint = ringBufferLogic->GetStreamingPivotPointToReference();
+    double* freshPivotPoint = freshLogic->GetStreamingPivotPointToReference();
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (fabs(ringBufferToolTip[axis] - freshToolTip[axis]) > toleranceMm
+        || fabs(ringBufferPivotPoint[axis] - freshPivotPoint[axis]) > toleranceMm)
+      {
+        std::cerr << "Solution after eviction differs from a fresh solve along axis " << axis << ": tool tip "
+          << ringBufferToolTip[axis] << " != " << freshToolTip[axis] << ", pivot point "
+          << ringBufferPivotPoint[axis] << " != " << freshPivotPoint[axis] << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    if (fabs(ringBufferLogic->GetStreamingPivotRMSE() - freshLogic->GetStreamingPivotRMSE()) > toleranceMm
+      || fabs(ringBufferLogic->GetStreamingToolTipUncertaintyMm() - freshLogic->GetStreamingToolTipUncertaintyMm()) > toleranceMm)
+    {
+      std::cerr << "RMSE or uncertainty after eviction differs from a fresh solve: RMSE "
+        << ringBufferLogic->GetStreamingPivotRMSE() << " != " << freshLogic->GetStreamingPivotRMSE() << ", uncertainty "
+        << ringBufferLogic->GetStreamingToolTipUncertaintyMm() << " != " << freshLogic->GetStreamingToolTipUncertaintyMm() << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Batch calibration of the ring buffer uses the retained poses, too
+    if (!IsStreamingSolutionEqualToBatchSolution(ringBufferLogic.GetPointer(), toleranceMm))
+    {
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // Add a pose rotated by angleDeg around axis and translated by translationMm along the x axis.
+  // Returns true if the pose was stored (not rejected by the pose diversity filter).
+  bool AddRotatedPose(vtkSlicerPivotCalibrationLogic* logic, double angleDeg, const double axis[3], double translationMm = 0.0)
+  {
+    vtkNew<vtkTransform> transform;
+    transform->Translate(translationMm, 0.0, 0.0);
+    transform->RotateWXYZ(angleDeg, axis[0], axis[1], axis[2]);
+    int numberOfRejectedMatricesBefore = logic->GetNumberOfRejectedToolToReferenceMatrices();
+    logic->AddToolToReferenceMatrix(transform->GetMatrix());
+    return logic->GetNumberOfRejectedToolToReferenceMatrices() == numberOfRejectedMatricesBefore;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestPoseDiversityFilter()
+  {
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    logic->SetPoseDiversityFilterEnabled(true);
+    logic->SetMinimumPoseOrientationDifferenceDeg(2.0);
+    logic->SetMinimumPosePositionDifferenceMm(1.0);
+
+    // Pose index cell size is the quaternion distance of rotations that differ by the minimum orientation difference
+    const double cellSize = 2.0 * sin(vtkMath::RadiansFromDegrees(2.0) / 4.0);
+
+    // Rotations that are 1 degree apart, on the two sides of a cell boundary. The quaternion vector part
+    // of a rotation around axis n by angle a is n*sin(a/2), the boundary is where a component equals 3*cellSize.
+    const double xAxis[3] = { 1.0, 0.0, 0.0 };
+    double boundaryAngleDeg = vtkMath::DegreesFromRadians(2.0 * asin(3.0 * cellSize));
+    if (!AddRotatedPose(logic.GetPointer(), boundaryAngleDeg + 0.5, xAxis)
+      || AddRotatedPose(logic.GetPointer(), boundaryAngleDeg - 0.5, xAxis))
+    {
+      std::cerr << "Similar poses in neighbor cells (along one axis) are not detected" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Cell boundary along all three axes, the similar pose is in a corner neighbor cell
+    const double diagonalAxis[3] = { 1.0, 1.0, 1.0 };
+    boundaryAngleDeg = vtkMath::DegreesFromRadians(2.0 * asin(3.0 * cellSize * sqrt(3.0)));
+    if (!AddRotatedPose(logic.GetPointer(), boundaryAngleDeg + 0.5, diagonalAxis)
+      || AddRotatedPose(logic.GetPointer(), boundaryAngleDeg - 0.5, diagonalAxis))
+    {
+      std::cerr << "Similar poses in neighbor cells (along three axes) are not detected" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Rotations near 180 degrees: quaternion w is close to 0, the quaternions of the two similar rotations
+    // (179.5 and 180.5 degrees) are stored with opposite sign of the vector part (q and -q)
+    const double yAxis[3] = { 0.0, 1.0, 0.0 };
+    if (!AddRotatedPose(logic.GetPointer(), 179.5, yAxis)
+      || AddRotatedPose(logic.GetPointer(), 180.5, yAxis))
+    {
+      std::cerr << "Similar poses with quaternions of opposite sign are not detected" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Diverse poses are stored: orientation differs more than the threshold, or position differs more than the threshold
+    if (!AddRotatedPose(logic.GetPointer(), 185.0, yAxis)
+      || !AddRotatedPose(logic.GetPointer(), 179.5, yAxis, 5.0))
+    {
+      std::cerr << "Diverse poses are rejected" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (logic->GetNumberOfToolToReferenceMatrices() != 5 || logic->GetNumberOfRejectedToolToReferenceMatrices() != 3)
+    {
+      std::cerr << "Unexpected number of stored poses: " << logic->GetNumberOfToolToReferenceMatrices()
+        << " (rejected: " << logic->GetNumberOfRejectedToolToReferenceMatrices() << "), expected: 5 (rejected: 3)" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Changing the orientation threshold rebuilds the index: with a smaller threshold 1 degree difference is enough
+    logic->SetMinimumPoseOrientationDifferenceDeg(0.5);
+    if (!AddRotatedPose(logic.GetPointer(), 180.5, yAxis))
+    {
+      std::cerr << "Pose is rejected after decreasing the minimum orientation difference" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    logic->ClearToolToReferenceMatrices();
+    if (logic->GetNumberOfRejectedToolToReferenceMatrices() != 0)
+    {
+      std::cerr << "Number of rejected poses is not reset by clear" << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  void CountEventCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* vtkNotUsed(callData))
+  {
+    int* numberOfEvents = static_cast<int*>(clientData);
+    (*numberOfEvents)++;
+  }
+
+  //----------------------------------------------------------------------------
+  // Returns the number of convergence events invoked while the matrices are added
+  int AddMatricesAndCountConvergenceEvents(vtkSlicerPivotCalibrationLogic* logic,
+    const std::vector< vtkSmartPointer<vtkMatrix4x4> >& matrices)
+  {
+    int numberOfEvents = 0;
+    vtkNew<vtkCallbackCommand> callback;
+    callback->SetCallback(CountEventCallback);
+    callback->SetClientData(&numberOfEvents);
+    unsigned long observerTag = logic->AddObserver(vtkSlicerPivotCalibrationLogic::PivotCalibrationConvergedEvent, callback.GetPointer());
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+      logic->AddToolToReferenceMatrix(matrices[i]);
+    }
+    logic->RemoveObserver(observerTag);
+    return numberOfEvents;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestStreamingPivotCalibrationConvergence()
+  {
+    vtkMath::RandomSeed(4);
+
+    // Tool pivoted in all directions: converged event is invoked exactly once
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > diverseMatrices;
+    GeneratePivotToolToReferenceMatrices(500, 0.1, diverseMatrices);
+    vtkNew<vtkSlicerPivotCalibrationLogic> logic;
+    int numberOfEvents = AddMatricesAndCountConvergenceEvents(logic.GetPointer(), diverseMatrices);
+    if (numberOfEvents != 1 || !logic->GetStreamingPivotConverged())
+    {
+      std::cerr << "Convergence event is expected once for diverse poses, received " << numberOfEvents << " times" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Tool only tilted around a single axis (sweeping in one plane): tool tip position along the axis is undetermined,
+    // therefore the calibration must not converge, even though the orientation difference is large.
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > singleAxisMatrices;
+    vtkNew<vtkTransform> transform;
+    for (int i = 0; i < 500; i++)
+    {
+      transform->Identity();
+      transform->Translate(PIVOT_POINT_TO_REFERENCE);
+      transform->RotateX(30.0 * sin(double(i) / 500 * 10.0 * vtkMath::Pi()));
+      transform->Translate(-TOOL_TIP_TO_TOOL[0], -TOOL_TIP_TO_TOOL[1], -TOOL_TIP_TO_TOOL[2]);
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      matrix->DeepCopy(transform->GetMatrix());
+      for (int axis = 0; axis < 3; axis++)
+      {
+        matrix->SetElement(axis, 3, matrix->GetElement(axis, 3) + vtkMath::Gaussian(0.0, 0.1));
+      }
+      singleAxisMatrices.push_back(matrix);
+    }
+    logic->ClearToolToReferenceMatrices();
+    numberOfEvents = AddMatricesAndCountConvergenceEvents(logic.GetPointer(), singleAxisMatrices);
+    if (numberOfEvents != 0 || logic->GetStreamingPivotConverged())
+    {
+      std::cerr << "Convergence event is not expected for poses rotated around a single axis, received " << numberOfEvents << " times" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (logic->GetStreamingMaximumOrientationDifferenceDeg() < 29.0)
+    {
+      std::cerr << "Unexpected orientation difference of single axis sweep: " << logic->GetStreamingMaximumOrientationDifferenceDeg() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Orientation difference is computed from the retained poses: after the diverse poses are removed from the ring buffer
+    // only poses with the same orientation remain.
+    logic->ClearToolToReferenceMatrices();
+    logic->SetMaximumNumberOfToolToReferenceMatrices(200);
+    std::vector< vtkSmartPointer<vtkMatrix4x4> > matrices(diverseMatrices.begin(), diverseMatrices.begin() + 50);
+    for (int i = 0; i < 300; i++)
+    {
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      matrix->DeepCopy(diverseMatrices[0]);
+      for (int axis = 0; axis < 3; axis++)
+      {
+        matrix->SetElement(axis, 3, matrix->GetElement(axis, 3) + vtkMath::Gaussian(0.0, 0.1));
+      }
+      matrices.push_back(matrix);
+    }
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+      logic->AddToolToReferenceMatrix(matrices[i]);
+    }
+    if (logic->GetStreamingMaximumOrientationDifferenceDeg() > 1e-6)
+    {
+      std::cerr << "Orientation difference includes removed poses: " << logic->GetStreamingMaximumOrientationDifferenceDeg() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogicTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  if (TestStreamingPivotCalibration() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestStreamingPivotCalibration failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestRobustPivotCalibration() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestRobustPivotCalibration failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestPivotCalibrationRingBuffer() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestPivotCalibrationRingBuffer failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestPoseDiversityFilter() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestPoseDiversityFilter failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestStreamingPivotCalibrationConvergence() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestStreamingPivotCalibrationConvergence failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
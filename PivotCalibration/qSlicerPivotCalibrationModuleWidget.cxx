@@ -32,6 +32,10 @@
 
 #include <vtkMRMLLinearTransformNode.h>
 
+// STD includes
+#include <iomanip>
+#include <sstream>
+
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class qSlicerPivotCalibrationModuleWidgetPrivate: public Ui_qSlicerPivotCalibrationModule
@@ -147,6 +151,12 @@ void qSlicerPivotCalibrationModuleWidget::setup()
   
   connect( d->startupTimerEdit, SIGNAL( valueChanged(double) ), this, SLOT( setStartupDurationSec(double) ) );
   connect( d->durationTimerEdit, SIGNAL( valueChanged(double) ), this, SLOT( setSamplingDurationSec(double) ) );
+
+  d->robustThresholdEdit->setValue( d->logic()->GetRobustInlierThresholdMm() );
+  connect( d->robustThresholdEdit, SIGNAL( valueChanged(double) ), this, SLOT( setRobustInlierThresholdMm(double) ) );
+
+  // Stop pivot sampling as soon as enough data is collected
+  qvtkConnect( d->logic(), vtkSlicerPivotCalibrationLogic::PivotCalibrationConvergedEvent, this, SLOT( onPivotCalibrationConverged() ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -215,8 +225,23 @@ void qSlicerPivotCalibrationModuleWidget::onPivotSamplingTimeout()
   
   --this->pivotSamplingRemainingTimerPeriodCount;
   ss << "Sampling time left: " << this->pivotSamplingRemainingTimerPeriodCount;
-  d->CountdownLabel->setText(ss.str().c_str());  
-  
+  d->CountdownLabel->setText(ss.str().c_str());
+
+  // Show the current estimate while still recording
+  if (d->logic()->GetNumberOfStreamingPivotSamples() > 0)
+  {
+    std::stringstream ssRmse;
+    ssRmse << d->logic()->GetStreamingPivotRMSE() << " (" << d->logic()->GetNumberOfStreamingPivotSamples() << " samples, tip uncertainty: "
+      << d->logic()->GetStreamingToolTipUncertaintyMm() << " mm)";
+    d->rmseLabel->setText(ssRmse.str().c_str());
+
+    double* toolTipToToolTranslation = d->logic()->GetStreamingToolTipToToolTranslation();
+    std::stringstream ssToolTip;
+    ssToolTip << std::fixed << std::setprecision(2) << toolTipToToolTranslation[0] << ", "
+      << toolTipToToolTranslation[1] << ", " << toolTipToToolTranslation[2];
+    d->toolTipOffsetLabel->setText(ssToolTip.str().c_str());
+  }
+
   if (this->pivotSamplingRemainingTimerPeriodCount <= 0)
   {
     d->CountdownLabel->setText("Sampling complete");
@@ -227,6 +252,22 @@ void qSlicerPivotCalibrationModuleWidget::onPivotSamplingTimeout()
 }
 
 
+//-----------------------------------------------------------------------------
+void qSlicerPivotCalibrationModuleWidget::onPivotCalibrationConverged()
+{
+  Q_D(qSlicerPivotCalibrationModuleWidget);
+
+  if (!this->pivotSamplingTimer->isActive())
+  {
+    // Not recording pivot calibration samples (e.g., transforms are added from a script)
+    return;
+  }
+  d->CountdownLabel->setText("Sampling complete (calibration converged)");
+
+  this->pivotSamplingTimer->stop();
+  this->onPivotStop();
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerPivotCalibrationModuleWidget::onSpinStartupTimeout()
 {
@@ -280,7 +321,15 @@ void qSlicerPivotCalibrationModuleWidget::onPivotStop()
   Q_D(qSlicerPivotCalibrationModuleWidget);
   
   d->logic()->SetRecordingState(false);
-  d->logic()->ComputePivotCalibration();
+  bool robust = (d->robustCheckBox->checkState() == Qt::Checked);
+  if (robust)
+  {
+    d->logic()->ComputeRobustPivotCalibration();
+  }
+  else
+  {
+    d->logic()->ComputePivotCalibration();
+  }
   
   vtkMRMLLinearTransformNode* outputTransform = vtkMRMLLinearTransformNode::SafeDownCast(d->OutputComboBox->currentNode());
   vtkSmartPointer<vtkMatrix4x4> outputMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
@@ -292,7 +341,16 @@ void qSlicerPivotCalibrationModuleWidget::onPivotStop()
   
   std::stringstream ss;
   ss << d->logic()->GetPivotRMSE();
+  if (robust)
+  {
+    ss << " (inliers: " << int(d->logic()->GetPivotInlierRatio() * 100.0 + 0.5) << "%)";
+  }
   d->rmseLabel->setText(ss.str().c_str());
+
+  std::stringstream ssToolTip;
+  ssToolTip << std::fixed << std::setprecision(2) << outputMatrix->GetElement(0, 3) << ", "
+    << outputMatrix->GetElement(1, 3) << ", " << outputMatrix->GetElement(2, 3);
+  d->toolTipOffsetLabel->setText(ssToolTip.str().c_str());
   
   d->logic()->ClearToolToReferenceMatrices();
 
@@ -342,3 +400,10 @@ void qSlicerPivotCalibrationModuleWidget::setSamplingDurationSec(double timeSec)
   this->samplingDurationSec = (int)timeSec;
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerPivotCalibrationModuleWidget::setRobustInlierThresholdMm(double thresholdMm)
+{
+  Q_D(qSlicerPivotCalibrationModuleWidget);
+  d->logic()->SetRobustInlierThresholdMm(thresholdMm);
+}
+
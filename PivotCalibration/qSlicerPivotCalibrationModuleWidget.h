@@ -54,11 +54,14 @@ protected slots:
   
   void setStartupDurationSec(double);
   void setSamplingDurationSec(double);
+  void setRobustInlierThresholdMm(double);
   
   void onPivotStartupTimeout();
   void onPivotSamplingTimeout();
   void onSpinStartupTimeout();
   void onSpinSamplingTimeout();
+
+  void onPivotCalibrationConverged();
   
 protected:
   QScopedPointer<qSlicerPivotCalibrationModuleWidgetPrivate> d_ptr;
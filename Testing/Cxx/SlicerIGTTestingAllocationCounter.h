@@ -0,0 +1,66 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Heap allocation counter for tests that check that a processing loop does not allocate memory.
+// Allocations are counted by replacing the global operator new, which affects the entire executable.
+// Therefore this file must be included in exactly one source file of a test executable
+// and that executable should not contain any other tests (use slicerigt_add_allocation_test,
+// defined in SlicerIGTTestingMacros.cmake, to add such a test).
+
+#ifndef SlicerIGTTestingAllocationCounter_h
+#define SlicerIGTTestingAllocationCounter_h
+
+// STD includes
+#include <cstdlib>
+#include <new>
+
+#if __cplusplus >= 201103L
+#define SLICERIGT_TESTING_NOEXCEPT noexcept
+#else
+#define SLICERIGT_TESTING_NOEXCEPT throw()
+#endif
+
+namespace SlicerIGTTesting
+{
+  // Number of heap allocations made through the global operator new since the start of the program
+  unsigned long NumberOfHeapAllocations = 0;
+
+  unsigned long GetNumberOfHeapAllocations()
+  {
+    return NumberOfHeapAllocations;
+  }
+}
+
+//----------------------------------------------------------------------------
+void* operator new(std::size_t size)
+{
+  SlicerIGTTesting::NumberOfHeapAllocations++;
+  void* p = malloc(size > 0 ? size : 1);
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+//----------------------------------------------------------------------------
+void operator delete(void* p) SLICERIGT_TESTING_NOEXCEPT
+{
+  free(p);
+}
+
+#endif
@@ -0,0 +1,18 @@
+#-----------------------------------------------------------------------------
+# slicerigt_add_allocation_test(<testname> <kit>)
+#
+# Add a test that counts heap allocations using SlicerIGTTestingAllocationCounter.h.
+# The counter replaces the global operator new, therefore the test is built into its own
+# executable (<testname>CxxTests) from <testname>.cxx, which is linked to <kit>.
+#
+function(slicerigt_add_allocation_test testname kit)
+  include_directories(${SlicerIGT_SOURCE_DIR}/Testing/Cxx)
+  create_test_sourcelist(${testname}Tests ${testname}CxxTests.cxx
+    ${testname}.cxx
+    EXTRA_INCLUDE vtkMRMLDebugLeaksMacro.h
+    )
+  add_executable(${testname}CxxTests ${${testname}Tests})
+  target_link_libraries(${testname}CxxTests ${kit})
+  add_test(NAME ${testname} COMMAND ${Slicer_LAUNCH_COMMAND} $<TARGET_FILE:${testname}CxxTests> ${testname})
+  set_property(TEST ${testname} PROPERTY LABELS ${kit})
+endfunction()
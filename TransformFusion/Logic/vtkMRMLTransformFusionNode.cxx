@@ -23,6 +23,8 @@
 
 // VTK includes
 #include <vtkCommand.h>
+#include <vtkIntArray.h>
+#include <vtkNew.h>
 #include <vtkObjectFactory.h>
 
 // MRML includes
@@ -35,6 +37,12 @@
 //----------------------------------------------------------------------------
 std::string vtkMRMLTransformFusionNode::OutputTransformReferenceRole = std::string("outputTransform");
 std::string vtkMRMLTransformFusionNode::InputTransformsReferenceRole = std::string("inputTransforms");
+std::string vtkMRMLTransformFusionNode::InputTimestampAttributeName = std::string("Timestamp");
+
+static const double DEFAULT_INPUT_POSITION_NOISE_MM = 0.5;
+static const double DEFAULT_INPUT_ORIENTATION_NOISE_DEG = 0.5;
+static const double DEFAULT_INPUT_WEIGHT = 1.0;
+static const double DEFAULT_INPUT_LATENCY_SEC = 0.0;
 
 //----------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLTransformFusionNode);
@@ -42,8 +50,23 @@ vtkMRMLNodeNewMacro(vtkMRMLTransformFusionNode);
 //----------------------------------------------------------------------------
 vtkMRMLTransformFusionNode::vtkMRMLTransformFusionNode()
 {
+  vtkNew<vtkIntArray> inputTransformEvents;
+  inputTransformEvents->InsertNextValue( vtkMRMLTransformableNode::TransformModifiedEvent );
+  this->AddNodeReferenceRole( vtkMRMLTransformFusionNode::InputTransformsReferenceRole.c_str(), NULL, inputTransformEvents.GetPointer() );
+
   //Parameters
   this->UpdatesPerSecond = 60;
+  this->EventDrivenUpdate = false;
+  this->SynchronizeInputs = false;
+  this->FusionTechnique = 0;
+  this->OutlierPositionThresholdMm = 5.0;
+  this->OutlierOrientationThresholdDeg = 5.0;
+  this->AccelerationNoiseMmPerSec2 = 2000.0;
+  this->AngularAccelerationNoiseDegPerSec2 = 1000.0;
+  this->PredictToUpdateTime = false;
+  this->PredictionLookAheadSec = 0.03;
+  this->PredictionVelocityWindowSec = 0.05;
+  this->MaximumPredictionIntervalSec = 0.2;
 }
 
 //----------------------------------------------------------------------------
@@ -51,6 +74,36 @@ vtkMRMLTransformFusionNode::~vtkMRMLTransformFusionNode()
 {
 }
 
+//----------------------------------------------------------------------------
+// Read space-separated list of numbers
+static void ReadDoubleList(const char* attValue, std::vector<double>& values)
+{
+  values.clear();
+  std::stringstream ss;
+  ss << attValue;
+  double value = 0;
+  while (ss >> value)
+  {
+    values.push_back(value);
+  }
+}
+
+//----------------------------------------------------------------------------
+// Replace zero and negative values by the default value. Returns true if any value was replaced.
+static bool ReplaceNonPositiveValues(std::vector<double>& values, double defaultValue)
+{
+  bool replaced = false;
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    if (values[i] <= 0)
+    {
+      values[i] = defaultValue;
+      replaced = true;
+    }
+  }
+  return replaced;
+}
+
 //----------------------------------------------------------------------------
 void vtkMRMLTransformFusionNode::ReadXMLAttributes(const char** atts)
 {
@@ -69,6 +122,91 @@ void vtkMRMLTransformFusionNode::ReadXMLAttributes(const char** atts)
       ss >> this->UpdatesPerSecond;
       continue;
     }    
+    if (!strcmp(attName,"EventDrivenUpdate")){
+      this->EventDrivenUpdate = (strcmp(attValue,"true") == 0);
+      continue;
+    }
+    if (!strcmp(attName,"SynchronizeInputs")){
+      this->SynchronizeInputs = (strcmp(attValue,"true") == 0);
+      continue;
+    }
+    if (!strcmp(attName,"FusionTechnique")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->FusionTechnique;
+      continue;
+    }
+    if (!strcmp(attName,"InputPositionNoiseMm")){
+      ReadDoubleList(attValue, this->InputPositionNoiseMm);
+      // Zero or negative noise would make the Kalman filter numerically invalid
+      if (ReplaceNonPositiveValues(this->InputPositionNoiseMm, DEFAULT_INPUT_POSITION_NOISE_MM))
+      {
+        vtkWarningMacro("ReadXMLAttributes: invalid InputPositionNoiseMm values are replaced by " << DEFAULT_INPUT_POSITION_NOISE_MM);
+      }
+      continue;
+    }
+    if (!strcmp(attName,"InputOrientationNoiseDeg")){
+      ReadDoubleList(attValue, this->InputOrientationNoiseDeg);
+      if (ReplaceNonPositiveValues(this->InputOrientationNoiseDeg, DEFAULT_INPUT_ORIENTATION_NOISE_DEG))
+      {
+        vtkWarningMacro("ReadXMLAttributes: invalid InputOrientationNoiseDeg values are replaced by " << DEFAULT_INPUT_ORIENTATION_NOISE_DEG);
+      }
+      continue;
+    }
+    if (!strcmp(attName,"InputWeights")){
+      ReadDoubleList(attValue, this->InputWeights);
+      continue;
+    }
+    if (!strcmp(attName,"InputLatencySec")){
+      ReadDoubleList(attValue, this->InputLatencySec);
+      continue;
+    }
+    if (!strcmp(attName,"OutlierPositionThresholdMm")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->OutlierPositionThresholdMm;
+      continue;
+    }
+    if (!strcmp(attName,"OutlierOrientationThresholdDeg")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->OutlierOrientationThresholdDeg;
+      continue;
+    }
+    if (!strcmp(attName,"AccelerationNoiseMmPerSec2")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->AccelerationNoiseMmPerSec2;
+      continue;
+    }
+    if (!strcmp(attName,"AngularAccelerationNoiseDegPerSec2")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->AngularAccelerationNoiseDegPerSec2;
+      continue;
+    }
+    if (!strcmp(attName,"PredictToUpdateTime")){
+      this->PredictToUpdateTime = (strcmp(attValue,"true") == 0);
+      continue;
+    }
+    if (!strcmp(attName,"PredictionLookAheadSec")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->PredictionLookAheadSec;
+      continue;
+    }
+    if (!strcmp(attName,"PredictionVelocityWindowSec")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->PredictionVelocityWindowSec;
+      continue;
+    }
+    if (!strcmp(attName,"MaximumPredictionIntervalSec")){
+      std::stringstream ss;
+      ss << attValue;
+      ss >> this->MaximumPredictionIntervalSec;
+      continue;
+    }
   }
 
   this->WriteXML(std::cout,1);
@@ -81,6 +219,41 @@ void vtkMRMLTransformFusionNode::WriteXML(ostream& of, int nIndent)
   vtkIndent indent(nIndent);
   
   of << indent << " UpdatesPerSecond=\""<< this->UpdatesPerSecond << "\"";    
+  of << indent << " EventDrivenUpdate=\""<< (this->EventDrivenUpdate ? "true" : "false") << "\"";
+  of << indent << " SynchronizeInputs=\""<< (this->SynchronizeInputs ? "true" : "false") << "\"";
+  of << indent << " FusionTechnique=\""<< this->FusionTechnique << "\"";
+  of << indent << " InputPositionNoiseMm=\"";
+  for (size_t i = 0; i < this->InputPositionNoiseMm.size(); i++)
+  {
+    of << (i > 0 ? " " : "") << this->InputPositionNoiseMm[i];
+  }
+  of << "\"";
+  of << indent << " InputOrientationNoiseDeg=\"";
+  for (size_t i = 0; i < this->InputOrientationNoiseDeg.size(); i++)
+  {
+    of << (i > 0 ? " " : "") << this->InputOrientationNoiseDeg[i];
+  }
+  of << "\"";
+  of << indent << " InputWeights=\"";
+  for (size_t i = 0; i < this->InputWeights.size(); i++)
+  {
+    of << (i > 0 ? " " : "") << this->InputWeights[i];
+  }
+  of << "\"";
+  of << indent << " InputLatencySec=\"";
+  for (size_t i = 0; i < this->InputLatencySec.size(); i++)
+  {
+    of << (i > 0 ? " " : "") << this->InputLatencySec[i];
+  }
+  of << "\"";
+  of << indent << " OutlierPositionThresholdMm=\""<< this->OutlierPositionThresholdMm << "\"";
+  of << indent << " OutlierOrientationThresholdDeg=\""<< this->OutlierOrientationThresholdDeg << "\"";
+  of << indent << " AccelerationNoiseMmPerSec2=\""<< this->AccelerationNoiseMmPerSec2 << "\"";
+  of << indent << " AngularAccelerationNoiseDegPerSec2=\""<< this->AngularAccelerationNoiseDegPerSec2 << "\"";
+  of << indent << " PredictToUpdateTime=\""<< (this->PredictToUpdateTime ? "true" : "false") << "\"";
+  of << indent << " PredictionLookAheadSec=\""<< this->PredictionLookAheadSec << "\"";
+  of << indent << " PredictionVelocityWindowSec=\""<< this->PredictionVelocityWindowSec << "\"";
+  of << indent << " MaximumPredictionIntervalSec=\""<< this->MaximumPredictionIntervalSec << "\"";
 }
 
 //----------------------------------------------------------------------------
@@ -91,6 +264,21 @@ void vtkMRMLTransformFusionNode::Copy(vtkMRMLNode *anode)
   this->DisableModifiedEventOn();
   
   this->UpdatesPerSecond = node->UpdatesPerSecond;
+  this->EventDrivenUpdate = node->EventDrivenUpdate;
+  this->SynchronizeInputs = node->SynchronizeInputs;
+  this->FusionTechnique = node->FusionTechnique;
+  this->InputPositionNoiseMm = node->InputPositionNoiseMm;
+  this->InputOrientationNoiseDeg = node->InputOrientationNoiseDeg;
+  this->InputWeights = node->InputWeights;
+  this->InputLatencySec = node->InputLatencySec;
+  this->OutlierPositionThresholdMm = node->OutlierPositionThresholdMm;
+  this->OutlierOrientationThresholdDeg = node->OutlierOrientationThresholdDeg;
+  this->AccelerationNoiseMmPerSec2 = node->AccelerationNoiseMmPerSec2;
+  this->AngularAccelerationNoiseDegPerSec2 = node->AngularAccelerationNoiseDegPerSec2;
+  this->PredictToUpdateTime = node->PredictToUpdateTime;
+  this->PredictionLookAheadSec = node->PredictionLookAheadSec;
+  this->PredictionVelocityWindowSec = node->PredictionVelocityWindowSec;
+  this->MaximumPredictionIntervalSec = node->MaximumPredictionIntervalSec;
 
   this->DisableModifiedEventOff();
   this->InvokePendingModifiedEvent();
@@ -117,13 +305,30 @@ vtkMRMLLinearTransformNode* vtkMRMLTransformFusionNode::GetInputTransformNode(in
 //----------------------------------------------------------------------------
 void vtkMRMLTransformFusionNode::AddAndObserveInputTransformNode(vtkMRMLLinearTransformNode* node)
 {
-  this->AddNodeReferenceID(vtkMRMLTransformFusionNode::InputTransformsReferenceRole.c_str(),node->GetID());
+  this->AddAndObserveNodeReferenceID(vtkMRMLTransformFusionNode::InputTransformsReferenceRole.c_str(),node->GetID());
 }
 
 //----------------------------------------------------------------------------
 void vtkMRMLTransformFusionNode::RemoveInputTransformNode(int n)
 {
   this->RemoveNthNodeReferenceID(vtkMRMLTransformFusionNode::InputTransformsReferenceRole.c_str(),n);
+  // Keep per-input parameters aligned with the inputs
+  if (n >= 0 && n < static_cast<int>(this->InputPositionNoiseMm.size()))
+  {
+    this->InputPositionNoiseMm.erase(this->InputPositionNoiseMm.begin() + n);
+  }
+  if (n >= 0 && n < static_cast<int>(this->InputOrientationNoiseDeg.size()))
+  {
+    this->InputOrientationNoiseDeg.erase(this->InputOrientationNoiseDeg.begin() + n);
+  }
+  if (n >= 0 && n < static_cast<int>(this->InputWeights.size()))
+  {
+    this->InputWeights.erase(this->InputWeights.begin() + n);
+  }
+  if (n >= 0 && n < static_cast<int>(this->InputLatencySec.size()))
+  {
+    this->InputLatencySec.erase(this->InputLatencySec.begin() + n);
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -132,11 +337,199 @@ int vtkMRMLTransformFusionNode::GetNumberOfInputTransformNodes()
   return this->GetNumberOfNodeReferences(vtkMRMLTransformFusionNode::InputTransformsReferenceRole.c_str());
 }
 
+//----------------------------------------------------------------------------
+void vtkMRMLTransformFusionNode::SetInputPositionNoiseMm(int n, double noiseMm)
+{
+  if (n < 0)
+  {
+    vtkErrorMacro("SetInputPositionNoiseMm failed: invalid input index " << n);
+    return;
+  }
+  if (noiseMm <= 0)
+  {
+    vtkErrorMacro("SetInputPositionNoiseMm failed: noise must be positive, got " << noiseMm);
+    return;
+  }
+  if (n >= static_cast<int>(this->InputPositionNoiseMm.size()))
+  {
+    this->InputPositionNoiseMm.resize(n + 1, DEFAULT_INPUT_POSITION_NOISE_MM);
+  }
+  else if (this->InputPositionNoiseMm[n] == noiseMm)
+  {
+    return;
+  }
+  this->InputPositionNoiseMm[n] = noiseMm;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLTransformFusionNode::GetInputPositionNoiseMm(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->InputPositionNoiseMm.size()))
+  {
+    return DEFAULT_INPUT_POSITION_NOISE_MM;
+  }
+  return this->InputPositionNoiseMm[n];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLTransformFusionNode::SetInputOrientationNoiseDeg(int n, double noiseDeg)
+{
+  if (n < 0)
+  {
+    vtkErrorMacro("SetInputOrientationNoiseDeg failed: invalid input index " << n);
+    return;
+  }
+  if (noiseDeg <= 0)
+  {
+    vtkErrorMacro("SetInputOrientationNoiseDeg failed: noise must be positive, got " << noiseDeg);
+    return;
+  }
+  if (n >= static_cast<int>(this->InputOrientationNoiseDeg.size()))
+  {
+    this->InputOrientationNoiseDeg.resize(n + 1, DEFAULT_INPUT_ORIENTATION_NOISE_DEG);
+  }
+  else if (this->InputOrientationNoiseDeg[n] == noiseDeg)
+  {
+    return;
+  }
+  this->InputOrientationNoiseDeg[n] = noiseDeg;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLTransformFusionNode::GetInputOrientationNoiseDeg(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->InputOrientationNoiseDeg.size()))
+  {
+    return DEFAULT_INPUT_ORIENTATION_NOISE_DEG;
+  }
+  return this->InputOrientationNoiseDeg[n];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLTransformFusionNode::SetInputWeight(int n, double weight)
+{
+  if (n < 0)
+  {
+    vtkErrorMacro("SetInputWeight failed: invalid input index " << n);
+    return;
+  }
+  if (weight < 0)
+  {
+    vtkWarningMacro("SetInputWeight: negative weight is not allowed, set to 0");
+    weight = 0;
+  }
+  if (n >= static_cast<int>(this->InputWeights.size()))
+  {
+    this->InputWeights.resize(n + 1, DEFAULT_INPUT_WEIGHT);
+  }
+  else if (this->InputWeights[n] == weight)
+  {
+    return;
+  }
+  this->InputWeights[n] = weight;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLTransformFusionNode::GetInputWeight(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->InputWeights.size()))
+  {
+    return DEFAULT_INPUT_WEIGHT;
+  }
+  return this->InputWeights[n];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLTransformFusionNode::SetInputLatencySec(int n, double latencySec)
+{
+  if (n < 0)
+  {
+    vtkErrorMacro("SetInputLatencySec failed: invalid input index " << n);
+    return;
+  }
+  if (n >= static_cast<int>(this->InputLatencySec.size()))
+  {
+    this->InputLatencySec.resize(n + 1, DEFAULT_INPUT_LATENCY_SEC);
+  }
+  else if (this->InputLatencySec[n] == latencySec)
+  {
+    return;
+  }
+  this->InputLatencySec[n] = latencySec;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLTransformFusionNode::GetInputLatencySec(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->InputLatencySec.size()))
+  {
+    return DEFAULT_INPUT_LATENCY_SEC;
+  }
+  return this->InputLatencySec[n];
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLTransformFusionNode::GetInputTransformNodeIndex(vtkMRMLNode* node)
+{
+  if (node == NULL)
+  {
+    return -1;
+  }
+  int numberOfInputs = this->GetNumberOfInputTransformNodes();
+  for (int i = 0; i < numberOfInputs; i++)
+  {
+    if (this->GetNthNodeReference(vtkMRMLTransformFusionNode::InputTransformsReferenceRole.c_str(), i) == node)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLTransformFusionNode::ProcessMRMLEvents( vtkObject *caller, unsigned long event, void *callData )
+{
+  this->Superclass::ProcessMRMLEvents(caller, event, callData);
+
+  vtkMRMLNode* callerNode = vtkMRMLNode::SafeDownCast( caller );
+  if ( callerNode == NULL || event != vtkMRMLTransformableNode::TransformModifiedEvent )
+  {
+    return;
+  }
+
+  int inputIndex = this->GetInputTransformNodeIndex(callerNode);
+  if (inputIndex >= 0)
+  {
+    this->InvokeEvent(InputDataModifiedEvent, &inputIndex);
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkMRMLTransformFusionNode::PrintSelf(ostream& os, vtkIndent indent)
 {
   Superclass::PrintSelf(os,indent);
 
   os << indent << " UpdatesPerSecond = "<< this->UpdatesPerSecond << "\n";   
+  os << indent << " EventDrivenUpdate = "<< (this->EventDrivenUpdate ? "true" : "false") << "\n";
+  os << indent << " SynchronizeInputs = "<< (this->SynchronizeInputs ? "true" : "false") << "\n";
+  os << indent << " FusionTechnique = "<< this->FusionTechnique << "\n";
+  for (int i = 0; i < this->GetNumberOfInputTransformNodes(); i++)
+  {
+    os << indent << " Input " << i << " noise = " << this->GetInputPositionNoiseMm(i) << "mm, "
+      << this->GetInputOrientationNoiseDeg(i) << "deg, weight = " << this->GetInputWeight(i)
+      << ", latency = " << this->GetInputLatencySec(i) << "sec\n";
+  }
+  os << indent << " OutlierPositionThresholdMm = "<< this->OutlierPositionThresholdMm << "\n";
+  os << indent << " OutlierOrientationThresholdDeg = "<< this->OutlierOrientationThresholdDeg << "\n";
+  os << indent << " AccelerationNoiseMmPerSec2 = "<< this->AccelerationNoiseMmPerSec2 << "\n";
+  os << indent << " AngularAccelerationNoiseDegPerSec2 = "<< this->AngularAccelerationNoiseDegPerSec2 << "\n";
+  os << indent << " PredictToUpdateTime = "<< (this->PredictToUpdateTime ? "true" : "false") << "\n";
+  os << indent << " PredictionLookAheadSec = "<< this->PredictionLookAheadSec << "\n";
+  os << indent << " PredictionVelocityWindowSec = "<< this->PredictionVelocityWindowSec << "\n";
+  os << indent << " MaximumPredictionIntervalSec = "<< this->MaximumPredictionIntervalSec << "\n";
 }
 
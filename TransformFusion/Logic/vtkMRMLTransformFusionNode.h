@@ -23,12 +23,16 @@
 #ifndef __vtkMRMLTransformFusionNode_h
 #define __vtkMRMLTransformFusionNode_h
 
+#include <vtkCommand.h>
 #include <vtkMRML.h>
 #include <vtkMRMLNode.h>
 #include <vtkMRMLLinearTransformNode.h>
 
 #include "vtkSlicerTransformFusionModuleLogicExport.h"
 
+// STD includes
+#include <vector>
+
 /// \ingroup Slicer_QtModules_TransformFusion
 class VTK_SLICER_TRANSFORMFUSION_MODULE_LOGIC_EXPORT vtkMRMLTransformFusionNode : 
   public vtkMRMLNode
@@ -39,14 +43,27 @@ public:
   vtkTypeMacro(vtkMRMLTransformFusionNode, vtkMRMLNode);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  enum Events
+  {
+    /// The node stores both inputs (e.g., tracked tool transforms) and computed parameters.
+    /// A separate event is used for indicating that an input transform has been changed,
+    /// the index of the changed input is passed as call data (int*).
+    // vtkCommand::UserEvent + 555 is just a random value that is very unlikely to be used for anything else in this class
+    InputDataModifiedEvent = vtkCommand::UserEvent + 555
+  };
+
   static std::string OutputTransformReferenceRole;
   static std::string InputTransformsReferenceRole;
+  /// Name of the input transform node attribute that stores the acquisition time of the current pose
+  /// (universal time, in seconds), if it is provided by the tracking device
+  static std::string InputTimestampAttributeName;
 
   virtual vtkMRMLNode* CreateNodeInstance();
   virtual void ReadXMLAttributes( const char** atts);
   virtual void WriteXML(ostream& of, int indent);
   virtual void Copy(vtkMRMLNode *node);
   virtual const char* GetNodeTagName() {return "TransformFusionParameters";};
+  virtual void ProcessMRMLEvents( vtkObject *caller, unsigned long event, void *callData );
 
 public:
   vtkMRMLLinearTransformNode* GetOutputTransformNode();
@@ -57,8 +74,84 @@ public:
   void RemoveInputTransformNode(int n);
   int GetNumberOfInputTransformNodes();
 
+  /// Return the index of the input transform node, -1 if the node is not an input
+  int GetInputTransformNodeIndex(vtkMRMLNode* node);
+
   vtkSetMacro(UpdatesPerSecond, int);
   vtkGetMacro(UpdatesPerSecond, int); 
+
+  /// If enabled then the output is recomputed by the logic when any of the input transforms is modified
+  /// (instead of updating at a fixed rate). Multiple input changes are coalesced into one update.
+  vtkSetMacro(EventDrivenUpdate, bool);
+  vtkGetMacro(EventDrivenUpdate, bool);
+  vtkBooleanMacro(EventDrivenUpdate, bool);
+
+  /// If enabled then the logic stores the recently received poses of each input with their acquisition time
+  /// (see SetInputLatencySec) and the inputs are interpolated to a common time point before fusion (so that the output
+  /// does not jitter when one input lags behind another).
+  vtkSetMacro(SynchronizeInputs, bool);
+  vtkGetMacro(SynchronizeInputs, bool);
+  vtkBooleanMacro(SynchronizeInputs, bool);
+
+  /// Fusion technique used for event-driven updates (vtkSlicerTransformFusionLogic::techniqueTypes)
+  vtkSetMacro(FusionTechnique, int);
+  vtkGetMacro(FusionTechnique, int);
+
+  /// Measurement noise (standard deviation) of an input, used by the Kalman filter fusion technique.
+  /// Inputs with lower noise have more influence on the output. Noise must be positive. Default: 0.5mm and 0.5deg.
+  void SetInputPositionNoiseMm(int n, double noiseMm);
+  double GetInputPositionNoiseMm(int n);
+  void SetInputOrientationNoiseDeg(int n, double noiseDeg);
+  double GetInputOrientationNoiseDeg(int n);
+
+  /// Weight of an input in the averaging techniques (quaternion average, prediction, robust average).
+  /// Inputs with higher weight have more influence on the output, inputs with zero weight are ignored. Default: 1.
+  void SetInputWeight(int n, double weight);
+  double GetInputWeight(int n);
+
+  /// Time between the acquisition of the input pose and its timestamp, subtracted from the timestamp.
+  /// The timestamp is the value of the InputTimestampAttributeName attribute of the input transform node if the
+  /// tracking device provides it, otherwise the time when the pose is received. Setting the latency of each input
+  /// allows synchronizing inputs that arrive with different delays. Default: 0.
+  void SetInputLatencySec(int n, double latencySec);
+  double GetInputLatencySec(int n);
+
+  /// Robust average technique: inputs whose position or orientation differs from the consensus of the inputs
+  /// by more than this value are ignored. Inputs that are closer are down-weighted smoothly as their difference
+  /// approaches this value. Default: 5mm and 5deg.
+  vtkSetMacro(OutlierPositionThresholdMm, double);
+  vtkGetMacro(OutlierPositionThresholdMm, double);
+  vtkSetMacro(OutlierOrientationThresholdDeg, double);
+  vtkGetMacro(OutlierOrientationThresholdDeg, double);
+
+  /// Process noise of the Kalman filter (standard deviation of the linear and angular acceleration
+  /// of the tool per unit time). Higher values make the output follow fast motion more closely,
+  /// lower values make it smoother. Default: 2000 mm/s^2 and 1000 deg/s^2.
+  vtkSetMacro(AccelerationNoiseMmPerSec2, double);
+  vtkGetMacro(AccelerationNoiseMmPerSec2, double);
+  vtkSetMacro(AngularAccelerationNoiseDegPerSec2, double);
+  vtkGetMacro(AngularAccelerationNoiseDegPerSec2, double);
+
+  /// If enabled then the Kalman filter state is extrapolated to the time of the output update
+  /// (just before rendering) instead of the time of the last input pose, which hides tracking latency.
+  vtkSetMacro(PredictToUpdateTime, bool);
+  vtkGetMacro(PredictToUpdateTime, bool);
+  vtkBooleanMacro(PredictToUpdateTime, bool);
+
+  /// Prediction technique: the output is extrapolated this much ahead of the update time,
+  /// to compensate the latency between tracking and display. Default: 0.03 sec.
+  vtkSetMacro(PredictionLookAheadSec, double);
+  vtkGetMacro(PredictionLookAheadSec, double);
+
+  /// Prediction technique: linear and angular velocity are estimated from the input poses
+  /// received in this time window. Longer window gives smoother but less responsive prediction. Default: 0.05 sec.
+  vtkSetMacro(PredictionVelocityWindowSec, double);
+  vtkGetMacro(PredictionVelocityWindowSec, double);
+
+  /// Input poses are not extrapolated further than this interval after their last update,
+  /// so that the output does not drift away if an input stops updating (e.g., the tool is occluded). Default: 0.2 sec.
+  vtkSetMacro(MaximumPredictionIntervalSec, double);
+  vtkGetMacro(MaximumPredictionIntervalSec, double);
   
 protected:
   vtkMRMLTransformFusionNode();
@@ -71,6 +164,21 @@ protected:
 protected:
   //std::vector<vtkMRMLLinearTransformNode*> InputTransforms;
   int UpdatesPerSecond;
+  bool EventDrivenUpdate;
+  bool SynchronizeInputs;
+  int FusionTechnique;
+  std::vector<double> InputPositionNoiseMm;
+  std::vector<double> InputOrientationNoiseDeg;
+  std::vector<double> InputWeights;
+  std::vector<double> InputLatencySec;
+  double OutlierPositionThresholdMm;
+  double OutlierOrientationThresholdDeg;
+  double AccelerationNoiseMmPerSec2;
+  double AngularAccelerationNoiseDegPerSec2;
+  bool PredictToUpdateTime;
+  double PredictionLookAheadSec;
+  double PredictionVelocityWindowSec;
+  double MaximumPredictionIntervalSec;
 };
 
 #endif
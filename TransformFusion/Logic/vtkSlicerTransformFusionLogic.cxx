@@ -28,22 +28,136 @@
 #include "vtkMRMLLinearTransformNode.h"
 
 // VTK includes
+#include <vtkIntArray.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkMatrix4x4.h>
 #include <vtkMath.h>
+#include <vtkTimerLog.h>
 //#include <vtkQuaternionInterpolator.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
-#include <sstream>
+#include <cstdlib>
 
 vtkStandardNewMacro(vtkSlicerTransformFusionLogic);
 
+// The Kalman filter is reinitialized if no input pose is received for this long
+static const double KALMAN_FILTER_MAXIMUM_MEASUREMENT_GAP_SEC = 1.0;
+// Uncertainty of the initial velocity estimate (standard deviation)
+static const double KALMAN_FILTER_INITIAL_VELOCITY_NOISE_MM_PER_SEC = 500.0;
+static const double KALMAN_FILTER_INITIAL_ANGULAR_VELOCITY_NOISE_DEG_PER_SEC = 180.0;
+// Robust average fusion
+static const int ROBUST_FUSION_NUMBER_OF_REWEIGHTING_ITERATIONS = 3;
+static const int ROBUST_FUSION_MAXIMUM_NUMBER_OF_MEDIAN_ITERATIONS = 50;
+static const double ROBUST_FUSION_MEDIAN_TOLERANCE_MM = 1e-4;
+
+//-----------------------------------------------------------------------------
+// Quaternion product c = a * b (quaternions are w, x, y, z)
+static void MultiplyQuaternions(const double a[4], const double b[4], double c[4])
+{
+  c[0] = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+  c[1] = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+  c[2] = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+  c[3] = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+}
+
+//-----------------------------------------------------------------------------
+// Unit quaternion of a rotation vector (axis * angle in radians)
+static void QuaternionFromRotationVector(const double v[3], double q[4])
+{
+  double angle = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+  if (angle < 1e-12)
+  {
+    q[0] = 1.0;
+    q[1] = 0.5 * v[0];
+    q[2] = 0.5 * v[1];
+    q[3] = 0.5 * v[2];
+  }
+  else
+  {
+    double scale = sin(0.5 * angle) / angle;
+    q[0] = cos(0.5 * angle);
+    q[1] = scale * v[0];
+    q[2] = scale * v[1];
+    q[3] = scale * v[2];
+  }
+  double magnitude = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+  for (int i = 0; i < 4; i++)
+  {
+    q[i] /= magnitude;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Rotation vector (axis * angle in radians, angle <= pi) of a unit quaternion
+static void RotationVectorFromQuaternion(const double q[4], double v[3])
+{
+  double sign = (q[0] < 0 ? -1.0 : 1.0);
+  double sinHalfAngle = sqrt(q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+  double scale = 2.0;
+  if (sinHalfAngle > 1e-12)
+  {
+    scale = 2.0 * atan2(sinHalfAngle, sign * q[0]) / sinHalfAngle;
+  }
+  v[0] = sign * scale * q[1];
+  v[1] = sign * scale * q[2];
+  v[2] = sign * scale * q[3];
+}
+
+//-----------------------------------------------------------------------------
+// Time update of a per-axis (position, velocity) covariance with white acceleration noise
+static void PredictCovariance2x2(double p[2][2], double dt, double accelerationVariance)
+{
+  double p00 = p[0][0] + dt * (p[0][1] + p[1][0]) + dt * dt * p[1][1] + accelerationVariance * dt * dt * dt / 3.0;
+  double p01 = p[0][1] + dt * p[1][1] + accelerationVariance * dt * dt / 2.0;
+  double p11 = p[1][1] + accelerationVariance * dt;
+  p[0][0] = p00;
+  p[0][1] = p01;
+  p[1][0] = p01;
+  p[1][1] = p11;
+}
+
+//-----------------------------------------------------------------------------
+// Measurement update of a per-axis (position, velocity) covariance with a position measurement,
+// returns the Kalman gain for position and velocity
+static void UpdateCovariance2x2(double p[2][2], double measurementVariance, double gain[2])
+{
+  double innovationVariance = p[0][0] + measurementVariance;
+  if (innovationVariance <= 0)
+  {
+    // Both the state and the measurement are exact (only possible with zero noise), the measurement is ignored
+    gain[0] = 0.0;
+    gain[1] = 0.0;
+    return;
+  }
+  gain[0] = p[0][0] / innovationVariance;
+  gain[1] = p[1][0] / innovationVariance;
+  double p00 = (1.0 - gain[0]) * p[0][0];
+  double p01 = (1.0 - gain[0]) * p[0][1];
+  double p11 = p[1][1] - gain[1] * p[0][1];
+  p[0][0] = p00;
+  p[0][1] = p01;
+  p[1][0] = p01;
+  p[1][1] = p11;
+}
+
 //-----------------------------------------------------------------------------
 vtkSlicerTransformFusionLogic::vtkSlicerTransformFusionLogic()
 {
   this->TransformFusionNode = NULL;
+  this->InputMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->OutputMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->UpdatePending = false;
+  this->NumberOfSkippedUpdates = 0;
+  this->NumberOfEventDrivenUpdates = 0;
+  this->InputPoseBuffering = false;
+  this->MaximumNumberOfBufferedPoses = 50;
+  this->MaximumSynchronizationLagSec = 0.2;
+  this->LastFusionTimestamp = -1.0;
+  this->KalmanFilter.Initialized = false;
+  this->NumberOfOutOfSequenceMeasurements = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -56,6 +170,21 @@ vtkSlicerTransformFusionLogic::~vtkSlicerTransformFusionLogic()
 void vtkSlicerTransformFusionLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "UpdatePending: " << (this->UpdatePending ? "true" : "false") << "\n";
+  os << indent << "NumberOfSkippedUpdates: " << this->NumberOfSkippedUpdates << "\n";
+  os << indent << "NumberOfEventDrivenUpdates: " << this->NumberOfEventDrivenUpdates << "\n";
+  os << indent << "InputPoseBuffering: " << (this->InputPoseBuffering ? "true" : "false") << "\n";
+  os << indent << "MaximumNumberOfBufferedPoses: " << this->MaximumNumberOfBufferedPoses << "\n";
+  os << indent << "MaximumSynchronizationLagSec: " << this->MaximumSynchronizationLagSec << "\n";
+  os << indent << "LastFusionTimestamp: " << this->LastFusionTimestamp << "\n";
+  os << indent << "KalmanFilter: " << (this->KalmanFilter.Initialized ? "initialized" : "not initialized") << "\n";
+  os << indent << "NumberOfOutOfSequenceMeasurements: " << this->NumberOfOutOfSequenceMeasurements << "\n";
+  if (this->KalmanFilter.Initialized)
+  {
+    os << indent.GetNextIndent() << "Position: " << this->KalmanFilter.Position[0] << ", " << this->KalmanFilter.Position[1] << ", " << this->KalmanFilter.Position[2] << "\n";
+    os << indent.GetNextIndent() << "Velocity: " << this->KalmanFilter.Velocity[0] << ", " << this->KalmanFilter.Velocity[1] << ", " << this->KalmanFilter.Velocity[2] << "\n";
+    os << indent.GetNextIndent() << "AngularVelocity: " << this->KalmanFilter.AngularVelocity[0] << ", " << this->KalmanFilter.AngularVelocity[1] << ", " << this->KalmanFilter.AngularVelocity[2] << "\n";
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -74,97 +203,1186 @@ void vtkSlicerTransformFusionLogic::RegisterNodes()
 //----------------------------------------------------------------------------
 void vtkSlicerTransformFusionLogic::SetAndObserveTransformFusionNode(vtkMRMLTransformFusionNode *node)
 {
-  vtkSetAndObserveMRMLNodeMacro(this->TransformFusionNode, node);
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue(vtkMRMLTransformFusionNode::InputDataModifiedEvent);
+  vtkSetAndObserveMRMLNodeEventsMacro(this->TransformFusionNode, node, events.GetPointer());
+  this->UpdatePending = false;
+  this->InputTransformModified.clear();
+  this->InputPoseBuffers.clear();
+  this->ResetKalmanFilter();
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlicerTransformFusionLogic::fuseInputTransforms(int fusionTechnique) //enum techniqueTypes
+void vtkSlicerTransformFusionLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
 {
-  switch (fusionTechnique){
-    case MODE_QUATERNION_AVERAGE:
+  vtkMRMLTransformFusionNode* fusionNode = vtkMRMLTransformFusionNode::SafeDownCast(caller);
+  if (fusionNode == NULL || fusionNode != this->TransformFusionNode)
+  {
+    this->Superclass::ProcessMRMLNodesEvents(caller, event, callData);
+    return;
+  }
+  if (event != vtkMRMLTransformFusionNode::InputDataModifiedEvent)
+  {
+    return;
+  }
+  int* inputIndexPtr = reinterpret_cast<int*>(callData);
+  int inputIndex = (inputIndexPtr != NULL ? *inputIndexPtr : -1);
+
+  double timestamp = vtkTimerLog::GetUniversalTime();
+  if (inputIndex >= 0)
+  {
+    timestamp = this->GetInputAcquisitionTimestamp(inputIndex, timestamp);
+  }
+  if (this->IsInputPoseBufferingEnabled() && inputIndex >= 0)
+  {
+    this->RecordInputPose(inputIndex, timestamp);
+  }
+  if (fusionNode->GetFusionTechnique() == MODE_KALMAN_FILTER && inputIndex >= 0)
+  {
+    this->AddKalmanFilterMeasurement(inputIndex, timestamp);
+  }
+  if (!fusionNode->GetEventDrivenUpdate())
+  {
+    return;
+  }
+
+  // Only mark the modified input, the fusion is performed in the next ProcessPendingUpdates() call
+  if (inputIndex >= 0)
+  {
+    if (inputIndex >= static_cast<int>(this->InputTransformModified.size()))
     {
-      this->QuaternionAverageFusion();
-      break;
+      this->InputTransformModified.resize(inputIndex + 1, false);
     }
-  } 
+    this->InputTransformModified[inputIndex] = true;
+  }
+  if (this->UpdatePending)
+  {
+    this->NumberOfSkippedUpdates++;
+    return;
+  }
+  this->UpdatePending = true;
+  this->InvokeEvent(FusionRequestedEvent);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::ProcessPendingUpdates()
+{
+  if (!this->UpdatePending)
+  {
+    return;
+  }
+  this->UpdatePending = false;
+  if (this->TransformFusionNode != NULL && this->TransformFusionNode->GetEventDrivenUpdate())
+  {
+    this->fuseInputTransforms(this->TransformFusionNode->GetFusionTechnique());
+    this->NumberOfEventDrivenUpdates++;
+  }
+  std::fill(this->InputTransformModified.begin(), this->InputTransformModified.end(), false);
 }
 
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::IsInputTransformModified(int inputIndex)
+{
+  if (inputIndex < 0 || inputIndex >= static_cast<int>(this->InputTransformModified.size()))
+  {
+    return false;
+  }
+  return this->InputTransformModified[inputIndex];
+}
 
 //-----------------------------------------------------------------------------
-void vtkSlicerTransformFusionLogic::QuaternionAverageFusion()
+void vtkSlicerTransformFusionLogic::ResetNumberOfUpdates()
 {
-  vtkMRMLLinearTransformNode* outputNode = this->TransformFusionNode->GetOutputTransformNode();
-  if (outputNode == NULL)
+  this->NumberOfSkippedUpdates = 0;
+  this->NumberOfEventDrivenUpdates = 0;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::SetMaximumNumberOfBufferedPoses(int numberOfPoses)
+{
+  // At least two poses are needed for interpolation
+  if (numberOfPoses < 2)
+  {
+    numberOfPoses = 2;
+  }
+  if (numberOfPoses == this->MaximumNumberOfBufferedPoses)
   {
     return;
   }
+  this->MaximumNumberOfBufferedPoses = numberOfPoses;
+  this->InputPoseBuffers.clear();
+  this->Modified();
+}
 
-  // Average quaternion
-  vtkSmartPointer<vtkMatrix4x4> outputMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  int numberOfInputs = this->TransformFusionNode->GetNumberOfInputTransformNodes();
-  vtkSmartPointer<vtkMatrix4x4> matrix4x4Pointer = vtkSmartPointer<vtkMatrix4x4>::New();
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::RecordInputPose(int inputIndex, double timestamp)
+{
+  if (this->TransformFusionNode == NULL || inputIndex < 0)
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* inputNode = this->TransformFusionNode->GetInputTransformNode(inputIndex);
+  if (inputNode == NULL)
+  {
+    return;
+  }
+  if (inputIndex >= static_cast<int>(this->InputPoseBuffers.size()))
+  {
+    this->InputPoseBuffers.resize(inputIndex + 1);
+  }
+  InputPoseBuffer& buffer = this->InputPoseBuffers[inputIndex];
+  int bufferSize = this->MaximumNumberOfBufferedPoses;
+  if (buffer.InputNode != inputNode || static_cast<int>(buffer.Poses.size()) != bufferSize)
+  {
+    // Inputs have been changed, previous poses are not valid anymore
+    buffer.InputNode = inputNode;
+    buffer.Poses.resize(bufferSize);
+    buffer.FirstPoseIndex = 0;
+    buffer.NumberOfPoses = 0;
+  }
 
-  float rotationMatrix[3][3] = {{0}};
-  float averageRotationMatrix[3][3] = {{0}};
-  float singleQuaternion[4] = {0};
-  float averageQuaternion[4] = {0};
+  if (buffer.NumberOfPoses > 0)
+  {
+    // Keep the poses ordered by time even if the system clock is adjusted
+    double latestTimestamp = buffer.Poses[(buffer.FirstPoseIndex + buffer.NumberOfPoses - 1) % bufferSize].Timestamp;
+    if (timestamp < latestTimestamp)
+    {
+      timestamp = latestTimestamp;
+    }
+  }
 
-  for (int i = 0; i < numberOfInputs; i++)
+  int poseIndex = 0;
+  if (buffer.NumberOfPoses < bufferSize)
   {
+    poseIndex = (buffer.FirstPoseIndex + buffer.NumberOfPoses) % bufferSize;
+    buffer.NumberOfPoses++;
+  }
+  else
+  {
+    // Buffer is full, overwrite the oldest pose
+    poseIndex = buffer.FirstPoseIndex;
+    buffer.FirstPoseIndex = (buffer.FirstPoseIndex + 1) % bufferSize;
+  }
 
-    this->TransformFusionNode->GetInputTransformNode(i)->GetMatrixTransformToParent(matrix4x4Pointer);
+  inputNode->GetMatrixTransformToParent(this->InputMatrix);
+  InputPose& pose = buffer.Poses[poseIndex];
+  SetInputPoseFromMatrix(this->InputMatrix, pose);
+  pose.Timestamp = timestamp;
+}
 
-    for (int row = 0; row < 3; row++)
+//-----------------------------------------------------------------------------
+double vtkSlicerTransformFusionLogic::GetInputAcquisitionTimestamp(int inputIndex, double arrivalTimestamp)
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return arrivalTimestamp;
+  }
+  double timestamp = arrivalTimestamp;
+  vtkMRMLLinearTransformNode* inputNode = this->TransformFusionNode->GetInputTransformNode(inputIndex);
+  const char* deviceTimestamp = (inputNode != NULL
+    ? inputNode->GetAttribute(vtkMRMLTransformFusionNode::InputTimestampAttributeName.c_str()) : NULL);
+  if (deviceTimestamp != NULL)
+  {
+    // Parsed at each input modification, therefore strtod is used (a string stream would allocate memory)
+    char* end = NULL;
+    double value = strtod(deviceTimestamp, &end);
+    if (end != deviceTimestamp)
     {
-      for (int column = 0; column < 3; column++)
-      { 
-        rotationMatrix[row][column] = matrix4x4Pointer->GetElement(row,column);
-      }
+      timestamp = value;
+    }
+  }
+  return timestamp - this->TransformFusionNode->GetInputLatencySec(inputIndex);
+}
+
+//-----------------------------------------------------------------------------
+vtkSlicerTransformFusionLogic::InputPoseBuffer* vtkSlicerTransformFusionLogic::GetInputPoseBuffer(int inputIndex)
+{
+  if (this->TransformFusionNode == NULL || inputIndex < 0 || inputIndex >= static_cast<int>(this->InputPoseBuffers.size()))
+  {
+    return NULL;
+  }
+  InputPoseBuffer& buffer = this->InputPoseBuffers[inputIndex];
+  if (buffer.NumberOfPoses == 0 || buffer.InputNode != this->TransformFusionNode->GetInputTransformNode(inputIndex))
+  {
+    return NULL;
+  }
+  return &buffer;
+}
+
+//-----------------------------------------------------------------------------
+double vtkSlicerTransformFusionLogic::GetSynchronizationTimestamp()
+{
+  if (this->TransformFusionNode == NULL || !this->TransformFusionNode->GetSynchronizeInputs())
+  {
+    return -1.0;
+  }
+  int numberOfInputs = this->TransformFusionNode->GetNumberOfInputTransformNodes();
+
+  // Time of the most recent pose of each input
+  double newestTimestamp = -1.0;
+  for (int i = 0; i < numberOfInputs; i++)
+  {
+    InputPoseBuffer* buffer = this->GetInputPoseBuffer(i);
+    if (buffer == NULL)
+    {
+      continue;
+    }
+    double latestTimestamp = buffer->Poses[(buffer->FirstPoseIndex + buffer->NumberOfPoses - 1) % buffer->Poses.size()].Timestamp;
+    if (latestTimestamp > newestTimestamp)
+    {
+      newestTimestamp = latestTimestamp;
+    }
+  }
+  if (newestTimestamp < 0)
+  {
+    return -1.0;
+  }
+
+  // Interpolate to the time of the input that lags most (but ignore inputs that stopped updating)
+  double synchronizationTimestamp = newestTimestamp;
+  for (int i = 0; i < numberOfInputs; i++)
+  {
+    InputPoseBuffer* buffer = this->GetInputPoseBuffer(i);
+    if (buffer == NULL)
+    {
+      continue;
+    }
+    double latestTimestamp = buffer->Poses[(buffer->FirstPoseIndex + buffer->NumberOfPoses - 1) % buffer->Poses.size()].Timestamp;
+    if (newestTimestamp - latestTimestamp <= this->MaximumSynchronizationLagSec && latestTimestamp < synchronizationTimestamp)
+    {
+      synchronizationTimestamp = latestTimestamp;
     }
+  }
+  return synchronizationTimestamp;
+}
 
-    vtkMath::Matrix3x3ToQuaternion(rotationMatrix, singleQuaternion);
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::GetInputPose(int inputIndex, double timestamp, InputPose& pose)
+{
+  if (timestamp >= 0)
+  {
+    InputPoseBuffer* buffer = this->GetInputPoseBuffer(inputIndex);
+    if (buffer != NULL)
+    {
+      InterpolateInputPose(*buffer, timestamp, pose);
+      return true;
+    }
+  }
 
-    averageQuaternion[0] = averageQuaternion[0] + singleQuaternion[0];
-    averageQuaternion[1] = averageQuaternion[1] + singleQuaternion[1];
-    averageQuaternion[2] = averageQuaternion[2] + singleQuaternion[2];
-    averageQuaternion[3] = averageQuaternion[3] + singleQuaternion[3];
+  // No buffered poses, use the current pose
+  vtkMRMLLinearTransformNode* inputNode = this->TransformFusionNode->GetInputTransformNode(inputIndex);
+  if (inputNode == NULL)
+  {
+    return false;
   }
+  inputNode->GetMatrixTransformToParent(this->InputMatrix);
+  SetInputPoseFromMatrix(this->InputMatrix, pose);
+  pose.Timestamp = timestamp;
+  return true;
+}
 
-  averageQuaternion[0] = averageQuaternion[0] / numberOfInputs;
-  averageQuaternion[1] = averageQuaternion[1] / numberOfInputs;
-  averageQuaternion[2] = averageQuaternion[2] / numberOfInputs;
-  averageQuaternion[3] = averageQuaternion[3] / numberOfInputs;
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::GetBufferedInputTransformMatrix(int inputIndex, double timestamp, vtkMatrix4x4* matrix)
+{
+  if (matrix == NULL)
+  {
+    vtkErrorMacro("GetBufferedInputTransformMatrix failed: invalid output matrix");
+    return false;
+  }
+  // Poses are recorded from now on, if they have not been recorded yet
+  this->InputPoseBuffering = true;
+  InputPoseBuffer* buffer = this->GetInputPoseBuffer(inputIndex);
+  if (buffer == NULL)
+  {
+    return false;
+  }
+  InputPose pose;
+  InterpolateInputPose(*buffer, timestamp, pose);
+  SetMatrixFromInputPose(pose, matrix);
+  return true;
+}
 
-  float magnitude = sqrt(averageQuaternion[0]*averageQuaternion[0] + averageQuaternion[1]*averageQuaternion[1] + averageQuaternion[2]*averageQuaternion[2] + averageQuaternion[3]*averageQuaternion[3]);
-  averageQuaternion[0] = averageQuaternion[0]/magnitude;
-  averageQuaternion[1] = averageQuaternion[1]/magnitude;
-  averageQuaternion[2] = averageQuaternion[2]/magnitude;
-  averageQuaternion[3] = averageQuaternion[3]/magnitude;
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::SetInputPoseFromMatrix(vtkMatrix4x4* matrix, InputPose& pose)
+{
+  double rotationMatrix[3][3] = {{0}};
+  for (int row = 0; row < 3; row++)
+  {
+    for (int column = 0; column < 3; column++)
+    {
+      rotationMatrix[row][column] = matrix->GetElement(row, column);
+    }
+    pose.Translation[row] = matrix->GetElement(row, 3);
+  }
+  vtkMath::Matrix3x3ToQuaternion(rotationMatrix, pose.Orientation);
+}
 
-  vtkMath::QuaternionToMatrix3x3(averageQuaternion,averageRotationMatrix);
-  
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::SetMatrixFromInputPose(const InputPose& pose, vtkMatrix4x4* matrix)
+{
+  double rotationMatrix[3][3] = {{0}};
+  vtkMath::QuaternionToMatrix3x3(pose.Orientation, rotationMatrix);
+  matrix->Identity();
   for (int row = 0; row < 3; row++)
   {
     for (int column = 0; column < 3; column++)
-    { 
-      outputMatrix->SetElement(row,column,averageRotationMatrix[row][column]);
+    {
+      matrix->SetElement(row, column, rotationMatrix[row][column]);
+    }
+    matrix->SetElement(row, 3, pose.Translation[row]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::InterpolateQuaternion(const double q0[4], const double q1[4], double weight1, double q[4])
+{
+  double cosTheta = q0[0]*q1[0] + q0[1]*q1[1] + q0[2]*q1[2] + q0[3]*q1[3];
+  // q and -q represent the same rotation, interpolate along the shorter arc
+  double sign = 1.0;
+  if (cosTheta < 0)
+  {
+    cosTheta = -cosTheta;
+    sign = -1.0;
+  }
+  double weight0 = 1.0 - weight1;
+  if (cosTheta < 0.9995)
+  {
+    double theta = acos(cosTheta);
+    double sinTheta = sin(theta);
+    weight0 = sin(weight0 * theta) / sinTheta;
+    weight1 = sin(weight1 * theta) / sinTheta;
+  }
+  // else: orientations are very close, linear interpolation (followed by normalization) is accurate
+  weight1 *= sign;
+  for (int i = 0; i < 4; i++)
+  {
+    q[i] = weight0 * q0[i] + weight1 * q1[i];
+  }
+  double magnitude = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+  if (magnitude > 0)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      q[i] /= magnitude;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::InterpolateInputPose(const InputPoseBuffer& buffer, double timestamp, InputPose& pose)
+{
+  int bufferSize = static_cast<int>(buffer.Poses.size());
+  const InputPose& oldestPose = buffer.Poses[buffer.FirstPoseIndex];
+  const InputPose& latestPose = buffer.Poses[(buffer.FirstPoseIndex + buffer.NumberOfPoses - 1) % bufferSize];
+  if (timestamp <= oldestPose.Timestamp)
+  {
+    pose = oldestPose;
+    return;
+  }
+  if (timestamp >= latestPose.Timestamp)
+  {
+    pose = latestPose;
+    return;
+  }
+
+  // Binary search for the poses before and after the timestamp (oldest <= timestamp < latest)
+  int beforeIndex = 0;
+  int afterIndex = buffer.NumberOfPoses - 1;
+  while (afterIndex - beforeIndex > 1)
+  {
+    int middleIndex = (beforeIndex + afterIndex) / 2;
+    if (buffer.Poses[(buffer.FirstPoseIndex + middleIndex) % bufferSize].Timestamp <= timestamp)
+    {
+      beforeIndex = middleIndex;
+    }
+    else
+    {
+      afterIndex = middleIndex;
     }
   }
+  const InputPose& beforePose = buffer.Poses[(buffer.FirstPoseIndex + beforeIndex) % bufferSize];
+  const InputPose& afterPose = buffer.Poses[(buffer.FirstPoseIndex + afterIndex) % bufferSize];
 
+  double timeDifference = afterPose.Timestamp - beforePose.Timestamp;
+  double weightAfter = (timeDifference > 0 ? (timestamp - beforePose.Timestamp) / timeDifference : 0.0);
+  for (int i = 0; i < 3; i++)
+  {
+    pose.Translation[i] = (1.0 - weightAfter) * beforePose.Translation[i] + weightAfter * afterPose.Translation[i];
+  }
+  InterpolateQuaternion(beforePose.Orientation, afterPose.Orientation, weightAfter, pose.Orientation);
+  pose.Timestamp = timestamp;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::ResetKalmanFilter()
+{
+  this->KalmanFilter.Initialized = false;
+  this->NumberOfOutOfSequenceMeasurements = 0;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::AddKalmanFilterMeasurement(int inputIndex, double timestamp)
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* inputNode = this->TransformFusionNode->GetInputTransformNode(inputIndex);
+  if (inputNode == NULL)
+  {
+    return;
+  }
+  inputNode->GetMatrixTransformToParent(this->InputMatrix);
+  InputPose measurement;
+  SetInputPoseFromMatrix(this->InputMatrix, measurement);
+  measurement.Timestamp = timestamp;
 
-  // Average linear elements
-  double value = 0;
-  for (int row = 0; row < 4; row++)
+  double positionNoiseMm = this->TransformFusionNode->GetInputPositionNoiseMm(inputIndex);
+  double orientationNoiseRad = vtkMath::RadiansFromDegrees(this->TransformFusionNode->GetInputOrientationNoiseDeg(inputIndex));
+  if (!this->KalmanFilter.Initialized || timestamp - this->KalmanFilter.Timestamp > KALMAN_FILTER_MAXIMUM_MEASUREMENT_GAP_SEC)
   {
-    for (int i = 0; i < numberOfInputs; i++)
+    InitializeKalmanFilterState(this->KalmanFilter, measurement, timestamp, positionNoiseMm, orientationNoiseRad);
+    return;
+  }
+  double accelerationNoiseMmPerSec2 = this->TransformFusionNode->GetAccelerationNoiseMmPerSec2();
+  double angularAccelerationNoiseRadPerSec2 = vtkMath::RadiansFromDegrees(this->TransformFusionNode->GetAngularAccelerationNoiseDegPerSec2());
+  double measurementAgeSec = this->KalmanFilter.Timestamp - timestamp;
+  if (measurementAgeSec > 0)
+  {
+    // Out-of-sequence measurement: an input with larger latency acquired this pose before the current filter state.
+    // Applying it at the current state time would pull the estimate back along the motion path.
+    this->NumberOfOutOfSequenceMeasurements++;
+    if (measurementAgeSec > KALMAN_FILTER_MAXIMUM_MEASUREMENT_GAP_SEC)
     {
-      this->TransformFusionNode->GetInputTransformNode(i)->GetMatrixTransformToParent(matrix4x4Pointer);
-      value += matrix4x4Pointer->GetElement(row,3);
+      return;
     }
-    value = value/numberOfInputs;
-    outputMatrix->SetElement(row,3,value);
-    value = 0;
+    ExtrapolateKalmanFilterMeasurement(this->KalmanFilter, measurementAgeSec, accelerationNoiseMmPerSec2,
+      angularAccelerationNoiseRadPerSec2, measurement, positionNoiseMm, orientationNoiseRad);
+  }
+  else
+  {
+    PredictKalmanFilterState(this->KalmanFilter, timestamp, accelerationNoiseMmPerSec2, angularAccelerationNoiseRadPerSec2);
+  }
+  UpdateKalmanFilterState(this->KalmanFilter, measurement, positionNoiseMm, orientationNoiseRad);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::ExtrapolateKalmanFilterMeasurement(const KalmanFilterState& state, double ageSec,
+  double accelerationNoiseMmPerSec2, double angularAccelerationNoiseRadPerSec2,
+  InputPose& measurement, double& positionNoiseMm, double& orientationNoiseRad)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    measurement.Translation[i] += ageSec * state.Velocity[i];
+  }
+  double rotationVector[3] = { ageSec * state.AngularVelocity[0], ageSec * state.AngularVelocity[1], ageSec * state.AngularVelocity[2] };
+  double rotationIncrement[4] = { 1.0, 0.0, 0.0, 0.0 };
+  QuaternionFromRotationVector(rotationVector, rotationIncrement);
+  double measuredOrientation[4] = { measurement.Orientation[0], measurement.Orientation[1], measurement.Orientation[2], measurement.Orientation[3] };
+  MultiplyQuaternions(measuredOrientation, rotationIncrement, measurement.Orientation);
+
+  // Extrapolation error: velocity uncertainty and unmodeled acceleration during the extrapolation interval
+  double ageSec2 = ageSec * ageSec;
+  positionNoiseMm = sqrt(positionNoiseMm * positionNoiseMm + ageSec2 * state.PositionCovariance[1][1]
+    + accelerationNoiseMmPerSec2 * accelerationNoiseMmPerSec2 * ageSec2 * ageSec / 3.0);
+  orientationNoiseRad = sqrt(orientationNoiseRad * orientationNoiseRad + ageSec2 * state.OrientationCovariance[1][1]
+    + angularAccelerationNoiseRadPerSec2 * angularAccelerationNoiseRadPerSec2 * ageSec2 * ageSec / 3.0);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::InitializeKalmanFilterState(KalmanFilterState& state, const InputPose& measurement, double timestamp,
+  double positionNoiseMm, double orientationNoiseRad)
+{
+  state.Initialized = true;
+  state.Timestamp = timestamp;
+  for (int i = 0; i < 3; i++)
+  {
+    state.Position[i] = measurement.Translation[i];
+    state.Velocity[i] = 0.0;
+    state.AngularVelocity[i] = 0.0;
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    state.Orientation[i] = measurement.Orientation[i];
+  }
+  double initialAngularVelocityNoiseRad = vtkMath::RadiansFromDegrees(KALMAN_FILTER_INITIAL_ANGULAR_VELOCITY_NOISE_DEG_PER_SEC);
+  state.PositionCovariance[0][0] = positionNoiseMm * positionNoiseMm;
+  state.PositionCovariance[0][1] = 0.0;
+  state.PositionCovariance[1][0] = 0.0;
+  state.PositionCovariance[1][1] = KALMAN_FILTER_INITIAL_VELOCITY_NOISE_MM_PER_SEC * KALMAN_FILTER_INITIAL_VELOCITY_NOISE_MM_PER_SEC;
+  state.OrientationCovariance[0][0] = orientationNoiseRad * orientationNoiseRad;
+  state.OrientationCovariance[0][1] = 0.0;
+  state.OrientationCovariance[1][0] = 0.0;
+  state.OrientationCovariance[1][1] = initialAngularVelocityNoiseRad * initialAngularVelocityNoiseRad;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::PredictKalmanFilterState(KalmanFilterState& state, double timestamp,
+  double accelerationNoiseMmPerSec2, double angularAccelerationNoiseRadPerSec2)
+{
+  double dt = timestamp - state.Timestamp;
+  if (dt <= 0)
+  {
+    return;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    state.Position[i] += dt * state.Velocity[i];
   }
+  double rotationVector[3] = { dt * state.AngularVelocity[0], dt * state.AngularVelocity[1], dt * state.AngularVelocity[2] };
+  double rotationIncrement[4] = { 1.0, 0.0, 0.0, 0.0 };
+  QuaternionFromRotationVector(rotationVector, rotationIncrement);
+  double previousOrientation[4] = { state.Orientation[0], state.Orientation[1], state.Orientation[2], state.Orientation[3] };
+  MultiplyQuaternions(previousOrientation, rotationIncrement, state.Orientation);
+
+  PredictCovariance2x2(state.PositionCovariance, dt, accelerationNoiseMmPerSec2 * accelerationNoiseMmPerSec2);
+  PredictCovariance2x2(state.OrientationCovariance, dt, angularAccelerationNoiseRadPerSec2 * angularAccelerationNoiseRadPerSec2);
+  state.Timestamp = timestamp;
+}
 
-  outputNode->SetMatrixTransformToParent(outputMatrix);
-}
\ No newline at end of file
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::UpdateKalmanFilterState(KalmanFilterState& state, const InputPose& measurement,
+  double positionNoiseMm, double orientationNoiseRad)
+{
+  // Position
+  double gain[2] = { 0.0, 0.0 };
+  UpdateCovariance2x2(state.PositionCovariance, positionNoiseMm * positionNoiseMm, gain);
+  for (int i = 0; i < 3; i++)
+  {
+    double residual = measurement.Translation[i] - state.Position[i];
+    state.Position[i] += gain[0] * residual;
+    state.Velocity[i] += gain[1] * residual;
+  }
+
+  // Orientation: the residual is the rotation vector from the predicted to the measured orientation
+  double inverseOrientation[4] = { state.Orientation[0], -state.Orientation[1], -state.Orientation[2], -state.Orientation[3] };
+  double residualQuaternion[4] = { 1.0, 0.0, 0.0, 0.0 };
+  MultiplyQuaternions(inverseOrientation, measurement.Orientation, residualQuaternion);
+  double residual[3] = { 0.0, 0.0, 0.0 };
+  RotationVectorFromQuaternion(residualQuaternion, residual);
+  UpdateCovariance2x2(state.OrientationCovariance, orientationNoiseRad * orientationNoiseRad, gain);
+  double correction[3] = { 0.0, 0.0, 0.0 };
+  for (int i = 0; i < 3; i++)
+  {
+    correction[i] = gain[0] * residual[i];
+    state.AngularVelocity[i] += gain[1] * residual[i];
+  }
+  double correctionQuaternion[4] = { 1.0, 0.0, 0.0, 0.0 };
+  QuaternionFromRotationVector(correction, correctionQuaternion);
+  double previousOrientation[4] = { state.Orientation[0], state.Orientation[1], state.Orientation[2], state.Orientation[3] };
+  MultiplyQuaternions(previousOrientation, correctionQuaternion, state.Orientation);
+  double magnitude = sqrt(state.Orientation[0]*state.Orientation[0] + state.Orientation[1]*state.Orientation[1]
+    + state.Orientation[2]*state.Orientation[2] + state.Orientation[3]*state.Orientation[3]);
+  for (int i = 0; i < 4; i++)
+  {
+    state.Orientation[i] /= magnitude;
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::KalmanFilterFusion()
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* outputNode = this->TransformFusionNode->GetOutputTransformNode();
+  if (outputNode == NULL)
+  {
+    return;
+  }
+
+  double currentTime = vtkTimerLog::GetUniversalTime();
+  if (!this->KalmanFilter.Initialized || currentTime - this->KalmanFilter.Timestamp > KALMAN_FILTER_MAXIMUM_MEASUREMENT_GAP_SEC)
+  {
+    // No recent input pose has been received, (re)initialize the filter from the current input poses
+    this->ResetKalmanFilter();
+    int numberOfInputs = this->TransformFusionNode->GetNumberOfInputTransformNodes();
+    for (int inputIndex = 0; inputIndex < numberOfInputs; inputIndex++)
+    {
+      this->AddKalmanFilterMeasurement(inputIndex, this->GetInputAcquisitionTimestamp(inputIndex, currentTime));
+    }
+    if (!this->KalmanFilter.Initialized)
+    {
+      return;
+    }
+  }
+
+  KalmanFilterState outputState = this->KalmanFilter;
+  if (this->TransformFusionNode->GetPredictToUpdateTime())
+  {
+    // Only the state is used, so the process noise does not matter
+    PredictKalmanFilterState(outputState, currentTime, 0.0, 0.0);
+  }
+  this->LastFusionTimestamp = outputState.Timestamp;
+
+  InputPose outputPose;
+  for (int i = 0; i < 4; i++)
+  {
+    outputPose.Orientation[i] = outputState.Orientation[i];
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    outputPose.Translation[i] = outputState.Position[i];
+  }
+  SetMatrixFromInputPose(outputPose, this->OutputMatrix);
+  outputNode->SetMatrixTransformToParent(this->OutputMatrix);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::fuseInputTransforms(int fusionTechnique) //enum techniqueTypes
+{
+  switch (fusionTechnique){
+    case MODE_QUATERNION_AVERAGE:
+    {
+      this->QuaternionAverageFusion();
+      break;
+    }
+    case MODE_KALMAN_FILTER:
+    {
+      this->KalmanFilterFusion();
+      break;
+    }
+    case MODE_PREDICTION:
+    {
+      this->PredictionFusion();
+      break;
+    }
+    case MODE_ROBUST_AVERAGE:
+    {
+      this->RobustAverageFusion();
+      break;
+    }
+  } 
+}
+
+
+//-----------------------------------------------------------------------------
+int vtkSlicerTransformFusionLogic::CollectFusionInputPoses(double timestamp, bool predict)
+{
+  int numberOfInputs = this->TransformFusionNode->GetNumberOfInputTransformNodes();
+  if (static_cast<int>(this->FusionInputPoses.size()) < numberOfInputs)
+  {
+    // Memory is only allocated when the number of inputs increases
+    this->FusionInputPoses.resize(numberOfInputs);
+    this->FusionInputWeights.resize(numberOfInputs);
+    this->FusionInputIndices.resize(numberOfInputs);
+  }
+  int numberOfValidInputs = 0;
+  for (int inputIndex = 0; inputIndex < numberOfInputs; inputIndex++)
+  {
+    double weight = this->TransformFusionNode->GetInputWeight(inputIndex);
+    if (weight <= 0)
+    {
+      continue;
+    }
+    InputPose& pose = this->FusionInputPoses[numberOfValidInputs];
+    // If predicting, inputs that have not been received since prediction was enabled are used as is
+    bool validPose = (predict ? (this->GetPredictedInputPose(inputIndex, timestamp, pose) || this->GetInputPose(inputIndex, -1.0, pose))
+      : this->GetInputPose(inputIndex, timestamp, pose));
+    if (!validPose)
+    {
+      continue;
+    }
+    this->FusionInputWeights[numberOfValidInputs] = weight;
+    this->FusionInputIndices[numberOfValidInputs] = inputIndex;
+    numberOfValidInputs++;
+  }
+  return numberOfValidInputs;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::AverageInputPoses(const std::vector<InputPose>& poses, const std::vector<double>& weights,
+  int numberOfPoses, InputPose& averagePose)
+{
+  if (numberOfPoses <= 0)
+  {
+    return false;
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    averagePose.Orientation[i] = 0.0;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    averagePose.Translation[i] = 0.0;
+  }
+  double sumWeights = 0.0;
+  const double* referenceOrientation = poses[0].Orientation;
+  for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+  {
+    const InputPose& pose = poses[poseIndex];
+    double weight = weights[poseIndex];
+    // q and -q represent the same rotation, flip the quaternions to the same hemisphere
+    // as the first input so that they do not cancel out in the average
+    double dotProduct = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+      dotProduct += referenceOrientation[i] * pose.Orientation[i];
+    }
+    double signedWeight = (dotProduct < 0 ? -weight : weight);
+    for (int i = 0; i < 4; i++)
+    {
+      averagePose.Orientation[i] += signedWeight * pose.Orientation[i];
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      averagePose.Translation[i] += weight * pose.Translation[i];
+    }
+    sumWeights += weight;
+  }
+
+  double magnitude = sqrt(averagePose.Orientation[0]*averagePose.Orientation[0] + averagePose.Orientation[1]*averagePose.Orientation[1]
+    + averagePose.Orientation[2]*averagePose.Orientation[2] + averagePose.Orientation[3]*averagePose.Orientation[3]);
+  if (magnitude <= 0 || sumWeights <= 0)
+  {
+    return false;
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    averagePose.Orientation[i] /= magnitude;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    averagePose.Translation[i] /= sumWeights;
+  }
+  averagePose.Timestamp = poses[0].Timestamp;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::ComputeAverageOrientation(const std::vector<InputPose>& poses, const std::vector<double>& weights,
+  int numberOfPoses, double averageOrientation[4])
+{
+  // Markley et al., "Averaging Quaternions", 2007: the average is the eigenvector of the weighted sum of q*q^T
+  // that belongs to the largest eigenvalue. It does not depend on the sign of the quaternions.
+  double m[4][4] = {{0.0}};
+  double sumWeights = 0.0;
+  for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+  {
+    const double* q = poses[poseIndex].Orientation;
+    double weight = weights[poseIndex];
+    for (int row = 0; row < 4; row++)
+    {
+      for (int column = row; column < 4; column++)
+      {
+        m[row][column] += weight * q[row] * q[column];
+      }
+    }
+    sumWeights += weight;
+  }
+  if (sumWeights <= 0)
+  {
+    return false;
+  }
+  for (int row = 1; row < 4; row++)
+  {
+    for (int column = 0; column < row; column++)
+    {
+      m[row][column] = m[column][row];
+    }
+  }
+  double eigenvectors[4][4] = {{0.0}};
+  double eigenvalues[4] = {0.0};
+  double* mRows[4] = { m[0], m[1], m[2], m[3] };
+  double* eigenvectorRows[4] = { eigenvectors[0], eigenvectors[1], eigenvectors[2], eigenvectors[3] };
+  if (!vtkMath::JacobiN(mRows, 4, eigenvalues, eigenvectorRows))
+  {
+    return false;
+  }
+  // Eigenvalues are sorted in decreasing order, eigenvectors are stored in columns
+  double sign = (eigenvectors[0][0] < 0 ? -1.0 : 1.0);
+  for (int i = 0; i < 4; i++)
+  {
+    averageOrientation[i] = sign * eigenvectors[i][0];
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::ComputeMedianPosition(const std::vector<InputPose>& poses, const std::vector<double>& weights,
+  int numberOfPoses, double medianPosition[3])
+{
+  // Weighted geometric median by Weiszfeld's algorithm, starting from the weighted mean
+  double sumWeights = 0.0;
+  for (int i = 0; i < 3; i++)
+  {
+    medianPosition[i] = 0.0;
+  }
+  for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      medianPosition[i] += weights[poseIndex] * poses[poseIndex].Translation[i];
+    }
+    sumWeights += weights[poseIndex];
+  }
+  if (sumWeights <= 0)
+  {
+    return;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    medianPosition[i] /= sumWeights;
+  }
+
+  for (int iteration = 0; iteration < ROBUST_FUSION_MAXIMUM_NUMBER_OF_MEDIAN_ITERATIONS; iteration++)
+  {
+    double weightedSum[3] = { 0.0, 0.0, 0.0 };
+    double sumInverseDistanceWeights = 0.0;
+    for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+    {
+      const double* position = poses[poseIndex].Translation;
+      double distance = sqrt(vtkMath::Distance2BetweenPoints(position, medianPosition));
+      // Avoid division by zero if the estimate coincides with an input
+      double inverseDistanceWeight = weights[poseIndex] / std::max(distance, ROBUST_FUSION_MEDIAN_TOLERANCE_MM);
+      for (int i = 0; i < 3; i++)
+      {
+        weightedSum[i] += inverseDistanceWeight * position[i];
+      }
+      sumInverseDistanceWeights += inverseDistanceWeight;
+    }
+    if (sumInverseDistanceWeights <= 0)
+    {
+      break;
+    }
+    double stepSquared = 0.0;
+    for (int i = 0; i < 3; i++)
+    {
+      double newPosition = weightedSum[i] / sumInverseDistanceWeights;
+      stepSquared += (newPosition - medianPosition[i]) * (newPosition - medianPosition[i]);
+      medianPosition[i] = newPosition;
+    }
+    if (stepSquared < ROBUST_FUSION_MEDIAN_TOLERANCE_MM * ROBUST_FUSION_MEDIAN_TOLERANCE_MM)
+    {
+      break;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::QuaternionAverageFusion()
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* outputNode = this->TransformFusionNode->GetOutputTransformNode();
+  if (outputNode == NULL)
+  {
+    return;
+  }
+
+  // If inputs are synchronized then all of them are interpolated to the same time point
+  double fusionTimestamp = this->GetSynchronizationTimestamp();
+  this->LastFusionTimestamp = fusionTimestamp;
+
+  // Each input pose is retrieved only once
+  int numberOfValidInputs = this->CollectFusionInputPoses(fusionTimestamp, false);
+  if (numberOfValidInputs == 0)
+  {
+    return;
+  }
+
+  InputPose averagePose;
+  if (!AverageInputPoses(this->FusionInputPoses, this->FusionInputWeights, numberOfValidInputs, averagePose))
+  {
+    vtkWarningMacro("QuaternionAverageFusion: average orientation is undefined");
+    return;
+  }
+  SetMatrixFromInputPose(averagePose, this->OutputMatrix);
+  outputNode->SetMatrixTransformToParent(this->OutputMatrix);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::PredictionFusion()
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* outputNode = this->TransformFusionNode->GetOutputTransformNode();
+  if (outputNode == NULL)
+  {
+    return;
+  }
+
+  double predictionTimestamp = vtkTimerLog::GetUniversalTime() + this->TransformFusionNode->GetPredictionLookAheadSec();
+  this->LastFusionTimestamp = predictionTimestamp;
+
+  int numberOfValidInputs = this->CollectFusionInputPoses(predictionTimestamp, true);
+  if (numberOfValidInputs == 0)
+  {
+    return;
+  }
+
+  InputPose averagePose;
+  if (!AverageInputPoses(this->FusionInputPoses, this->FusionInputWeights, numberOfValidInputs, averagePose))
+  {
+    vtkWarningMacro("PredictionFusion: average orientation is undefined");
+    return;
+  }
+  SetMatrixFromInputPose(averagePose, this->OutputMatrix);
+  outputNode->SetMatrixTransformToParent(this->OutputMatrix);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::RobustAverageFusion()
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return;
+  }
+  vtkMRMLLinearTransformNode* outputNode = this->TransformFusionNode->GetOutputTransformNode();
+  if (outputNode == NULL)
+  {
+    return;
+  }
+
+  double fusionTimestamp = this->GetSynchronizationTimestamp();
+  this->LastFusionTimestamp = fusionTimestamp;
+
+  int numberOfInputs = this->TransformFusionNode->GetNumberOfInputTransformNodes();
+  if (static_cast<int>(this->InputRobustWeights.size()) < numberOfInputs)
+  {
+    this->InputRobustWeights.resize(numberOfInputs);
+  }
+  std::fill(this->InputRobustWeights.begin(), this->InputRobustWeights.end(), 0.0);
+
+  int numberOfValidInputs = this->CollectFusionInputPoses(fusionTimestamp, false);
+  if (numberOfValidInputs == 0)
+  {
+    return;
+  }
+
+  InputPose consensusPose;
+  this->ComputeRobustAveragePose(numberOfValidInputs, this->TransformFusionNode->GetOutlierPositionThresholdMm(),
+    vtkMath::RadiansFromDegrees(this->TransformFusionNode->GetOutlierOrientationThresholdDeg()), consensusPose);
+
+  for (int poseIndex = 0; poseIndex < numberOfValidInputs; poseIndex++)
+  {
+    this->InputRobustWeights[this->FusionInputIndices[poseIndex]] = this->FusionInputRobustWeights[poseIndex];
+  }
+  SetMatrixFromInputPose(consensusPose, this->OutputMatrix);
+  outputNode->SetMatrixTransformToParent(this->OutputMatrix);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerTransformFusionLogic::ComputeRobustAveragePose(int numberOfPoses,
+  double outlierPositionThresholdMm, double outlierOrientationThresholdRad, InputPose& consensusPose)
+{
+  if (static_cast<int>(this->FusionInputRobustWeights.size()) < numberOfPoses)
+  {
+    this->FusionInputRobustWeights.resize(numberOfPoses);
+  }
+
+  // Initial consensus that is not influenced by a minority of outliers:
+  // geometric median of the positions and the input orientation that is closest to all the others (medoid).
+  ComputeMedianPosition(this->FusionInputPoses, this->FusionInputWeights, numberOfPoses, consensusPose.Translation);
+  double minimumSumAngleDifferences = -1.0;
+  for (int candidateIndex = 0; candidateIndex < numberOfPoses; candidateIndex++)
+  {
+    const double* candidateOrientation = this->FusionInputPoses[candidateIndex].Orientation;
+    double sumAngleDifferences = 0.0;
+    for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+    {
+      const double* orientation = this->FusionInputPoses[poseIndex].Orientation;
+      double dotProduct = fabs(candidateOrientation[0]*orientation[0] + candidateOrientation[1]*orientation[1]
+        + candidateOrientation[2]*orientation[2] + candidateOrientation[3]*orientation[3]);
+      sumAngleDifferences += this->FusionInputWeights[poseIndex] * 2.0 * acos(std::min(dotProduct, 1.0));
+    }
+    if (minimumSumAngleDifferences < 0 || sumAngleDifferences < minimumSumAngleDifferences)
+    {
+      minimumSumAngleDifferences = sumAngleDifferences;
+      for (int i = 0; i < 4; i++)
+      {
+        consensusPose.Orientation[i] = candidateOrientation[i];
+      }
+    }
+  }
+
+  // Iteratively reweighted estimation: inputs far from the consensus are down-weighted (Tukey biweight)
+  for (int iteration = 0; iteration < ROBUST_FUSION_NUMBER_OF_REWEIGHTING_ITERATIONS; iteration++)
+  {
+    double sumRobustWeights = 0.0;
+    for (int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++)
+    {
+      const InputPose& pose = this->FusionInputPoses[poseIndex];
+      double positionDifferenceMm = sqrt(vtkMath::Distance2BetweenPoints(pose.Translation, consensusPose.Translation));
+      double dotProduct = fabs(pose.Orientation[0]*consensusPose.Orientation[0] + pose.Orientation[1]*consensusPose.Orientation[1]
+        + pose.Orientation[2]*consensusPose.Orientation[2] + pose.Orientation[3]*consensusPose.Orientation[3]);
+      double orientationDifferenceRad = 2.0 * acos(std::min(dotProduct, 1.0));
+      double normalizedDifference = std::max(
+        outlierPositionThresholdMm > 0 ? positionDifferenceMm / outlierPositionThresholdMm : 0.0,
+        outlierOrientationThresholdRad > 0 ? orientationDifferenceRad / outlierOrientationThresholdRad : 0.0);
+      double robustWeight = 0.0;
+      if (normalizedDifference < 1.0)
+      {
+        robustWeight = (1.0 - normalizedDifference * normalizedDifference) * (1.0 - normalizedDifference * normalizedDifference);
+      }
+      this->FusionInputRobustWeights[poseIndex] = this->FusionInputWeights[poseIndex] * robustWeight;
+      sumRobustWeights += this->FusionInputRobustWeights[poseIndex];
+    }
+    if (sumRobustWeights <= 0)
+    {
+      // Inputs do not agree at all, keep the initial consensus
+      break;
+    }
+    ComputeMedianPosition(this->FusionInputPoses, this->FusionInputRobustWeights, numberOfPoses, consensusPose.Translation);
+    ComputeAverageOrientation(this->FusionInputPoses, this->FusionInputRobustWeights, numberOfPoses, consensusPose.Orientation);
+  }
+
+  consensusPose.Timestamp = this->FusionInputPoses[0].Timestamp;
+}
+
+//-----------------------------------------------------------------------------
+double vtkSlicerTransformFusionLogic::GetInputRobustWeight(int inputIndex)
+{
+  if (inputIndex < 0 || inputIndex >= static_cast<int>(this->InputRobustWeights.size()))
+  {
+    return 0.0;
+  }
+  return this->InputRobustWeights[inputIndex];
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::IsInputPoseBufferingEnabled()
+{
+  if (this->TransformFusionNode == NULL)
+  {
+    return false;
+  }
+  return this->InputPoseBuffering
+    || this->TransformFusionNode->GetSynchronizeInputs()
+    || this->TransformFusionNode->GetFusionTechnique() == MODE_PREDICTION;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::EstimateInputVelocity(const InputPoseBuffer& buffer,
+  double velocityMmPerSec[3], double angularVelocityRadPerSec[3])
+{
+  for (int i = 0; i < 3; i++)
+  {
+    velocityMmPerSec[i] = 0.0;
+    angularVelocityRadPerSec[i] = 0.0;
+  }
+  int bufferSize = static_cast<int>(buffer.Poses.size());
+  const InputPose& latestPose = buffer.Poses[(buffer.FirstPoseIndex + buffer.NumberOfPoses - 1) % bufferSize];
+  double windowStartTimestamp = latestPose.Timestamp - this->TransformFusionNode->GetPredictionVelocityWindowSec();
+
+  // Least squares line fit to the positions and to the rotation vectors (relative to the latest pose) in the time window.
+  // Time, position, and rotation are relative to the latest pose for numerical accuracy.
+  double inverseLatestOrientation[4] = { latestPose.Orientation[0], -latestPose.Orientation[1], -latestPose.Orientation[2], -latestPose.Orientation[3] };
+  double sumTime = 0.0;
+  double sumTimeSquared = 0.0;
+  double sumPosition[3] = { 0.0, 0.0, 0.0 };
+  double sumTimePosition[3] = { 0.0, 0.0, 0.0 };
+  double sumRotation[3] = { 0.0, 0.0, 0.0 };
+  double sumTimeRotation[3] = { 0.0, 0.0, 0.0 };
+  int numberOfPosesInWindow = 0;
+  for (int poseIndex = buffer.NumberOfPoses - 1; poseIndex >= 0; poseIndex--)
+  {
+    const InputPose& pose = buffer.Poses[(buffer.FirstPoseIndex + poseIndex) % bufferSize];
+    if (pose.Timestamp < windowStartTimestamp)
+    {
+      break;
+    }
+    double time = pose.Timestamp - latestPose.Timestamp;
+    double relativeOrientation[4] = { 1.0, 0.0, 0.0, 0.0 };
+    MultiplyQuaternions(inverseLatestOrientation, pose.Orientation, relativeOrientation);
+    double rotation[3] = { 0.0, 0.0, 0.0 };
+    RotationVectorFromQuaternion(relativeOrientation, rotation);
+    sumTime += time;
+    sumTimeSquared += time * time;
+    for (int i = 0; i < 3; i++)
+    {
+      double position = pose.Translation[i] - latestPose.Translation[i];
+      sumPosition[i] += position;
+      sumTimePosition[i] += time * position;
+      sumRotation[i] += rotation[i];
+      sumTimeRotation[i] += time * rotation[i];
+    }
+    numberOfPosesInWindow++;
+  }
+
+  double timeVariance = numberOfPosesInWindow * sumTimeSquared - sumTime * sumTime;
+  if (numberOfPosesInWindow < 2 || timeVariance <= 0)
+  {
+    // Not enough poses for estimating the velocity, assume the input is not moving
+    return true;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    velocityMmPerSec[i] = (numberOfPosesInWindow * sumTimePosition[i] - sumTime * sumPosition[i]) / timeVariance;
+    angularVelocityRadPerSec[i] = (numberOfPosesInWindow * sumTimeRotation[i] - sumTime * sumRotation[i]) / timeVariance;
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::GetPredictedInputPose(int inputIndex, double timestamp, InputPose& pose)
+{
+  InputPoseBuffer* buffer = this->GetInputPoseBuffer(inputIndex);
+  if (buffer == NULL)
+  {
+    return false;
+  }
+  double velocityMmPerSec[3] = { 0.0, 0.0, 0.0 };
+  double angularVelocityRadPerSec[3] = { 0.0, 0.0, 0.0 };
+  this->EstimateInputVelocity(*buffer, velocityMmPerSec, angularVelocityRadPerSec);
+
+  const InputPose& latestPose = buffer->Poses[(buffer->FirstPoseIndex + buffer->NumberOfPoses - 1) % buffer->Poses.size()];
+  // Do not extrapolate far into the future if the input stopped updating (e.g., tool is occluded)
+  double predictionIntervalSec = timestamp - latestPose.Timestamp;
+  double maximumPredictionIntervalSec = this->TransformFusionNode->GetMaximumPredictionIntervalSec();
+  if (predictionIntervalSec > maximumPredictionIntervalSec)
+  {
+    predictionIntervalSec = maximumPredictionIntervalSec;
+  }
+  if (predictionIntervalSec < 0)
+  {
+    predictionIntervalSec = 0;
+  }
+
+  double rotationVector[3] = { 0.0, 0.0, 0.0 };
+  for (int i = 0; i < 3; i++)
+  {
+    pose.Translation[i] = latestPose.Translation[i] + predictionIntervalSec * velocityMmPerSec[i];
+    rotationVector[i] = predictionIntervalSec * angularVelocityRadPerSec[i];
+  }
+  double rotationIncrement[4] = { 1.0, 0.0, 0.0, 0.0 };
+  QuaternionFromRotationVector(rotationVector, rotationIncrement);
+  MultiplyQuaternions(latestPose.Orientation, rotationIncrement, pose.Orientation);
+  pose.Timestamp = timestamp;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::GetPredictedInputTransformMatrix(int inputIndex, double timestamp, vtkMatrix4x4* matrix)
+{
+  if (matrix == NULL)
+  {
+    vtkErrorMacro("GetPredictedInputTransformMatrix failed: invalid output matrix");
+    return false;
+  }
+  this->InputPoseBuffering = true;
+  InputPose pose;
+  if (!this->GetPredictedInputPose(inputIndex, timestamp, pose))
+  {
+    return false;
+  }
+  SetMatrixFromInputPose(pose, matrix);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerTransformFusionLogic::GetInputVelocity(int inputIndex, double velocityMmPerSec[3], double angularVelocityRadPerSec[3])
+{
+  this->InputPoseBuffering = true;
+  InputPoseBuffer* buffer = this->GetInputPoseBuffer(inputIndex);
+  if (buffer == NULL)
+  {
+    return false;
+  }
+  return this->EstimateInputVelocity(*buffer, velocityMmPerSec, angularVelocityRadPerSec);
+}
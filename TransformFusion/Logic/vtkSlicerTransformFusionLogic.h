@@ -36,12 +36,18 @@
 #include "vtkMRMLNode.h"
 #include "vtkMRMLScene.h"
 
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
 class vtkMRMLTransformFusionNode;
 class vtkMRMLLinearTransformNode;
 
 
 // STD includes
 #include <cstdlib>
+#include <vector>
 
 #include "vtkSlicerTransformFusionModuleLogicExport.h"
 
@@ -59,20 +65,227 @@ public:
   enum techniqueTypes
   {
     MODE_QUATERNION_AVERAGE = 0,
+    MODE_KALMAN_FILTER = 1,
+    MODE_PREDICTION = 2,
+    MODE_ROBUST_AVERAGE = 3
+  };
+
+  enum Events
+  {
+    /// Invoked when an input transform is modified in event-driven update mode and no update
+    /// has been pending yet. The application should call ProcessPendingUpdates() in its next
+    /// event loop iteration (before rendering), so that all input changes that arrive until then
+    /// are fused together, at most once per rendered frame.
+    FusionRequestedEvent = vtkCommand::UserEvent + 556
   };
   
 public:
   void fuseInputTransforms(int techniqueType);
   void QuaternionAverageFusion();
 
+  /// Constant-velocity error-state Kalman filter. Each input pose is added to the filter as a measurement
+  /// when the input transform is modified (weighted by the input's noise settings in the parameter node),
+  /// this method only writes the filtered (and optionally extrapolated) pose to the output.
+  /// Process and measurement noises are isotropic, therefore the filter covariance is the same for each axis
+  /// and the cost of adding a measurement is constant and small (no matrix inversion, no memory allocation).
+  void KalmanFilterFusion();
+
+  /// Discard the filter state, the next input pose reinitializes the filter
+  void ResetKalmanFilter();
+
+  /// Number of Kalman filter measurements that were acquired before the current filter state
+  /// (e.g., from an input that has larger latency than the others). These measurements are extrapolated
+  /// to the time of the filter state using the estimated velocity, with correspondingly increased noise.
+  /// Measurements older than the filter state by more than the reinitialization gap (1 sec) are discarded.
+  vtkGetMacro(NumberOfOutOfSequenceMeasurements, unsigned long);
+
+  /// Latency compensation: linear and angular velocity of each input are estimated from its recently
+  /// received poses and the output is set to the input pose extrapolated to the update time plus
+  /// PredictionLookAheadSec (if there are multiple inputs then the average of the predicted poses).
+  void PredictionFusion();
+
+  /// Outlier-robust weighted average: position is the weighted geometric median of the input positions
+  /// (Weiszfeld algorithm), orientation is the weighted quaternion average of Markley et al. (eigenvector
+  /// of the largest eigenvalue). Starting from the median position and the most central input orientation,
+  /// inputs far from the consensus (see OutlierPositionThresholdMm and OutlierOrientationThresholdDeg
+  /// in the parameter node) are iteratively down-weighted, so a single occluded or jumping input does not
+  /// displace the output. Memory is only allocated when the number of inputs increases.
+  void RobustAverageFusion();
+
+  /// Weight of the input in the last robust average fusion (input weight multiplied by the outlier weight).
+  /// 0 if the input was considered as an outlier.
+  double GetInputRobustWeight(int inputIndex);
+
+  /// Get the pose of an input extrapolated to the specified time (universal time, in seconds)
+  /// based on its recently received poses. Returns false if no poses are buffered for the input.
+  /// Calling this method enables input pose buffering (see InputPoseBuffering).
+  bool GetPredictedInputTransformMatrix(int inputIndex, double timestamp, vtkMatrix4x4* matrix);
+
+  /// Get the linear (mm/s) and angular (rad/s, in the input's coordinate system) velocity of the input
+  /// estimated from its recently received poses. Returns false if no poses are buffered for the input.
+  /// Calling this method enables input pose buffering (see InputPoseBuffering).
+  bool GetInputVelocity(int inputIndex, double velocityMmPerSec[3], double angularVelocityRadPerSec[3]);
+
+  /// If enabled then recent poses of the inputs are buffered even if neither SynchronizeInputs
+  /// nor the prediction technique is used. Buffered poses are needed by GetPredictedInputTransformMatrix,
+  /// GetInputVelocity, and GetBufferedInputTransformMatrix, therefore these methods enable buffering
+  /// when they are called (they return false until poses are received). Default: disabled.
+  vtkSetMacro(InputPoseBuffering, bool);
+  vtkGetMacro(InputPoseBuffering, bool);
+  vtkBooleanMacro(InputPoseBuffering, bool);
+
   void SetAndObserveTransformFusionNode(vtkMRMLTransformFusionNode *node);
   vtkGetObjectMacro(TransformFusionNode, vtkMRMLTransformFusionNode);
+
+  /// Fuse the input transforms if any of them has been modified since the last update
+  /// (only in event-driven update mode). Called by the module after FusionRequestedEvent.
+  void ProcessPendingUpdates();
+
+  /// Returns true if the input has been modified since the last fusion
+  bool IsInputTransformModified(int inputIndex);
+
+  /// Number of input changes that did not trigger a separate fusion because an update was already pending
+  vtkGetMacro(NumberOfSkippedUpdates, unsigned long);
+  /// Number of fusions performed in event-driven update mode
+  vtkGetMacro(NumberOfEventDrivenUpdates, unsigned long);
+  void ResetNumberOfUpdates();
+
+  /// Number of recent poses stored for each input if SynchronizeInputs is enabled in the parameter node
+  /// or the prediction technique is used or InputPoseBuffering is enabled.
+  /// The buffer of an input is a ring buffer, the oldest pose is overwritten when it is full. Default: 50.
+  void SetMaximumNumberOfBufferedPoses(int numberOfPoses);
+  vtkGetMacro(MaximumNumberOfBufferedPoses, int);
+
+  /// Inputs are interpolated to the time of the most recent pose of the input that lags most.
+  /// Inputs whose most recent pose is older than the newest input pose by more than this value
+  /// (e.g., occluded or disconnected tools) are not waited for, their latest pose is used instead. Default: 0.2 sec.
+  vtkSetMacro(MaximumSynchronizationLagSec, double);
+  vtkGetMacro(MaximumSynchronizationLagSec, double);
+
+  /// Time point (universal time, in seconds) that the inputs were interpolated to (or the Kalman filter
+  /// state was predicted to) in the last fusion. Negative if the inputs were not synchronized.
+  vtkGetMacro(LastFusionTimestamp, double);
+
+  /// Get the pose of an input interpolated at the specified time from its buffered poses.
+  /// Returns false if no poses are buffered for the input.
+  /// Calling this method enables input pose buffering (see InputPoseBuffering).
+  bool GetBufferedInputTransformMatrix(int inputIndex, double timestamp, vtkMatrix4x4* matrix);
+
+  /// Spherical linear interpolation between unit quaternions (w, x, y, z). The shorter arc is used.
+  static void InterpolateQuaternion(const double q0[4], const double q1[4], double weight1, double q[4]);
+
+  virtual void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData);
   
 protected:
   vtkSlicerTransformFusionLogic();
   ~vtkSlicerTransformFusionLogic();
 
   virtual void RegisterNodes();
+
+  /// Rigid pose of an input (orientation as unit quaternion w, x, y, z) with its acquisition time
+  struct InputPose
+  {
+    double Timestamp;
+    double Orientation[4];
+    double Translation[3];
+  };
+
+  /// Recent poses of an input, ordered by time
+  struct InputPoseBuffer
+  {
+    vtkMRMLNode* InputNode; // only used for checking if the input at this index is still the same node, not dereferenced
+    std::vector<InputPose> Poses;
+    int FirstPoseIndex;
+    int NumberOfPoses;
+
+    InputPoseBuffer()
+    : InputNode(NULL)
+    , FirstPoseIndex(0)
+    , NumberOfPoses(0)
+    {
+    }
+  };
+
+  /// Store the current pose of the input in its buffer
+  void RecordInputPose(int inputIndex, double timestamp);
+
+  /// Acquisition time of the current pose of the input: the timestamp provided by the tracking device
+  /// (see vtkMRMLTransformFusionNode::InputTimestampAttributeName) or the arrival time if the device does not
+  /// provide one, minus the latency of the input
+  double GetInputAcquisitionTimestamp(int inputIndex, double arrivalTimestamp);
+
+  /// Return the buffer of the input, NULL if there are no poses recorded for the current input node at this index
+  InputPoseBuffer* GetInputPoseBuffer(int inputIndex);
+
+  /// Time point that all the inputs are interpolated to, negative if inputs are not synchronized
+  double GetSynchronizationTimestamp();
+
+  /// Returns true if poses of the inputs have to be stored
+  bool IsInputPoseBufferingEnabled();
+
+  /// Estimate velocity from the poses in the last PredictionVelocityWindowSec and extrapolate the
+  /// latest pose to the specified time
+  bool GetPredictedInputPose(int inputIndex, double timestamp, InputPose& pose);
+  bool EstimateInputVelocity(const InputPoseBuffer& buffer, double velocityMmPerSec[3], double angularVelocityRadPerSec[3]);
+
+  /// Get the pose of the input at the specified time (interpolated from the buffered poses if timestamp is not negative,
+  /// otherwise the current pose of the input transform node). Returns false if the input is not available.
+  bool GetInputPose(int inputIndex, double timestamp, InputPose& pose);
+
+  /// State of the constant-velocity Kalman filter. Orientation error and angular velocity
+  /// are expressed in the tool coordinate system. Covariances are per axis: (position, velocity).
+  struct KalmanFilterState
+  {
+    bool Initialized;
+    double Timestamp;
+    double Position[3];
+    double Velocity[3];
+    double PositionCovariance[2][2];
+    double Orientation[4];
+    double AngularVelocity[3];
+    double OrientationCovariance[2][2];
+  };
+
+  /// Add the current pose of the input as a measurement to the Kalman filter
+  void AddKalmanFilterMeasurement(int inputIndex, double timestamp);
+
+  static void InitializeKalmanFilterState(KalmanFilterState& state, const InputPose& measurement, double timestamp,
+    double positionNoiseMm, double orientationNoiseRad);
+  static void PredictKalmanFilterState(KalmanFilterState& state, double timestamp,
+    double accelerationNoiseMmPerSec2, double angularAccelerationNoiseRadPerSec2);
+  static void UpdateKalmanFilterState(KalmanFilterState& state, const InputPose& measurement,
+    double positionNoiseMm, double orientationNoiseRad);
+  /// Move a measurement that was acquired ageSec before the filter state to the time of the filter state
+  /// (constant velocity motion) and add the uncertainty of the extrapolation to the measurement noise
+  static void ExtrapolateKalmanFilterMeasurement(const KalmanFilterState& state, double ageSec,
+    double accelerationNoiseMmPerSec2, double angularAccelerationNoiseRadPerSec2,
+    InputPose& measurement, double& positionNoiseMm, double& orientationNoiseRad);
+
+  /// Get the pose of each input with non-zero weight into FusionInputPoses, FusionInputWeights, FusionInputIndices.
+  /// Poses are interpolated to the timestamp (if not negative) or extrapolated to the timestamp (if predict is true).
+  /// Returns the number of collected poses.
+  int CollectFusionInputPoses(double timestamp, bool predict);
+
+  /// Robust average of the first numberOfPoses poses in FusionInputPoses, weighted by FusionInputWeights
+  /// (see RobustAverageFusion). Robust weight of each pose is returned in FusionInputRobustWeights.
+  /// Memory is only allocated when the number of poses increases.
+  void ComputeRobustAveragePose(int numberOfPoses, double outlierPositionThresholdMm, double outlierOrientationThresholdRad,
+    InputPose& consensusPose);
+
+  /// Weighted average of the first numberOfPoses poses (quaternions are flipped to the same hemisphere before averaging).
+  /// Returns false if the average orientation is undefined.
+  static bool AverageInputPoses(const std::vector<InputPose>& poses, const std::vector<double>& weights,
+    int numberOfPoses, InputPose& averagePose);
+  /// Weighted average orientation by eigen decomposition (Markley). Returns false if the average is undefined.
+  static bool ComputeAverageOrientation(const std::vector<InputPose>& poses, const std::vector<double>& weights,
+    int numberOfPoses, double averageOrientation[4]);
+  /// Weighted geometric median of positions (Weiszfeld algorithm)
+  static void ComputeMedianPosition(const std::vector<InputPose>& poses, const std::vector<double>& weights,
+    int numberOfPoses, double medianPosition[3]);
+
+  static void SetInputPoseFromMatrix(vtkMatrix4x4* matrix, InputPose& pose);
+  static void SetMatrixFromInputPose(const InputPose& pose, vtkMatrix4x4* matrix);
+  static void InterpolateInputPose(const InputPoseBuffer& buffer, double timestamp, InputPose& pose);
   
 private:
   vtkSlicerTransformFusionLogic(const vtkSlicerTransformFusionLogic&);// Not implemented
@@ -82,6 +295,35 @@ protected:
   /// Parameter set MRML node
   vtkMRMLTransformFusionNode* TransformFusionNode;
 
+  /// Reused for retrieving the input transforms (each input matrix is retrieved once per fusion)
+  vtkSmartPointer<vtkMatrix4x4> InputMatrix;
+  vtkSmartPointer<vtkMatrix4x4> OutputMatrix;
+
+  /// Event-driven update state
+  bool UpdatePending;
+  std::vector<bool> InputTransformModified;
+  unsigned long NumberOfSkippedUpdates;
+  unsigned long NumberOfEventDrivenUpdates;
+
+  /// Time synchronization of the inputs
+  bool InputPoseBuffering;
+  std::vector<InputPoseBuffer> InputPoseBuffers;
+  int MaximumNumberOfBufferedPoses;
+  double MaximumSynchronizationLagSec;
+  double LastFusionTimestamp;
+
+  KalmanFilterState KalmanFilter;
+  unsigned long NumberOfOutOfSequenceMeasurements;
+
+  /// Input poses used in the current fusion (reused to avoid memory allocation in each update)
+  std::vector<InputPose> FusionInputPoses;
+  std::vector<double> FusionInputWeights;
+  std::vector<double> FusionInputRobustWeights;
+  std::vector<int> FusionInputIndices;
+
+  /// Robust weight of each input in the last robust average fusion
+  std::vector<double> InputRobustWeights;
+
 };
 
 #endif
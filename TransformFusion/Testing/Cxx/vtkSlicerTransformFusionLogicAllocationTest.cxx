@@ -0,0 +1,168 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks that event-driven robust average fusion does not allocate heap memory after the first update.
+// Input transform nodes are modified as a tracker would do it, then the pending update is processed
+// (input poses are collected, fused, and written to the output transform node). Allocations made by
+// the MRML transform node when the output matrix is set are measured separately and are not
+// attributed to the fusion.
+
+// TransformFusion includes
+#include "vtkMRMLTransformFusionNode.h"
+#include "vtkSlicerTransformFusionLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+
+// SlicerIGT testing includes
+#include "SlicerIGTTestingAllocationCounter.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Set the matrix to a rotation around the z axis and a translation
+  void SetPoseMatrix(vtkMatrix4x4* matrix, double angleDeg, double x, double y, double z)
+  {
+    double angleRad = vtkMath::RadiansFromDegrees(angleDeg);
+    matrix->Identity();
+    matrix->SetElement(0, 0, cos(angleRad));
+    matrix->SetElement(0, 1, -sin(angleRad));
+    matrix->SetElement(1, 0, sin(angleRad));
+    matrix->SetElement(1, 1, cos(angleRad));
+    matrix->SetElement(0, 3, x);
+    matrix->SetElement(1, 3, y);
+    matrix->SetElement(2, 3, z);
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerTransformFusionLogicAllocationTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int numberOfInputs = 5;
+  const int jumpingInputIndex = 3;
+  const int numberOfUpdates = 1000;
+
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkSlicerTransformFusionLogic> logic;
+  logic->SetMRMLScene(scene.GetPointer());
+
+  vtkNew<vtkMRMLLinearTransformNode> outputNode;
+  scene->AddNode(outputNode.GetPointer());
+  vtkNew<vtkMRMLTransformFusionNode> fusionNode;
+  scene->AddNode(fusionNode.GetPointer());
+  fusionNode->SetAndObserveOutputTransformNode(outputNode.GetPointer());
+  for (int i = 0; i < numberOfInputs; i++)
+  {
+    vtkNew<vtkMRMLLinearTransformNode> inputNode;
+    scene->AddNode(inputNode.GetPointer());
+    fusionNode->AddAndObserveInputTransformNode(inputNode.GetPointer());
+  }
+  fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_ROBUST_AVERAGE);
+  fusionNode->SetEventDrivenUpdate(true);
+  logic->SetAndObserveTransformFusionNode(fusionNode.GetPointer());
+
+  vtkNew<vtkMatrix4x4> inputMatrix;
+  vtkNew<vtkMatrix4x4> outputMatrix;
+
+  // Allocations made by the output transform node itself when its matrix is set
+  unsigned long maximumNumberOfOutputSetAllocations = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    SetPoseMatrix(outputMatrix.GetPointer(), i, i, 0.0, 0.0);
+    unsigned long numberOfAllocationsBeforeSet = SlicerIGTTesting::GetNumberOfHeapAllocations();
+    outputNode->SetMatrixTransformToParent(outputMatrix.GetPointer());
+    unsigned long numberOfSetAllocations = SlicerIGTTesting::GetNumberOfHeapAllocations() - numberOfAllocationsBeforeSet;
+    if (i > 0)
+    {
+      maximumNumberOfOutputSetAllocations = std::max(maximumNumberOfOutputSetAllocations, numberOfSetAllocations);
+    }
+  }
+
+  unsigned long maximumNumberOfUpdateAllocations = 0;
+  for (int updateIndex = 0; updateIndex <= numberOfUpdates; updateIndex++)
+  {
+    // All the inputs move along a circle with a small deterministic jitter, one of them jumps away in every 10th update
+    double angleRad = 0.01 * updateIndex;
+    double expectedPosition[3] = { 100.0 * cos(angleRad), 100.0 * sin(angleRad), 50.0 };
+    bool jumped = (updateIndex % 10 == 0);
+    for (int inputIndex = 0; inputIndex < numberOfInputs; inputIndex++)
+    {
+      double jitterMm = 0.2 * sin(1.7 * updateIndex + inputIndex);
+      SetPoseMatrix(inputMatrix.GetPointer(), 0.5 * sin(0.3 * updateIndex + inputIndex),
+        expectedPosition[0] + jitterMm, expectedPosition[1] - jitterMm, expectedPosition[2] + jitterMm);
+      if (jumped && inputIndex == jumpingInputIndex)
+      {
+        SetPoseMatrix(inputMatrix.GetPointer(), 0.0, expectedPosition[0] + 50.0, expectedPosition[1], expectedPosition[2]);
+      }
+      fusionNode->GetInputTransformNode(inputIndex)->SetMatrixTransformToParent(inputMatrix.GetPointer());
+    }
+
+    unsigned long numberOfAllocationsBeforeUpdate = SlicerIGTTesting::GetNumberOfHeapAllocations();
+    logic->ProcessPendingUpdates();
+    if (updateIndex > 0)
+    {
+      // Memory may be allocated in the first update
+      maximumNumberOfUpdateAllocations = std::max(maximumNumberOfUpdateAllocations,
+        SlicerIGTTesting::GetNumberOfHeapAllocations() - numberOfAllocationsBeforeUpdate);
+    }
+
+    double robustWeight = logic->GetInputRobustWeight(jumpingInputIndex);
+    if (jumped != (robustWeight == 0.0))
+    {
+      std::cerr << "Robust weight of the jumping input is " << robustWeight << " in update " << updateIndex
+        << ", expected " << (jumped ? "0" : "non-zero") << std::endl;
+      return EXIT_FAILURE;
+    }
+    outputNode->GetMatrixTransformToParent(outputMatrix.GetPointer());
+    double outputPosition[3] = { outputMatrix->GetElement(0, 3), outputMatrix->GetElement(1, 3), outputMatrix->GetElement(2, 3) };
+    if (sqrt(vtkMath::Distance2BetweenPoints(outputPosition, expectedPosition)) > 0.5)
+    {
+      std::cerr << "Robust average position mismatch in update " << updateIndex << ": expected (" << expectedPosition[0] << ", "
+        << expectedPosition[1] << ", " << expectedPosition[2] << "), got (" << outputPosition[0] << ", "
+        << outputPosition[1] << ", " << outputPosition[2] << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (logic->GetNumberOfEventDrivenUpdates() != static_cast<unsigned long>(numberOfUpdates + 1))
+  {
+    std::cerr << "Number of event-driven updates mismatch: expected " << numberOfUpdates + 1
+      << ", got " << logic->GetNumberOfEventDrivenUpdates() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Maximum number of heap allocations per update: " << maximumNumberOfUpdateAllocations
+    << " (setting the output transform: " << maximumNumberOfOutputSetAllocations << ")" << std::endl;
+  if (maximumNumberOfUpdateAllocations > maximumNumberOfOutputSetAllocations)
+  {
+    std::cerr << "Robust average fusion allocated heap memory after the first update" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,796 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// TransformFusion includes
+#include "vtkMRMLTransformFusionNode.h"
+#include "vtkSlicerTransformFusionLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkTimerLog.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Gives access to the static helper functions of the logic
+  class vtkSlicerTransformFusionLogicTester : public vtkSlicerTransformFusionLogic
+  {
+  public:
+    typedef vtkSlicerTransformFusionLogic::InputPose InputPose;
+    using vtkSlicerTransformFusionLogic::ComputeMedianPosition;
+    using vtkSlicerTransformFusionLogic::ComputeAverageOrientation;
+  };
+
+  //----------------------------------------------------------------------------
+  // Add a fusion parameter node with the specified number of input transforms and an output transform to the scene
+  vtkMRMLTransformFusionNode* AddTransformFusionNode(vtkMRMLScene* scene, int numberOfInputs)
+  {
+    vtkNew<vtkMRMLLinearTransformNode> outputNode;
+    scene->AddNode(outputNode.GetPointer());
+    vtkNew<vtkMRMLTransformFusionNode> fusionNode;
+    scene->AddNode(fusionNode.GetPointer());
+    fusionNode->SetAndObserveOutputTransformNode(outputNode.GetPointer());
+    for (int i = 0; i < numberOfInputs; i++)
+    {
+      vtkNew<vtkMRMLLinearTransformNode> inputNode;
+      scene->AddNode(inputNode.GetPointer());
+      fusionNode->AddAndObserveInputTransformNode(inputNode.GetPointer());
+    }
+    return fusionNode.GetPointer();
+  }
+
+  //----------------------------------------------------------------------------
+  void SetTranslation(vtkMRMLLinearTransformNode* node, double x, double y, double z)
+  {
+    vtkNew<vtkMatrix4x4> matrix;
+    matrix->SetElement(0, 3, x);
+    matrix->SetElement(1, 3, y);
+    matrix->SetElement(2, 3, z);
+    node->SetMatrixTransformToParent(matrix.GetPointer());
+  }
+
+  //----------------------------------------------------------------------------
+  // Set the timestamp that the tracking device provides for the next pose of the input (universal time, in seconds)
+  void SetDeviceTimestamp(vtkMRMLLinearTransformNode* node, double timestamp)
+  {
+    std::ostringstream timestampString;
+    timestampString << std::setprecision(17) << timestamp;
+    node->SetAttribute(vtkMRMLTransformFusionNode::InputTimestampAttributeName.c_str(), timestampString.str().c_str());
+  }
+
+  //----------------------------------------------------------------------------
+  void CountEventCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* vtkNotUsed(callData))
+  {
+    int* numberOfEvents = static_cast<int*>(clientData);
+    (*numberOfEvents)++;
+  }
+
+  //----------------------------------------------------------------------------
+  // Multiple input changes between two ProcessPendingUpdates calls must result in a single fusion
+  int TestEventDrivenUpdateCoalescing()
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), 2);
+    fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_QUATERNION_AVERAGE);
+    fusionNode->SetEventDrivenUpdate(true);
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+
+    int numberOfFusionRequests = 0;
+    vtkNew<vtkCallbackCommand> fusionRequestCallback;
+    fusionRequestCallback->SetCallback(CountEventCallback);
+    fusionRequestCallback->SetClientData(&numberOfFusionRequests);
+    logic->AddObserver(vtkSlicerTransformFusionLogic::FusionRequestedEvent, fusionRequestCallback.GetPointer());
+
+    // Each fusion sets the output transform once
+    int numberOfOutputModifications = 0;
+    vtkNew<vtkCallbackCommand> outputModifiedCallback;
+    outputModifiedCallback->SetCallback(CountEventCallback);
+    outputModifiedCallback->SetClientData(&numberOfOutputModifications);
+    fusionNode->GetOutputTransformNode()->AddObserver(vtkMRMLTransformableNode::TransformModifiedEvent, outputModifiedCallback.GetPointer());
+
+    // Five input changes arrive before the application processes the pending updates
+    SetTranslation(fusionNode->GetInputTransformNode(0), 1.0, 0.0, 0.0);
+    SetTranslation(fusionNode->GetInputTransformNode(0), 2.0, 0.0, 0.0);
+    SetTranslation(fusionNode->GetInputTransformNode(1), 0.0, 4.0, 0.0);
+    SetTranslation(fusionNode->GetInputTransformNode(0), 3.0, 0.0, 0.0);
+    SetTranslation(fusionNode->GetInputTransformNode(1), 0.0, 6.0, 0.0);
+
+    if (numberOfFusionRequests != 1)
+    {
+      std::cerr << "FusionRequestedEvent is expected once for multiple input changes, received " << numberOfFusionRequests << " times" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (logic->GetNumberOfSkippedUpdates() != 4)
+    {
+      std::cerr << "Number of skipped updates mismatch: expected 4, got " << logic->GetNumberOfSkippedUpdates() << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (!logic->IsInputTransformModified(0) || !logic->IsInputTransformModified(1))
+    {
+      std::cerr << "Modified inputs are not marked as modified" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (numberOfOutputModifications != 0 || logic->GetNumberOfEventDrivenUpdates() != 0)
+    {
+      std::cerr << "Fusion is not expected before ProcessPendingUpdates is called" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    logic->ProcessPendingUpdates();
+    if (numberOfOutputModifications != 1 || logic->GetNumberOfEventDrivenUpdates() != 1)
+    {
+      std::cerr << "Exactly one fusion is expected, output modified " << numberOfOutputModifications << " times, number of event-driven updates: "
+        << logic->GetNumberOfEventDrivenUpdates() << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (logic->IsInputTransformModified(0) || logic->IsInputTransformModified(1))
+    {
+      std::cerr << "Inputs are still marked as modified after the fusion" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Fusion uses the latest pose of each input
+    vtkNew<vtkMatrix4x4> outputMatrix;
+    fusionNode->GetOutputTransformNode()->GetMatrixTransformToParent(outputMatrix.GetPointer());
+    if (fabs(outputMatrix->GetElement(0, 3) - 1.5) > 1e-6 || fabs(outputMatrix->GetElement(1, 3) - 3.0) > 1e-6
+      || fabs(outputMatrix->GetElement(2, 3)) > 1e-6)
+    {
+      std::cerr << "Output position mismatch: expected (1.5, 3, 0), got (" << outputMatrix->GetElement(0, 3) << ", "
+        << outputMatrix->GetElement(1, 3) << ", " << outputMatrix->GetElement(2, 3) << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // No input changes: nothing to do
+    logic->ProcessPendingUpdates();
+    if (numberOfOutputModifications != 1 || logic->GetNumberOfEventDrivenUpdates() != 1)
+    {
+      std::cerr << "Fusion is not expected if no input has been modified" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Next input change requests a new fusion
+    SetTranslation(fusionNode->GetInputTransformNode(1), 0.0, 8.0, 0.0);
+    logic->ProcessPendingUpdates();
+    if (numberOfFusionRequests != 2 || numberOfOutputModifications != 2 || logic->GetNumberOfEventDrivenUpdates() != 2
+      || logic->GetNumberOfSkippedUpdates() != 4)
+    {
+      std::cerr << "Unexpected number of updates after a single input change: " << numberOfFusionRequests << " requests, "
+        << numberOfOutputModifications << " output modifications, " << logic->GetNumberOfEventDrivenUpdates() << " event-driven updates, "
+        << logic->GetNumberOfSkippedUpdates() << " skipped updates" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // Tool moving at constant velocity is tracked by two devices at different rates and with different latencies.
+  // The devices provide timestamps, which are the time of sending the pose (acquisition time + latency).
+  // Returns the maximum difference between the fused position and the true tool position at the fusion time.
+  double GetMaximumFusionErrorOfDelayedInputs(bool compensateLatency)
+  {
+    const double velocityMmPerSec = 100.0;
+    const double samplingPeriodSec[2] = { 0.02, 0.03 };
+    const double latencySec[2] = { 0.05, 0.01 };
+
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), 2);
+    fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_QUATERNION_AVERAGE);
+    fusionNode->SetSynchronizeInputs(true);
+    if (compensateLatency)
+    {
+      fusionNode->SetInputLatencySec(0, latencySec[0]);
+      fusionNode->SetInputLatencySec(1, latencySec[1]);
+    }
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+
+    double startTime = vtkTimerLog::GetUniversalTime();
+    int numberOfSamples[2] = { 0, 0 };
+    double maximumErrorMm = 0.0;
+    for (int i = 0; i < 200; i++)
+    {
+      // Poses are received in the order of their device timestamp
+      double deviceTimestamp[2] = { 0.0, 0.0 };
+      for (int inputIndex = 0; inputIndex < 2; inputIndex++)
+      {
+        deviceTimestamp[inputIndex] = numberOfSamples[inputIndex] * samplingPeriodSec[inputIndex] + latencySec[inputIndex];
+      }
+      int inputIndex = (deviceTimestamp[0] <= deviceTimestamp[1] ? 0 : 1);
+      double acquisitionTime = numberOfSamples[inputIndex] * samplingPeriodSec[inputIndex];
+      numberOfSamples[inputIndex]++;
+
+      vtkMRMLLinearTransformNode* inputNode = fusionNode->GetInputTransformNode(inputIndex);
+      SetDeviceTimestamp(inputNode, startTime + deviceTimestamp[inputIndex]);
+      SetTranslation(inputNode, velocityMmPerSec * acquisitionTime, 0.0, 0.0);
+
+      logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_QUATERNION_AVERAGE);
+      if (numberOfSamples[0] == 0 || numberOfSamples[1] == 0)
+      {
+        // Fusion needs poses from both inputs
+        continue;
+      }
+      vtkNew<vtkMatrix4x4> outputMatrix;
+      fusionNode->GetOutputTransformNode()->GetMatrixTransformToParent(outputMatrix.GetPointer());
+      double expectedPositionMm = velocityMmPerSec * (logic->GetLastFusionTimestamp() - startTime);
+      double errorMm = fabs(outputMatrix->GetElement(0, 3) - expectedPositionMm);
+      if (errorMm > maximumErrorMm)
+      {
+        maximumErrorMm = errorMm;
+      }
+    }
+
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return maximumErrorMm;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestInputLatencyCompensation()
+  {
+    // Inputs with different latencies are synchronized if the latency of each input is specified
+    double maximumErrorMm = GetMaximumFusionErrorOfDelayedInputs(true);
+    if (maximumErrorMm > 1e-3)
+    {
+      std::cerr << "Fused position differs from the tool position by " << maximumErrorMm << "mm, although input latencies are compensated" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Check that the test is sensitive to the latency: poses are acquired 50ms and 10ms before their timestamp,
+    // which is a 3mm error in the average position at 100mm/s
+    maximumErrorMm = GetMaximumFusionErrorOfDelayedInputs(false);
+    if (maximumErrorMm < 1.0)
+    {
+      std::cerr << "Fused position error is expected to be large if input latencies are not compensated, got " << maximumErrorMm << "mm" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // If the device does not provide a timestamp then the latency is subtracted from the arrival time
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), 1);
+    fusionNode->SetSynchronizeInputs(true);
+    fusionNode->SetInputLatencySec(0, 0.1);
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+    double timeBeforeArrival = vtkTimerLog::GetUniversalTime();
+    SetTranslation(fusionNode->GetInputTransformNode(0), 1.0, 2.0, 3.0);
+    double timeAfterArrival = vtkTimerLog::GetUniversalTime();
+    logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_QUATERNION_AVERAGE);
+    if (logic->GetLastFusionTimestamp() < timeBeforeArrival - 0.1 || logic->GetLastFusionTimestamp() > timeAfterArrival - 0.1)
+    {
+      std::cerr << "Pose acquisition time mismatch: expected arrival time - 0.1 sec (" << std::setprecision(17) << timeBeforeArrival - 0.1
+        << " to " << timeAfterArrival - 0.1 << "), got " << logic->GetLastFusionTimestamp() << std::endl;
+      return EXIT_FAILURE;
+    }
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestKalmanFilterFusion()
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), 2);
+    fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_KALMAN_FILTER);
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+
+    // Zero or negative noise is rejected
+    fusionNode->SetInputPositionNoiseMm(0, 1.0);
+    fusionNode->SetInputPositionNoiseMm(0, 0.0);
+    fusionNode->SetInputOrientationNoiseDeg(0, -1.0);
+    if (fusionNode->GetInputPositionNoiseMm(0) != 1.0 || fusionNode->GetInputOrientationNoiseDeg(0) <= 0)
+    {
+      std::cerr << "Invalid input noise was accepted: " << fusionNode->GetInputPositionNoiseMm(0) << "mm, "
+        << fusionNode->GetInputOrientationNoiseDeg(0) << "deg" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Filter initialized from the current poses of both inputs (at the same time point):
+    // the output is the average of the inputs weighted by the inverse of their noise variance.
+    double firstPosition[3] = { 10.0, 20.0, 30.0 };
+    double secondPosition[3] = { 15.0, 10.0, 30.0 };
+    fusionNode->SetInputPositionNoiseMm(0, 0.5);
+    fusionNode->SetInputPositionNoiseMm(1, 1.0);
+    SetTranslation(fusionNode->GetInputTransformNode(0), firstPosition[0], firstPosition[1], firstPosition[2]);
+    SetTranslation(fusionNode->GetInputTransformNode(1), secondPosition[0], secondPosition[1], secondPosition[2]);
+    logic->ResetKalmanFilter();
+    logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_KALMAN_FILTER);
+    vtkNew<vtkMatrix4x4> outputMatrix;
+    fusionNode->GetOutputTransformNode()->GetMatrixTransformToParent(outputMatrix.GetPointer());
+    for (int axis = 0; axis < 3; axis++)
+    {
+      double expectedPosition = 0.8 * firstPosition[axis] + 0.2 * secondPosition[axis];
+      if (!(fabs(outputMatrix->GetElement(axis, 3) - expectedPosition) < 1e-6))
+      {
+        std::cerr << "Initial Kalman filter position mismatch along axis " << axis << ": expected " << expectedPosition
+          << ", got " << outputMatrix->GetElement(axis, 3) << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Noisy measurements of a tool moving at constant velocity, at 100Hz for 2 seconds.
+    // Device timestamps start at the current time, so that the filter is not reinitialized
+    // because of a long time since the last measurement.
+    fusionNode->RemoveInputTransformNode(1);
+    fusionNode->SetInputPositionNoiseMm(0, 0.5);
+    fusionNode->SetAccelerationNoiseMmPerSec2(100.0);
+    logic->ResetKalmanFilter();
+    vtkMath::RandomSeed(23);
+    const double startPosition[3] = { 10.0, 20.0, 30.0 };
+    const double velocityMmPerSec[3] = { 50.0, -20.0, 10.0 };
+    double startTime = vtkTimerLog::GetUniversalTime();
+    double maximumErrorMm = 0.0;
+    double sumSquaredErrorMm2 = 0.0;
+    int numberOfSquaredErrors = 0;
+    for (int i = 0; i < 200; i++)
+    {
+      double time = i * 0.01;
+      double truePosition[3] = { 0.0, 0.0, 0.0 };
+      double measuredPosition[3] = { 0.0, 0.0, 0.0 };
+      for (int axis = 0; axis < 3; axis++)
+      {
+        truePosition[axis] = startPosition[axis] + time * velocityMmPerSec[axis];
+        measuredPosition[axis] = truePosition[axis] + vtkMath::Gaussian(0.0, 0.5);
+      }
+      SetDeviceTimestamp(fusionNode->GetInputTransformNode(0), startTime + time);
+      SetTranslation(fusionNode->GetInputTransformNode(0), measuredPosition[0], measuredPosition[1], measuredPosition[2]);
+      logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_KALMAN_FILTER);
+
+      fusionNode->GetOutputTransformNode()->GetMatrixTransformToParent(outputMatrix.GetPointer());
+      double filteredPosition[3] = { outputMatrix->GetElement(0, 3), outputMatrix->GetElement(1, 3), outputMatrix->GetElement(2, 3) };
+      double errorMm = sqrt(vtkMath::Distance2BetweenPoints(filteredPosition, truePosition));
+      if (!(errorMm < 10.0))
+      {
+        // Also catches NaN
+        std::cerr << "Kalman filter output is not bounded at sample " << i << ": error = " << errorMm << "mm" << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (i < 20)
+      {
+        // Velocity is not known yet
+        continue;
+      }
+      maximumErrorMm = std::max(maximumErrorMm, errorMm);
+      if (i >= 100)
+      {
+        sumSquaredErrorMm2 += errorMm * errorMm;
+        numberOfSquaredErrors++;
+      }
+    }
+    // Measurement error is 0.87mm RMS (0.5mm on each axis), the converged filter is expected to reduce it
+    double rmsErrorMm = sqrt(sumSquaredErrorMm2 / numberOfSquaredErrors);
+    if (maximumErrorMm > 3.0 || rmsErrorMm > 0.75)
+    {
+      std::cerr << "Kalman filter did not converge: maximum error = " << maximumErrorMm << "mm, RMS error = " << rmsErrorMm << "mm" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // Two inputs with different latencies track the same moving tool: the input with larger latency provides
+  // measurements that were acquired before the current filter state. These must not pull the estimate back.
+  int TestKalmanFilterOutOfSequenceMeasurements()
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), 2);
+    fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_KALMAN_FILTER);
+    fusionNode->SetInputLatencySec(0, 0.05);
+    fusionNode->SetInputLatencySec(1, 0.01);
+    fusionNode->SetInputPositionNoiseMm(0, 0.5);
+    fusionNode->SetInputPositionNoiseMm(1, 0.5);
+    fusionNode->SetAccelerationNoiseMmPerSec2(100.0);
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+    logic->ResetKalmanFilter();
+
+    // Both inputs send poses at 100Hz, interleaved. Device timestamps are the arrival times,
+    // poses are the true positions at the acquisition time (arrival time minus latency).
+    const double velocityMmPerSec = 100.0;
+    double startTime = vtkTimerLog::GetUniversalTime();
+    double maximumErrorMm = 0.0;
+    vtkNew<vtkMatrix4x4> outputMatrix;
+    for (int i = 0; i < 300; i++)
+    {
+      for (int inputIndex = 0; inputIndex < 2; inputIndex++)
+      {
+        double arrivalTime = i * 0.01 + inputIndex * 0.005;
+        double acquisitionTime = arrivalTime - fusionNode->GetInputLatencySec(inputIndex);
+        vtkMRMLLinearTransformNode* inputNode = fusionNode->GetInputTransformNode(inputIndex);
+        SetDeviceTimestamp(inputNode, startTime + arrivalTime);
+        SetTranslation(inputNode, velocityMmPerSec * acquisitionTime, 0.0, 0.0);
+        logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_KALMAN_FILTER);
+        if (i < 200)
+        {
+          // Velocity estimate has not converged yet
+          continue;
+        }
+        fusionNode->GetOutputTransformNode()->GetMatrixTransformToParent(outputMatrix.GetPointer());
+        double expectedPositionMm = velocityMmPerSec * (logic->GetLastFusionTimestamp() - startTime);
+        maximumErrorMm = std::max(maximumErrorMm, fabs(outputMatrix->GetElement(0, 3) - expectedPositionMm));
+      }
+    }
+
+    if (logic->GetNumberOfOutOfSequenceMeasurements() == 0)
+    {
+      std::cerr << "Measurements of the input with larger latency were not detected as out-of-sequence" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Fusing the delayed measurements at the current filter time would cause a lag of more than 1mm
+    if (!(maximumErrorMm < 0.1))
+    {
+      std::cerr << "Kalman filter error with inputs of different latencies: " << maximumErrorMm << "mm" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // Prediction of an input moving and rotating at constant velocity, without using the prediction technique
+  int TestInputPrediction()
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), 1);
+    fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_QUATERNION_AVERAGE);
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+    vtkMRMLLinearTransformNode* inputNode = fusionNode->GetInputTransformNode(0);
+
+    // No poses have been received yet, but querying the velocity enables buffering
+    double velocityMmPerSec[3] = { 0.0, 0.0, 0.0 };
+    double angularVelocityRadPerSec[3] = { 0.0, 0.0, 0.0 };
+    if (logic->GetInputVelocity(0, velocityMmPerSec, angularVelocityRadPerSec) || !logic->GetInputPoseBuffering())
+    {
+      std::cerr << "Input velocity is not expected to be available before receiving poses and input pose buffering is expected to be enabled" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Tool moves along a line and rotates around its z axis, poses are received at 100Hz
+    const double startPosition[3] = { 10.0, 20.0, 30.0 };
+    const double expectedVelocityMmPerSec[3] = { 50.0, -20.0, 10.0 };
+    const double angularVelocityDegPerSec = 90.0;
+    double startTime = vtkTimerLog::GetUniversalTime();
+    vtkNew<vtkTransform> transform;
+    double time = 0.0;
+    for (int i = 0; i < 20; i++)
+    {
+      time = i * 0.01;
+      transform->Identity();
+      transform->Translate(startPosition[0] + time * expectedVelocityMmPerSec[0], startPosition[1] + time * expectedVelocityMmPerSec[1],
+        startPosition[2] + time * expectedVelocityMmPerSec[2]);
+      transform->RotateZ(time * angularVelocityDegPerSec);
+      SetDeviceTimestamp(inputNode, startTime + time);
+      inputNode->SetMatrixTransformToParent(transform->GetMatrix());
+    }
+
+    if (!logic->GetInputVelocity(0, velocityMmPerSec, angularVelocityRadPerSec))
+    {
+      std::cerr << "Input velocity is not available" << std::endl;
+      return EXIT_FAILURE;
+    }
+    const double expectedAngularVelocityRadPerSec[3] = { 0.0, 0.0, vtkMath::RadiansFromDegrees(angularVelocityDegPerSec) };
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (fabs(velocityMmPerSec[axis] - expectedVelocityMmPerSec[axis]) > 1e-2
+        || fabs(angularVelocityRadPerSec[axis] - expectedAngularVelocityRadPerSec[axis]) > 1e-3)
+      {
+        std::cerr << "Input velocity mismatch along axis " << axis << ": expected " << expectedVelocityMmPerSec[axis] << "mm/s, "
+          << expectedAngularVelocityRadPerSec[axis] << "rad/s, got " << velocityMmPerSec[axis] << "mm/s, "
+          << angularVelocityRadPerSec[axis] << "rad/s" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Extrapolate the latest pose by the look-ahead time
+    double lookAheadSec = fusionNode->GetPredictionLookAheadSec();
+    double predictionTime = time + lookAheadSec;
+    vtkNew<vtkMatrix4x4> predictedMatrix;
+    if (!logic->GetPredictedInputTransformMatrix(0, startTime + predictionTime, predictedMatrix.GetPointer()))
+    {
+      std::cerr << "Predicted input pose is not available" << std::endl;
+      return EXIT_FAILURE;
+    }
+    transform->Identity();
+    transform->Translate(startPosition[0] + predictionTime * expectedVelocityMmPerSec[0], startPosition[1] + predictionTime * expectedVelocityMmPerSec[1],
+      startPosition[2] + predictionTime * expectedVelocityMmPerSec[2]);
+    transform->RotateZ(predictionTime * angularVelocityDegPerSec);
+    for (int row = 0; row < 3; row++)
+    {
+      for (int column = 0; column < 4; column++)
+      {
+        double tolerance = (column < 3 ? 1e-5 : 1e-3);
+        if (fabs(predictedMatrix->GetElement(row, column) - transform->GetMatrix()->GetElement(row, column)) > tolerance)
+        {
+          std::cerr << "Predicted pose mismatch at (" << row << ", " << column << "): expected " << transform->GetMatrix()->GetElement(row, column)
+            << ", got " << predictedMatrix->GetElement(row, column) << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+
+    // Prediction far ahead of the latest pose is clamped to the maximum prediction interval,
+    // independently of the synchronization lag tolerance
+    fusionNode->SetMaximumPredictionIntervalSec(0.1);
+    logic->SetMaximumSynchronizationLagSec(5.0);
+    if (!logic->GetPredictedInputTransformMatrix(0, startTime + time + 1.0, predictedMatrix.GetPointer()))
+    {
+      std::cerr << "Predicted input pose is not available" << std::endl;
+      return EXIT_FAILURE;
+    }
+    double clampedPredictionTime = time + fusionNode->GetMaximumPredictionIntervalSec();
+    for (int axis = 0; axis < 3; axis++)
+    {
+      double expectedPosition = startPosition[axis] + clampedPredictionTime * expectedVelocityMmPerSec[axis];
+      if (fabs(predictedMatrix->GetElement(axis, 3) - expectedPosition) > 1e-3)
+      {
+        std::cerr << "Prediction was not clamped to the maximum prediction interval along axis " << axis << ": expected "
+          << expectedPosition << ", got " << predictedMatrix->GetElement(axis, 3) << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  void SetPosition(vtkSlicerTransformFusionLogicTester::InputPose& pose, double x, double y, double z)
+  {
+    pose.Timestamp = 0.0;
+    pose.Orientation[0] = 1.0;
+    pose.Orientation[1] = 0.0;
+    pose.Orientation[2] = 0.0;
+    pose.Orientation[3] = 0.0;
+    pose.Translation[0] = x;
+    pose.Translation[1] = y;
+    pose.Translation[2] = z;
+  }
+
+  //----------------------------------------------------------------------------
+  // Set the orientation of the pose to a rotation around the z axis (sign is the sign of the quaternion)
+  void SetRotationZ(vtkSlicerTransformFusionLogicTester::InputPose& pose, double angleDeg, double sign)
+  {
+    double halfAngleRad = vtkMath::RadiansFromDegrees(angleDeg) / 2.0;
+    pose.Orientation[0] = sign * cos(halfAngleRad);
+    pose.Orientation[1] = 0.0;
+    pose.Orientation[2] = 0.0;
+    pose.Orientation[3] = sign * sin(halfAngleRad);
+  }
+
+  //----------------------------------------------------------------------------
+  int TestMedianPositionAndAverageOrientation()
+  {
+    typedef vtkSlicerTransformFusionLogicTester::InputPose InputPose;
+    std::vector<InputPose> poses(5);
+    std::vector<double> weights(5, 1.0);
+
+    // Four positions around a center point and one far away along the z axis: the geometric median is where the sum of
+    // unit vectors pointing to the positions is zero, which is 5mm/sqrt(15) from the center towards the far position
+    // (the arithmetic mean would be 200mm from the center)
+    const double center[3] = { 10.0, 20.0, 30.0 };
+    SetPosition(poses[0], center[0] + 5.0, center[1], center[2]);
+    SetPosition(poses[1], center[0] - 5.0, center[1], center[2]);
+    SetPosition(poses[2], center[0], center[1] + 5.0, center[2]);
+    SetPosition(poses[3], center[0], center[1] - 5.0, center[2]);
+    SetPosition(poses[4], center[0], center[1], center[2] + 1000.0);
+    double medianPosition[3] = { 0.0, 0.0, 0.0 };
+    vtkSlicerTransformFusionLogicTester::ComputeMedianPosition(poses, weights, 5, medianPosition);
+    double expectedMedianPosition[3] = { center[0], center[1], center[2] + 5.0 / sqrt(15.0) };
+    if (sqrt(vtkMath::Distance2BetweenPoints(medianPosition, expectedMedianPosition)) > 1e-3)
+    {
+      std::cerr << "Median position mismatch: expected (" << expectedMedianPosition[0] << ", " << expectedMedianPosition[1] << ", "
+        << expectedMedianPosition[2] << "), got (" << medianPosition[0] << ", " << medianPosition[1] << ", " << medianPosition[2] << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // A position that has at least as much weight as all the others together is the median
+    SetPosition(poses[0], 0.0, 0.0, 0.0);
+    SetPosition(poses[1], 10.0, 0.0, 0.0);
+    SetPosition(poses[2], 0.0, 10.0, 0.0);
+    weights[0] = 3.0;
+    weights[1] = 1.0;
+    weights[2] = 1.0;
+    vtkSlicerTransformFusionLogicTester::ComputeMedianPosition(poses, weights, 3, medianPosition);
+    if (vtkMath::Norm(medianPosition) > 1e-3)
+    {
+      std::cerr << "Weighted median position mismatch: expected (0, 0, 0), got (" << medianPosition[0] << ", "
+        << medianPosition[1] << ", " << medianPosition[2] << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Average of rotations by 10 and 50 degrees around the same axis is a rotation by 30 degrees,
+    // regardless of the sign of the quaternions. Inputs with zero weight are ignored.
+    InputPose expectedPose;
+    SetRotationZ(expectedPose, 30.0, 1.0);
+    for (int flipSign = 0; flipSign < 2; flipSign++)
+    {
+      SetRotationZ(poses[0], 10.0, 1.0);
+      SetRotationZ(poses[1], 50.0, flipSign ? -1.0 : 1.0);
+      SetRotationZ(poses[2], 170.0, 1.0);
+      weights[0] = 1.0;
+      weights[1] = 1.0;
+      weights[2] = 0.0;
+      double averageOrientation[4] = { 0.0, 0.0, 0.0, 0.0 };
+      if (!vtkSlicerTransformFusionLogicTester::ComputeAverageOrientation(poses, weights, 3, averageOrientation))
+      {
+        std::cerr << "Average orientation computation failed" << std::endl;
+        return EXIT_FAILURE;
+      }
+      double dotProduct = 0.0;
+      for (int i = 0; i < 4; i++)
+      {
+        dotProduct += averageOrientation[i] * expectedPose.Orientation[i];
+      }
+      if (fabs(dotProduct) < 1.0 - 1e-9)
+      {
+        std::cerr << "Average orientation mismatch: expected (" << expectedPose.Orientation[0] << ", " << expectedPose.Orientation[1] << ", "
+          << expectedPose.Orientation[2] << ", " << expectedPose.Orientation[3] << "), got (" << averageOrientation[0] << ", "
+          << averageOrientation[1] << ", " << averageOrientation[2] << ", " << averageOrientation[3] << ")" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // One of the inputs jumps away from the others, it must be ignored in the robust average
+  int TestRobustAverageFusion()
+  {
+    const int numberOfInputs = 5;
+    const int jumpingInputIndex = 2;
+    const double center[3] = { 10.0, 20.0, 30.0 };
+    // Inliers are placed symmetrically around the center, so that their geometric median is the center
+    const double inlierOffsets[numberOfInputs][3] = { { 0.2, 0.0, 0.0 }, { -0.2, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.2, 0.0 }, { 0.0, -0.2, 0.0 } };
+
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerTransformFusionLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    vtkMRMLTransformFusionNode* fusionNode = AddTransformFusionNode(scene.GetPointer(), numberOfInputs);
+    fusionNode->SetFusionTechnique(vtkSlicerTransformFusionLogic::MODE_ROBUST_AVERAGE);
+    logic->SetAndObserveTransformFusionNode(fusionNode);
+    for (int i = 0; i < numberOfInputs; i++)
+    {
+      SetTranslation(fusionNode->GetInputTransformNode(i), center[0] + inlierOffsets[i][0], center[1] + inlierOffsets[i][1], center[2] + inlierOffsets[i][2]);
+    }
+
+    vtkNew<vtkTransform> jumpingInputTransform;
+    vtkNew<vtkMatrix4x4> outputMatrix;
+    for (int jumpType = 0; jumpType < 3; jumpType++)
+    {
+      // Input jumps 50mm away (position outlier), rotates by 30 degrees (orientation outlier), or returns to the others
+      jumpingInputTransform->Identity();
+      jumpingInputTransform->Translate(center[0], center[1], center[2]);
+      if (jumpType == 0)
+      {
+        jumpingInputTransform->Translate(50.0, 0.0, 0.0);
+      }
+      else if (jumpType == 1)
+      {
+        jumpingInputTransform->RotateX(30.0);
+      }
+      fusionNode->GetInputTransformNode(jumpingInputIndex)->SetMatrixTransformToParent(jumpingInputTransform->GetMatrix());
+      logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_ROBUST_AVERAGE);
+
+      bool jumpingInputIsOutlier = (jumpType < 2);
+      for (int i = 0; i < numberOfInputs; i++)
+      {
+        double robustWeight = logic->GetInputRobustWeight(i);
+        bool expectedOutlier = (i == jumpingInputIndex && jumpingInputIsOutlier);
+        if ((expectedOutlier && robustWeight != 0.0) || (!expectedOutlier && robustWeight < 0.9))
+        {
+          std::cerr << "Robust weight of input " << i << " is " << robustWeight << " after jump type " << jumpType
+            << ", expected " << (expectedOutlier ? "0" : "close to 1") << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+      fusionNode->GetOutputTransformNode()->GetMatrixTransformToParent(outputMatrix.GetPointer());
+      for (int row = 0; row < 3; row++)
+      {
+        for (int column = 0; column < 4; column++)
+        {
+          double expectedValue = (column < 3 ? (row == column ? 1.0 : 0.0) : center[row]);
+          if (fabs(outputMatrix->GetElement(row, column) - expectedValue) > 1e-3)
+          {
+            std::cerr << "Robust average mismatch after jump type " << jumpType << " at (" << row << ", " << column << "): expected "
+              << expectedValue << ", got " << outputMatrix->GetElement(row, column) << std::endl;
+            return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+
+    // Inputs with zero input weight are not used
+    fusionNode->SetInputWeight(0, 0.0);
+    logic->fuseInputTransforms(vtkSlicerTransformFusionLogic::MODE_ROBUST_AVERAGE);
+    if (logic->GetInputRobustWeight(0) != 0.0 || logic->GetInputRobustWeight(1) < 0.9)
+    {
+      std::cerr << "Input with zero weight is expected to have zero robust weight, got " << logic->GetInputRobustWeight(0) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    logic->SetAndObserveTransformFusionNode(NULL);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerTransformFusionLogicTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  if (TestEventDrivenUpdateCoalescing() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestEventDrivenUpdateCoalescing failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestInputLatencyCompensation() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestInputLatencyCompensation failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestKalmanFilterFusion() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestKalmanFilterFusion failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestKalmanFilterOutOfSequenceMeasurements() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestKalmanFilterOutOfSequenceMeasurements failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestInputPrediction() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestInputPrediction failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestMedianPositionAndAverageOrientation() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestMedianPositionAndAverageOrientation failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (TestRobustAverageFusion() != EXIT_SUCCESS)
+  {
+    std::cerr << "TestRobustAverageFusion failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -16,6 +16,7 @@
 ==============================================================================*/
 
 // Qt includes
+#include <QTimer>
 #include <QtPlugin>
 
 // TransformFusion Logic includes
@@ -34,6 +35,9 @@ class qSlicerTransformFusionModulePrivate
 {
 public:
   qSlicerTransformFusionModulePrivate();
+
+  vtkSlicerTransformFusionLogic* ObservedLogic; // should be the same as logic(), it is used for adding/removing observer safely
+  QTimer ProcessPendingUpdatesTimer;
 };
 
 //-----------------------------------------------------------------------------
@@ -41,6 +45,7 @@ public:
 
 //-----------------------------------------------------------------------------
 qSlicerTransformFusionModulePrivate::qSlicerTransformFusionModulePrivate()
+: ObservedLogic(NULL)
 {
 }
 
@@ -63,6 +68,10 @@ QStringList qSlicerTransformFusionModule::categories()const
 //-----------------------------------------------------------------------------
 qSlicerTransformFusionModule::~qSlicerTransformFusionModule()
 {
+  Q_D(qSlicerTransformFusionModule);
+  disconnect(&d->ProcessPendingUpdatesTimer, SIGNAL(timeout()), this, SLOT(processPendingUpdates()));
+  this->qvtkReconnect(d->ObservedLogic, NULL, vtkSlicerTransformFusionLogic::FusionRequestedEvent, this, SLOT(onFusionRequested()));
+  d->ObservedLogic = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -96,7 +105,19 @@ QIcon qSlicerTransformFusionModule::icon()const
 //-----------------------------------------------------------------------------
 void qSlicerTransformFusionModule::setup()
 {
+  Q_D(qSlicerTransformFusionModule);
+
   this->Superclass::setup();
+
+  vtkSlicerTransformFusionLogic* moduleLogic = vtkSlicerTransformFusionLogic::SafeDownCast(logic());
+  this->qvtkReconnect(d->ObservedLogic, moduleLogic, vtkSlicerTransformFusionLogic::FusionRequestedEvent, this, SLOT(onFusionRequested()));
+  d->ObservedLogic = moduleLogic;
+
+  // Zero-interval single-shot timer: all input changes that arrive before the next event loop iteration
+  // (where rendering happens) are fused in one update
+  d->ProcessPendingUpdatesTimer.setSingleShot(true);
+  d->ProcessPendingUpdatesTimer.setInterval(0);
+  connect(&d->ProcessPendingUpdatesTimer, SIGNAL(timeout()), this, SLOT(processPendingUpdates()));
 }
 
 //-----------------------------------------------------------------------------
@@ -110,3 +131,23 @@ vtkMRMLAbstractLogic* qSlicerTransformFusionModule::createLogic()
 {
   return vtkSlicerTransformFusionLogic::New();
 }
+
+//------------------------------------------------------------------------------
+void qSlicerTransformFusionModule::onFusionRequested()
+{
+  Q_D(qSlicerTransformFusionModule);
+  if (!d->ProcessPendingUpdatesTimer.isActive())
+  {
+    d->ProcessPendingUpdatesTimer.start();
+  }
+}
+
+//------------------------------------------------------------------------------
+void qSlicerTransformFusionModule::processPendingUpdates()
+{
+  Q_D(qSlicerTransformFusionModule);
+  if (d->ObservedLogic != NULL)
+  {
+    d->ObservedLogic->ProcessPendingUpdates();
+  }
+}
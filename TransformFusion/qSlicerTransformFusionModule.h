@@ -21,6 +21,8 @@
 // SlicerQt includes
 #include "qSlicerLoadableModule.h"
 
+#include <ctkVTKObject.h>
+
 #include "qSlicerTransformFusionModuleExport.h"
 
 class qSlicerTransformFusionModulePrivate;
@@ -30,6 +32,7 @@ class Q_SLICER_QTMODULES_TRANSFORMFUSION_EXPORT qSlicerTransformFusionModule :
   public qSlicerLoadableModule
 {
   Q_OBJECT
+  QVTK_OBJECT
   Q_INTERFACES(qSlicerLoadableModule);
 
 public:
@@ -55,6 +58,13 @@ public:
   /// Return the categories for the module
   virtual QStringList categories()const;
 
+public slots:
+  /// Schedule fusion of the modified inputs for the next event loop iteration (in event-driven update mode)
+  void onFusionRequested();
+
+  /// Fuse the inputs that have changed since the last update (in event-driven update mode)
+  void processPendingUpdates();
+
 protected:
 
   /// Initialize the module. Register the volumes reader/writer
@@ -182,6 +182,11 @@ void qSlicerTransformFusionModuleWidget::updateWidget()
 
   // Parameters
   d->updateRateBox->setValue(pNode->GetUpdatesPerSecond());
+  d->eventDrivenCheckBox->setChecked(pNode->GetEventDrivenUpdate());
+  d->synchronizeInputsCheckBox->setChecked(pNode->GetSynchronizeInputs());
+  d->techniqueBox->setCurrentIndex(pNode->GetFusionTechnique());
+  d->predictionLookAheadBox->setValue(pNode->GetPredictionLookAheadSec() * 1000.0);
+  d->maximumPredictionIntervalBox->setValue(pNode->GetMaximumPredictionIntervalSec() * 1000.0);
 
   this->updateButtons();
 }
@@ -197,7 +202,7 @@ void qSlicerTransformFusionModuleWidget::updateButtons()
     return;
   }
 
-  if (pNode->GetNumberOfInputTransformNodes() >= 2 && pNode->GetOutputTransformNode() != NULL)
+  if (pNode->GetNumberOfInputTransformNodes() >= this->minimumNumberOfInputs() && pNode->GetOutputTransformNode() != NULL)
   {
     d->updateButton->setEnabled(true);
     if (!currentlyUpdating)
@@ -229,6 +234,43 @@ void qSlicerTransformFusionModuleWidget::updateInputList()
   {
       new QListWidgetItem(tr(pNode->GetInputTransformNode(i)->GetName()), d->inputTransformList);
   }
+  this->onInputTransformSelectionChanged();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::onInputTransformSelectionChanged()
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  int selectedInputListIndex = d->inputTransformList->currentRow();
+  if (!pNode || selectedInputListIndex < 0 || selectedInputListIndex >= pNode->GetNumberOfInputTransformNodes())
+  {
+    d->inputWeightBox->setEnabled(false);
+    return;
+  }
+
+  // Only show the weight of the newly selected input, do not write it back to the node
+  bool wasBlocked = d->inputWeightBox->blockSignals(true);
+  d->inputWeightBox->setValue(pNode->GetInputWeight(selectedInputListIndex));
+  d->inputWeightBox->blockSignals(wasBlocked);
+  d->inputWeightBox->setEnabled(true);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::setInputWeight(double weight)
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  if (!pNode || !this->mrmlScene())
+  {
+    return;
+  }
+
+  int selectedInputListIndex = d->inputTransformList->currentRow();
+  if (selectedInputListIndex >= 0 && selectedInputListIndex < pNode->GetNumberOfInputTransformNodes())
+  {
+    pNode->SetInputWeight(selectedInputListIndex, weight);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -236,7 +278,7 @@ void qSlicerTransformFusionModuleWidget::onSingleUpdate()
 {
   Q_D(qSlicerTransformFusionModuleWidget);
   vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
-  if (!pNode || !this->mrmlScene() || pNode->GetOutputTransformNode() == NULL || pNode->GetNumberOfInputTransformNodes() < 2)
+  if (!pNode || !this->mrmlScene() || pNode->GetOutputTransformNode() == NULL || pNode->GetNumberOfInputTransformNodes() < this->minimumNumberOfInputs())
   {
     std::cerr << "Error: Failed to update transform" << std::endl;
     return;
@@ -244,6 +286,9 @@ void qSlicerTransformFusionModuleWidget::onSingleUpdate()
 
   /*
     MODE_QUATERNION_AVERAGE = 0
+    MODE_KALMAN_FILTER = 1
+    MODE_PREDICTION = 2
+    MODE_ROBUST_AVERAGE = 3
   */
   d->logic()->fuseInputTransforms(d->techniqueBox->currentIndex());
 }
@@ -262,12 +307,91 @@ void qSlicerTransformFusionModuleWidget::setUpdatesPerSecond(double updatesPerSe
   updateTimer->setInterval((1/updatesPerSecond)*1000);
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::setEventDrivenUpdate(bool eventDriven)
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  if (!pNode || !this->mrmlScene())
+  {
+    return;
+  }
+
+  pNode->SetEventDrivenUpdate(eventDriven);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::setSynchronizeInputs(bool synchronize)
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  if (!pNode || !this->mrmlScene())
+  {
+    return;
+  }
+
+  pNode->SetSynchronizeInputs(synchronize);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::setFusionTechnique(int techniqueType)
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  if (!pNode || !this->mrmlScene() || techniqueType < 0)
+  {
+    return;
+  }
+
+  pNode->SetFusionTechnique(techniqueType);
+  this->updateButtons();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::setPredictionLookAheadMs(double lookAheadMs)
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  if (!pNode || !this->mrmlScene())
+  {
+    return;
+  }
+
+  pNode->SetPredictionLookAheadSec(lookAheadMs / 1000.0);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerTransformFusionModuleWidget::setMaximumPredictionIntervalMs(double intervalMs)
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
+  if (!pNode || !this->mrmlScene())
+  {
+    return;
+  }
+
+  pNode->SetMaximumPredictionIntervalSec(intervalMs / 1000.0);
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerTransformFusionModuleWidget::minimumNumberOfInputs()
+{
+  Q_D(qSlicerTransformFusionModuleWidget);
+  // Filtering and prediction are meaningful for a single input, too
+  if (d->techniqueBox->currentIndex() == vtkSlicerTransformFusionLogic::MODE_QUATERNION_AVERAGE
+    || d->techniqueBox->currentIndex() == vtkSlicerTransformFusionLogic::MODE_ROBUST_AVERAGE)
+  {
+    return 2;
+  }
+  return 1;
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerTransformFusionModuleWidget::onStartAutoUpdate()
 {
   Q_D(qSlicerTransformFusionModuleWidget);
   vtkMRMLTransformFusionNode* pNode = d->logic()->GetTransformFusionNode();
-  if (!pNode || !this->mrmlScene() || pNode->GetOutputTransformNode() == NULL || pNode->GetNumberOfInputTransformNodes() < 2)
+  if (!pNode || !this->mrmlScene() || pNode->GetOutputTransformNode() == NULL || pNode->GetNumberOfInputTransformNodes() < this->minimumNumberOfInputs())
   {
     std::cerr << "Error: Failed to start auto-update" << std::endl;
     return;
@@ -367,6 +491,8 @@ void qSlicerTransformFusionModuleWidget::setup()
   
   connect(d->addTransformButton, SIGNAL(clicked()), this, SLOT(onAddTransform()));
   connect(d->removeTransformButton, SIGNAL(clicked()), this, SLOT(onRemoveTransform()));
+  connect(d->inputTransformList, SIGNAL(currentRowChanged(int)), this, SLOT(onInputTransformSelectionChanged()));
+  connect(d->inputWeightBox, SIGNAL(valueChanged(double)), this, SLOT(setInputWeight(double)));
 
   connect(d->updateButton, SIGNAL(clicked()), this, SLOT(onSingleUpdate()));
 
@@ -374,6 +500,11 @@ void qSlicerTransformFusionModuleWidget::setup()
   connect(d->startUpdateButton, SIGNAL(clicked()), this, SLOT(onStartAutoUpdate()));
   connect(d->stopUpdateButton, SIGNAL(clicked()), this, SLOT(onStopAutoUpdate()));
   connect(updateTimer, SIGNAL(timeout()), this, SLOT(onSingleUpdate()));
+  connect(d->eventDrivenCheckBox, SIGNAL(toggled(bool)), this, SLOT(setEventDrivenUpdate(bool)));
+  connect(d->synchronizeInputsCheckBox, SIGNAL(toggled(bool)), this, SLOT(setSynchronizeInputs(bool)));
+  connect(d->predictionLookAheadBox, SIGNAL(valueChanged(double)), this, SLOT(setPredictionLookAheadMs(double)));
+  connect(d->maximumPredictionIntervalBox, SIGNAL(valueChanged(double)), this, SLOT(setMaximumPredictionIntervalMs(double)));
+  connect(d->techniqueBox, SIGNAL(currentIndexChanged(int)), this, SLOT(setFusionTechnique(int)));
 
   qvtkConnect( d->logic(), vtkCommand::ModifiedEvent, this, SLOT( onLogicModified() ) );
 }
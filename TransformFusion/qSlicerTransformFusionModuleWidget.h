@@ -57,6 +57,8 @@ protected slots:
 
   void onAddTransform();
   void onRemoveTransform();
+  void onInputTransformSelectionChanged();
+  void setInputWeight(double);
 
   void onOutputTransformNodeSelected(vtkMRMLNode* node);
   
@@ -65,6 +67,11 @@ protected slots:
   void onStopAutoUpdate();
 
   void setUpdatesPerSecond(double);
+  void setEventDrivenUpdate(bool);
+  void setSynchronizeInputs(bool);
+  void setFusionTechnique(int);
+  void setPredictionLookAheadMs(double);
+  void setMaximumPredictionIntervalMs(double);
   
 
 protected:
@@ -73,6 +80,9 @@ protected:
   virtual void setup();
   void onEnter();
 
+  /// Minimum number of inputs that the selected fusion technique needs
+  int minimumNumberOfInputs();
+
   bool currentlyUpdating;
 
   QTimer* updateTimer;